@@ -10,26 +10,37 @@
 %   getmask       - Interactively calculate a threshold mask.
 %   resampleblood - Get resampled blood data from a data set.
 %   closeimage    - Close an image volume.
+%   flushimagecache - Close MINC files kept open by mireadimages.
 %
 % Low-level (CMEX or standalone executables) MINC I/O functions
 %
+%   mireadblocks  - Read masked voxels from MINC files a block at a time.
 %   mireadimages  - Read images from a MINC file (used by getimages).
+%   mireadmasked  - Read the masked voxels from a list of MINC files.
 %   mireadvar     - Read a hyperslab from any NetCDF variable.
 %   micreate      - Create a new MINC file from scratch.
+%   minewimage    - Create a new MINC file in-process (used by newimage).
 %   miwriteimages - Write images to a MINC file (used by putimages).
+%   miwritemasked - Write a volume given only the voxels under a mask.
 %   miinquire     - Get netCDF variable, dimension, or attribute information.
+%   niireadmasked - Read the masked voxels from a list of NIfTI files.
+%   niiwrite      - Write a volume to a NIfTI file, given a reference header.
 %
-%     Note: these seven functions should not generally be called by 
+%     Note: these functions should not generally be called by 
 %     general purpose image analysis applications.  Use the high-
 %     level functions instead.
 %
 % General utility functions (numeric)
 %   deriv         - Calculate the derivative of a numerical function.
+%   irlsfit       - Fit one generalized linear model to every column of a data matrix.
+%   lmefit        - Fit a linear mixed-effects model at every voxel.
 %   lookup        - Fast CMEX function for linear interpolation.
 %   nconv         - Convolution of two vectors with not necessarily unit spacing.
 %   nfmins        - Minimize a function of several variables.
 %   nframeint     - Fast CMEX integration across frames.
 %   ntrapz        - Fast CMEX function for trapezoidal integration.
+%   olsbatch      - Fit a linear model with image predictors at every voxel.
+%   olsfit        - Fit one linear model to every column of a data matrix.
 %   rescale       - Multiply a matrix by a scalar.
 %   
 % General utility functions (image processing)
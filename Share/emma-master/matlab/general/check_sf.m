@@ -1,7 +1,7 @@
-function msg = check_sf (handle, slices, frames)
+function msg = check_sf (handle, slices, frames, allow_both)
 %  CHECK_SF  determine the validity of slice and frame lists (internal use)
 %
-%      msg = check_sf (handle, slices, frames)
+%      msg = check_sf (handle, slices, frames [, allow_both])
 %
 %  examines the lists of slices and frames, compares them to the 
 %  properties of the MINC file specified by handle, and generates
@@ -11,7 +11,8 @@ function msg = check_sf (handle, slices, frames)
 %
 %  The specific conditions that cause an error message are:
 %
-%     - both slices and frames have multiple values
+%     - both slices and frames have multiple values (unless allow_both
+%       is given and non-zero, as by getimages)
 %     - the file has no time dimension, but a frame list was given
 %     - the file has a time dimension, but no frame list was given
 %     - the file has no slice dimension, but a slice list was given
@@ -26,6 +27,7 @@ function msg = check_sf (handle, slices, frames)
 % $Name:  $
 
 msg = [];
+if (nargin < 4), allow_both = 0; end
 
 % First retrieve the number of frames and slices
 
@@ -33,7 +35,7 @@ dim_sizes = handlefield(handle, 'DimSizes');
 num_frames = dim_sizes(1);
 num_slices = dim_sizes(2);
 
-if (length(slices) > 1) & (length(frames) > 1)
+if (length(slices) > 1) & (length(frames) > 1) & ~allow_both
    msg = 'Cannot specify both multiple slices and multiple frames';
 end
 
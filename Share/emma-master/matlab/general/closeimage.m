@@ -7,7 +7,7 @@ function closeimage (handles)
 % Closes one or more image data sets.  If the associated MINC was a
 % compressed file (and therefore uncompressed by openimage), then the
 % temporary file and directory used for the uncompressed data are
-% deleted.
+% deleted.  The file is also closed if mireadimages still has it open.
 
 % $Id: closeimage.m,v 1.12 2004-10-06 15:04:13 bert Exp $
 % $Name:  $
@@ -15,6 +15,10 @@ function closeimage (handles)
 for handle = handles
    Flags = handlefield(handle, 'Flags');
    Filename = handlefield(handle, 'Filename');
+
+   if (~isempty(Filename))
+      flushimagecache (Filename);
+   end
    
    if (size(Flags) == [1 2])		% was it actually a compressed file?
       if (Flags(2))                     % then nuke the temp directory
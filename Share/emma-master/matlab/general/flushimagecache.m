@@ -0,0 +1,25 @@
+function flushimagecache (filename)
+% FLUSHIMAGECACHE  close MINC files kept open by mireadimages
+%
+%     flushimagecache
+%     flushimagecache (filename)
+%
+% mireadimages keeps the last few MINC files it has read open, so that
+% reading a volume slice by slice only opens the file once.  With no
+% arguments, flushimagecache closes all of them; given a filename, it
+% closes just that one.  This is done for you by closeimage, newimage
+% and putimages, and a file that has changed on disk is reopened anyway,
+% so it should rarely be needed otherwise.
+
+% $Id: flushimagecache.m,v 1.1 $
+% $Name:  $
+
+if (exist ('mireadimages') ~= 3)     % not the CMEX version: no cache
+   return;
+end
+
+if (nargin < 1)
+   mireadimages ('-flush');
+else
+   mireadimages ('-flush', filename);
+end
@@ -170,6 +170,12 @@ if (size(filename) == [0 0] | size(dimsizes) == [0 0])
    error ('handle does not specify an open image volume');
 end
 
+% Images opened by openimage with the CMEX miinquire keep everything
+% from its 'imageinfo' struct in the handle; use that rather than
+% reopening the file.  Other handles (eg. from newimage) get [] here.
+
+imageinfo = handlefield(handle, 'ImageInfo');
+
 % If "whatinfo" is one of the MINC image dimension names, just do 
 % an miinquire on the MINC file for the length of that dimension.
 % If miinquire returns an empty matrix, that means the dimension 
@@ -213,13 +219,28 @@ elseif (strcmp (lwhatinfo, 'midframetimes'))
    info = handlefield(handle, 'FrameTimes') + ...
        handlefield(handle, 'FrameLengths') / 2;
 elseif (strcmp (lwhatinfo, 'minmax'))
-   allmin = sort (mireadvar (filename, 'image-min'));
-   allmax = sort (mireadvar (filename, 'image-max'));
+   if (~isempty (imageinfo))
+      allmin = sort (imageinfo.AllMin);
+      allmax = sort (imageinfo.AllMax);
+   else
+      allmin = sort (mireadvar (filename, 'image-min'));
+      allmax = sort (mireadvar (filename, 'image-max'));
+   end
    info = [allmin(1) allmax(length(allmax))];
 elseif (strcmp (lwhatinfo, 'allmin'))
-   info = mireadvar (filename, 'image-min');
+   if (~isempty (imageinfo))
+      info = imageinfo.AllMin;
+   else
+      info = mireadvar (filename, 'image-min');
+   end
 elseif (strcmp (lwhatinfo, 'allmax'))
-   info = mireadvar (filename, 'image-max');
+   if (~isempty (imageinfo))
+      info = imageinfo.AllMax;
+   else
+      info = mireadvar (filename, 'image-max');
+   end
+elseif (strcmp (lwhatinfo, 'steps') & ~isempty (imageinfo))
+   info = imageinfo.Steps;
 elseif (strcmp (lwhatinfo, 'steps'))
    [xstep,ystep,zstep] = miinquire (filename, ...
       'attvalue', 'xspace', 'step', ...
@@ -229,6 +250,8 @@ elseif (strcmp (lwhatinfo, 'steps'))
       error (['volume is missing one of xstep, ystep, or zstep']);
    end
    info = [xstep; ystep; zstep];
+elseif (strcmp (lwhatinfo, 'starts') & ~isempty (imageinfo))
+   info = imageinfo.Starts;
 elseif (strcmp (lwhatinfo, 'starts'))
    [xstart, ystart, zstart] = miinquire (filename, ...
       'attvalue', 'xspace', 'start', ...
@@ -238,6 +261,8 @@ elseif (strcmp (lwhatinfo, 'starts'))
    if (isempty (ystart)), ystart = 0; end;
    if (isempty (zstart)), zstart = 0; end;
    info = [xstart; ystart; zstart];
+elseif (strcmp (lwhatinfo, 'dircosines') & ~isempty (imageinfo))
+   info = imageinfo.DirCosines;
 elseif (strcmp (lwhatinfo, 'dircosines'))
    [xdircos,ydircos,zdircos] = miinquire (filename, ...
       'attvalue', 'xspace', 'direction_cosines', ...
@@ -249,7 +274,11 @@ elseif (strcmp (lwhatinfo, 'dircosines'))
    info = [xdircos' ydircos' zdircos'];
 
 elseif (strcmp (lwhatinfo, 'permutation'))
-   info = miinquire (filename, 'permutation');
+   if (~isempty (imageinfo))
+      info = imageinfo.Permutation;
+   else
+      info = miinquire (filename, 'permutation');
+   end
 
 % Finally check for one of the default fields for this volume
 
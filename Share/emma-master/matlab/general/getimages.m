@@ -1,15 +1,13 @@
-function images = getimages (handle, slices, frames, old_matrix, start_row, num_rows)
+function images = getimages (handle, slices, frames, old_matrix, start_row, num_rows, precision)
 %GETIMAGES  Retrieve whole or partial images from an open MINC file.
 %
 %  images = getimages (handle [, slices [, frames [, old_matrix ...
-%                      [, start_row [, num_rows]]]]])
+%                      [, start_row [, num_rows [, precision]]]]]])
 %
 %  reads whole or partial images from the MINC file specified by
-%  handle.  Either slices or frames can be a vector (to specify a
-%  set of several images), but at least one of them must be a scalar
-%  -- it is not possible to read images from both different slices and
-%  different frames at the same time.  (Multiple calls to getimages
-%  will be needed for this.)  If the file is non-dynamic (no time
+%  handle.  Either or both of slices and frames can be a vector (to
+%  specify a set of several images); if both are, every combination of
+%  slice and frame is read, in one go.  If the file is non-dynamic (no time
 %  dimension), then the frames argument can be omitted or empty;
 %  likewise, if there is no slice dimension, the slices argument can
 %  be omitted or empty.  (But note that slices must be given if any
@@ -23,7 +21,10 @@ function images = getimages (handle, slices, frames, old_matrix, start_row, num_
 %  returned as the columns of a matrix.  For instance, if 10 128x128
 %  images are read, then getimages will return a 16384x10 matrix; to
 %  extract a single image, use MATLAB's colon operator, as in foo
-%  (:,1) to extract all rows of column 1 of the matrix foo.
+%  (:,1) to extract all rows of column 1 of the matrix foo.  When
+%  several slices and several frames are read, the frames vary fastest:
+%  the image for slices(i) and frames(j) is in column
+%  (i-1)*length(frames) + j.
 %
 %  To read partial images, you can specify a starting image row in
 %  start_row; if num_rows is not supplied and start_row is, then a
@@ -43,6 +44,12 @@ function images = getimages (handle, slices, frames, old_matrix, start_row, num_
 %  This will get around MATLAB's tendency to unnecessarily allocate
 %  new blocks of memory and leave old blocks unused.
 %
+%  Images are normally returned as doubles.  To halve the memory
+%  they take up, pass 'single' as precision (use empty matrices for
+%  any of old_matrix, start_row and num_rows you do not need):
+%
+%  img = getimages (handle, 1:numslices, [], [], [], [], 'single');
+%
 %  EXAMPLES (assuming handle = openimage ('some_minc_file');)
 %
 %   To read in the first frame of the first slice:
@@ -51,6 +58,8 @@ function images = getimages (handle, slices, frames, old_matrix, start_row, num_
 %     first_10 = getimages (handle, 1, 1:10);
 %   To read in the first 10 slices of a non-dynamic (i.e. no frames) file:
 %     first_10 = getimages (handle, 1:10);
+%   To read in all slices of all frames of a dynamic file:
+%     imgs = getimages (handle, 1:numslices, 1:numframes);
 %   
 %  Note that there is currently no way to write partial images -- this 
 %  feature is provided in the hopes of cutting down memory usage due
@@ -69,6 +78,7 @@ function images = getimages (handle, slices, frames, old_matrix, start_row, num_
 %              old_matrix - previously used block of memory to be recycled
 %              start_row - image row to start reading at
 %              num_rows - number of rows to read
+%              precision - 'double' (default) or 'single'
 %@OUTPUT     : 
 %@RETURNS    : images - matrix whose columns contain entire images
 %              layed out linearly.
@@ -104,7 +114,7 @@ function images = getimages (handle, slices, frames, old_matrix, start_row, num_
 
 % Check for valid number of arguments
 
-if (nargin < 1) | (nargin > 6)
+if (nargin < 1) | (nargin > 7)
    error ('Incorrect number of arguments.');
 end
 
@@ -134,7 +144,7 @@ end
 % now make sure input arguments are valid: check_sf returns an error message
 % if not.
 
-s = check_sf (handle, slices, frames);
+s = check_sf (handle, slices, frames, 1);
 if ~isempty (s); error (s); end;
 
 % Do not try to re-use memory for matlab version 5 and later - it crashes
@@ -156,4 +166,17 @@ elseif (nargin < 6)
 elseif (nargin < 7)
     images = mireadimages (filename, slices-1, frames-1, old_matrix, ...
                            start_row-1, num_rows);
+else
+    if (isempty (num_rows))
+       if (isempty (start_row))
+          num_rows = getimageinfo (handle, 'ImageHeight');
+       else
+          num_rows = 1;
+       end
+    end
+    if (isempty (start_row))
+       start_row = 1;
+    end
+    images = mireadimages (filename, slices-1, frames-1, old_matrix, ...
+                           start_row-1, num_rows, precision);
 end
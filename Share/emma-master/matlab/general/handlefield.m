@@ -1,5 +1,5 @@
 function value = handlefield(externalhandle, key, filename, ...
-    dimsizes, flags, frametimes, framelengths);
+    dimsizes, flags, frametimes, framelengths, imageinfo);
 % HANDLEVARS   EMMA internal function to set or get handle fields
 %
 %    value = handlefield(handle, key)
@@ -7,14 +7,17 @@ function value = handlefield(externalhandle, key, filename, ...
 %    if (handlefield(handle))
 % or
 %    handle = handlefield([], 'Create', filename, dimsizes, flags, ...
-%                         frametimes, framelengths)
+%                         frametimes, framelengths [, imageinfo])
 % or
 %    handlefield(handle, 'Free')
 %
 % The first form returns the value of the specified field for the given
 % handle. The second form returns true if the handle is valid. The third 
 % form (with an empty handle) create a handle and sets the appropriate 
-% fields. The last form frees the given handle.
+% fields; imageinfo is the optional struct from miinquire's 'imageinfo'
+% option, kept so that getimageinfo need not go back to the file (the
+% 'ImageInfo' key returns it, or [] if none was given). The last form
+% frees the given handle.
 %
 % Note that key is case insensitive.
 %
@@ -47,6 +50,7 @@ global EMMA_FrameTimes;
 global EMMA_FrameLengths;
 global EMMA_Dimsizes;
 global EMMA_Flags;
+global EMMA_ImageInfo;
 
 % Set up globals the first time through
 if (isempty(EMMA_Filename_Index))
@@ -73,6 +77,7 @@ if (isempty(EMMA_Filename_Index))
   EMMA_Filenames = blanks(EMMA_Filename_Index(1,2));
   EMMA_FrameTimes = zeros(1, EMMA_Frame_Index(1,2));
   EMMA_FrameLengths = zeros(1, EMMA_Frame_Index(1,2));
+  EMMA_ImageInfo = cell(handles_alloc_at_once, 1);
   
 end
 
@@ -112,9 +117,12 @@ if (strcmp(key, 'create'))
   % Create a handle
   
   % Check arguments
-  if (nargin ~= 7)
+  if ((nargin ~= 7) & (nargin ~= 8))
     error('Please specify all arguments to create a handle');
   end
+  if (nargin < 8)
+    imageinfo = [];
+  end
   if (~isempty(handle))
     error('The specified handle is not empty');
   end
@@ -150,11 +158,14 @@ if (strcmp(key, 'create'))
         zeros(handles_alloc_at_once, num_dims)];
     EMMA_Flags          = [EMMA_Flags; ...
         zeros(handles_alloc_at_once, num_flags)];
+    EMMA_ImageInfo      = [EMMA_ImageInfo; ...
+        cell(handles_alloc_at_once, 1)];
   end
   
   % Set the fixed-size fields
   EMMA_Dimsizes(handle, 1:num_dims) = dimsizes(:)';
   EMMA_Flags(handle, 1:num_flags) = flags(:)';
+  EMMA_ImageInfo{handle} = imageinfo;
   
   % See if there is enough space for the file name
   if ((EMMA_Filename_Index(1, 2) - EMMA_Filename_Index(1, 1) + 1) < ...
@@ -258,6 +269,7 @@ elseif (strcmp(key, 'free'))
   % Mark the handle as free
   EMMA_Dimsizes(handle, 1:num_dims) = zeros(1, num_dims);
   EMMA_Flags(handle, 1:num_flags) = zeros(1, num_flags);
+  EMMA_ImageInfo{handle} = [];
   EMMA_Filename_Index(handle, 1:num_indices) = zeros(1, num_indices);
   EMMA_Frame_Index(handle, 1:num_indices) = zeros(1, num_indices);
   EMMA_ExternalHandles(handle) = 0;
@@ -303,6 +315,8 @@ else
       value = [];
     end
     value = value(:);
+  elseif (strcmp(key, 'imageinfo'))
+    value = EMMA_ImageInfo{handle};
   else
     error(['Unrecognized key ' key]);
   end
@@ -0,0 +1,38 @@
+%IRLSFIT  Fit one generalized linear model to every column of a data matrix.
+%
+%  [beta, se, t, dispersion, iterations] = irlsfit (X, Y, family)
+%
+%  fits the generalized linear model with design X (n x p, including
+%  any intercept column, with n > p and p at most 32) to every column
+%  of Y (n x V, double or single; eg. one column per masked voxel and
+%  one row per subject), by iteratively reweighted least squares.
+%  family is 'normal', 'binomial' (Y holding proportions, 0 to 1),
+%  'poisson' or 'gamma', each with its canonical link (identity,
+%  logit, log and reciprocal), as with
+%
+%  >> glm = fitglm (X, Y(:,v), 'Distribution', family, ...
+%                   'Intercept', false);
+%
+%  beta, se and t are p x V: the Estimate, SE and tStat columns of
+%  glm.Coefficients for each column of Y.  dispersion (1 x V) is
+%  glm.Dispersion: 1 for the binomial and Poisson families, and the
+%  sum of squared Pearson residuals over n-p for the others.
+%  iterations (1 x V) is the number of least-squares fits each column
+%  took; the iterations start and stop as glmfit's do (after at most
+%  100 of them).
+%
+%  Each iteration fits a block of 1024 columns at once, with the
+%  weighted normal equations of every column formed by one matrix
+%  product; a column that has converged drops out of the block, so
+%  that the later iterations cost only what the columns still
+%  converging need.  A column of Y with any NaN or Inf, or a value
+%  outside the family's range (eg. a negative count), or whose fit
+%  breaks down or does not converge, gives NaN in all its results;
+%  refit such columns with fitglm if need be.
+%
+%  See also OLSFIT, FITGLM, GLMFIT.
+
+% $Id: irlsfit.m,v 1.1 $
+% $Name:  $
+
+error ('IRLSFIT CMEX file not found');
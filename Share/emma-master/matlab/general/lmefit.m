@@ -0,0 +1,63 @@
+%LMEFIT  Fit a linear mixed-effects model at every voxel.
+%
+%  [beta, se, t, sigma2, theta, evals] = ...
+%        lmefit (fixed, random, group, response [, pattern ...
+%                [, method [, num_threads]]])
+%
+%  fits the linear mixed-effects model
+%
+%     y = fixed*beta + Z*b + e,   e ~ N(0, sigma2*I)
+%
+%  to every column y of response (n subjects x V voxels; double or
+%  single), where the random effects b belong to the groups in group
+%  (n x 1, the integers 1 to m, eg. the subject of each scan of a
+%  longitudinal study).  random is n x q: row i holds the values of
+%  the q random effects of group(i) for observation i, so that
+%
+%  >> random = ones(n,1);                 % (1|Subject)
+%  >> random = [ones(n,1) Time];          % (1+Time|Subject)
+%
+%  and each group's effects are N(0, sigma2*L*L'), with the q x q
+%  lower triangular L built from theta according to pattern, as
+%  fitlme's 'CovariancePattern' names them: 'FullCholesky' (the
+%  default; theta is the lower triangle of L, by columns), 'Diagonal'
+%  (theta is diag(L)), 'Isotropic' (L = theta*eye(q)) or 'CompSymm'
+%  (theta = [s; rho], and L*L' = s^2*((1-rho)*eye(q) + rho*ones(q))).
+%  fixed is the n x p fixed-effects design; p may be at most 32, and q
+%  at most 6.
+%
+%  theta is found by minimising the profiled deviance -- restricted
+%  (method 'REML', the default) or not ('ML') -- and beta, sigma2
+%  and the covariance of beta, sigma2*inv(fixed'*inv(V)*fixed),
+%  follow from it.  So, as with
+%
+%  >> lme = fitlme (tbl, 'FDG ~ Age + Time + (1+Time|Subject)', ...
+%                   'FitMethod', 'REML');
+%
+%  beta, se and t (p x V) are the Estimate, SE and tStat of
+%  lme.Coefficients at each voxel; sigma2 (1 x V) is lme.MSE; and
+%  theta (one column per voxel) gives the random effects' covariance.
+%  A voxel with any NaN or Inf in its response, or whose search does
+%  not converge, gives NaN in all its results; refit such voxels with
+%  fitlme if need be.
+%
+%  The cross products of fixed and random are computed once for all
+%  the voxels, so that each step of the search costs the same however
+%  many observations each group has.  And since neighbouring voxels
+%  have much the same theta, each voxel's search starts from the last
+%  voxel's theta (and the curvature of the deviance there), with a
+%  quasi-Newton search; if that fails, or finds a minimum no better
+%  than the usual starting point, a Nelder-Mead search starts afresh.
+%  So the columns of response should be in spatial order, each next
+%  to the one before it.  evals (1 x V) is the number of times each
+%  voxel's deviance was computed.
+%
+%  num_threads sets the number of threads (default 1; if given as [],
+%  one per processor), each fitting runs of neighbouring voxels.
+%
+%  See also OLSFIT, FITLME.
+
+% $Id: lmefit.m,v 1.1 $
+% $Name:  $
+
+error ('LMEFIT CMEX file not found');
@@ -31,9 +31,13 @@ function [o1, o2, o3, o4, o5, o6, o7, o8, o9, o10] = ...
 %                  'coronal', or 'sagittal'
 %     dimnames     list of dimensions associated with the image variable
 %     permutation  matrix to reorder voxel coordinates to (x,y,z) order
+%     imageinfo    a struct with everything openimage and getimageinfo
+%                  need: fields DimSizes, DimNames, Orientation,
+%                  Permutation, Steps, Starts, DirCosines, FrameTimes,
+%                  FrameLengths, AllMax and AllMin (CMEX version only)
 %
-% dimlength requires one item, the dimension name.  imagesize requires 
-% no items.  vartype requires the variable name.  attvalue requires
+% dimlength requires one item, the dimension name.  imagesize and
+% imageinfo require no items.  vartype requires the variable name.  attvalue requires
 % both the variable name and attribute name, in that order.  See Examples
 % below for further illumination.
 % 
@@ -0,0 +1,33 @@
+%MINEWIMAGE  Create a new MINC file (in-process micreateimage).
+%
+%  dim_sizes = minewimage (new_file, dim_sizes [, parent_file ...
+%                          [, image_type [, valid_range [, orientation ...
+%                          [, compress [, chunk]]]]]])
+%
+%  creates the MINC file new_file, just as the standalone program
+%  micreateimage does, but without leaving MATLAB.  The arguments have
+%  the same meaning and defaults as for newimage: dim_sizes is either
+%  [frames slices height width] or (if parent_file is given) just
+%  [frames slices], and any of image_type, valid_range and orientation
+%  that are empty or not given are inherited from parent_file (or set
+%  to 'byte', the full range of the type, and 'transverse' if there
+%  is no parent).  A parent_file of '' or '-' means no parent.
+%  compress and chunk set how the image is stored in a MINC 2 file,
+%  again as for newimage.
+%
+%  The return value is the full four-element dim_sizes actually used.
+%
+%  The parent file is kept open between calls (it is reopened if it
+%  changes on disk), so creating many files from the same parent --
+%  eg. one per statistic -- reads its header only once.  It is closed
+%  when the MEX-file is cleared.  new_file must not already exist.
+%
+%  minewimage is called by newimage when it is available, and should
+%  not generally be called directly.
+%
+%  See also NEWIMAGE.
+
+% $Id: minewimage.m,v 1.1 $
+% $Name:  $
+
+error ('MINEWIMAGE CMEX file not found');
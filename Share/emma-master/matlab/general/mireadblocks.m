@@ -0,0 +1,44 @@
+%MIREADBLOCKS  Read masked voxels from a list of MINC files a block at a time.
+%
+%  [stream, num_blocks] = mireadblocks ('open', minc_files, mask_index, ...
+%                             block_mb [, precision [, num_threads [, read_ahead [, frames]]]])
+%  [data, cols] = mireadblocks ('next', stream)
+%  mireadblocks ('rewind', stream)
+%  mireadblocks ('close', stream)
+%
+%  reads the same voxels as mireadmasked, but in blocks, so that the
+%  full (files x masked voxels) matrix never has to be held in memory.
+%
+%  'open' sets up a stream over the MINC files named in the cell array
+%  minc_files, for the voxels selected by mask_index (one-based and
+%  strictly ascending, eg. find(mask) -- see mireadmasked).  The mask
+%  is divided into blocks of consecutive slices such that one block of
+%  data from all files takes no more than block_mb megabytes (unless a
+%  single slice needs more than that, in which case each such slice is
+%  a block on its own).  num_blocks is the number of blocks.
+%  precision ('double' or 'single'), num_threads, read_ahead and
+%  frames are as for mireadmasked.
+%
+%  Each 'next' reads the next block from all of the files: data has
+%  one row per file and one column per masked voxel in the block, and
+%  cols gives the positions in mask_index of those voxels, so that
+%
+%  >> while true
+%  >>    [data, cols] = mireadblocks ('next', stream);
+%  >>    if isempty (cols), break; end
+%  >>    all_data(:,cols) = data;
+%  >> end
+%
+%  rebuilds the result of mireadmasked (files, mask_index).  Once every
+%  block has been read, 'next' returns empty matrices.  'rewind' makes
+%  the next 'next' start over with the first block.
+%
+%  'close' frees the stream.  At most 16 streams may be open at once;
+%  all are closed when the MEX-file is cleared.
+%
+%  See also MIREADMASKED, GETIMAGES.
+
+% $Id: mireadblocks.m,v 1.1 $
+% $Name:  $
+
+error ('MIREADBLOCKS CMEX file not found');
@@ -1,8 +1,9 @@
-function images = mireadimages(minc_file, slices, frames, old_matrix, start_row, num_rows);
+function images = mireadimages(minc_file, slices, frames, old_matrix, start_row, num_rows, precision);
 %MIREADIMAGES  Read images from specified slice(s)/frame(s) of a MINC file.
 %
 %  images = mireadimages ('minc_file' [, slices [, frames ...
-%                         [, old_matrix [, start_row [, num_rows]]]]])
+%                         [, old_matrix [, start_row [, num_rows ...
+%                         [, precision]]]]]])
 %
 %  opens the given MINC file, and attempts to read whole or partial
 %  images from the slices and frames specified in the slices and
@@ -46,11 +47,30 @@ function images = mireadimages(minc_file, slices, frames, old_matrix, start_row,
 %  0 .. 20 of the MINC file are read into columns 1 .. 21 of the
 %  matrix images.
 %
+%  By default the images are returned as a double matrix.  Passing
+%  'single' as precision returns a single matrix instead, which halves
+%  the memory needed to hold the images; the values are still the real
+%  (scaled) voxel values.
+%
+%  The MINC file is left open between calls (along with up to 15
+%  others), so that reading a file slice by slice does not pay for
+%  opening it every time.  A file that has changed on disk since it
+%  was last read is reopened automatically; to close the files
+%  explicitly, use
+%
+%  >> mireadimages ('-flush')                 % all files
+%  >> mireadimages ('-flush', 'foobar.mnc')   % just foobar.mnc
+%
+%  (see also FLUSHIMAGECACHE).
+%
 %  For most dynamic analyses, it will also be necessary to extract
 %  the frame timing data.  This can be done using MIREADVAR.
 %
-%  Currently, only one of the vectors slices or frames can contain multiple
-%  elements.
+%  Both slices and frames may contain multiple elements, in which
+%  case every combination is read (as a single box of the file
+%  wherever the slices and frames are consecutive).  The frames vary
+%  fastest: slice slices(i), frame frames(j) ends up in column
+%  (i-1)*length(frames) + j.
 
 % $Id: mireadimages.m,v 1.7 2005-08-24 22:27:00 bert Exp $
 % $Name:  $
@@ -63,12 +83,19 @@ if (nargin < 1)
 end
 
 % Make sure that all input arguments are set
+if (nargin < 7), precision=[];end
 if (nargin < 6), num_rows=[];end
 if (nargin < 5), start_row=[];end
 old_matrix = [];
 if (nargin < 3), frames=[];end
 if (nargin < 2), slices=[];end
 
+% Check the precision
+if (isempty(precision)), precision = 'double'; end
+if (~strcmp(precision, 'double') & ~strcmp(precision, 'single'))
+  error('precision must be either ''double'' or ''single''');
+end
+
 % Check that slices and frames are set
 if (isempty(slices)), slices = 0; end
 if (isempty(frames)), frames = 0; end
@@ -180,11 +207,15 @@ nfrmrange = icount;
 
 % Get space for images
 imgsize = num_rows * imagesize(4);
-images=zeros(imgsize, length(slices)*length(frames));
+images=zeros(imgsize, length(slices)*length(frames), precision);
 
 % Get a temporary file name
 tempfile = tempfilename;
 
+% Images come out of mincextract in file order: see if frames vary
+% slower than slices there
+frames_outer = (dimmap(1) < dimmap(2));
+
 % Loop over slices and frames
 for islice=1:nslcrange
   
@@ -215,25 +246,32 @@ for islice=1:nslcrange
       error('Error opening temp file to read image data');
     end
     
-    % Loop over slices and frames
-    for jslice=1:slcrange(islice,2)
+    % Loop over the images in the box, in file order
+    nbox = slcrange(islice,2) * frmrange(iframe,2);
+    for ibox=1:nbox
       
-      for jframe=1:frmrange(iframe,2)
-
-        % Read the data back in
-        thisimage = fread(fid, imgsize, 'double');
-        if (length(thisimage) ~= imgsize)
-          fclose(fid);
-          delete(tempfile);
-          error(['Error reading in image data, expected ' num2str(imgsize) ...
-                  ', got ', num2str(length(thisimage))]);
-        end
-    
-        % Stick it in the array
-        imgnum = (jslice-1)*nframes + jframe;
-        images(:, imgnum) = thisimage;
-        
+      if (frames_outer)
+        jslice = rem(ibox-1, slcrange(islice,2)) + 1;
+        jframe = floor((ibox-1) / slcrange(islice,2)) + 1;
+      else
+        jframe = rem(ibox-1, frmrange(iframe,2)) + 1;
+        jslice = floor((ibox-1) / frmrange(iframe,2)) + 1;
       end
+
+      % Read the data back in
+      thisimage = fread(fid, imgsize, 'double');
+      if (length(thisimage) ~= imgsize)
+        fclose(fid);
+        delete(tempfile);
+        error(['Error reading in image data, expected ' num2str(imgsize) ...
+                ', got ', num2str(length(thisimage))]);
+      end
+  
+      % Stick it in the array
+      thisslice = sum(slcrange(1:islice-1,2)) + jslice;
+      thisframe = sum(frmrange(1:iframe-1,2)) + jframe;
+      imgnum = (thisslice-1)*nframes + thisframe;
+      images(:, imgnum) = thisimage;
       
     end
     
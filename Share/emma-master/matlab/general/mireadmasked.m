@@ -0,0 +1,51 @@
+%MIREADMASKED  Read the masked voxels from a list of MINC files.
+%
+%  data = mireadmasked (minc_files, mask_index [, precision ...
+%                       [, num_threads [, read_ahead [, frames]]]])
+%
+%  reads, from each of the MINC files named in the cell array
+%  minc_files, the voxels selected by mask_index, and returns them as
+%  the rows of data: data(i,k) is the value of masked voxel k in file
+%  minc_files{i}.
+%
+%  mask_index is a vector of one-based, strictly ascending voxel
+%  indices into the volume, laid out the same way as the matrix
+%  returned by getimages (one column per slice).  Thus, if mask is
+%  such a matrix for a mask volume,
+%
+%  >> data = mireadmasked (files, find (mask));
+%
+%  gives the same result as reading each volume with getimages and
+%  taking vol(mask)', but without ever holding a whole volume in
+%  memory: only the slices that contain masked voxels are read, a few
+%  at a time, and only the masked values are kept.  All files must
+%  have the same dimensions as the first one.  For files with a time
+%  dimension, only the first frame is read unless frames is given.
+%
+%  precision may be 'double' (the default) or 'single'.
+%
+%  num_threads sets the number of threads used to read the files
+%  (default 1; if given as [], one per processor).  The MINC library
+%  can only be used by one thread at a time, so the threads overlap
+%  fetching the files from disk or network, and copying each decoded
+%  file into data, with decoding the next; this helps most when the
+%  files live on a network file system.
+%
+%  read_ahead (default 0) is used when reading with a single thread:
+%  a background thread then opens and decodes up to read_ahead files
+%  ahead of the one being copied into data, so that decompressing the
+%  next files overlaps with gathering the current one.  Each file
+%  ahead costs one row of data in memory.  With several threads, each
+%  already decodes while the others copy, so read_ahead is ignored.
+%
+%  frames gives the (one-based) frame to read from each file, one per
+%  element of minc_files; so a cohort stacked as the frames of a single
+%  4-D file can be read by naming that file once per subject:
+%
+%  >> data = mireadmasked (repmat ({'cohort.mnc'}, 1, n), find (mask), ...
+%  >>                      'double', [], 0, 1:n);
+%
+%  See also GETIMAGES, MIREADIMAGES.
+
+% $Id: mireadmasked.m,v 1.1 $
+% $Name:  $
@@ -12,12 +12,20 @@ function miwriteimages (filename, images, slices, frames)
 %  file, which must exist and have an image variable in it.  The number
 %  of images to write (implied by the number of elements in slices or frames)
 %  must be the same as the number of columns in the matrix images.  Since
-%  miwriteimages only expects to be called by putimages, none of these
-%  requirements are checked here -- all that is done by putimages.
+%  miwriteimages only expects to be called by putimages, most of these
+%  requirements are checked by putimages rather than here.
 %
-%  Note that there is also a standalone executable miwriteimages; this 
-%  is called by miwriteimages.m via a shell escape.  Neither of these
-%  programs are meant for everyday use by the end user.
+%  miwriteimages is normally a CMEX file, which writes the images
+%  straight from the MATLAB matrix into the MINC file.  This .m file is
+%  only used if the CMEX file has not been built: it then writes the
+%  images to a temporary file and runs the old standalone miwriteimages
+%  program on it via a shell escape.  Neither is meant for everyday use
+%  by the end user.
+%
+%  Each image is scaled to fill the valid range of an integer file
+%  (byte, short or long) slice by slice, as usual.  Images written to a
+%  float or double file (eg. one made with newimage type 'float') are
+%  stored exactly as they are, with no scaling or rounding at all.
 
 % $Id: miwriteimages.m,v 1.18 2005-08-24 22:27:01 bert Exp $
 % $Name:  $
@@ -0,0 +1,28 @@
+%MIWRITEMASKED  Write a volume to a MINC file from the voxels under a mask.
+%
+%  miwritemasked (minc_file, values, mask_index [, fill_value])
+%
+%  writes a whole volume into minc_file, which must already exist (eg.
+%  created with newimage) and have no frame dimension.  values gives
+%  the voxels selected by mask_index (one value per element, in the
+%  same order), and every other voxel is set to fill_value (default 0).
+%  mask_index is as for mireadmasked: one-based and strictly ascending
+%  positions in the (image_size x slices) matrix that getimages returns
+%  for the whole volume, eg. find(mask).  values may be double or
+%  single.
+%
+%  The result is the same as
+%
+%  >> vol = repmat (fill_value, image_size, slices);
+%  >> vol(mask_index) = values;
+%  >> putimages (handle, vol, 1:slices);
+%
+%  but the volume is built and written one slice at a time, so only
+%  one slice is ever held in memory.
+%
+%  See also MIREADMASKED, PUTIMAGES, NEWIMAGE.
+
+% $Id: miwritemasked.m,v 1.1 $
+% $Name:  $
+
+error ('MIWRITEMASKED CMEX file not found');
@@ -1,9 +1,10 @@
 function handle = newimage (NewFile, DimSizes, ParentFile, ...
-                            ImageType, ValidRange, Orientation)
+                            ImageType, ValidRange, Orientation, ...
+                            Compress, Chunk)
 % NEWIMAGE  create a new MINC file, possibly descended from an old one
 %
 %  handle = newimage (NewFile, DimSizes, ParentFile, ...
-%                     ImageType, ValidRange, Orientation)
+%                     ImageType, ValidRange, Orientation, Compress, Chunk)
 %
 % creates a new MINC file.  NewFile and DimSizes must always be given,
 % although the number of elements required in DimSizes varies
@@ -72,6 +73,21 @@ function handle = newimage (NewFile, DimSizes, ParentFile, ...
 %                     transverse   MIzspace     MIyspace     MIxspace
 %                     sagittal     MIxspace     MIzspace     MIyspace
 %                     coronal      MIyspace     MIzspace     MIxspace
+%
+%   Compress   - the zlib compression level of the image, from 0 (no
+%                compression) to 9.  The default is 4.
+%
+%   Chunk      - the edge length, in voxels, of the chunks the image
+%                is stored in, or 0 to store it in one piece.  By
+%                default this is chosen to suit reading the images
+%                slice by slice (as getimages does), except that an
+%                uncompressed image is stored in one piece, which is
+%                the quickest to write -- so a Compress of 0 is best
+%                for scratch files.
+%
+%                Compress and Chunk only apply to MINC 2 files, ie.
+%                if EMMA was built against MINC 2; NetCDF files are
+%                never compressed or chunked.
 
 % ------------------------------ MNI Header ----------------------------------
 %@NAME       : newimage
@@ -82,7 +98,8 @@ function handle = newimage (NewFile, DimSizes, ParentFile, ...
 %              data set from within MATLAB, and creates an 
 %              associated MINC file.
 %@METHOD     : 
-%@CALLS      : (if a MINC filename is supplied) micreate, micreateimage
+%@CALLS      : (if a MINC filename is supplied) minewimage (if the CMEX
+%              is available), else micreateimage
 %@CREATED    : June 1993, Greg Ward & Mark Wolforth
 %@MODIFIED   : 6-17 Aug 1993 - totally overhauled (GPW).
 %              18 Aug 1993   - fixed up argument parsing code
@@ -90,6 +107,9 @@ function handle = newimage (NewFile, DimSizes, ParentFile, ...
 %                              image type/valid range/orientation;
 %                              a few more fixes to the argument handling code
 %              27 May 1997   - Modified to work with Matlab 5 (MW)
+%              uses the minewimage CMEX when available, rather than
+%              running micreateimage for every new file
+%              Compress and Chunk options
 %@VERSION    : $Id: newimage.m,v 2.17 2005-08-24 22:27:01 bert Exp $
 %              $Name:  $
 %-----------------------------------------------------------------------------
@@ -101,10 +121,39 @@ if (nargin < 2)
    error ('You must supply at least a new filename and dimension sizes');
 end
 
-if (nargin > 6)
+if (nargin > 8)
    error ('Too many input arguments');
 end
 
+if (nargin < 7), Compress = []; end
+if (nargin < 8), Chunk = []; end
+
+% mireadimages may still hold an old copy of NewFile open; close it
+% before the file is clobbered, as the cache can't always tell that a
+% file re-created within the same second has changed
+
+flushimagecache (NewFile);
+
+% If the minewimage CMEX is available, it works out all the defaults
+% below for itself (keeping the parent file open from one call to the
+% next) and creates the file in-process, so none of the rest of this
+% is needed.
+
+if (exist ('minewimage') == 3)
+   if (nargin < 3), ParentFile = ''; end
+   if (nargin < 4), ImageType = ''; end
+   if (nargin < 5), ValidRange = []; end
+   if (nargin < 6), Orientation = ''; end
+   if (~isempty (ParentFile) & ~isstr (ParentFile))
+      ParentFile = getimageinfo (ParentFile, 'Filename');
+   end
+   DimSizes = minewimage (NewFile, DimSizes, ParentFile, ...
+                          ImageType, ValidRange, Orientation, ...
+                          Compress, Chunk);
+   handle = handlefield([], 'Create', NewFile, DimSizes, [1 0], [], []);
+   return;
+end
+
 % If at least the parent file was given, let's open it so we can override
 % the defaults on the other arguments with values from the parent file.
 % Note also that if we open the file, we will read in the type of the
@@ -259,6 +308,13 @@ else
 		      ImageType, ValidRange, Orientation);
 end
 
+if (~isempty (Compress))
+   execstr = [execstr sprintf(' -compress %d', Compress)];
+end
+if (~isempty (Chunk))
+   execstr = [execstr sprintf(' -chunk %d', Chunk)];
+end
+
 %disp (execstr);
 
 [result,output] = unix (execstr);
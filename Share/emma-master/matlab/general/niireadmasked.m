@@ -0,0 +1,52 @@
+%NIIREADMASKED  Read the masked voxels from a list of NIfTI files.
+%
+%  data = niireadmasked (nii_files, mask_index [, precision ...
+%                        [, num_threads [, volumes]]])
+%
+%  reads, from each of the NIfTI files named in the cell array
+%  nii_files, the voxels selected by mask_index, and returns them as
+%  the rows of data: data(i,k) is the value of masked voxel k in file
+%  nii_files{i}.
+%
+%  mask_index is a vector of one-based, strictly ascending voxel
+%  indices into the volume, in the order the voxels are stored in the
+%  file.  If load_nii does not reorient the files (see
+%  niftiInFileOrder) and mask is the image of a mask volume,
+%
+%  >> data = niireadmasked (files, find (mask));
+%
+%  gives the same result as taking nii.img(mask)' from load_nii on
+%  each file, scl_slope and scl_inter included, but without ever
+%  reading a whole volume: each image is memory-mapped and only the
+%  masked voxels are copied out of it.  A gzip'd image is instead
+%  inflated once, in order, a piece at a time, and the masked voxels
+%  picked out as it goes by -- no temporary copy is written, as
+%  load_nii would do.  All files must have the same dimensions and
+%  orientation as the first one.  For files with more than three
+%  dimensions, only the first volume is read unless volumes is given.
+%
+%  Both NIfTI-1 and NIfTI-2 files (.nii, .nii.gz, or .hdr/.img pairs,
+%  gzip'd or not) of either byte order can be read.
+%
+%  precision may be 'double' (the default) or 'single'.
+%
+%  num_threads sets the number of threads used to read the files
+%  (default 1; if given as [], one per processor).  With gzip'd files,
+%  that is how many are inflated at once.
+%
+%  volumes gives the (one-based) volume to read from each file, one
+%  per element of nii_files; so a cohort stacked as the volumes of a
+%  single 4-D file is read by naming that file once per subject:
+%
+%  >> data = niireadmasked (repmat ({'cohort.nii.gz'}, 1, n), ...
+%  >>                       find (mask), 'double', [], 1:n);
+%
+%  All the volumes wanted from one gzip'd file are picked out in a
+%  single pass through it, in whatever order they are listed.
+%
+%  See also MIREADMASKED, LOAD_NII.
+
+% $Id: niireadmasked.m,v 1.1 $
+% $Name:  $
+
+error ('NIIREADMASKED CMEX file not found');
@@ -0,0 +1,42 @@
+%NIIWRITE  Write a volume to a NIfTI file, given a reference header.
+%
+%  niiwrite (nii_file, data, ref_file [, data_type])
+%
+%  writes data to the new NIfTI file nii_file, which is a single .nii
+%  file, gzip'd if its name ends in .gz (eg. 'tmap.nii.gz').  The
+%  header is copied from the NIfTI file ref_file (a .nii or .hdr,
+%  possibly gzip'd), of which only the header is read.  data must
+%  have as many elements as one volume of ref_file, in file order (ie.
+%  reshape (data, dims) is the image, where dims is the first three
+%  elements of ref_file's dim).
+%
+%  data_type is the type the image is stored as: 'byte', 'short',
+%  'long', 'float' or 'double'.  If it is empty or not given, it is
+%  the reference's own type (or 'float' if the reference is scaled,
+%  since load_nii would have unscaled it).  Integer types are rounded
+%  and clipped, and NaN stored as 0, just as save_nii does; 'float'
+%  keeps the values (and NaNs) as they are.
+%
+%  For a reference that load_nii does not reorient (see xform_nii),
+%  the file written is the same as
+%
+%  >> nii = load_nii (ref_file);
+%  >> nii.img = reshape (data, size (nii.img));
+%  >> save_nii (nii, nii_file);
+%
+%  except that any header extensions are not copied.  The volume is
+%  converted and written a slice at a time; a .nii.gz is compressed by
+%  a second thread while the next slice is converted.
+%
+%  niiwrite ('-header', ref_file, hdr_file)
+%
+%  instead just copies ref_file's header, uncompressed, to hdr_file,
+%  reading no more of ref_file than the header even if it is gzip'd --
+%  so that load_nii_hdr can be used on it (see NIFTIINFILEORDER).
+%
+%  See also VOXELSTATSWRITENIFTI.
+
+% $Id: niiwrite.m,v 1.1 $
+% $Name:  $
+
+error ('NIIWRITE CMEX file not found');
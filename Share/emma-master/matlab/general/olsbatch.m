@@ -0,0 +1,41 @@
+%OLSBATCH  Fit a linear model with image predictors at every voxel.
+%
+%  [beta, se, t, mse] = olsbatch (fixed, powers, response, images ...
+%                                 [, num_threads])
+%
+%  fits, by ordinary least squares, a linear model whose design matrix
+%  is different at every voxel because some of its predictors are
+%  images (eg. amyloid PET predicting FDG).  images is a cell array of
+%  the m image predictors, each n x V (n subjects, V voxels); fixed is
+%  n x p; and powers is p x m.  Column c of the design at voxel v is
+%
+%     fixed(:,c) .* images{1}(:,v).^powers(c,1) .* ...
+%                .* images{m}(:,v).^powers(c,m)
+%
+%  so that, for the model 'FDG ~ AV45*Age', with coefficients
+%  (Intercept), AV45, Age and AV45:Age,
+%
+%  >> fixed = [ones(n,2) Age Age];
+%  >> powers = [0; 1; 0; 1];
+%  >> [beta, se, t] = olsbatch (fixed, powers, FDG, {AV45});
+%
+%  response is n x V (an image), or n x 1 if it is the same at every
+%  voxel.  Images and response may be double or single; p may be at
+%  most 16.
+%
+%  beta, se and t are p x V: the Estimate, SE and tStat columns of
+%  fitlm's Coefficients at each voxel; mse is 1 x V, the residual
+%  variance.  A voxel with any NaN or Inf among its values, or whose
+%  design is rank deficient, gives NaN in all its results; refit such
+%  voxels with fitlm if need be.
+%
+%  The voxels are fitted eight at a time, with one voxel in each lane
+%  of the processor's vector instructions.  num_threads sets the number
+%  of threads (default 1; if given as [], one per processor).
+%
+%  See also OLSFIT, FITLM.
+
+% $Id: olsbatch.m,v 1.1 $
+% $Name:  $
+
+error ('OLSBATCH CMEX file not found');
@@ -0,0 +1,28 @@
+%OLSFIT  Fit one linear model to every column of a data matrix.
+%
+%  [beta, se, t, mse] = olsfit (X, Y)
+%
+%  fits the linear model Y(:,v) = X*beta(:,v) + error, by ordinary
+%  least squares, for every column v of Y (eg. one column per masked
+%  voxel and one row per subject).  X is the n x p design matrix
+%  (including any intercept column), with n > p and full rank; Y is
+%  n x V, double or single.
+%
+%  beta, se and t are p x V: the estimated coefficients, their
+%  standard errors and their t values (the Estimate, SE and tStat
+%  columns of fitlm's Coefficients, for each column of Y).  mse is
+%  1 x V: the residual variance, SSE/(n-p).  All are double.
+%
+%  X is factored (QR) once, and Y is then fitted 1024 columns at a
+%  time with two matrix products and a triangular solve, so that
+%  a whole brain's worth of voxels takes about as long as reading
+%  Y.  A column of Y holding any NaN or Inf gives NaN in all its
+%  results; refit such columns (eg. with fitlm, which drops the
+%  missing rows) if need be.  A rank-deficient X is an error.
+%
+%  See also FITLM, MLDIVIDE.
+
+% $Id: olsfit.m,v 1.1 $
+% $Name:  $
+
+error ('OLSFIT CMEX file not found');
@@ -15,6 +15,12 @@ function ImHandle = openimage (filename, mode)
 % getimageinfo (handle, 'filename') in this case will be the name of
 % the temporary, uncompressed file.  When the file is closed with
 % closeimage, this temporary file (and its directory) will be deleted.
+% When the CMEX versions of miinquire, mireadvar and mireadimages are
+% available, gzip'd files (.gz or .z) are instead read directly: the
+% EMMA library inflates them in-process into a scratch cache that is
+% shared between sessions (under $TMPDIR by default) and kept to a
+% fixed size (see the environment variables EMMA_GZCACHE_DIR and
+% EMMA_GZCACHE_MB), and the filename is left as given.
 % 
 % The value returned by openimage is a handle to be passed to
 % getimages, putimages, getimageinfo, etc.
@@ -102,12 +108,22 @@ end
       
 
 % Check to see if it's a compressed file, and if so uncompress
-% (and give it a new filename)
+% (and give it a new filename).  gzip'd files can be read directly by
+% the CMEX versions of miinquire, mireadvar and mireadimages (the EMMA
+% library inflates them into its own scratch cache), so that is only
+% necessary when those are not available.
 
 len = length (filename);
-if (strcmp (filename(len-2:len), '.gz') | ...
-    strcmp (filename(len-1:len), '.z') | ...
-    strcmp (filename(len-1:len), '.Z'))
+gzipped = (strcmp (filename(len-2:len), '.gz') | ...
+           strcmp (filename(len-1:len), '.z'));
+direct = gzipped & (exist ('miinquire') == 3) & ...
+         (exist ('mireadvar') == 3) & (exist ('mireadimages') == 3);
+
+if (direct & Flags(1))
+   error (['Cannot open compressed files for writing']);
+end
+
+if (~direct & (gzipped | strcmp (filename(len-1:len), '.Z')))
 
    Flags(2) = 1;
    if (Flags(1))
@@ -170,21 +186,31 @@ end
 % element of DimSizes will be zero.  (See also miinquire documentation
 % ... when it exists!)
 
-DimSizes = miinquire (filename, 'imagesize');
+%
+% Get the frame times and lengths for all frames too.  Note that
+% mireadvar returns an empty matrix for non-existent variables, so we
+% don't need to check the dimensions of the file.  If miinquire is
+% the CMEX version, all of this comes from one 'imageinfo' call
+% (which opens the file only once), and the struct is kept in the
+% handle so that getimageinfo can answer from it later.
+
+if (exist ('miinquire') == 3)
+   info = miinquire (filename, 'imageinfo');
+   DimSizes = info.DimSizes;
+   FrameTimes = info.FrameTimes;
+   FrameLengths = info.FrameLengths;
+else
+   info = [];
+   DimSizes = miinquire (filename, 'imagesize');
+   FrameTimes = mireadvar (filename, 'time');
+   FrameLengths = mireadvar (filename, 'time-width');
+end
 
 NumFrames = DimSizes (1);
 NumSlices = DimSizes (2);
 Height = DimSizes (3);
 Width = DimSizes (4);
 
-% Get the frame times and lengths for all frames.  Note that mireadvar
-% returns an empty matrix for non-existent variables, so we don't need
-% to check the dimensions of the file.
-
-
-FrameTimes = mireadvar (filename, 'time');
-FrameLengths = mireadvar (filename, 'time-width');
-
 %%%%%%%%%%%%%
 %Forced EMMA modification to get over ECAt average of time dimestion.
 %Though the MINC file is 3D, minchear still have time dimension info
@@ -197,5 +223,5 @@ FrameLengths = [];
 
 % Create a handle that stores the file information
 ImHandle = handlefield([], 'Create', filename, DimSizes, Flags, ...
-    FrameTimes, FrameLengths);
+    FrameTimes, FrameLengths, info);
 
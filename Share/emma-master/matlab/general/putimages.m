@@ -109,6 +109,7 @@ end
 filename = handlefield(handle, 'Filename');
 
 if ~isempty (filename)        % write images to MINC file if there is one
+   flushimagecache (filename);
    miwriteimages (filename, images, slices, frames);
 else
    disp ('Warning: cannot put images without a filename');
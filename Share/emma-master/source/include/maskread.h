@@ -0,0 +1,50 @@
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : maskread.h
+@DESCRIPTION: Types and prototypes for maskread.c (part of the EMMA
+              library): reading just the voxels under a mask from a list
+              of MINC files, as done by mireadmasked and mireadblocks.
+@CREATED    :
+@MODIFIED   :
+@VERSION    : $Id: maskread.h,v 1.1 $
+              $Name:  $
+---------------------------------------------------------------------------- */
+
+#ifndef _MASKREAD_H
+#define _MASKREAD_H
+
+#define MAX_SLAB       16             /* max number of slices read into
+                                         a slab buffer at a time */
+
+/*
+ * Description of the mask: which voxels of the volume to pick, and
+ * where each slice's voxels start in that list.  Both arrays are
+ * malloc'd, and freed by FreeMask.
+ */
+
+typedef struct
+{
+   long     NumVoxels;        /* number of elements in Index[] */
+   long     *Index;           /* zero-based, ascending voxel offsets into
+                                 the volume (ImageSize * Slices voxels) */
+   long     Slices;           /* geometry of the volume the index is for */
+   long     Height;
+   long     Width;
+   long     ImageSize;
+   long     *SliceFirst;      /* Index[SliceFirst[s]] is the first masked
+                                 voxel in slice s; Slices+1 elements */
+} MaskInfoRec;
+
+int  SetMaskIndex (double Values[], long NumVoxels, MaskInfoRec *Mask);
+int  SetFrameList (double Values[], long NumValues, long NumFiles,
+                   long **Frames);
+int  SetupMask (ImageInfoRec *Image, MaskInfoRec *Mask);
+void FreeMask (MaskInfoRec *Mask);
+int  ReadMasked (ImageInfoRec *Image, MaskInfoRec *Mask,
+                 long FirstSlice, long EndSlice, long Frame, void *Slab,
+                 void *Out, long Row, long NumRows);
+int  ReadMaskedFiles (char *Filenames[], long NumFiles, long Frames[],
+                      MaskInfoRec *Mask, long FirstSlice, long EndSlice,
+                      nc_type ICVType, double NaN, int NumThreads,
+                      int ReadAhead, void *Out, long *Failed);
+
+#endif
@@ -20,4 +20,6 @@
 #define ERR_BAD_MINC -9       /* detected some error in a MINC file */
 #define ERR_NO_MEM  -10	      /* not enough memory for something */
 #define ERR_OTHER   -11       /* anything else */
+#define ERR_IN_NIFTI  -12     /* error reading input NIfTI file */
+#define ERR_OUT_NIFTI -13     /* error writing output NIfTI file */
 
@@ -15,6 +15,7 @@
               $Name:  $
 ---------------------------------------------------------------------------- */
 
+#include "emmageneral.h"        /* for Boolean */
 
 typedef struct
 {
@@ -52,6 +53,7 @@ typedef struct
    int      NumDims;       /* usually 4 (dynamic) or 3 (non-dynamic) */
    int      NumAtts;       /* number of attributes */
    int      ICV;           /* ID of any ICV attached to the variable */
+   nc_type  ICVType;       /* type the ICV converts to (usually NC_DOUBLE) */
 
    /*
     * Size and "location" of image data.  N.B.: The [..]Dim variables are
@@ -77,4 +79,30 @@ int OpenFile (char *Filename, int *CDF, int Mode);
 int GetVarInfo (int CDF, char vName[], VarInfoRec *vInfo);
 int GetImageInfo (int CDF, ImageInfoRec *Image);
 int OpenImage (char Filename[], ImageInfoRec *Image, int mode, double NaN);
+int OpenImageAs (char Filename[], ImageInfoRec *Image, int mode, double NaN,
+                 nc_type ICVType);
+int ReadImageData (ImageInfoRec *Image, long Slices[], long Frames[],
+                   long NumSlices, long NumFrames,
+                   long StartRow, long NumRows, void *Buffer);
 void CloseImage (ImageInfoRec *Image);
+int PrefetchFile (char Filename[]);
+
+/* Writing images, in imagewrite.c */
+
+void PutMaxMin (ImageInfoRec *ImInfo, double Max, double Min,
+                long SliceNum, long FrameNum, 
+                Boolean DoSlices, Boolean DoFrames);
+int WriteImages (double *Images, ImageInfoRec *Image,
+                 long Slices[], long Frames[],
+                 long NumSlices, long NumFrames);
+
+/* Opening gzip'd files, in gzcache.c */
+
+int ExpandCompressed (char Filename[], char **Expanded, char Msg[]);
+
+/* The image cache, in imagecache.c */
+
+int OpenCachedImage (char Filename[], ImageInfoRec **Image, double NaN,
+                     nc_type ICVType);
+void FlushCachedImage (char Filename[]);
+void FlushImageCache (void);
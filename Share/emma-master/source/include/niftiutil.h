@@ -0,0 +1,147 @@
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : niftiutil.h
+@DESCRIPTION: The NIfTI-1 header, and prototypes for niftiutil.c (part of
+              the EMMA library): reading the header of a NIfTI file
+              without its image, gathering masked voxels from NIfTI-1
+              and NIfTI-2 files (mapped, or inflated as a stream), and
+              writing a new .nii or .nii.gz file a piece at a time.
+@CREATED    :
+@MODIFIED   :
+@VERSION    : $Id: niftiutil.h,v 1.1 $
+              $Name:  $
+---------------------------------------------------------------------------- */
+
+#ifndef _NIFTIUTIL_H
+#define _NIFTIUTIL_H
+
+#include "emmageneral.h"        /* for Boolean */
+
+#define NIFTI_HEADER_SIZE   348
+#define NIFTI_VOX_OFFSET    352       /* header plus 4 bytes of extender */
+#define NIFTI2_HEADER_SIZE  540
+
+/* The data types we can read and write (as in nifti1.h) */
+
+#define NIFTI_UINT8         2
+#define NIFTI_INT16         4
+#define NIFTI_INT32         8
+#define NIFTI_FLOAT32      16
+#define NIFTI_FLOAT64      64
+#define NIFTI_INT8        256
+#define NIFTI_UINT16      512
+#define NIFTI_UINT32      768
+
+/*
+ * The NIfTI-1 header, exactly as it is on disk (nifti_1_header in
+ * nifti1.h; every field is naturally aligned, so there is no padding).
+ */
+
+typedef struct
+{
+   int    sizeof_hdr;           /* must be 348 */
+   char   data_type [10];
+   char   db_name [18];
+   int    extents;
+   short  session_error;
+   char   regular;
+   char   dim_info;
+   short  dim [8];              /* dim[0] is the number of dimensions */
+   float  intent_p1;
+   float  intent_p2;
+   float  intent_p3;
+   short  intent_code;
+   short  datatype;             /* one of NIFTI_UINT8, etc. */
+   short  bitpix;
+   short  slice_start;
+   float  pixdim [8];
+   float  vox_offset;           /* where the image starts in a .nii */
+   float  scl_slope;
+   float  scl_inter;
+   short  slice_end;
+   char   slice_code;
+   char   xyzt_units;
+   float  cal_max;
+   float  cal_min;
+   float  slice_duration;
+   float  toffset;
+   int    glmax;
+   int    glmin;
+   char   descrip [80];
+   char   aux_file [24];
+   short  qform_code;
+   short  sform_code;
+   float  quatern_b;
+   float  quatern_c;
+   float  quatern_d;
+   float  qoffset_x;
+   float  qoffset_y;
+   float  qoffset_z;
+   float  srow_x [4];
+   float  srow_y [4];
+   float  srow_z [4];
+   char   intent_name [16];
+   char   magic [4];            /* "n+1" for .nii, "ni1" for .hdr/.img */
+} NiftiHeader;
+
+/*
+ * What is needed to read the image of a NIfTI-1 or NIfTI-2 file (see
+ * GetNiftiInfo), whichever the header; and, once MapNiftiImage has
+ * been called, the memory-mapped volumes.  A file of more than three
+ * dimensions is treated as NumVolumes 3-D volumes, one after another
+ * (eg. one subject per volume of a 4-D file).  Geometry holds the
+ * qform/sform codes, pixdim[0..3], the quaternion and offsets, and
+ * the srow_* rows, for checking that files share a voxel grid.
+ */
+
+#define NIFTI_GEOMETRY     24
+
+typedef struct
+{
+   char    *ImageFile;          /* the .nii, or the .img of a pair */
+   int      Version;            /* 1 or 2 */
+   long     Dim [8];            /* unused dimensions are 1 */
+   long     NumVolumes;         /* Dim[4] * ... * Dim[7] */
+   int      DataType;
+   int      TypeSize;
+   long     VoxOffset;          /* where the image starts in ImageFile */
+   double   Slope;              /* scl_slope and scl_inter as load_nii */
+   double   Inter;              /*   applies them: 1 and 0 if unscaled */
+   Boolean  RoundToFloat;       /* load_nii makes scaled data single */
+   Boolean  Swapped;
+   Boolean  Compressed;         /* ImageFile is gzip'd */
+   double   Geometry [NIFTI_GEOMETRY];
+   void    *Map;                /* from MapNiftiImage, or NULL */
+   long     MapLength;
+   unsigned char *MapData;      /* the start of volume MapFirst */
+   long     MapFirst;
+} NiftiInfoRec;
+
+/*
+ * A .nii file being written; see OpenNiftiWriter.  Its contents are
+ * private to niftiutil.c.
+ */
+
+typedef struct NiftiWriter NiftiWriterRec;
+
+int  NiftiTypeSize (int DataType);
+int  ReadNiftiHeader (char Filename[], NiftiHeader *Hdr, Boolean *Swapped);
+int  GetNiftiInfo (char Filename[], NiftiInfoRec *Info);
+Boolean SameNiftiGeometry (NiftiInfoRec *A, NiftiInfoRec *B);
+int  MapNiftiImage (NiftiInfoRec *Info, long FirstVolume, long EndVolume);
+void GatherNiftiMasked (NiftiInfoRec *Info, long Volume, long Index[],
+                        long NumVoxels, Boolean IsFloat,
+                        void *Out, long Row, long Stride);
+int  StreamNiftiMasked (NiftiInfoRec *Info, long Volumes[], long Rows[],
+                        long Count, long Index[], long NumVoxels,
+                        Boolean IsFloat, void *Out, long Stride);
+void FreeNiftiInfo (NiftiInfoRec *Info);
+int  ReadNiftiMaskedFiles (char *Filenames[], long NumFiles, long Volumes[],
+                           long Index[], long NumVoxels, Boolean IsFloat,
+                           int NumThreads, void *Out, long *Failed);
+int  OpenNiftiWriter (char Filename[], NiftiHeader *Hdr, long BufferVoxels,
+                      NiftiWriterRec **Writer);
+int  WriteNiftiData (NiftiWriterRec *Writer, void *Values, Boolean IsFloat,
+                     long NumValues);
+int  CloseNiftiWriter (NiftiWriterRec *Writer);
+
+#endif
@@ -0,0 +1,29 @@
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : threadpool.h
+@DESCRIPTION: Prototypes for the simple thread pool in threadpool.c (part
+              of the EMMA library), used by CMEX programs that want to
+              work on several files at once.
+@CREATED    :
+@MODIFIED   :
+@VERSION    : $Id: threadpool.h,v 1.1 $
+              $Name:  $
+---------------------------------------------------------------------------- */
+
+#ifndef _THREADPOOL_H
+#define _THREADPOOL_H
+
+#define MAX_THREADS   64          /* most threads RunTasks will start */
+
+/*
+ * A task function is called once for every task number in 0..NumTasks-1,
+ * from whichever thread (0..NumThreads-1) picks the task up.
+ */
+
+typedef void (*TaskFunc) (long Task, int Thread, void *Arg);
+
+int  DefaultThreads (void);
+int  RunTasks (long NumTasks, int NumThreads, TaskFunc Func, void *Arg);
+void LockSerial (void);
+void UnlockSerial (void);
+
+#endif
@@ -0,0 +1,850 @@
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : irlsfit (CMEX)
+@INPUT      :
+@OUTPUT     :
+@RETURNS    :
+@DESCRIPTION: CMEX routine to fit the same generalized linear model
+              (binomial, Poisson, gamma or normal, with the canonical
+              link) to every column of a data matrix, by iteratively
+              reweighted least squares.  See irlsfit.m (or type
+              "help irlsfit" in MATLAB) for details.
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+@COMMENTS   : For full usage documentation, see irlsfit.m
+---------------------------------------------------------------------------- */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <ctype.h>
+#include <math.h>
+#include <float.h>
+#include "mex.h"
+#include "blas.h"             /* MATLAB's own BLAS */
+#include "emmageneral.h"
+#include "mierrors.h"         /* mine and Mark's */
+#include "mexutils.h"         /* N.B. must link in mexutils.o */
+
+#define PROGNAME "irlsfit"
+
+/*
+ * Constants to check for argument number and position
+ */
+
+#define NUM_IN_ARGS        3
+#define MAX_OUT_ARGS       5
+
+/*
+ * Macros to access the input and output arguments from/to MATLAB
+ * (N.B. these only work in mexFunction())
+ */
+
+#define DESIGN         prhs[0]                  /* subjects x coefficients */
+#define DATA           prhs[1]                  /* subjects x voxels */
+#define FAMILY         prhs[2]
+#define BETA           plhs[0]                  /* coefficients x voxels */
+#define STD_ERR        plhs[1]
+#define T_VALUES       plhs[2]
+#define DISPERSION     plhs[3]                  /* 1 x voxels */
+#define ITERATIONS     plhs[4]                  /* 1 x voxels */
+
+/*
+ * The voxels are fitted BLOCK_VOXELS at a time.  A voxel has converged
+ * when no coefficient changed by more than CONV_TOL (relative) in the
+ * last iteration, as with glmfit, which also gives up after MAX_ITER.
+ * MAX_COEFFS bounds the design, so that each voxel's normal equations
+ * can live on the stack.
+ */
+
+#define BLOCK_VOXELS   1024
+#define CONV_TOL       1e-6
+#define MAX_ITER       100
+#define MAX_COEFFS     32
+
+typedef enum { NORMAL, BINOMIAL, POISSON, GAMMA } FamilyType;
+
+char       *ErrMsg ;             /* set as close to the occurence of the
+                                    error as possible; displayed by whatever
+                                    code exits */
+
+/*
+ * The design, and the products of each pair of its columns: column
+ * Pair(j,k) of Pairs (j >= k, by columns of the lower triangle) is
+ * X(:,j).*X(:,k), so that Pairs'*W gives X'*diag(w)*X for every
+ * column w of W at once.
+ */
+
+typedef struct
+{
+   ptrdiff_t   n, p, NumPairs;
+   double     *X;
+   double     *Pairs;
+   FamilyType  Family;
+} ModelRec;
+
+/*
+ * The voxels of a block still being fitted, NumActive of them, each
+ * one a column of the matrices (Index gives its place in the block).
+ * Columns are dropped as voxels converge or fail.
+ */
+
+typedef struct
+{
+   ptrdiff_t   NumActive;
+   ptrdiff_t  *Index;
+   double     *Y, *Eta, *Mu;           /* n x NumActive */
+   double     *W, *WZ;                 /* n x NumActive */
+   double     *Gram;                   /* NumPairs x NumActive */
+   double     *C, *B, *BOld;           /* p x NumActive */
+} ActiveRec;
+
+
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : ErrAbort
+@INPUT      : msg - character to string to print just before aborting
+              PrintUsage - whether or not to print a usage summary before
+                aborting
+              ExitCode - one of the standard codes from mierrors.h -- NOTE!
+                this parameter is NOT currently used, but I've included it for
+                consistency with other functions named ErrAbort in other
+                programs
+@OUTPUT     : none - function does not return!!!
+@RETURNS    :
+@DESCRIPTION: Optionally prints a usage summary, and calls mexErrMsgTxt with
+              the supplied msg, which ABORTS the mex-file!!!
+@METHOD     :
+@GLOBALS    : requires PROGNAME macro
+@CALLS      : standard mex functions
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+void ErrAbort (char msg[], Boolean PrintUsage, int ExitCode)
+{
+   if (PrintUsage)
+   {
+      (void) mexPrintf ("Usage: [beta, se, t, dispersion, iterations] = "
+                        "%s (X, Y, family)\n", PROGNAME);
+   }
+   (void) mexErrMsgTxt (msg);
+}
+
+
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : ParseFamily
+@INPUT      : Name - the family, as given to fitglm's 'Distribution'
+@OUTPUT     : *Family
+@RETURNS    : TRUE, or FALSE if Name is not a family this can fit
+@DESCRIPTION: Case-insensitive match of Name against 'normal',
+              'binomial', 'poisson' and 'gamma'.
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+static Boolean ParseFamily (char *Name, FamilyType *Family)
+{
+   static const char *Names [] = { "normal", "binomial", "poisson",
+                                   "gamma" };
+   char       *c;
+   int         i;
+
+   for (c = Name; *c != '\0'; c++)
+      *c = (char) tolower ((unsigned char) *c);
+   for (i = 0; i < 4; i++)
+   {
+      if (strcmp (Name, Names [i]) == 0)
+      {
+         *Family = (FamilyType) i;
+         return (TRUE);
+      }
+   }
+   return (FALSE);
+}     /* ParseFamily */
+
+
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : ValidResponse
+@INPUT      : Family
+              Y - one voxel's response, n values
+              n
+@OUTPUT     :
+@RETURNS    : TRUE if every value is finite and one Family allows
+@DESCRIPTION: Binomial responses are proportions (0 to 1), Poisson ones
+              counts (0 or more) and gamma ones positive.
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+static Boolean ValidResponse (FamilyType Family, double *Y, ptrdiff_t n)
+{
+   ptrdiff_t   i;
+
+   for (i = 0; i < n; i++)
+   {
+      if (!isfinite (Y [i]))
+         return (FALSE);
+      if (((Family == BINOMIAL) && !((Y [i] >= 0) && (Y [i] <= 1))) ||
+          ((Family == POISSON) && !(Y [i] >= 0)) ||
+          ((Family == GAMMA) && !(Y [i] > 0)))
+         return (FALSE);
+   }
+   return (TRUE);
+}     /* ValidResponse */
+
+
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : InverseLink
+@INPUT      : Family
+              Eta - linear predictors, Count of them
+              Count
+@OUTPUT     : Mu - the means they give
+@RETURNS    : TRUE, or FALSE if some mean is not one the family allows
+@DESCRIPTION: The inverse of the canonical link: identity, logit, log or
+              reciprocal.  As in glmfit, the linear predictor is kept
+              where the logit and log links can be inverted without
+              overflow (the means then being within eps of 0 or 1, or
+              between realmin and realmax).  A gamma mean must come
+              from a positive linear predictor.
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+static Boolean InverseLink (FamilyType Family, double *Eta, double *Mu,
+                            ptrdiff_t Count)
+{
+   double      Low, High;
+   ptrdiff_t   i;
+
+   switch (Family)
+   {
+      case NORMAL:
+         memcpy (Mu, Eta, Count * sizeof (double));
+         break;
+      case BINOMIAL:
+         High = -log (DBL_EPSILON);
+         for (i = 0; i < Count; i++)
+            Mu [i] = 1.0 / (1.0 + exp (-min (max (Eta [i], -High), High)));
+         break;
+      case POISSON:
+         Low = log (DBL_MIN);
+         High = log (DBL_MAX);
+         for (i = 0; i < Count; i++)
+            Mu [i] = exp (min (max (Eta [i], Low), High));
+         break;
+      case GAMMA:
+         for (i = 0; i < Count; i++)
+         {
+            if (!(Eta [i] > 0))
+               return (FALSE);
+            Mu [i] = 1.0 / Eta [i];
+         }
+         break;
+   }
+   return (TRUE);
+}     /* InverseLink */
+
+
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : StartValues
+@INPUT      : Family
+              Y - responses, Count of them
+              Count
+@OUTPUT     : Mu, Eta - the means and linear predictors to start from
+@RETURNS    : (void)
+@DESCRIPTION: glmfit's starting means: the responses themselves, moved
+              off the ends of the range where the link is infinite
+              ((y+0.5)/2 for binomial, y+0.25 for Poisson).
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+static void StartValues (FamilyType Family, double *Y, double *Mu,
+                         double *Eta, ptrdiff_t Count)
+{
+   ptrdiff_t   i;
+
+   for (i = 0; i < Count; i++)
+   {
+      switch (Family)
+      {
+         case NORMAL:
+            Mu [i] = Eta [i] = Y [i];
+            break;
+         case BINOMIAL:
+            Mu [i] = (Y [i] + 0.5) / 2.0;
+            Eta [i] = log (Mu [i] / (1.0 - Mu [i]));
+            break;
+         case POISSON:
+            Mu [i] = Y [i] + 0.25;
+            Eta [i] = log (Mu [i]);
+            break;
+         case GAMMA:
+            Mu [i] = Y [i];
+            Eta [i] = 1.0 / Mu [i];
+            break;
+      }
+   }
+}     /* StartValues */
+
+
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : WorkingResponse
+@INPUT      : Family
+              Y, Mu, Eta - responses, means and linear predictors, Count
+                of each
+              Count
+@OUTPUT     : W - the weights of the next least-squares fit
+              WZ - the working response, times the weights
+@RETURNS    : (void)
+@DESCRIPTION: With the canonical link g, the weights are
+              1/(g'(mu)^2 V(mu)) and the working response is
+              eta + (y-mu) g'(mu):
+
+                 normal    w = 1            z = y
+                 binomial  w = mu (1-mu)    z = eta + (y-mu)/w
+                 Poisson   w = mu           z = eta + (y-mu)/w
+                 gamma     w = mu^2         z = eta - (y-mu)/w
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+static void WorkingResponse (FamilyType Family, double *Y, double *Mu,
+                             double *Eta, double *W, double *WZ,
+                             ptrdiff_t Count)
+{
+   ptrdiff_t   i;
+
+   switch (Family)
+   {
+      case NORMAL:
+         for (i = 0; i < Count; i++)
+         {
+            W [i] = 1.0;
+            WZ [i] = Y [i];
+         }
+         break;
+      case BINOMIAL:
+         for (i = 0; i < Count; i++)
+         {
+            W [i] = Mu [i] * (1.0 - Mu [i]);
+            WZ [i] = W [i] * Eta [i] + (Y [i] - Mu [i]);
+         }
+         break;
+      case POISSON:
+         for (i = 0; i < Count; i++)
+         {
+            W [i] = Mu [i];
+            WZ [i] = W [i] * Eta [i] + (Y [i] - Mu [i]);
+         }
+         break;
+      case GAMMA:
+         for (i = 0; i < Count; i++)
+         {
+            W [i] = Mu [i] * Mu [i];
+            WZ [i] = W [i] * Eta [i] - (Y [i] - Mu [i]);
+         }
+         break;
+   }
+}     /* WorkingResponse */
+
+
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : Dispersion
+@INPUT      : *Model
+              Y, Mu - one voxel's responses and fitted means
+@OUTPUT     :
+@RETURNS    : the dispersion: 1 for the binomial and Poisson families,
+              and otherwise the sum of squared Pearson residuals over
+              the degrees of freedom, n-p (as fitglm estimates it)
+@DESCRIPTION:
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+static double Dispersion (ModelRec *Model, double *Y, double *Mu)
+{
+   double      Sum, r;
+   ptrdiff_t   i;
+
+   if ((Model->Family == BINOMIAL) || (Model->Family == POISSON))
+      return (1.0);
+
+   Sum = 0;
+   for (i = 0; i < Model->n; i++)
+   {
+      r = Y [i] - Mu [i];
+      if (Model->Family == GAMMA)
+         r /= Mu [i];
+      Sum += r * r;
+   }
+   return (Sum / (double) (Model->n - Model->p));
+}     /* Dispersion */
+
+
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : SolveNormal
+@INPUT      : Gram - the lower triangle of X'*diag(w)*X, packed by columns
+                (NumPairs values)
+              C - X'*diag(w)*z, p values
+              p
+@OUTPUT     : B - the solution of (X'*diag(w)*X) B = C
+              CovDiag - diag(inv(X'*diag(w)*X)), if not NULL
+@RETURNS    : TRUE, or FALSE if X'*diag(w)*X is (numerically) singular
+@DESCRIPTION: Cholesky factorization L*L' of the p x p matrix, then
+              forward and back substitution.  The diagonal of its
+              inverse is the sum of squares of each column of inv(L).
+@METHOD     : A pivot below p * eps times the largest diagonal element
+              is taken as singular.
+@GLOBALS    :
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+static Boolean SolveNormal (double *Gram, double *C, ptrdiff_t p,
+                            double *B, double *CovDiag)
+{
+   double      L [MAX_COEFFS * MAX_COEFFS];
+   double      Col [MAX_COEFFS];
+   double      Sum, MaxDiag, Tol;
+   ptrdiff_t   i, j, k;
+
+   MaxDiag = 0;
+   for (k = 0; k < p; k++)
+   {
+      for (j = k; j < p; j++)
+         L [j + k*p] = *Gram++;
+      MaxDiag = max (MaxDiag, L [k + k*p]);
+   }
+   Tol = (double) p * DBL_EPSILON * MaxDiag;
+
+   for (j = 0; j < p; j++)
+   {
+      Sum = L [j + j*p];
+      for (k = 0; k < j; k++)
+         Sum -= L [j + k*p] * L [j + k*p];
+      if (!(Sum > Tol))
+         return (FALSE);
+      L [j + j*p] = sqrt (Sum);
+      for (i = j+1; i < p; i++)
+      {
+         Sum = L [i + j*p];
+         for (k = 0; k < j; k++)
+            Sum -= L [i + k*p] * L [j + k*p];
+         L [i + j*p] = Sum / L [j + j*p];
+      }
+   }
+
+   /* B = L' \ (L \ C) */
+
+   for (i = 0; i < p; i++)
+   {
+      Sum = C [i];
+      for (k = 0; k < i; k++)
+         Sum -= L [i + k*p] * B [k];
+      B [i] = Sum / L [i + i*p];
+   }
+   for (i = p-1; i >= 0; i--)
+   {
+      Sum = B [i];
+      for (k = i+1; k < p; k++)
+         Sum -= L [k + i*p] * B [k];
+      B [i] = Sum / L [i + i*p];
+   }
+
+   if (CovDiag != NULL)
+   {
+      for (i = 0; i < p; i++)
+         CovDiag [i] = 0;
+      for (j = 0; j < p; j++)
+      {
+         /* Column j of inv(L) */
+
+         for (i = j; i < p; i++)
+         {
+            Sum = (i == j) ? 1.0 : 0.0;
+            for (k = j; k < i; k++)
+               Sum -= L [i + k*p] * Col [k];
+            Col [i] = Sum / L [i + i*p];
+            CovDiag [j] += Col [i] * Col [i];
+         }
+      }
+   }
+   return (TRUE);
+}     /* SolveNormal */
+
+
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : DropColumn
+@INPUT      : Matrix - Rows x Columns (column major)
+              Rows
+              From, To - column indices, To < From
+@OUTPUT     : Matrix - with column From copied to column To
+@RETURNS    : (void)
+@DESCRIPTION: Used to pack the active voxels' columns together as others
+              drop out.
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+static void DropColumn (double *Matrix, ptrdiff_t Rows, ptrdiff_t From,
+                        ptrdiff_t To)
+{
+   memcpy (Matrix + To*Rows, Matrix + From*Rows, Rows * sizeof (double));
+}     /* DropColumn */
+
+
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : FitBlock
+@INPUT      : *Model - the design and family
+              *Active - its matrices allocated for Count voxels, and Y
+                and Index filled in for the NumActive voxels with valid
+                responses
+              Count - number of voxels in the block
+              Iter - NaN for the voxels that are not active
+@OUTPUT     : Beta, SE, T - p x Count: the estimates, their standard
+                errors and t values
+              Disp, Iter - Count dispersions and numbers of iterations
+@RETURNS    : (void)
+@DESCRIPTION: Iteratively reweighted least squares, on all the voxels
+              of the block at once.  Each iteration forms the weighted
+              normal equations of every active voxel with two level-3
+              BLAS products,
+
+                 Gram = Pairs'*W;   C = X'*WZ
+
+              solves each voxel's p x p system, and updates all the
+              linear predictors with a third, Eta = X*B.  A voxel that
+              converges is finished there (its covariance comes from
+              the weights of its last fit, as in glmfit) and its column
+              dropped, so the later iterations cost only what the
+              voxels still converging need.  Voxels that fail -- a
+              singular system, a mean outside the family's range, or
+              no convergence after MAX_ITER iterations -- are NaN in
+              all their results, as are those that were never active.
+@METHOD     :
+@GLOBALS    :
+@CALLS      : StartValues, WorkingResponse, SolveNormal, InverseLink,
+              Dispersion, DropColumn; BLAS: dgemm
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+static void FitBlock (ModelRec *Model, ActiveRec *Active, ptrdiff_t Count,
+                      double *Beta, double *SE, double *T, double *Disp,
+                      double *Iter)
+{
+   ptrdiff_t   n = Model->n;
+   ptrdiff_t   p = Model->p;
+   ptrdiff_t   NumPairs = Model->NumPairs;
+   ptrdiff_t   A, a, Keep, v, j;
+   double      One = 1.0, Zero = 0.0;
+   double      CovDiag [MAX_COEFFS];
+   double      D, *b, *bOld;
+   Boolean    *Solved, *Done;
+   Boolean     Converged;
+   int         Iteration;
+
+   Solved = (Boolean *) mxCalloc (Count, sizeof (Boolean));
+   Done = (Boolean *) mxCalloc (Count, sizeof (Boolean));
+
+   A = Active->NumActive;
+   StartValues (Model->Family, Active->Y, Active->Mu, Active->Eta, n*A);
+   for (a = 0; a < p*A; a++)
+      Active->B [a] = 0;
+
+   for (Iteration = 1; (Iteration <= MAX_ITER) && (A > 0); Iteration++)
+   {
+      WorkingResponse (Model->Family, Active->Y, Active->Mu, Active->Eta,
+                       Active->W, Active->WZ, n*A);
+      memcpy (Active->BOld, Active->B, p*A * sizeof (double));
+      dgemm ("T", "N", &NumPairs, &A, &n, &One, Model->Pairs, &n,
+             Active->W, &n, &Zero, Active->Gram, &NumPairs);
+      dgemm ("T", "N", &p, &A, &n, &One, Model->X, &n, Active->WZ, &n,
+             &Zero, Active->C, &p);
+
+      /* Solve each voxel's system; those that converge are finished */
+
+      for (a = 0; a < A; a++)
+      {
+         v = Active->Index [a];
+         b = Active->B + a*p;
+         bOld = Active->BOld + a*p;
+         Solved [a] = SolveNormal (Active->Gram + a*NumPairs,
+                                   Active->C + a*p, p, b, CovDiag);
+         Converged = Solved [a];
+         for (j = 0; (j < p) && Converged; j++)
+         {
+            Converged = fabs (b [j] - bOld [j]) <=
+                        CONV_TOL * max (sqrt (DBL_EPSILON), fabs (bOld [j]));
+         }
+         Done [a] = Converged;
+         if (Converged)
+         {
+            for (j = 0; j < p; j++)
+            {
+               Beta [v*p + j] = b [j];
+               SE [v*p + j] = CovDiag [j];
+            }
+         }
+      }
+
+      dgemm ("N", "N", &n, &A, &p, &One, Model->X, &n, Active->B, &p,
+             &Zero, Active->Eta, &n);
+
+      /* Finish the converged voxels, and pack the rest together */
+
+      Keep = 0;
+      for (a = 0; a < A; a++)
+      {
+         v = Active->Index [a];
+         if (!Solved [a] ||
+             !InverseLink (Model->Family, Active->Eta + a*n,
+                           Active->Mu + a*n, n))
+         {
+            Iter [v] = mxGetNaN ();
+            continue;
+         }
+         if (Done [a])
+         {
+            D = Dispersion (Model, Active->Y + a*n, Active->Mu + a*n);
+            Disp [v] = D;
+            Iter [v] = (double) Iteration;
+            for (j = 0; j < p; j++)
+            {
+               SE [v*p + j] = sqrt (D * SE [v*p + j]);
+               T [v*p + j] = Beta [v*p + j] / SE [v*p + j];
+            }
+            continue;
+         }
+         if (Keep < a)
+         {
+            Active->Index [Keep] = v;
+            DropColumn (Active->Y, n, a, Keep);
+            DropColumn (Active->Eta, n, a, Keep);
+            DropColumn (Active->Mu, n, a, Keep);
+            DropColumn (Active->B, p, a, Keep);
+         }
+         Keep++;
+      }
+      A = Keep;
+   }
+
+   /* Those that did not converge give NaN, like the failures */
+
+   for (a = 0; a < A; a++)
+   {
+      Iter [Active->Index [a]] = mxGetNaN ();
+   }
+   for (v = 0; v < Count; v++)
+   {
+      if (!isfinite (Iter [v]))
+      {
+         for (j = 0; j < p; j++)
+            Beta [v*p + j] = SE [v*p + j] = T [v*p + j] = mxGetNaN ();
+         Disp [v] = Iter [v] = mxGetNaN ();
+      }
+   }
+
+   mxFree (Done);
+   mxFree (Solved);
+}     /* FitBlock */
+
+
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : mexFunction
+@INPUT      : nlhs, nrhs - number of output/input arguments (from MATLAB)
+              prhs - actual input arguments
+@OUTPUT     : plhs[0..4] - beta, se, t, dispersion and iterations (see
+                irlsfit.m)
+@RETURNS    : (void)
+@DESCRIPTION: Checks the arguments, forms the products of the pairs of
+              design columns, and fits the voxels BLOCK_VOXELS at a
+              time: the valid columns of each block of the data (double
+              or single) are copied into the active set, which FitBlock
+              fits, with the results going straight into the outputs.
+@METHOD     :
+@GLOBALS    : ErrMsg
+@CALLS      : ParseFamily, ValidResponse, FitBlock
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+void mexFunction(int    nlhs,
+                 mxArray *plhs[],
+                 int    nrhs,
+                 const mxArray *prhs[])
+{
+   ModelRec     Model;
+   ActiveRec    Active;
+   ptrdiff_t    n, p, NumVoxels, BlockSize;
+   ptrdiff_t    Start, Count;
+   ptrdiff_t    i, j, k, v, Pair;
+   double      *X, *Y;
+   double      *Beta, *SE, *T, *Disp, *Iter;
+   char        *FamilyName;
+   Boolean      IsFloat;
+
+   ErrMsg = (char *) mxCalloc (256, sizeof (char));
+
+   if ((nrhs != NUM_IN_ARGS) || (nlhs > MAX_OUT_ARGS))
+   {
+      ErrAbort ("Incorrect number of arguments", TRUE, ERR_ARGS);
+   }
+
+   if (!mxIsDouble (DESIGN) || mxIsComplex (DESIGN) || mxIsSparse (DESIGN) ||
+       (mxGetNumberOfDimensions (DESIGN) != 2))
+   {
+      ErrAbort ("X must be a real, full matrix of doubles", TRUE, ERR_ARGS);
+   }
+   if ((!mxIsDouble (DATA) && !mxIsSingle (DATA)) ||
+       mxIsComplex (DATA) || mxIsSparse (DATA) ||
+       (mxGetNumberOfDimensions (DATA) != 2))
+   {
+      ErrAbort ("Y must be a real, full matrix of doubles or singles",
+                TRUE, ERR_ARGS);
+   }
+   if ((ParseStringArg (FAMILY, &FamilyName) == NULL) ||
+       !ParseFamily (FamilyName, &Model.Family))
+   {
+      ErrAbort ("family must be one of 'normal', 'binomial', 'poisson' "
+                "or 'gamma'", TRUE, ERR_ARGS);
+   }
+
+   n = (ptrdiff_t) mxGetM (DESIGN);
+   p = (ptrdiff_t) mxGetN (DESIGN);
+   NumVoxels = (ptrdiff_t) mxGetN (DATA);
+   IsFloat = mxIsSingle (DATA);
+   if ((p < 1) || (n <= p))
+   {
+      ErrAbort ("X must have more rows than columns", TRUE, ERR_ARGS);
+   }
+   if (p > MAX_COEFFS)
+   {
+      sprintf (ErrMsg, "X may have at most %d columns", MAX_COEFFS);
+      ErrAbort (ErrMsg, TRUE, ERR_ARGS);
+   }
+   if ((ptrdiff_t) mxGetM (DATA) != n)
+   {
+      ErrAbort ("X and Y must have the same number of rows", TRUE, ERR_ARGS);
+   }
+   X = mxGetPr (DESIGN);
+   for (i = 0; i < n*p; i++)
+   {
+      if (!isfinite (X [i]))
+      {
+         ErrAbort ("X must not contain NaN or Inf", TRUE, ERR_ARGS);
+      }
+   }
+
+   Model.n = n;
+   Model.p = p;
+   Model.X = X;
+   Model.NumPairs = p * (p+1) / 2;
+   Model.Pairs = (double *) mxCalloc (n * Model.NumPairs, sizeof (double));
+   Pair = 0;
+   for (k = 0; k < p; k++)
+   {
+      for (j = k; j < p; j++, Pair++)
+      {
+         for (i = 0; i < n; i++)
+            Model.Pairs [Pair*n + i] = X [j*n + i] * X [k*n + i];
+      }
+   }
+
+   BETA = mxCreateDoubleMatrix (p, NumVoxels, mxREAL);
+   STD_ERR = mxCreateDoubleMatrix (p, NumVoxels, mxREAL);
+   T_VALUES = mxCreateDoubleMatrix (p, NumVoxels, mxREAL);
+   DISPERSION = mxCreateDoubleMatrix (1, NumVoxels, mxREAL);
+   ITERATIONS = mxCreateDoubleMatrix (1, NumVoxels, mxREAL);
+   Beta = mxGetPr (BETA);
+   SE = mxGetPr (STD_ERR);
+   T = mxGetPr (T_VALUES);
+   Disp = mxGetPr (DISPERSION);
+   Iter = mxGetPr (ITERATIONS);
+
+   BlockSize = min (NumVoxels, BLOCK_VOXELS) + 1;
+   Active.Index = (ptrdiff_t *) mxCalloc (BlockSize, sizeof (ptrdiff_t));
+   Active.Y = (double *) mxCalloc (n * BlockSize, sizeof (double));
+   Active.Eta = (double *) mxCalloc (n * BlockSize, sizeof (double));
+   Active.Mu = (double *) mxCalloc (n * BlockSize, sizeof (double));
+   Active.W = (double *) mxCalloc (n * BlockSize, sizeof (double));
+   Active.WZ = (double *) mxCalloc (n * BlockSize, sizeof (double));
+   Active.Gram = (double *) mxCalloc (Model.NumPairs * BlockSize,
+                                      sizeof (double));
+   Active.C = (double *) mxCalloc (p * BlockSize, sizeof (double));
+   Active.B = (double *) mxCalloc (p * BlockSize, sizeof (double));
+   Active.BOld = (double *) mxCalloc (p * BlockSize, sizeof (double));
+
+   for (Start = 0; Start < NumVoxels; Start += Count)
+   {
+      Count = min (NumVoxels - Start, BLOCK_VOXELS);
+
+      /* Only voxels with valid responses start out active */
+
+      Active.NumActive = 0;
+      for (v = 0; v < Count; v++)
+      {
+         Y = Active.Y + Active.NumActive * n;
+         if (IsFloat)
+         {
+            float  *F = (float *) mxGetData (DATA) + (Start+v)*n;
+
+            for (i = 0; i < n; i++)
+               Y [i] = (double) F [i];
+         }
+         else
+         {
+            memcpy (Y, mxGetPr (DATA) + (Start+v)*n, n * sizeof (double));
+         }
+
+         Iter [Start + v] = mxGetNaN ();
+         if (ValidResponse (Model.Family, Y, n))
+         {
+            Iter [Start + v] = 0;
+            Active.Index [Active.NumActive++] = v;
+         }
+      }
+
+      FitBlock (&Model, &Active, Count, Beta + Start*p, SE + Start*p,
+                T + Start*p, Disp + Start, Iter + Start);
+   }
+
+   mxFree (Active.BOld);
+   mxFree (Active.B);
+   mxFree (Active.C);
+   mxFree (Active.Gram);
+   mxFree (Active.WZ);
+   mxFree (Active.W);
+   mxFree (Active.Mu);
+   mxFree (Active.Eta);
+   mxFree (Active.Y);
+   mxFree (Active.Index);
+   mxFree (Model.Pairs);
+
+}     /* mexFunction */
@@ -0,0 +1,442 @@
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : gzcache.c
+@DESCRIPTION: Lets the EMMA library open gzip'd MINC files (foo.mnc.gz)
+              directly.  The MINC/NetCDF libraries can only open a real,
+              uncompressed file, so a compressed file is inflated (with
+              zlib, in-process -- no gunzip is run) into a scratch cache
+              directory, and the expanded copy is opened instead.  The
+              copy is kept, so the next open of the same file (by any
+              process) costs nothing but a stat(), and the cache is
+              trimmed back to a size limit by deleting the least
+              recently used copies.
+
+              The cache lives in $EMMA_GZCACHE_DIR if that is set,
+              otherwise in a per-user directory under $TMPDIR or /tmp.
+              (Setting EMMA_GZCACHE_DIR to somewhere under /dev/shm
+              keeps it in memory, but the copies outlive the session,
+              so this is not the default.)  Its size limit is
+              $EMMA_GZCACHE_MB megabytes (default DEFAULT_CACHE_MB).
+
+              Cached copies are named after the device, inode, size and
+              modification time of the compressed file, so a file that
+              is changed or replaced never matches its old copy.
+@CREATED    :
+@MODIFIED   :
+@VERSION    : $Id: gzcache.c,v 1.1 $
+              $Name:  $
+---------------------------------------------------------------------------- */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <utime.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <zlib.h>
+#include "minc.h"
+#include "emmageneral.h"
+#include "mierrors.h"
+#include "mincutil.h"
+
+#define DEFAULT_CACHE_MB   2048
+#define CACHE_SUFFIX       ".mnc"
+#define INFLATE_CHUNK      262144        /* bytes per gzread */
+#define MAX_CACHE_FILES    4096          /* most files considered by
+                                            TrimCache at once */
+#define TEMP_PREFIX        ".inflate"
+#define STALE_TEMP_SECS    3600          /* age at which a temporary
+                                            file is taken to be left
+                                            by a crashed inflate */
+
+
+
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : IsGzipped
+@INPUT      : Filename
+@OUTPUT     :
+@RETURNS    : TRUE if Filename ends in .gz or .z
+@DESCRIPTION: Decides whether a file should go through the cache.  (.Z
+              files are made by compress(1), which zlib cannot read.)
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+static Boolean IsGzipped (char Filename[])
+{
+   size_t   len = strlen (Filename);
+
+   return ((len > 3 && strcmp (Filename + len - 3, ".gz") == 0) ||
+           (len > 2 && strcmp (Filename + len - 2, ".z") == 0));
+}     /* IsGzipped */
+
+
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : CacheDir
+@INPUT      : Dir - buffer of at least PATH_LEN characters
+              Msg - buffer for an error message
+@OUTPUT     : Dir - name of the cache directory
+              Msg - why it could not be created (on error)
+@RETURNS    : ERR_NONE if the directory exists (or was created)
+              ERR_OTHER if not
+@DESCRIPTION: Works out where the cache lives (see above), creating the
+              directory if needed.
+@METHOD     :
+@GLOBALS    :
+@CALLS      : getenv, mkdir
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+#define PATH_LEN   1024
+
+static int CacheDir (char Dir[], char Msg[])
+{
+   char        *Base;
+
+   Base = getenv ("EMMA_GZCACHE_DIR");
+   if (Base != NULL && *Base != '\0')
+   {
+      strncpy (Dir, Base, PATH_LEN-1);
+      Dir [PATH_LEN-1] = '\0';
+   }
+   else
+   {
+      Base = getenv ("TMPDIR");
+      if (Base == NULL || *Base == '\0')
+      {
+         Base = "/tmp";
+      }
+      sprintf (Dir, "%.900s/emma-gzcache-%ld", Base, (long) getuid ());
+   }
+
+   if (mkdir (Dir, 0700) != 0 && errno != EEXIST)
+   {
+      sprintf (Msg, "Unable to create cache directory %.200s: %s",
+               Dir, strerror (errno));
+      return (ERR_OTHER);
+   }
+   return (ERR_NONE);
+}     /* CacheDir */
+
+
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : TrimCache
+@INPUT      : Dir - the cache directory
+              Keep - full name of a file never to delete (the one just
+                added, which the caller is about to open)
+@OUTPUT     :
+@RETURNS    : (void)
+@DESCRIPTION: Deletes the least recently used files in the cache until
+              the total size is under the limit.  Files are "used" when
+              they are created or found by ExpandCompressed, which
+              touches them, so the modification time gives the order.
+              Temporary files that have not been written to for
+              STALE_TEMP_SECS (left by a process that died while
+              inflating) are deleted as well.  Errors are ignored:
+              someone else may be trimming too.
+@METHOD     :
+@GLOBALS    :
+@CALLS      : opendir, readdir, stat, unlink, time
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+typedef struct
+{
+   char     Name [PATH_LEN];
+   time_t   MTime;
+   off_t    Size;
+} CacheFileRec;
+
+static int CompareAge (const void *a, const void *b)
+{
+   time_t   ta = ((const CacheFileRec *) a)->MTime;
+   time_t   tb = ((const CacheFileRec *) b)->MTime;
+
+   return ((ta < tb) ? -1 : (ta > tb) ? 1 : 0);
+}
+
+static void TrimCache (char Dir[], char Keep[])
+{
+   DIR            *dp;
+   struct dirent  *de;
+   struct stat     Stat;
+   CacheFileRec   *Files;
+   int             NumFiles;
+   double          Total;
+   double          Limit;
+   char           *LimitStr;
+   size_t          len;
+   time_t          Now;
+   int             i;
+
+   LimitStr = getenv ("EMMA_GZCACHE_MB");
+   Limit = (LimitStr != NULL) ? atof (LimitStr) : 0;
+   if (Limit <= 0)
+   {
+      Limit = DEFAULT_CACHE_MB;
+   }
+   Limit *= 1048576.0;
+
+   dp = opendir (Dir);
+   if (dp == NULL)
+   {
+      return;
+   }
+   Files = (CacheFileRec *) malloc (MAX_CACHE_FILES * sizeof (CacheFileRec));
+   if (Files == NULL)
+   {
+      closedir (dp);
+      return;
+   }
+
+   NumFiles = 0;
+   Total = 0;
+   Now = time (NULL);
+   while ((de = readdir (dp)) != NULL && NumFiles < MAX_CACHE_FILES)
+   {
+      if (strncmp (de->d_name, TEMP_PREFIX, strlen (TEMP_PREFIX)) == 0)
+      {
+         sprintf (Files [NumFiles].Name, "%.900s/%.100s", Dir, de->d_name);
+         if (stat (Files [NumFiles].Name, &Stat) == 0 &&
+             Now - Stat.st_mtime > STALE_TEMP_SECS)
+         {
+#ifdef DEBUG
+            printf ("TrimCache: removing stale %s\n", Files [NumFiles].Name);
+#endif
+            (void) unlink (Files [NumFiles].Name);
+         }
+         continue;
+      }
+      len = strlen (de->d_name);
+      if (len <= strlen (CACHE_SUFFIX) || de->d_name [0] == '.' ||
+          strcmp (de->d_name + len - strlen (CACHE_SUFFIX), CACHE_SUFFIX))
+      {
+         continue;
+      }
+      sprintf (Files [NumFiles].Name, "%.900s/%.100s", Dir, de->d_name);
+      if (stat (Files [NumFiles].Name, &Stat) != 0)
+      {
+         continue;
+      }
+      Files [NumFiles].MTime = Stat.st_mtime;
+      Files [NumFiles].Size = Stat.st_size;
+      Total += Stat.st_size;
+      NumFiles++;
+   }
+   closedir (dp);
+
+   if (Total > Limit)
+   {
+      qsort (Files, NumFiles, sizeof (CacheFileRec), CompareAge);
+      for (i = 0; i < NumFiles && Total > Limit; i++)
+      {
+         if (strcmp (Files [i].Name, Keep) == 0)
+         {
+            continue;
+         }
+#ifdef DEBUG
+         printf ("TrimCache: removing %s\n", Files [i].Name);
+#endif
+         (void) unlink (Files [i].Name);
+         Total -= Files [i].Size;
+      }
+   }
+
+   free (Files);
+}     /* TrimCache */
+
+
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : Inflate
+@INPUT      : Filename - the gzip'd file
+              DestFD - open file descriptor to write to
+              Dest - name of that file (for error messages)
+              Msg - buffer for an error message
+@OUTPUT     : Msg - what went wrong (on error)
+@RETURNS    : ERR_NONE if all went well
+              ERR_IN_MINC if Filename could not be read or is corrupt
+              ERR_OUT_TEMP if Dest could not be written
+@DESCRIPTION: Decompresses Filename into Dest with zlib.
+@METHOD     :
+@GLOBALS    :
+@CALLS      : zlib (gzopen, gzread, gzclose)
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+static int Inflate (char Filename[], int DestFD, char Dest[], char Msg[])
+{
+   gzFile   gz;
+   char    *Buffer;
+   int      Got;
+   int      errnum;
+   int      Result;
+
+   gz = gzopen (Filename, "rb");
+   if (gz == NULL)
+   {
+      sprintf (Msg, "Error opening file %.200s: %s",
+               Filename, strerror (errno));
+      return (ERR_IN_MINC);
+   }
+   (void) gzbuffer (gz, INFLATE_CHUNK);
+
+   Buffer = (char *) malloc (INFLATE_CHUNK);
+   if (Buffer == NULL)
+   {
+      gzclose (gz);
+      strcpy (Msg, "Out of memory decompressing file");
+      return (ERR_NO_MEM);
+   }
+
+   Result = ERR_NONE;
+   while ((Got = gzread (gz, Buffer, INFLATE_CHUNK)) > 0)
+   {
+      if (write (DestFD, Buffer, Got) != Got)
+      {
+         sprintf (Msg, "Error writing %.200s: %s",
+                  Dest, strerror (errno));
+         Result = ERR_OUT_TEMP;
+         break;
+      }
+   }
+   if (Got < 0)
+   {
+      sprintf (Msg, "Error decompressing file %.200s: %s",
+               Filename, gzerror (gz, &errnum));
+      Result = ERR_IN_MINC;
+   }
+
+   free (Buffer);
+   gzclose (gz);
+   return (Result);
+}     /* Inflate */
+
+
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : ExpandCompressed
+@INPUT      : Filename - name of a (possibly gzip'd) file to be opened
+              Msg - buffer (of at least 256 characters) for an error
+                message
+@OUTPUT     : *Expanded - name of the file to actually open: Filename
+                itself if it is not compressed, otherwise the cached
+                copy.  Either way, this is malloc()'d and must be freed
+                by the caller.
+              Msg - what went wrong (on error)
+@RETURNS    : ERR_NONE if all went well, with *Expanded set
+              some other ERR_ code if not
+@DESCRIPTION: Makes sure an uncompressed copy of a gzip'd file is in
+              the scratch cache, and returns its name.  An existing copy
+              is reused (and marked as recently used); otherwise the
+              file is inflated into a temporary file in the cache, which
+              is then renamed into place, so that concurrent openers
+              (other threads or processes) never see a partial copy.
+
+              Only plain, read-only use is supported: the cached copy
+              must never be written to.  This does not call any MINC or
+              NetCDF functions, and writes nothing global (errors go to
+              the caller's Msg), and so may be used from several threads
+              at once (eg. to decompress files ahead of opening them).
+@METHOD     :
+@GLOBALS    :
+@CALLS      : CacheDir, Inflate, TrimCache
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+int ExpandCompressed (char Filename[], char **Expanded, char Msg[])
+{
+   struct stat  Stat;
+   char         Dir [PATH_LEN];
+   char         Temp [PATH_LEN];
+   char        *Name;
+   int          fd;
+   int          Result;
+
+   if (!IsGzipped (Filename))
+   {
+      *Expanded = strdup (Filename);
+      return ((*Expanded == NULL) ? ERR_NO_MEM : ERR_NONE);
+   }
+
+   if (stat (Filename, &Stat) != 0)
+   {
+      sprintf (Msg, "Error opening file %.200s: %s",
+               Filename, strerror (errno));
+      return (ERR_IN_MINC);
+   }
+
+   Result = CacheDir (Dir, Msg);
+   if (Result != ERR_NONE)
+   {
+      return (Result);
+   }
+
+   Name = (char *) malloc (PATH_LEN);
+   if (Name == NULL)
+   {
+      strcpy (Msg, "Out of memory");
+      return (ERR_NO_MEM);
+   }
+   sprintf (Name, "%.900s/%lx-%lx-%lx-%lx%s", Dir,
+            (unsigned long) Stat.st_dev, (unsigned long) Stat.st_ino,
+            (unsigned long) Stat.st_size, (unsigned long) Stat.st_mtime,
+            CACHE_SUFFIX);
+
+   /* Already there?  Then just mark it as used. */
+
+   if (access (Name, R_OK) == 0)
+   {
+#ifdef DEBUG
+      printf ("ExpandCompressed: using cached %s\n", Name);
+#endif
+      (void) utime (Name, NULL);
+      *Expanded = Name;
+      return (ERR_NONE);
+   }
+
+   /* No: inflate to a temporary file, and move it into place */
+
+   sprintf (Temp, "%.900s/%sXXXXXX", Dir, TEMP_PREFIX);
+   fd = mkstemp (Temp);
+   if (fd < 0)
+   {
+      sprintf (Msg, "Unable to create temporary file in %.200s: %s",
+               Dir, strerror (errno));
+      free (Name);
+      return (ERR_OUT_TEMP);
+   }
+
+#ifdef DEBUG
+   printf ("ExpandCompressed: inflating %s to %s\n", Filename, Name);
+#endif
+   Result = Inflate (Filename, fd, Temp, Msg);
+   if (close (fd) != 0 && Result == ERR_NONE)
+   {
+      sprintf (Msg, "Error writing %.200s: %s", Temp, strerror (errno));
+      Result = ERR_OUT_TEMP;
+   }
+   if (Result == ERR_NONE && rename (Temp, Name) != 0)
+   {
+      sprintf (Msg, "Error renaming %.200s: %s", Temp, strerror (errno));
+      Result = ERR_OUT_TEMP;
+   }
+   if (Result != ERR_NONE)
+   {
+      (void) unlink (Temp);
+      free (Name);
+      return (Result);
+   }
+
+   TrimCache (Dir, Name);
+
+   *Expanded = Name;
+   return (ERR_NONE);
+}     /* ExpandCompressed */
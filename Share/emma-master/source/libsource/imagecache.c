@@ -0,0 +1,272 @@
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : imagecache.c
+@DESCRIPTION: A small cache of open MINC images (with their ICVs already
+              attached) for programs that read the same files over and
+              over, such as a CMEX program called once per slice from a
+              MATLAB loop.  Opening a MINC file means an ncopen, a scan
+              of all its dimensions (GetImageInfo) and setting up an
+              ICV; with the cache, this is only done the first time a
+              file is read.
+
+              Entries are keyed by filename, and checked against the
+              file's modification and status change times (to the
+              nanosecond where stat gives them), size and inode on every
+              lookup, so a file that has been rewritten (or replaced)
+              since it was cached is transparently reopened.  Programs
+              that rewrite a file in place should still flush it first
+              (newimage does), as a filesystem with coarse timestamps
+              can miss a rewrite within the same tick.  The least recently
+              used entry is closed when the cache is full.
+
+              Since the cache outlives any one call of a CMEX program,
+              it is allocated with malloc() rather than mxCalloc(), and
+              the program should register FlushImageCache with
+              mexAtExit() so that the files are closed when MATLAB
+              clears the MEX-file.
+@CREATED    :
+@MODIFIED   :
+@VERSION    : $Id: imagecache.c,v 1.1 $
+              $Name:  $
+---------------------------------------------------------------------------- */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include "minc.h"
+#include "emmageneral.h"
+#include "mincutil.h"
+#include "mierrors.h"
+
+#define MAX_CACHED_IMAGES   16
+
+/* The sub-second part of a file's modification time, where available */
+
+#if defined(__linux__)
+#  define MTIME_NSEC(Stat)  ((long) (Stat).st_mtim.tv_nsec)
+#elif defined(__APPLE__)
+#  define MTIME_NSEC(Stat)  ((long) (Stat).st_mtimespec.tv_nsec)
+#else
+#  define MTIME_NSEC(Stat)  0L
+#endif
+
+typedef struct
+{
+   char          *Filename;      /* NULL if the entry is unused */
+   time_t         MTime;         /* to tell if the file has changed */
+   long           MTimeNsec;
+   time_t         CTime;
+   off_t          FileSize;
+   ino_t          Inode;
+   unsigned long  LastUsed;      /* value of UseCount when last looked up */
+   ImageInfoRec   Image;
+} CacheEntryRec;
+
+static CacheEntryRec  Cache [MAX_CACHED_IMAGES];
+static unsigned long  UseCount = 0;
+
+extern char *ErrMsg;
+
+
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : DropEntry
+@INPUT      : *Entry - a cache entry
+@OUTPUT     : *Entry - marked unused
+@RETURNS    : (void)
+@DESCRIPTION: Closes the image held by a cache entry (if any) and frees
+              the entry.
+@METHOD     :
+@GLOBALS    :
+@CALLS      : CloseImage
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+static void DropEntry (CacheEntryRec *Entry)
+{
+   if (Entry->Filename != NULL)
+   {
+#ifdef DEBUG
+      printf ("DropEntry: closing %s\n", Entry->Filename);
+#endif
+      CloseImage (&Entry->Image);
+      free (Entry->Filename);
+      Entry->Filename = NULL;
+   }
+}     /* DropEntry */
+
+
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : OpenCachedImage
+@INPUT      : Filename - name of the MINC file to read
+              NaN - value to use for out-of-range voxels (as for OpenImage)
+              ICVType - type the ICV should convert to (NC_DOUBLE/NC_FLOAT)
+@OUTPUT     : **Image - set to point to the cached ImageInfoRec; this
+                belongs to the cache, and must NOT be passed to CloseImage
+@RETURNS    : ERR_NONE if all went well
+              any error code from OpenImageAs, or ERR_IN_MINC if the file
+                cannot be stat'ed (ErrMsg set)
+@DESCRIPTION: Returns an open image (read-only) for Filename, with its
+              ICV set up for ICVType.  If the file is already in the
+              cache and has not changed on disk, no MINC calls are made
+              at all (unless the ICV type differs from last time, in
+              which case the ICV is simply reattached).  Otherwise, the
+              file is opened with OpenImageAs and added to the cache.
+@METHOD     :
+@GLOBALS    : Cache, UseCount, ErrMsg
+@CALLS      : stat, OpenImageAs, miicv{...} functions
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+int OpenCachedImage (char Filename[], ImageInfoRec **Image, double NaN,
+                     nc_type ICVType)
+{
+   struct stat    Stat;
+   CacheEntryRec *Entry;
+   int            i;
+   int            Result;
+
+   if (stat (Filename, &Stat) != 0)
+   {
+      FlushCachedImage (Filename);
+      sprintf (ErrMsg, "Error opening file %s: %s",
+               Filename, strerror (errno));
+      return (ERR_IN_MINC);
+   }
+
+   UseCount++;
+
+   /* Look for the file in the cache, checking that it hasn't changed */
+
+   for (i = 0; i < MAX_CACHED_IMAGES; i++)
+   {
+      Entry = &Cache [i];
+      if ((Entry->Filename == NULL) || (strcmp (Entry->Filename, Filename)))
+      {
+         continue;
+      }
+
+      if ((Entry->MTime != Stat.st_mtime) ||
+          (Entry->MTimeNsec != MTIME_NSEC (Stat)) ||
+          (Entry->CTime != Stat.st_ctime) ||
+          (Entry->FileSize != Stat.st_size) ||
+          (Entry->Inode != Stat.st_ino))
+      {
+         DropEntry (Entry);
+         break;
+      }
+
+#ifdef DEBUG
+      printf ("OpenCachedImage: %s found in cache\n", Filename);
+#endif
+      if (Entry->Image.ICVType != ICVType)
+      {
+         (void) miicv_detach (Entry->Image.ICV);
+         (void) miicv_setint (Entry->Image.ICV, MI_ICV_TYPE, ICVType);
+         (void) miicv_attach (Entry->Image.ICV,
+                              Entry->Image.CDF, Entry->Image.ID);
+         Entry->Image.ICVType = ICVType;
+      }
+      Entry->LastUsed = UseCount;
+      *Image = &Entry->Image;
+      return (ERR_NONE);
+   }
+
+   /* Not there (or out of date): use a free slot, or else the LRU one */
+
+   Entry = &Cache [0];
+   for (i = 0; i < MAX_CACHED_IMAGES; i++)
+   {
+      if (Cache [i].Filename == NULL)
+      {
+         Entry = &Cache [i];
+         break;
+      }
+      if (Cache [i].LastUsed < Entry->LastUsed)
+      {
+         Entry = &Cache [i];
+      }
+   }
+   DropEntry (Entry);
+
+   Result = OpenImageAs (Filename, &Entry->Image, NC_NOWRITE, NaN, ICVType);
+   if (Result != ERR_NONE)
+   {
+      return (Result);
+   }
+
+   Entry->Filename = strdup (Filename);
+   if (Entry->Filename == NULL)
+   {
+      CloseImage (&Entry->Image);
+      sprintf (ErrMsg, "Out of memory caching image %s", Filename);
+      return (ERR_NO_MEM);
+   }
+   Entry->MTime = Stat.st_mtime;
+   Entry->MTimeNsec = MTIME_NSEC (Stat);
+   Entry->CTime = Stat.st_ctime;
+   Entry->FileSize = Stat.st_size;
+   Entry->Inode = Stat.st_ino;
+   Entry->LastUsed = UseCount;
+
+   *Image = &Entry->Image;
+   return (ERR_NONE);
+}     /* OpenCachedImage */
+
+
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : FlushCachedImage
+@INPUT      : Filename - name of a MINC file
+@OUTPUT     : (none)
+@RETURNS    : (void)
+@DESCRIPTION: Closes Filename if it is in the image cache.  Should be
+              used before writing to a file that may have been cached,
+              since a change made within the resolution of the file's
+              modification time would otherwise go unnoticed.
+@METHOD     :
+@GLOBALS    : Cache
+@CALLS      : DropEntry
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+void FlushCachedImage (char Filename[])
+{
+   int   i;
+
+   for (i = 0; i < MAX_CACHED_IMAGES; i++)
+   {
+      if ((Cache [i].Filename != NULL) &&
+          (strcmp (Cache [i].Filename, Filename) == 0))
+      {
+         DropEntry (&Cache [i]);
+      }
+   }
+}     /* FlushCachedImage */
+
+
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : FlushImageCache
+@INPUT      : (none)
+@OUTPUT     : (none)
+@RETURNS    : (void)
+@DESCRIPTION: Closes every image in the cache.  Suitable for passing to
+              mexAtExit().
+@METHOD     :
+@GLOBALS    : Cache
+@CALLS      : DropEntry
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+void FlushImageCache (void)
+{
+   int   i;
+
+   for (i = 0; i < MAX_CACHED_IMAGES; i++)
+   {
+      DropEntry (&Cache [i]);
+   }
+}     /* FlushImageCache */
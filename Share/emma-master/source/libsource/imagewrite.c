@@ -0,0 +1,584 @@
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : imagewrite.c
+@DESCRIPTION: Writing whole images into an open MINC file, keeping the
+              image max/min variables (and, for floating-point files, the
+              valid range) up to date.  Used by miwriteimages, which
+              writes images straight from a MATLAB matrix, and by
+              miwritemasked, which builds each slice from the voxels
+              under a mask.
+
+              Each image is converted to the file's own type here rather
+              than by the MINC ICV: one pass finds its range (skipping
+              NaNs), and a second pass scales, rounds and clamps it (or,
+              for float and double files, just stores it) into a buffer
+              of that type.  Both are simple loops over a single image,
+              which the compiler can vectorise, where the ICV converts
+              voxel by voxel through a general-purpose routine.  The
+              buffer is then written through a second ICV that only does
+              dimension conversion, so images are laid out exactly as
+              before.
+@CREATED    : 93-6-3, Greg Ward (in miwriteimages.c)
+@MODIFIED   : moved out of miwriteimages.c
+@VERSION    : $Id: imagewrite.c,v 1.1 $
+              $Name:  $
+---------------------------------------------------------------------------- */
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <float.h>
+#include "minc.h"
+#include "emmageneral.h"
+#include "mincutil.h"
+#include "mierrors.h"
+
+extern char *ErrMsg;
+
+
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : PutMaxMin
+@INPUT      : ImInfo - pointer to struct describing the image variable
+              Max, Min - the range of the image (see ScanRange)
+              SliceNum, FrameNum - needed to correctly place the max and min
+                values into the MIimagemax and MIimagemin variables
+              DoFrames - whether or not there is a time dimension in this file
+@OUTPUT     : (none)
+@RETURNS    : (void)
+@DESCRIPTION: Puts the max and min values of an image
+              into the MIimagemax and MIimagemin variables associated
+              with the specified image variable.  Note: the caller must
+              make sure that MIimagemax and MIimagemin exist in the
+              file, and ensure that ImInfo->MaxID and ImInfo->MinID contain
+              their variable ID's.
+@METHOD     : 
+@GLOBALS    : 
+@CALLS      : 
+@CREATED    : 93-6-3, Greg Ward
+@MODIFIED   : takes the range from the caller (ScanRange) instead of
+              finding it itself
+---------------------------------------------------------------------------- */
+void PutMaxMin (ImageInfoRec *ImInfo, double Max, double Min,
+                long SliceNum, long FrameNum, 
+                Boolean DoSlices, Boolean DoFrames)
+{
+   long     Coord [2];          /* might use 0, 1 or 2 elements */
+   int      old_ncopts;
+   int      ret;
+   nc_type  range_type;
+   int      range_len;
+   int      update_vr;
+   double   valid_range[2];
+   double   vr_max;
+
+#ifdef DEBUG
+   int      i;
+   int      NumDims;            /* number of dimensions in imagemax/imagemin */
+   int      Dims [4];           /* dimension ID's of imagemax/imagemin */
+
+   printf ("Slice dimension is %d\n", ImInfo->SliceDim);
+   printf ("Frame dimension is %d\n", ImInfo->FrameDim);
+
+   ncvarinq (ImInfo->CDF, ImInfo->MaxID, NULL, NULL, &NumDims, Dims, NULL);
+   printf ("MIimagemax has %d dimensions: ", NumDims);
+   for (i = 0; i < NumDims; i++)
+   {
+      printf ("%5d", Dims [i]);
+   }
+   putchar ('\n');
+
+   ncvarinq (ImInfo->CDF, ImInfo->MinID, NULL, NULL, &NumDims, Dims, NULL);
+   printf ("MIimagemin has %d dimensions: ", NumDims);
+   for (i = 0; i < NumDims; i++)
+   {
+      printf ("%5d", Dims [i]);
+   }
+   putchar ('\n');
+#endif
+
+   /*
+    * Now figure out the Coord vector (where to put the max and min
+    * within the MIimagemax and MIimagemin variables), and put 'em there
+    */
+
+   if (DoFrames)        /* i.e. some frame was specified */
+   { 
+      Coord [ImInfo->FrameDim] = FrameNum;
+   }
+
+   if (DoSlices)
+   {
+      Coord [ImInfo->SliceDim] = SliceNum;
+   }
+
+#ifdef DEBUG
+   printf ("Slice %ld, frame %ld: max is %lg, min is %lg\n", 
+           (DoSlices) ? (SliceNum) : -1,
+           (DoFrames) ? (FrameNum) : -1,
+           Max, Min);
+   if (DoSlices && DoFrames)
+      printf ("Coord vector is: %ld %ld\n", Coord [0], Coord [1]);
+   
+#endif
+
+   mivarput1 (ImInfo->CDF, ImInfo->MaxID, Coord, NC_DOUBLE, MI_SIGNED, &Max);
+   mivarput1 (ImInfo->CDF, ImInfo->MinID, Coord, NC_DOUBLE, MI_SIGNED, &Min);
+
+   /*
+    * Update the image valid_range attribute for floating-point volumes
+    */
+   if ((ImInfo->DataType == NC_FLOAT) || (ImInfo->DataType == NC_DOUBLE)) {
+
+      /* Get type and length of valid_range attribute */
+      old_ncopts = ncopts; ncopts = 0;
+      ret = ncattinq(ImInfo->CDF, ImInfo->ID, MIvalid_range, 
+                     &range_type, &range_len);
+      ncopts = old_ncopts;
+
+      /* If type and length are okay, then read in old value and update */
+      if ((ret != MI_ERROR) && 
+          (range_type == NC_DOUBLE) && (range_len == 2)) {
+
+         (void) ncattget(ImInfo->CDF, ImInfo->ID, MIvalid_range, valid_range);
+
+         /* Test for first write of valid range */
+         vr_max = (ImInfo->DataType == NC_DOUBLE ? 
+                   1.79769313e+308 : 3.402e+38);
+         update_vr = ((valid_range[0] < -vr_max) && (valid_range[1] > vr_max));
+
+         /* Check the range */
+         if ((Min < valid_range[0]) || update_vr)
+            valid_range[0] = Min;
+         if ((Max > valid_range[1]) || update_vr)
+            valid_range[1] = Max;
+
+         /* Check for whether float rounding is needed */
+         if (ImInfo->DataType == NC_FLOAT) {
+            valid_range[0] = (float) valid_range[0];
+            valid_range[1] = (float) valid_range[1];
+         }
+
+         /* Write it out */
+         (void) ncattput(ImInfo->CDF, ImInfo->ID, MIvalid_range, 
+                         NC_DOUBLE, 2, valid_range);
+
+      }
+
+   }     /* if DataType is floating-point */
+
+}     /* PutMaxMin */
+
+
+/*
+ * How the images are stored in the file: WriteImages converts each one
+ * to this type itself and writes it through ICV, which does no scaling.
+ */
+
+typedef struct
+{
+   int      ICV;                /* attached; converts dimensions only */
+   nc_type  Type;
+   Boolean  Signed;
+   double   ValidMin;           /* range of the stored values (integer */
+   double   ValidMax;           /* types only) */
+   size_t   Size;               /* bytes per voxel */
+} FileTypeRec;
+
+
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : ScanRange
+@INPUT      : Vals - the image
+              N - number of voxels in it
+@OUTPUT     : *Max, *Min - the largest and smallest values in the image,
+                ignoring NaNs (both zero if there is nothing but NaNs)
+@RETURNS    : (void)
+@DESCRIPTION: Finds the range of one image in a single pass.
+@METHOD     : NaN compares false both ways, so the two conditional
+              assignments skip it without a separate test; the loop has
+              no branches and can be vectorised.
+@GLOBALS    : 
+@CALLS      : 
+@CREATED    : 
+@MODIFIED   : 
+---------------------------------------------------------------------------- */
+static void ScanRange (double *Vals, long N, double *Max, double *Min)
+{
+   long     i;
+   double   v;
+   double   Hi = -DBL_MAX;
+   double   Lo = DBL_MAX;
+
+   for (i = 0; i < N; i++)
+   {
+      v = Vals [i];
+      Hi = (v > Hi) ? v : Hi;
+      Lo = (v < Lo) ? v : Lo;
+   }
+
+   if (Hi < Lo)                 /* no real values at all */
+   {
+      Hi = Lo = 0;
+   }
+   *Max = Hi;
+   *Min = Lo;
+
+}     /* ScanRange */
+
+
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : AttachFileType
+@INPUT      : Image - the open image variable
+@OUTPUT     : *File - the image's type, sign and valid range, and an ICV
+                attached to it that leaves values alone
+@RETURNS    : TRUE if the images can be converted by ConvertImage;
+              FALSE if not (eg. NC_CHAR, or some MINC error), in which
+              case the caller should go through Image->ICV as usual
+@DESCRIPTION: Sets up for WriteImages to convert images to the file's
+              type itself.
+@METHOD     : The ICV is given the file's own type and sign, and range
+              and normalisation are turned off, so it stores what it is
+              given; dimension conversion is left on (as for the ICV set
+              up by OpenImage) so the images end up in the same places.
+@GLOBALS    : 
+@CALLS      : MINC library
+@CREATED    : 
+@MODIFIED   : 
+---------------------------------------------------------------------------- */
+static Boolean AttachFileType (ImageInfoRec *Image, FileTypeRec *File)
+{
+   int      is_signed;
+   double   valid_range [2];
+
+   if (miget_datatype (Image->CDF, Image->ID, &File->Type, &is_signed)
+       == MI_ERROR)
+   {
+      return (FALSE);
+   }
+   File->Signed = is_signed ? TRUE : FALSE;
+
+   switch (File->Type)
+   {
+      case NC_BYTE:   File->Size = sizeof (char);   break;
+      case NC_SHORT:  File->Size = sizeof (short);  break;
+      case NC_LONG:   File->Size = sizeof (int);    break;
+      case NC_FLOAT:  File->Size = sizeof (float);  break;
+      case NC_DOUBLE: File->Size = sizeof (double); break;
+      default:        return (FALSE);
+   }
+
+   if (miget_valid_range (Image->CDF, Image->ID, valid_range) == MI_ERROR)
+   {
+      return (FALSE);
+   }
+   File->ValidMin = valid_range [0];
+   File->ValidMax = valid_range [1];
+
+   File->ICV = miicv_create ();
+   if (File->ICV == MI_ERROR)
+   {
+      return (FALSE);
+   }
+   miicv_setint (File->ICV, MI_ICV_TYPE, File->Type);
+   miicv_setstr (File->ICV, MI_ICV_SIGN, File->Signed ? MI_SIGNED : MI_UNSIGNED);
+   miicv_setint (File->ICV, MI_ICV_DO_RANGE, FALSE);
+   miicv_setint (File->ICV, MI_ICV_DO_NORM, FALSE);
+   miicv_setint (File->ICV, MI_ICV_DO_DIM_CONV, TRUE);
+   miicv_setint (File->ICV, MI_ICV_DO_SCALAR, FALSE);
+
+   if (miicv_attach (File->ICV, Image->CDF, Image->ID) == MI_ERROR)
+   {
+      miicv_free (File->ICV);
+      return (FALSE);
+   }
+   return (TRUE);
+
+}     /* AttachFileType */
+
+
+
+/*
+ * Scale, clamp and round one image into an integer buffer of the given
+ * type.  NaN fails both comparisons with itself, so it is caught by
+ * (v != v) and stored as the bottom of the valid range, which is where
+ * MINC puts anything it cannot represent.
+ */
+
+#define QUANTIZE(type)                                            \
+   {                                                              \
+      type  *Out = (type *) Buffer;                               \
+                                                                  \
+      for (i = 0; i < N; i++)                                     \
+      {                                                           \
+         v = Vals [i] * Scale + Offset;                           \
+         v = (v != v) ? Lo : v;                                   \
+         v = (v < Lo) ? Lo : ((v > Hi) ? Hi : v);                 \
+         Out [i] = (type) ((v < 0) ? (v - 0.5) : (v + 0.5));      \
+      }                                                           \
+   }
+
+
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : ConvertImage
+@INPUT      : Vals - the image, as doubles
+              N - number of voxels in it
+              Max, Min - its range (from ScanRange)
+              File - the type to convert to (from AttachFileType)
+@OUTPUT     : Buffer - N voxels of type File->Type
+@RETURNS    : (void)
+@DESCRIPTION: Converts one image to the type it is stored as.  For
+              integer types, Min..Max is mapped linearly onto the valid
+              range (which is how MINC will map it back, given the
+              image-max and image-min written by PutMaxMin), rounded to
+              the nearest integer, and clamped; NaNs are stored as the
+              bottom of the valid range.  float and double images are
+              stored as they are (NaNs included), with no scaling at all.
+@METHOD     : One loop per type, with no function calls or branches in
+              the body, so that each can be vectorised.
+@GLOBALS    : 
+@CALLS      : 
+@CREATED    : 
+@MODIFIED   : 
+---------------------------------------------------------------------------- */
+static void ConvertImage (double *Vals, long N, double Max, double Min,
+                          FileTypeRec *File, void *Buffer)
+{
+   long     i;
+   double   v;
+   double   Scale, Offset;
+   double   Lo = File->ValidMin;
+   double   Hi = File->ValidMax;
+
+   if (File->Type == NC_DOUBLE)
+   {
+      double *Out = (double *) Buffer;
+
+      for (i = 0; i < N; i++)
+      {
+         Out [i] = Vals [i];
+      }
+      return;
+   }
+
+   if (File->Type == NC_FLOAT)
+   {
+      float *Out = (float *) Buffer;
+
+      for (i = 0; i < N; i++)
+      {
+         Out [i] = (float) Vals [i];
+      }
+      return;
+   }
+
+   /* An image with a single value maps it to the bottom of the range */
+
+   Scale = (Max > Min) ? (Hi - Lo) / (Max - Min) : 0;
+   Offset = Lo - Min * Scale;
+
+   switch (File->Type)
+   {
+      case NC_BYTE:
+         if (File->Signed)
+            QUANTIZE (signed char)
+         else
+            QUANTIZE (unsigned char)
+         break;
+      case NC_SHORT:
+         if (File->Signed)
+            QUANTIZE (short)
+         else
+            QUANTIZE (unsigned short)
+         break;
+      case NC_LONG:
+         if (File->Signed)
+            QUANTIZE (int)
+         else
+            QUANTIZE (unsigned int)
+         break;
+      default:
+         break;
+   }
+
+}     /* ConvertImage */
+
+
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : WriteImages
+@INPUT      : Images - the images to write, one after the other (ie. the
+                columns of the MATLAB matrix), as doubles
+              Image - where they're going
+              Slices - vector containing list of slices to write
+              Frames - vector containing list of frames to write
+              NumSlices - the number of elements of Slices[] actually used
+              NumFrames - the number of elements of Frames[] actually used
+@OUTPUT     : 
+@RETURNS    : an error code as defined in mierrors.h
+              ERR_NONE = all went well
+              ERR_OUT_MINC = some problem writing to MINC file
+                (this should not happen!!!)
+              also sets ErrMsg in the event of an error
+@DESCRIPTION: Writes images sequentially from Images into the image
+              variable specified by *Image at the slice/frame locations
+              specified by Slices[] and Frames[].  Smart enough to handle
+              files with no time dimension, or no z dimension.
+@METHOD     : Each image is scanned for its range (ScanRange), converted
+              to the file's type in a buffer one image long
+              (ConvertImage), and written through an ICV that does no
+              further conversion.  If the file's type is one that
+              ConvertImage can't handle, images go straight from the
+              caller's buffer to Image->ICV instead.
+@GLOBALS    : 
+@CALLS      : ScanRange, AttachFileType, ConvertImage, PutMaxMin,
+              MINC library
+@CREATED    : 93-6-3, Greg Ward
+@MODIFIED   : Takes the images from memory rather than a temporary file.
+              Converts images to the file's type itself, one image at a
+              time, instead of leaving it to the ICV.
+---------------------------------------------------------------------------- */
+int WriteImages (double *Images,
+                 ImageInfoRec *Image,
+                 long Slices[], 
+                 long Frames[],
+                 long NumSlices,
+                 long NumFrames)
+{
+   int      slice, frame;
+   long     Start [MAX_NC_DIMS], Count [MAX_NC_DIMS];
+   double   *Buffer;
+   double   Max, Min;
+   Boolean  DoFrames;
+   Boolean  DoSlices;
+   int      RetVal;
+   FileTypeRec File;
+   void     *Converted;
+
+   /*
+    * First ensure that we will always write an *entire* image, but only
+    * one slice/frame at a time (no matter how many slices/frames we
+    * may be writing)
+    */
+
+   Start [Image->HeightDim] = 0; Count [Image->HeightDim] = Image->Height;
+   Start [Image->WidthDim] = 0;  Count [Image->WidthDim] = Image->Width;
+
+   /*
+    * Handle files with missing frames or slices.  See the function
+    * ReadImages in the file mireadimages.c for a detailed explanation.
+    */
+
+   if (NumFrames > 0)
+   {
+      Count [Image->FrameDim] = 1;
+      DoFrames = TRUE;
+   }
+   else
+   {
+      DoFrames = FALSE;
+      NumFrames = 1;
+   }
+
+   /* Exact same code as for frames, but changed to slices */
+
+   if (NumSlices > 0)
+   {
+      Count [Image->SliceDim] = 1;
+      DoSlices = TRUE;
+   }
+   else
+   {
+      DoSlices = FALSE;
+      NumSlices = 1;
+   }
+
+#ifdef DEBUG
+   printf ("Ready to start writing.\n");
+   printf ("NumFrames = %ld, DoFrames = %d\n", NumFrames, (int) DoFrames);
+   printf ("NumSlices = %ld, DoSlices = %d\n", NumSlices, (int) DoSlices);
+#endif
+
+   /*
+    * Set up to convert the images ourselves; if that can't be done,
+    * Converted stays NULL and they go through Image->ICV as they are.
+    */
+
+   Converted = NULL;
+   if (AttachFileType (Image, &File))
+   {
+      Converted = malloc (Image->ImageSize * File.Size);
+      if (Converted == NULL)
+      {
+         miicv_free (File.ICV);
+      }
+   }
+
+   Buffer = Images;
+   for (slice = 0; slice < NumSlices; slice++)
+   {
+      if (DoSlices)
+      {
+         Start [Image->SliceDim] = Slices [slice];
+      }
+
+      /* 
+       * Loop through all frames, writing one image each time.  Note
+       * that NumFrames will be one even if DoFrames is false; so this
+       * loop WILL always execute, but it and the functions it calls
+       * (particularly PutMaxMin) act slightly differently depending on
+       * the value of DoFrames,
+       */
+
+      for (frame = 0; frame < NumFrames; frame++)
+      {
+         ScanRange (Buffer, Image->ImageSize, &Max, &Min);
+         PutMaxMin (Image, Max, Min,
+                    DoSlices ? Slices [slice] : 0, 
+                    DoFrames ? Frames [frame] : 0,
+                    DoSlices, DoFrames);
+
+         if (DoFrames)
+         {
+            Start [Image->FrameDim] = Frames [frame];
+         }
+
+         if (Converted != NULL)
+         {
+            ConvertImage (Buffer, Image->ImageSize, Max, Min,
+                          &File, Converted);
+            RetVal = miicv_put (File.ICV, Start, Count, Converted);
+         }
+         else
+         {
+            RetVal = miicv_put (Image->ICV, Start, Count, Buffer);
+         }
+
+         if (RetVal == MI_ERROR)
+         {
+            sprintf (ErrMsg, "INTERNAL BUG: Fail on miicv_put: Error code %d",
+                     ncerr);
+            if (Converted != NULL)
+            {
+               free (Converted);
+               miicv_free (File.ICV);
+            }
+            return (ERR_OUT_MINC);
+         }
+         Buffer += Image->ImageSize;
+      }     /* for frame */
+   }     /* for slice */
+
+   if (Converted != NULL)
+   {
+      free (Converted);
+      miicv_free (File.ICV);
+   }
+
+   /*
+    * Use the MIcomplete attribute to signal that we are done writing
+    */
+   miattputstr (Image->CDF, Image->ID, MIcomplete, MI_TRUE);
+   return (ERR_NONE);
+
+}     /* WriteImages */
@@ -0,0 +1,864 @@
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : maskread.c
+@DESCRIPTION: Functions for reading only the voxels under a mask from a
+              list of MINC files, with one row of output per file and
+              one column per masked voxel.  Only slices that contain
+              masked voxels are read, a slab of a few slices at a time,
+              so no whole volume is ever held in memory.  A range of
+              slices may be given, so that a caller can work through the
+              mask a block at a time (see mireadblocks.c) as well as all
+              at once (mireadmasked.c).
+
+              Everything here uses malloc() rather than mxCalloc(), so
+              that a mask can be kept between calls of a CMEX program
+              and the reading can be done from threads other than
+              MATLAB's.
+@CREATED    :
+@MODIFIED   :
+@VERSION    : $Id: maskread.c,v 1.1 $
+              $Name:  $
+---------------------------------------------------------------------------- */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include "minc.h"
+#include "emmageneral.h"
+#include "mincutil.h"
+#include "mierrors.h"
+#include "threadpool.h"
+#include "maskread.h"
+
+/*
+ * Everything the file-reading tasks need; shared by all threads.
+ */
+
+typedef struct
+{
+   char        **Filenames;
+   long         *Frames;        /* zero-based frame of each file, or
+                                   NULL for the first of every one */
+   MaskInfoRec  *Mask;
+   long          FirstSlice;    /* range of slices to read */
+   long          EndSlice;
+   nc_type       ICVType;
+   double        NaN;
+   int           NumThreads;
+   void        **Slabs;         /* one slab buffer per thread */
+   void        **Stages;        /* with several threads, one buffer of
+                                   a file's masked voxels per thread;
+                                   else NULL */
+   long          Count;         /* masked voxels per file */
+   void         *Out;           /* the output matrix */
+   long          NumFiles;      /* == number of rows of Out */
+   int           Result;        /* of the first file to fail */
+   long          Failed;        /* which file that was */
+} ReadTaskRec;
+
+/*
+ * The state shared by the two threads of a read-ahead pipeline (see
+ * ReadWithReadAhead).  File f is decoded into Stage[f % Depth]; Lock
+ * protects Produced, Consumed, Abandoned and the ReadTaskRec's Result.
+ */
+
+typedef struct
+{
+   ReadTaskRec     *Read;
+   int              Depth;
+   void           **Stage;       /* Depth buffers of one file's voxels */
+   long             Produced;    /* number of files decoded so far */
+   long             Consumed;    /* number copied to the output so far */
+   Boolean          Abandoned;   /* the copying thread has given up */
+   pthread_mutex_t  Lock;
+   pthread_cond_t   Cond;
+} ReadAheadRec;
+
+extern char *ErrMsg;
+
+
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : SetMaskIndex
+@INPUT      : Values - one-based voxel indices, as returned by MATLAB's
+                find() on a mask matrix
+              NumVoxels - number of elements in Values
+@OUTPUT     : *Mask - NumVoxels and Index[] are filled in (the rest of
+                the struct is cleared until SetupMask is called)
+@RETURNS    : ERR_NONE if all went well
+              ERR_ARGS if the index is not strictly ascending and
+                positive (ErrMsg is set)
+              ERR_NO_MEM if Index[] could not be allocated
+@DESCRIPTION: Converts the mask index to zero-based longs, checking that
+              it is sorted so that voxels can be gathered a slab at a time.
+@METHOD     :
+@GLOBALS    : ErrMsg
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+int SetMaskIndex (double Values[], long NumVoxels, MaskInfoRec *Mask)
+{
+   long     i;
+
+   memset (Mask, 0, sizeof (MaskInfoRec));
+   Mask->NumVoxels = NumVoxels;
+   Mask->Index = (long *) malloc ((NumVoxels + 1) * sizeof (long));
+   if (Mask->Index == NULL)
+   {
+      sprintf (ErrMsg, "Out of memory for a mask of %ld voxels", NumVoxels);
+      return (ERR_NO_MEM);
+   }
+
+   for (i = 0; i < NumVoxels; i++)
+   {
+      Mask->Index [i] = (long) Values [i] - 1;
+      if ((Mask->Index [i] < 0) ||
+          ((i > 0) && (Mask->Index [i] <= Mask->Index [i-1])))
+      {
+         sprintf (ErrMsg, "Mask index must be positive and strictly "
+                  "ascending (element %ld)", i+1);
+         FreeMask (Mask);
+         return (ERR_ARGS);
+      }
+   }
+
+   return (ERR_NONE);
+}     /* SetMaskIndex */
+
+
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : SetFrameList
+@INPUT      : Values - one-based frame (or volume) numbers, one per file
+              NumValues - number of elements in Values
+              NumFiles - number of files they are for
+@OUTPUT     : *Frames - the zero-based frame numbers, malloc'd (free
+                with free()) if all went well
+@RETURNS    : ERR_NONE if all went well
+              ERR_ARGS if there is not one positive integer per file
+              ERR_NO_MEM if Frames could not be allocated
+              (ErrMsg is set on error)
+@DESCRIPTION: Converts the frame list given to mireadmasked and friends,
+              which says which frame of a 4-D file holds each subject.
+@METHOD     :
+@GLOBALS    : ErrMsg
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+int SetFrameList (double Values[], long NumValues, long NumFiles,
+                  long **Frames)
+{
+   long     i;
+
+   if (NumValues != NumFiles)
+   {
+      sprintf (ErrMsg, "There must be one frame per file (got %ld frames "
+               "for %ld files)", NumValues, NumFiles);
+      return (ERR_ARGS);
+   }
+
+   *Frames = (long *) malloc ((NumFiles + 1) * sizeof (long));
+   if (*Frames == NULL)
+   {
+      sprintf (ErrMsg, "Out of memory for a list of %ld frames", NumFiles);
+      return (ERR_NO_MEM);
+   }
+
+   for (i = 0; i < NumFiles; i++)
+   {
+      if ((Values [i] < 1) || (Values [i] != (double) (long) Values [i]))
+      {
+         sprintf (ErrMsg, "Frames must be positive integers (element %ld)",
+                  i+1);
+         free (*Frames);
+         *Frames = NULL;
+         return (ERR_ARGS);
+      }
+      (*Frames) [i] = (long) Values [i] - 1;
+   }
+
+   return (ERR_NONE);
+}     /* SetFrameList */
+
+
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : SetupMask
+@INPUT      : *Image - struct describing the first MINC file
+              *Mask - mask with the index already set
+@OUTPUT     : *Mask - geometry and SliceFirst[] are filled in
+@RETURNS    : ERR_NONE if all went well
+              ERR_ARGS if the mask index points outside the volume
+              ERR_NO_MEM if SliceFirst[] could not be allocated
+@DESCRIPTION: Records the volume geometry that the mask index refers to
+              (taken from the first file), and splits the index up by
+              slice.
+@METHOD     :
+@GLOBALS    : ErrMsg
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+int SetupMask (ImageInfoRec *Image, MaskInfoRec *Mask)
+{
+   long     slice;
+   long     i;
+
+   Mask->Slices = max (Image->Slices, 1);
+   Mask->Height = Image->Height;
+   Mask->Width = Image->Width;
+   Mask->ImageSize = Image->ImageSize;
+
+   if ((Mask->NumVoxels > 0) &&
+       (Mask->Index [Mask->NumVoxels-1] >= Mask->Slices * Mask->ImageSize))
+   {
+      sprintf (ErrMsg, "Mask index out of range (volume has %ld voxels)",
+               Mask->Slices * Mask->ImageSize);
+      return (ERR_ARGS);
+   }
+
+   free (Mask->SliceFirst);
+   Mask->SliceFirst = (long *) malloc ((Mask->Slices + 1) * sizeof (long));
+   if (Mask->SliceFirst == NULL)
+   {
+      sprintf (ErrMsg, "Out of memory setting up mask");
+      return (ERR_NO_MEM);
+   }
+
+   i = 0;
+   for (slice = 0; slice <= Mask->Slices; slice++)
+   {
+      while ((i < Mask->NumVoxels) &&
+             (Mask->Index [i] < slice * Mask->ImageSize))
+      {
+         i++;
+      }
+      Mask->SliceFirst [slice] = i;
+   }
+
+   return (ERR_NONE);
+}     /* SetupMask */
+
+
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : FreeMask
+@INPUT      : *Mask - a mask set up by SetMaskIndex (and maybe SetupMask)
+@OUTPUT     : *Mask - with its arrays freed
+@RETURNS    : (void)
+@DESCRIPTION: Frees the arrays of a MaskInfoRec.  Safe to call more than
+              once.
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+void FreeMask (MaskInfoRec *Mask)
+{
+   free (Mask->Index);
+   free (Mask->SliceFirst);
+   Mask->Index = NULL;
+   Mask->SliceFirst = NULL;
+}     /* FreeMask */
+
+
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : ReadMasked
+@INPUT      : *Image - struct describing an open MINC file
+              *Mask - mask set up by SetupMask
+              FirstSlice, EndSlice - read the masked voxels of slices
+                FirstSlice .. EndSlice-1 only
+              Frame - the (zero-based) frame to read; must be 0 if the
+                file has no time dimension
+              Slab - buffer big enough for MAX_SLAB images of the ICV type
+              Row - the row of the output matrix for this file
+              NumRows - number of rows in the output matrix
+@OUTPUT     : Out - data of the output matrix (double or float, same as
+                the ICV type); Out[k*NumRows + Row] is set to the value
+                of masked voxel SliceFirst[FirstSlice]+k
+@RETURNS    : ERR_NONE if all went well
+              ERR_BAD_MINC if the file does not match the mask geometry,
+                or has no such frame
+              ERR_IN_MINC if there was an error reading the file
+              (ErrMsg is set on error)
+@DESCRIPTION: Reads the masked voxels of one file (in the given range of
+              slices) straight into its row of the output matrix.  Only
+              slices containing masked voxels are read, a few at a time.
+              Only one frame is read from a file with a time dimension
+              (eg. a 4-D file holding one subject per frame).
+@METHOD     :
+@GLOBALS    : ErrMsg
+@CALLS      : ReadImageData
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+int ReadMasked (ImageInfoRec *Image, MaskInfoRec *Mask,
+                long FirstSlice, long EndSlice, long Frame, void *Slab,
+                void *Out, long Row, long NumRows)
+{
+   long     Slices [MAX_SLAB];
+   long     slice, run, i, k;
+   long     NumSlices;
+   long     Offset;
+   long     Base;             /* first masked voxel in the slice range */
+   int      Result;
+
+   if ((max (Image->Slices, 1) != Mask->Slices) ||
+       (Image->Height != Mask->Height) || (Image->Width != Mask->Width))
+   {
+      sprintf (ErrMsg, "Image dimensions (%ld x %ld x %ld) differ from "
+               "those of the first file (%ld x %ld x %ld)",
+               max (Image->Slices, 1), Image->Height, Image->Width,
+               Mask->Slices, Mask->Height, Mask->Width);
+      return (ERR_BAD_MINC);
+   }
+
+   if ((Frame < 0) ||
+       (Frame >= ((Image->FrameDim == -1) ? 1 : Image->Frames)))
+   {
+      sprintf (ErrMsg, "No frame %ld in the file (it has %ld)", Frame+1,
+               (Image->FrameDim == -1) ? 1L : Image->Frames);
+      return (ERR_BAD_MINC);
+   }
+
+   Base = Mask->SliceFirst [FirstSlice];
+
+   slice = FirstSlice;
+   while (slice < EndSlice)
+   {
+      /* Skip slices without any masked voxels */
+
+      if (Mask->SliceFirst [slice] == Mask->SliceFirst [slice+1])
+      {
+         slice++;
+         continue;
+      }
+
+      /* Gather a slab of consecutive slices that all have masked voxels */
+
+      run = 0;
+      while ((slice + run < EndSlice) && (run < MAX_SLAB) &&
+             (Mask->SliceFirst [slice+run] != Mask->SliceFirst [slice+run+1]))
+      {
+         Slices [run] = slice + run;
+         run++;
+      }
+
+      NumSlices = (Image->SliceDim == -1) ? 0 : run;
+      Result = ReadImageData (Image, Slices, &Frame,
+                              NumSlices, (Image->FrameDim == -1) ? 0 : 1,
+                              0L, Image->Height, Slab);
+      if (Result != ERR_NONE)
+      {
+         return (Result);
+      }
+
+      /* And pick the masked voxels out of the slab */
+
+      Offset = slice * Mask->ImageSize;
+      if (Image->ICVType == NC_FLOAT)
+      {
+         float    *Src = (float *) Slab;
+         float    *Dst = (float *) Out + Row;
+
+         for (k = Mask->SliceFirst [slice];
+              k < Mask->SliceFirst [slice+run]; k++)
+         {
+            i = Mask->Index [k] - Offset;
+            Dst [(k-Base)*NumRows] = Src [i];
+         }
+      }
+      else
+      {
+         double   *Src = (double *) Slab;
+         double   *Dst = (double *) Out + Row;
+
+         for (k = Mask->SliceFirst [slice];
+              k < Mask->SliceFirst [slice+run]; k++)
+         {
+            i = Mask->Index [k] - Offset;
+            Dst [(k-Base)*NumRows] = Src [i];
+         }
+      }
+
+      slice += run;
+   }
+
+   return (ERR_NONE);
+}     /* ReadMasked */
+
+
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : ScatterRow
+@INPUT      : Stage - Count masked values of one file, packed together
+              ICVType - their type (NC_DOUBLE or NC_FLOAT)
+              Count - number of values
+              Row, NumRows - where they go in the output matrix
+@OUTPUT     : Out - data of the output matrix; Out[k*NumRows + Row] is
+                set to Stage[k]
+@RETURNS    : (void)
+@DESCRIPTION: Copies one file's masked voxels into its row of the output.
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+static void ScatterRow (void *Stage, nc_type ICVType, long Count,
+                        void *Out, long Row, long NumRows)
+{
+   long    k;
+
+   if (ICVType == NC_FLOAT)
+   {
+      float   *Src = (float *) Stage;
+      float   *Dst = (float *) Out + Row;
+
+      for (k = 0; k < Count; k++)
+      {
+         Dst [k*NumRows] = Src [k];
+      }
+   }
+   else
+   {
+      double  *Src = (double *) Stage;
+      double  *Dst = (double *) Out + Row;
+
+      for (k = 0; k < Count; k++)
+      {
+         Dst [k*NumRows] = Src [k];
+      }
+   }
+}     /* ScatterRow */
+
+
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : ReadFileTask
+@INPUT      : Task - index of the file to read
+              Thread - index of the thread doing the reading
+              Arg - pointer to the shared ReadTaskRec
+@OUTPUT     : row Task of the output matrix
+@RETURNS    : (void)
+@DESCRIPTION: Reads the masked voxels of one file; called from the
+              thread pool.  When running with several threads, the file
+              is first pulled into the system cache without holding any
+              lock, so that fetching one file (eg. over NFS) overlaps
+              with decoding another.  Everything that touches MINC is
+              done under the serial lock, with ErrMsg pointed at this
+              task's own buffer (Msg); nothing is done once some other
+              file has failed, and only the first failure's message is
+              copied into ErrMsg, so it describes the first error when
+              the pool finishes.  With several threads, the voxels are
+              decoded into this thread's stage buffer, and copied into
+              the output only once the lock is released, so that the
+              (strided) copy overlaps with the next file's decoding in
+              another thread -- the other threads act as the read-ahead.
+@METHOD     :
+@GLOBALS    : ErrMsg
+@CALLS      : ExpandCompressed, PrefetchFile, OpenImageAs, ReadMasked,
+              CloseImage, ScatterRow
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+static void ReadFileTask (long Task, int Thread, void *Arg)
+{
+   ReadTaskRec  *Read = (ReadTaskRec *) Arg;
+   ImageInfoRec  ImInfo;
+   char         *Expanded;
+   char         *Shared;
+   char          Msg [256];
+   int           Result;
+
+   /*
+    * Outside the lock, decompress the file if it is gzip'd and read it
+    * into the cache; OpenImageAs then finds the expanded copy.  Any
+    * error here will simply happen again (and be reported) below.
+    */
+
+   if (Read->NumThreads > 1)
+   {
+      if (ExpandCompressed (Read->Filenames [Task], &Expanded,
+                            Msg) == ERR_NONE)
+      {
+         (void) PrefetchFile (Expanded);
+         free (Expanded);
+      }
+   }
+
+   Result = ERR_OTHER;
+   LockSerial ();
+   if (Read->Result == ERR_NONE)
+   {
+      Shared = ErrMsg;
+      ErrMsg = Msg;
+      Msg [0] = '\0';
+      Result = OpenImageAs (Read->Filenames [Task], &ImInfo, NC_NOWRITE,
+                            Read->NaN, Read->ICVType);
+      if ((Result == ERR_NONE) && (Read->Stages != NULL))
+      {
+         Result = ReadMasked (&ImInfo, Read->Mask,
+                              Read->FirstSlice, Read->EndSlice,
+                              (Read->Frames == NULL) ? 0 : Read->Frames [Task],
+                              Read->Slabs [Thread],
+                              Read->Stages [Thread], 0L, 1L);
+         CloseImage (&ImInfo);
+      }
+      else if (Result == ERR_NONE)
+      {
+         Result = ReadMasked (&ImInfo, Read->Mask,
+                              Read->FirstSlice, Read->EndSlice,
+                              (Read->Frames == NULL) ? 0 : Read->Frames [Task],
+                              Read->Slabs [Thread],
+                              Read->Out, Task, Read->NumFiles);
+         CloseImage (&ImInfo);
+      }
+      ErrMsg = Shared;
+      if (Result != ERR_NONE)
+      {
+         Read->Result = Result;
+         Read->Failed = Task;
+         strcpy (ErrMsg, Msg);
+      }
+   }
+   UnlockSerial ();
+
+   if ((Result == ERR_NONE) && (Read->Stages != NULL))
+   {
+      ScatterRow (Read->Stages [Thread], Read->ICVType, Read->Count,
+                  Read->Out, Task, Read->NumFiles);
+   }
+}     /* ReadFileTask */
+
+
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : ReadAheadThread
+@INPUT      : Arg - pointer to the shared ReadAheadRec
+@OUTPUT     : the Stage[] buffers, one file at a time
+@RETURNS    : NULL
+@DESCRIPTION: The background half of a read-ahead pipeline: expands,
+              prefetches, opens and decodes the files in order, each into
+              the next free stage buffer, staying at most Depth files
+              ahead of the thread that copies them into the output.
+              Stops at the first error (recorded in the ReadTaskRec).
+              As in ReadFileTask, the MINC functions write any message
+              into this thread's own buffer, which is copied into
+              ErrMsg (under the serial lock) only for that error.
+@METHOD     :
+@GLOBALS    : ErrMsg
+@CALLS      : ExpandCompressed, PrefetchFile, OpenImageAs, ReadMasked,
+              CloseImage
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+static void *ReadAheadThread (void *Arg)
+{
+   ReadAheadRec  *Pipe = (ReadAheadRec *) Arg;
+   ReadTaskRec   *Read = Pipe->Read;
+   ImageInfoRec   ImInfo;
+   char          *Expanded;
+   char          *Shared;
+   char           Msg [256];
+   long           file;
+   Boolean        Abandoned;
+   int            Result;
+
+   for (file = 0; file < Read->NumFiles; file++)
+   {
+      /* Wait for a free stage buffer */
+
+      pthread_mutex_lock (&Pipe->Lock);
+      while ((file - Pipe->Consumed >= Pipe->Depth) && !Pipe->Abandoned)
+      {
+         pthread_cond_wait (&Pipe->Cond, &Pipe->Lock);
+      }
+      Abandoned = Pipe->Abandoned;
+      pthread_mutex_unlock (&Pipe->Lock);
+      if (Abandoned)
+      {
+         break;
+      }
+
+      if (ExpandCompressed (Read->Filenames [file], &Expanded,
+                            Msg) == ERR_NONE)
+      {
+         (void) PrefetchFile (Expanded);
+         free (Expanded);
+      }
+
+      LockSerial ();
+      Shared = ErrMsg;
+      ErrMsg = Msg;
+      Msg [0] = '\0';
+      Result = OpenImageAs (Read->Filenames [file], &ImInfo, NC_NOWRITE,
+                            Read->NaN, Read->ICVType);
+      if (Result == ERR_NONE)
+      {
+         Result = ReadMasked (&ImInfo, Read->Mask,
+                              Read->FirstSlice, Read->EndSlice,
+                              (Read->Frames == NULL) ? 0 : Read->Frames [file],
+                              Read->Slabs [0],
+                              Pipe->Stage [file % Pipe->Depth], 0L, 1L);
+         CloseImage (&ImInfo);
+      }
+      ErrMsg = Shared;
+      if (Result != ERR_NONE)
+      {
+         strcpy (ErrMsg, Msg);
+      }
+      UnlockSerial ();
+
+      pthread_mutex_lock (&Pipe->Lock);
+      if (Result == ERR_NONE)
+      {
+         Pipe->Produced = file+1;
+      }
+      else
+      {
+         Read->Result = Result;
+         Read->Failed = file;
+      }
+      pthread_cond_broadcast (&Pipe->Cond);
+      pthread_mutex_unlock (&Pipe->Lock);
+
+      if (Result != ERR_NONE)
+      {
+         break;
+      }
+   }
+   return (NULL);
+}     /* ReadAheadThread */
+
+
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : ReadWithReadAhead
+@INPUT      : *Read - describes the files to read (with one slab buffer)
+              Depth - number of files to decode ahead of the copying
+@OUTPUT     : Read->Out - the output matrix
+@RETURNS    : ERR_NONE if all went well
+              ERR_NO_MEM if the stage buffers could not be allocated
+              ERR_OTHER if the read-ahead thread could not be started
+              otherwise, the error from the first file to fail
+@DESCRIPTION: Reads the files through a two-stage pipeline: a background
+              thread decodes each file's masked voxels into one of Depth
+              stage buffers, while this thread copies the previous files
+              from their stage buffers into their rows of the output.
+              Thus the MINC/HDF5 decoding of the next files overlaps
+              with the (strided, cache-unfriendly) copying of the current
+              one, even with only one thread doing I/O.
+@METHOD     :
+@GLOBALS    : ErrMsg
+@CALLS      : ReadAheadThread, ScatterRow
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+static int ReadWithReadAhead (ReadTaskRec *Read, int Depth)
+{
+   ReadAheadRec  Pipe;
+   pthread_t     Thread;
+   long          Count;         /* masked voxels per file */
+   long          file;
+   Boolean       Ready;
+   int           i;
+
+   Count = Read->Count;
+
+   Pipe.Read = Read;
+   Pipe.Depth = (int) min (Depth, Read->NumFiles);
+   Pipe.Produced = 0;
+   Pipe.Consumed = 0;
+   Pipe.Abandoned = FALSE;
+   Pipe.Stage = (void **) malloc (Pipe.Depth * sizeof (void *));
+   if (Pipe.Stage == NULL)
+   {
+      sprintf (ErrMsg, "Out of memory for read-ahead buffers");
+      return (ERR_NO_MEM);
+   }
+   for (i = 0; i < Pipe.Depth; i++)
+   {
+      Pipe.Stage [i] = malloc (max (Count, 1) * nctypelen (Read->ICVType));
+      if (Pipe.Stage [i] == NULL)
+      {
+         while (--i >= 0)
+         {
+            free (Pipe.Stage [i]);
+         }
+         free (Pipe.Stage);
+         sprintf (ErrMsg, "Out of memory for read-ahead buffers");
+         return (ERR_NO_MEM);
+      }
+   }
+   pthread_mutex_init (&Pipe.Lock, NULL);
+   pthread_cond_init (&Pipe.Cond, NULL);
+
+   if (pthread_create (&Thread, NULL, ReadAheadThread, &Pipe) != 0)
+   {
+      sprintf (ErrMsg, "Could not start read-ahead thread");
+      Read->Result = ERR_OTHER;
+   }
+   else
+   {
+      for (file = 0; file < Read->NumFiles; file++)
+      {
+         pthread_mutex_lock (&Pipe.Lock);
+         while ((Pipe.Produced <= file) && (Read->Result == ERR_NONE))
+         {
+            pthread_cond_wait (&Pipe.Cond, &Pipe.Lock);
+         }
+         Ready = (Pipe.Produced > file);
+         pthread_mutex_unlock (&Pipe.Lock);
+         if (!Ready)
+         {
+            break;                          /* the reader failed */
+         }
+
+         ScatterRow (Pipe.Stage [file % Pipe.Depth], Read->ICVType, Count,
+                     Read->Out, file, Read->NumFiles);
+
+         pthread_mutex_lock (&Pipe.Lock);
+         Pipe.Consumed = file+1;
+         pthread_cond_broadcast (&Pipe.Cond);
+         pthread_mutex_unlock (&Pipe.Lock);
+      }
+
+      pthread_mutex_lock (&Pipe.Lock);
+      Pipe.Abandoned = TRUE;
+      pthread_cond_broadcast (&Pipe.Cond);
+      pthread_mutex_unlock (&Pipe.Lock);
+      pthread_join (Thread, NULL);
+   }
+
+   pthread_cond_destroy (&Pipe.Cond);
+   pthread_mutex_destroy (&Pipe.Lock);
+   for (i = 0; i < Pipe.Depth; i++)
+   {
+      free (Pipe.Stage [i]);
+   }
+   free (Pipe.Stage);
+
+   return (Read->Result);
+}     /* ReadWithReadAhead */
+
+
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : ReadMaskedFiles
+@INPUT      : Filenames - the MINC files to read
+              NumFiles - how many of them
+              Frames - the zero-based frame to read from each file (see
+                SetFrameList), or NULL to read the first of every file
+              *Mask - mask set up by SetupMask
+              FirstSlice, EndSlice - range of slices to read
+              ICVType - NC_DOUBLE or NC_FLOAT; the type of Out
+              NaN - value for out-of-range voxels
+              NumThreads - number of threads to read the files with
+              ReadAhead - when reading with one thread, the number of
+                files to decode in the background ahead of the one
+                being copied to Out (0 for none); several threads
+                read ahead of each other anyway, so it is not used
+                then
+@OUTPUT     : Out - a NumFiles x (SliceFirst[EndSlice]-SliceFirst[FirstSlice])
+                matrix (column major) of the masked voxels
+              *Failed - index of the file that failed (if any)
+@RETURNS    : ERR_NONE if all went well
+              ERR_NO_MEM if the slab or stage buffers could not be
+                allocated
+              otherwise, the error from the first file to fail
+              (ErrMsg is set on error)
+@DESCRIPTION: Reads the masked voxels in a range of slices from every
+              file, using a pool of NumThreads threads (each decoding a
+              file into its own stage buffer while another copies its
+              last one out; see ReadFileTask), or with one thread and a
+              read-ahead pipeline (see ReadWithReadAhead).
+              May be called from a thread other than MATLAB's.
+@METHOD     :
+@GLOBALS    : ErrMsg
+@CALLS      : RunTasks, ReadFileTask, ReadWithReadAhead
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+int ReadMaskedFiles (char *Filenames[], long NumFiles, long Frames[],
+                     MaskInfoRec *Mask, long FirstSlice, long EndSlice,
+                     nc_type ICVType, double NaN, int NumThreads,
+                     int ReadAhead, void *Out, long *Failed)
+{
+   ReadTaskRec  Read;
+   void        *Slabs [MAX_THREADS];
+   void        *Stages [MAX_THREADS];
+   long         Count;
+   int          thread;
+
+   *Failed = -1;
+   if (NumFiles == 0)
+   {
+      return (ERR_NONE);
+   }
+
+   NumThreads = (int) min (min (max (NumThreads, 1), NumFiles), MAX_THREADS);
+   Count = Mask->SliceFirst [EndSlice] - Mask->SliceFirst [FirstSlice];
+   for (thread = 0; thread < NumThreads; thread++)
+   {
+      Slabs [thread] = malloc (MAX_SLAB * Mask->ImageSize *
+                               nctypelen (ICVType));
+      Stages [thread] = NULL;
+      if ((Slabs [thread] != NULL) && (NumThreads > 1))
+      {
+         Stages [thread] = malloc (max (Count, 1) * nctypelen (ICVType));
+         if (Stages [thread] == NULL)
+         {
+            free (Slabs [thread]);
+            Slabs [thread] = NULL;
+         }
+      }
+      if (Slabs [thread] == NULL)
+      {
+         while (--thread >= 0)
+         {
+            free (Slabs [thread]);
+            free (Stages [thread]);
+         }
+         sprintf (ErrMsg, "Out of memory for slab buffers");
+         return (ERR_NO_MEM);
+      }
+   }
+
+   Read.Filenames = Filenames;
+   Read.Frames = Frames;
+   Read.Mask = Mask;
+   Read.FirstSlice = FirstSlice;
+   Read.EndSlice = EndSlice;
+   Read.ICVType = ICVType;
+   Read.NaN = NaN;
+   Read.NumThreads = NumThreads;
+   Read.Slabs = Slabs;
+   Read.Stages = (NumThreads > 1) ? Stages : NULL;
+   Read.Count = Count;
+   Read.Out = Out;
+   Read.NumFiles = NumFiles;
+   Read.Result = ERR_NONE;
+   Read.Failed = -1;
+
+   if ((NumThreads == 1) && (ReadAhead > 0) && (NumFiles > 1))
+   {
+      (void) ReadWithReadAhead (&Read, ReadAhead);
+   }
+   else
+   {
+      (void) RunTasks (NumFiles, NumThreads, ReadFileTask, &Read);
+   }
+
+   for (thread = 0; thread < NumThreads; thread++)
+   {
+      free (Slabs [thread]);
+      free (Stages [thread]);
+   }
+
+   *Failed = Read.Failed;
+   return (Read.Result);
+}     /* ReadMaskedFiles */
@@ -24,6 +24,8 @@
 #include <string.h>
 #include <float.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
 #include "minc.h"
 #include "emmageneral.h"
 #include "mincutil.h"
@@ -170,10 +172,12 @@ char *NCErrMsg (int NCErrCode, int SysErrCode)
 @RETURNS    : ERR_NONE if file successfully opened
               ERR_IN_MINC if any error opening file
               sets ErrMsg on error
-@DESCRIPTION: Opens a NetCDF/MINC file using ncopen.
+@DESCRIPTION: Opens a NetCDF/MINC file using ncopen.  A gzip'd file
+              opened read-only is expanded into the scratch cache (see
+              gzcache.c) and the uncompressed copy is opened instead.
 @METHOD     : 
 @GLOBALS    : ErrMsg
-@CALLS      : standard NetCDF, mex functions.
+@CALLS      : ExpandCompressed, standard NetCDF, mex functions.
 @CREATED    : 93-5-31, adapted from code in micopyvardefs.c, Greg Ward
 @MODIFIED   : 93-6-4, modified debug/error handling and added Mode parameter
             : 93-6-30, changed error message
@@ -182,7 +186,23 @@ char *NCErrMsg (int NCErrCode, int SysErrCode)
 ---------------------------------------------------------------------------- */
 int OpenFile (char *Filename, int *CDF, int Mode)
 {
-   *CDF = ncopen (Filename, Mode);
+   char  *Expanded;
+   int    Result;
+
+   if (Mode == NC_NOWRITE)
+   {
+      Result = ExpandCompressed (Filename, &Expanded, ErrMsg);
+      if (Result != ERR_NONE)
+      {
+         return (Result);
+      }
+      *CDF = ncopen (Expanded, Mode);
+      free (Expanded);
+   }
+   else
+   {
+      *CDF = ncopen (Filename, Mode);
+   }
 
    if (*CDF == MI_ERROR)
    {
@@ -443,15 +463,45 @@ int GetImageInfo (int CDF, ImageInfoRec *Image)
               ERR_IN_MINC if error opening MINC file (from OpenFile)
               ERR_NO_VAR if error reading variables (from GetImageInfo)
               ErrMsg will be set by OpenFile or GetImageInfo
-@DESCRIPTION: Open a MINC file and read relevant data about the image variable.
+@DESCRIPTION: Open a MINC file and read relevant data about the image
+              variable.  Image data will be read as doubles; see
+              OpenImageAs to get some other type.
 @METHOD     : 
 @GLOBALS    : 
-@CALLS      : OpenFile, GetImageInfo, miicv{...} functions
+@CALLS      : OpenImageAs
 @CREATED    : 93-6-3, Greg Ward
 @MODIFIED   : 95-2-1, Mark Wolforth
                       -Added DO_FILLVALUE to the created ICV.
 ---------------------------------------------------------------------------- */
 int OpenImage (char Filename[], ImageInfoRec *Image, int mode, double NaN)
+{
+   return (OpenImageAs (Filename, Image, mode, NaN, NC_DOUBLE));
+}     /* OpenImage */
+
+
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : OpenImageAs
+@INPUT      : Filename - name of the MINC file to open
+              mode - either NC_WRITE or NC_NOWRITE
+              NaN - value that out-of-range voxels are mapped to (see
+                    OpenImage)
+              ICVType - the type that image data is converted to by
+                    the ICV; NC_DOUBLE or NC_FLOAT.  Either way the
+                    values are real (i.e. normalised) voxel values.
+@OUTPUT     : *Image - as for OpenImage; Image->ICVType is set to ICVType
+@RETURNS    : as for OpenImage
+@DESCRIPTION: Open a MINC file, read relevant data about the image
+              variable, and attach an ICV that delivers real voxel values
+              of the requested type.
+@METHOD     : 
+@GLOBALS    : 
+@CALLS      : OpenFile, GetImageInfo, miicv{...} functions
+@CREATED    : 93-6-3, Greg Ward (as OpenImage)
+@MODIFIED   : 
+---------------------------------------------------------------------------- */
+int OpenImageAs (char Filename[], ImageInfoRec *Image, int mode, double NaN,
+                 nc_type ICVType)
 {
    int   CDF;
    int   Result;        /* of various function calls */
@@ -469,8 +519,9 @@ int OpenImage (char Filename[], ImageInfoRec *Image, int mode, double NaN)
       return (Result);
    }
 
+   Image->ICVType = ICVType;
    Image->ICV = miicv_create ();
-   (void) miicv_setint (Image->ICV, MI_ICV_TYPE, NC_DOUBLE);
+   (void) miicv_setint (Image->ICV, MI_ICV_TYPE, ICVType);
    (void) miicv_setint (Image->ICV, MI_ICV_DO_RANGE, TRUE);
    (void) miicv_setint (Image->ICV, MI_ICV_DO_NORM, TRUE);
    (void) miicv_setint (Image->ICV, MI_ICV_DO_DIM_CONV, TRUE);
@@ -480,7 +531,276 @@ int OpenImage (char Filename[], ImageInfoRec *Image, int mode, double NaN)
    (void) miicv_attach (Image->ICV, Image->CDF, Image->ID);
 
    return (ERR_NONE);
-}     /* OpenImage */
+}     /* OpenImageAs */
+
+
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : RunLength
+@INPUT      : List[] - vector of zero-based slice or frame numbers
+              First - index into List[] where the run starts
+              NumInList - number of elements used in List[]
+@OUTPUT     : 
+@RETURNS    : the number of elements, starting at List[First], that form
+              a run of consecutive ascending numbers (always at least 1)
+@DESCRIPTION: Used by ReadImageData to find blocks of adjacent slices or
+              frames that can be fetched from the MINC file with a single
+              hyperslab read rather than one read per image.
+@METHOD     : 
+@GLOBALS    : 
+@CALLS      : 
+@CREATED    : 
+@MODIFIED   : 
+---------------------------------------------------------------------------- */
+static long RunLength (long List[], long First, long NumInList)
+{
+   long   i;
+
+   for (i = First+1; i < NumInList; i++)
+   {
+      if (List [i] != List [i-1] + 1)
+      {
+         break;
+      }
+   }
+   return (i - First);
+}     /* RunLength */
+
+
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : ReadImageData
+@INPUT      : *Image - struct describing the image (as set up by OpenImage
+                or OpenImageAs)
+              Slices[] - vector of zero-based slice numbers to read
+              Frames[] - vector of zero-based frame numbers to read
+              NumSlices - number of elements in Slices[]
+              NumFrames - number of elements in Frames[]
+              StartRow - starting row ('height' dimension) (zero-based!)
+              NumRows - number of rows to read
+@OUTPUT     : Buffer - filled with the images specified by Slices[] and
+                Frames[], one after the other (slices varying slowest, so
+                that slice Slices[i], frame Frames[j] is image number
+                i*NumFrames + j), each image being Image->Width * NumRows
+                voxels with the
+                highest dimension of the image variable varying fastest.
+                The voxels are of type Image->ICVType (double or float),
+                and Buffer must be allocated by the caller.
+@RETURNS    : ERR_NONE if all went well
+              ERR_IN_MINC if miicv_get failed (ErrMsg is set)
+              ERR_NO_MEM if the scratch buffer could not be allocated
+@DESCRIPTION: Reads a series of images from a MINC file.  Any number of
+              slices may be combined with any number of frames.  The Slices and
+              Frames vectors should contain valid zero-based slice and
+              frame numbers for the given MINC file (the caller is
+              responsible for checking this).  If either the slice or
+              frame dimension is missing from the MINC file, NumSlices or
+              NumFrames (whichever applies, possibly both) should be zero;
+              the "only" slice/frame in the file is read then.
+@METHOD     : Each box of consecutive slices by consecutive frames is
+              read with one miicv_get call, so that eg. all slices of all
+              frames of a dynamic volume cost a single hyperslab read.
+              When the images of a box are not laid out in the file the
+              way they must be in Buffer (ie. the box spans several
+              slices and only some of the frames, or the file has frames
+              varying faster than slices), the box is read into a
+              scratch buffer and its images are then copied to their
+              places in Buffer.
+@GLOBALS    : ErrMsg
+@CALLS      : RunLength, MINC functions
+@CREATED    : 93-6-6, Greg Ward (as ReadImages, in mireadimages.c)
+@MODIFIED   : 
+---------------------------------------------------------------------------- */
+int ReadImageData (ImageInfoRec *Image,
+                   long    Slices [],
+                   long    Frames [],
+                   long    NumSlices,
+                   long    NumFrames,
+                   long    StartRow,
+                   long    NumRows,
+                   void    *Buffer)
+{
+   long     slice, frame;
+   long     SliceRun, FrameRun; /* size of the box read by one miicv_get */
+   long     si, fi;             /* slice/frame within the box */
+   long     BoxImage;           /* image number within the box */
+   long     Start [MAX_NC_DIMS], Count [MAX_NC_DIMS];
+   long     Size;               /* the number of voxels per image (taking
+                                   NumRows into account!) */
+   char     *VectorImages;      /* really double or float (see ElemSize) */
+   char     *Scratch;           /* for boxes that must be rearranged */
+   long     ScratchSize;        /* number of images Scratch can hold */
+   char     *Target;            /* where miicv_get puts the current box */
+   Boolean  Direct;             /* box can be read straight into Buffer */
+   Boolean  FramesOuter;        /* frames vary slower than slices in file */
+   int      ElemSize;           /* bytes per voxel in VectorImages */
+   Boolean  DoFrames;           /* false if NumFrames (NumSlices) == 0, so we*/
+   Boolean  DoSlices;           /* know to not set a frame (slice) number */
+   int      RetVal;             /* from miicv_get -- if this is MI_ERROR */
+                                /* we have a problem!!  Should NOT!!! happen */
+   /*
+    * Setup start/count vectors.  The user is allowed to specify
+    * slices/frames such that non-contiguous images are read, so the
+    * slice/frame elements of Start/Count are set in the loops below for
+    * each run of adjacent images.  However, the image rows read are
+    * always contiguous, so we'll set the Height elements of Start/Count
+    * just once -- right here -- and leave them alone in the loops.
+    */
+
+   Start [Image->HeightDim] = StartRow;
+   Count [Image->HeightDim] = NumRows;
+   Start [Image->WidthDim] = 0L;
+   Count [Image->WidthDim] = Image->Width;
+
+   Size = Image->Width * NumRows;
+   ElemSize = nctypelen (Image->ICVType);
+   VectorImages = (char *) Buffer;
+   Scratch = NULL;
+   ScratchSize = 0;
+   FramesOuter = (Image->FrameDim != -1) && (Image->SliceDim != -1) &&
+                 (Image->FrameDim < Image->SliceDim);
+
+   /* 
+    * If the caller has set NumFrames (NumSlices) to 0, that REALLY means
+    * read one frame (slice) from a file with no frame (slice) dimension.
+    * We need to set NumFrames (NumSlices) to 1 so that we at least get
+    * into the inner (outer) loop below, but DoFrames (DoSlices) to 
+    * FALSE so we know there's really no frame (slice) dimension.
+    */
+
+   if (NumFrames == 0)
+   {
+      DoFrames = FALSE;
+      NumFrames = 1;         /* so that we at least get into the frames loop */
+   }
+   else
+   {
+      DoFrames = TRUE;
+   }
+
+   if (NumSlices == 0)
+   {
+      DoSlices = FALSE;
+      NumSlices = 1;
+   }
+   else
+   {
+      DoSlices = TRUE;
+   }
+
+#ifdef DEBUG
+   printf ("Reading %ld slices, %ld frames: %ld total images.\n",
+           NumSlices, NumFrames, NumSlices*NumFrames);
+   printf ("  Any frame dimension: %s\n", DoFrames ? "YES" : "NO");
+   printf ("  Any slice dimension: %s\n", DoSlices ? "YES" : "NO");
+   printf ("Reading from row %ld, for %ld rows.\n", StartRow, NumRows);
+#endif
+
+   /*
+    * Now loop through slices and frames to read in the images, one box
+    * of adjacent slices and frames at a time.
+    */
+
+   for (slice = 0; slice < NumSlices; slice += SliceRun)
+   {  
+      /* Set the slice(s) for all frames read in this run of slices */
+
+      SliceRun = 1;
+      if (DoSlices)
+      {
+         SliceRun = RunLength (Slices, slice, NumSlices);
+         Start [Image->SliceDim] = Slices [slice];
+         Count [Image->SliceDim] = SliceRun;
+      }
+
+      for (frame = 0L; frame < NumFrames; frame += FrameRun)
+      {
+         /* Set the frame(s) for this box of images only */
+
+         FrameRun = 1;
+         if (DoFrames)
+         {
+            FrameRun = RunLength (Frames, frame, NumFrames);
+            Start [Image->FrameDim] = Frames [frame];
+            Count [Image->FrameDim] = FrameRun;
+         }
+
+         /*
+          * The box can go straight into Buffer if its images are
+          * contiguous there (a single slice, or all the frames) and
+          * come out of the file in the same order (no more than one
+          * slice or one frame, or slices varying slowest in the file).
+          */
+
+         Direct = (SliceRun == 1) ||
+                  ((FrameRun == NumFrames) &&
+                   ((FrameRun == 1) || !FramesOuter));
+
+         if (Direct)
+         {
+            Target = VectorImages + ElemSize * Size *
+                     (slice * NumFrames + frame);
+         }
+         else
+         {
+            if (ScratchSize < SliceRun * FrameRun)
+            {
+               free (Scratch);
+               ScratchSize = SliceRun * FrameRun;
+               Scratch = (char *) malloc (ScratchSize * Size * ElemSize);
+               if (Scratch == NULL)
+               {
+                  sprintf (ErrMsg, "Out of memory reading %ld x %ld images",
+                           SliceRun, FrameRun);
+                  return (ERR_NO_MEM);
+               }
+            }
+            Target = Scratch;
+         }
+
+         /* Now read the images */
+
+#ifdef DEBUG
+         printf ("Start: %ld %ld %ld %ld;  Count: %ld %ld %ld %ld (%s)\n",
+                 Start [0], Start [1], Start [2], Start [3],
+                 Count [0], Count [1], Count [2], Count [3],
+                 Direct ? "direct" : "scattered");
+#endif
+         RetVal = miicv_get (Image->ICV, Start, Count, Target);
+         if (RetVal == MI_ERROR)
+         {
+            sprintf (ErrMsg, "!! BOMB !! error code %d (%s) set by miicv_get",
+                     ncerr, NCErrMsg (ncerr, errno));
+            free (Scratch);
+            return (ERR_IN_MINC);
+         }
+
+         /* Copy a scattered box's images to where they belong */
+
+         if (!Direct)
+         {
+            for (si = 0; si < SliceRun; si++)
+            {
+               for (fi = 0; fi < FrameRun; fi++)
+               {
+                  BoxImage = FramesOuter ? (fi * SliceRun + si)
+                                         : (si * FrameRun + fi);
+                  memcpy (VectorImages + ElemSize * Size *
+                          ((slice + si) * NumFrames + frame + fi),
+                          Scratch + ElemSize * Size * BoxImage,
+                          ElemSize * Size);
+               }
+            }
+         }
+
+      }     /* for frame */
+
+   }     /* for slice */
+
+   free (Scratch);
+   return (ERR_NONE);
+
+}     /* ReadImageData */
 
 
 
@@ -501,3 +821,49 @@ void CloseImage (ImageInfoRec *Image)
    miicv_free (Image->ICV);
    ncclose (Image->CDF);
 }
+
+
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : PrefetchFile
+@INPUT      : Filename - name of a file that is about to be opened
+@OUTPUT     : (none)
+@RETURNS    : ERR_NONE if the file was read
+              ERR_IN_MINC if it could not be opened (ErrMsg is NOT set,
+                since this may be called from a worker thread; the
+                subsequent OpenImage will report the problem)
+@DESCRIPTION: Reads the whole of a file once, so that it is in the
+              operating system's cache by the time the MINC library
+              gets to it.  Touches no MINC/NetCDF state, so may be
+              called from several threads at once: this is how the
+              network/disk latency of a list of files can be overlapped
+              even though the files themselves must be decoded one at
+              a time.
+@METHOD     : posix_fadvise (where available) followed by plain read()s
+@GLOBALS    : (none)
+@CALLS      : open, read, close
+@CREATED    : 
+@MODIFIED   : 
+---------------------------------------------------------------------------- */
+int PrefetchFile (char Filename[])
+{
+   char   Buffer [65536];
+   int    fd;
+
+   fd = open (Filename, O_RDONLY);
+   if (fd < 0)
+   {
+      return (ERR_IN_MINC);
+   }
+
+#ifdef POSIX_FADV_WILLNEED
+   (void) posix_fadvise (fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+   (void) posix_fadvise (fd, 0, 0, POSIX_FADV_WILLNEED);
+#endif
+
+   while (read (fd, Buffer, sizeof (Buffer)) > 0)
+      ;
+
+   close (fd);
+   return (ERR_NONE);
+}     /* PrefetchFile */
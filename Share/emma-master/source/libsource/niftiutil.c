@@ -0,0 +1,1821 @@
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : niftiutil.c
+@DESCRIPTION: Reading and writing NIfTI-1 files without going through
+              MATLAB's load_nii/save_nii.  ReadNiftiHeader reads just the
+              348-byte header of a .nii, .hdr (or .img) file, compressed
+              or not, so that a file can serve as a template for a new
+              one without its image being read.  OpenNiftiWriter,
+              WriteNiftiData and CloseNiftiWriter write a new .nii file
+              from a header and any number of pieces of data, converting
+              the data to the header's type as they go, so the caller
+              never needs more than a piece of the image in memory.
+
+              GetNiftiInfo, MapNiftiImage and GatherNiftiMasked read
+              the voxels under a mask from an uncompressed NIfTI-1 or
+              NIfTI-2 file by memory-mapping its image, so that only the
+              pages holding masked voxels are ever touched and the image
+              is never copied as a whole.  A gzip'd image can't be
+              mapped, so StreamNiftiMasked inflates it once, in order, a
+              piece at a time, picking off the masked voxels as it goes
+              -- never writing a temporary copy as load_nii does.
+              ReadNiftiMaskedFiles does either for a list of files,
+              several at once.
+
+              A .nii.gz file is compressed by a background thread while
+              the caller converts the next piece, through a small ring
+              of buffers (WRITE_DEPTH of them), so that zlib -- by far
+              the slowest part of writing a compressed file -- runs
+              alongside rather than after everything else.
+@CREATED    :
+@MODIFIED   :
+@VERSION    : $Id: niftiutil.c,v 1.1 $
+              $Name:  $
+---------------------------------------------------------------------------- */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <pthread.h>
+#include <zlib.h>
+#include "emmageneral.h"
+#include "mierrors.h"
+#include "threadpool.h"
+#include "niftiutil.h"
+
+#define WRITE_DEPTH    3              /* buffers between the caller and
+                                         the gzip thread */
+#define STREAM_VOXELS  65536          /* voxels inflated at a time when
+                                         gathering from a gzip'd image */
+#define STREAM_BUFFER  (128*1024)     /* zlib's input buffer for that */
+#define MAP_VOLUMES    16             /* most volumes of an uncompressed
+                                         file read by one task */
+
+/*
+ * A .nii or .nii.gz file being written.  For a .nii.gz, file f's piece
+ * is converted into Buffer[f % WRITE_DEPTH] and compressed from there by
+ * GzipThread; Lock protects Queued, Written, Done and Failed.  An
+ * uncompressed file uses only Buffer[0], and no thread.
+ */
+
+struct NiftiWriter
+{
+   char            *Filename;
+   FILE            *File;             /* uncompressed output, or NULL */
+   gzFile           GzFile;           /* compressed output, or NULL */
+   int              DataType;
+   int              TypeSize;
+   long             BufferVoxels;     /* capacity of each buffer */
+   void            *Buffer [WRITE_DEPTH];
+   long             Length [WRITE_DEPTH];  /* bytes in each queued buffer */
+   long             Queued;           /* buffers handed to GzipThread */
+   long             Written;          /* buffers it has compressed */
+   Boolean          Done;             /* no more buffers are coming */
+   Boolean          Failed;           /* some write has failed */
+   Boolean          Threaded;         /* GzipThread is running */
+   pthread_t        Thread;
+   pthread_mutex_t  Lock;
+   pthread_cond_t   Cond;
+};
+
+/*
+ * One entry of the list given to ReadNiftiMaskedFiles: a volume of a
+ * file, and the row of Out it goes in.
+ */
+
+typedef struct
+{
+   char            *Filename;
+   long             Volume;
+   long             Row;
+} NiftiEntryRec;
+
+/*
+ * The files being read by ReadNiftiMaskedFiles.  The entries, sorted by
+ * file and volume, are split into tasks: task t reads Volumes[i] of
+ * file Filenames[Rows[i]] into row Rows[i] of Out (NumFiles x NumVoxels,
+ * column major), for TaskFirst[t] <= i < TaskFirst[t+1].  Result and
+ * Failed are set by the first file to fail, under LockSerial.
+ */
+
+typedef struct
+{
+   char           **Filenames;
+   long             NumFiles;
+   long            *Volumes;
+   long            *Rows;
+   long            *TaskFirst;
+   long            *Index;
+   long             NumVoxels;
+   Boolean          IsFloat;
+   void            *Out;
+   NiftiInfoRec    *First;
+   int              Result;
+   long             Failed;
+} NiftiReadRec;
+
+extern char *ErrMsg;
+
+
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : NiftiTypeSize
+@INPUT      : DataType - a NIfTI datatype code
+@OUTPUT     :
+@RETURNS    : the size in bytes of one voxel of that type, or 0 if it is
+              not one of the scalar types we handle (see niftiutil.h)
+@DESCRIPTION:
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+int NiftiTypeSize (int DataType)
+{
+   switch (DataType)
+   {
+      case NIFTI_UINT8:
+      case NIFTI_INT8:    return (1);
+      case NIFTI_INT16:
+      case NIFTI_UINT16:  return (2);
+      case NIFTI_INT32:
+      case NIFTI_UINT32:
+      case NIFTI_FLOAT32: return (4);
+      case NIFTI_FLOAT64: return (8);
+      default:            return (0);
+   }
+}     /* NiftiTypeSize */
+
+
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : Swap2, Swap4, Swap8
+@INPUT      : Data - array of 2-, 4- (or 8-) byte values
+              N - number of values
+@OUTPUT     : Data - with the bytes of every value reversed
+@RETURNS    : (void)
+@DESCRIPTION: Byte-swapping for files written on a machine of the other
+              endianness.
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+static void Swap2 (void *Data, long N)
+{
+   unsigned char *p = (unsigned char *) Data;
+   unsigned char  t;
+   long           i;
+
+   for (i = 0; i < N; i++, p += 2)
+   {
+      t = p[0]; p[0] = p[1]; p[1] = t;
+   }
+}
+
+static void Swap4 (void *Data, long N)
+{
+   unsigned char *p = (unsigned char *) Data;
+   unsigned char  t;
+   long           i;
+
+   for (i = 0; i < N; i++, p += 4)
+   {
+      t = p[0]; p[0] = p[3]; p[3] = t;
+      t = p[1]; p[1] = p[2]; p[2] = t;
+   }
+}
+
+static void Swap8 (void *Data, long N)
+{
+   unsigned char *p = (unsigned char *) Data;
+   unsigned char  t;
+   long           i;
+   int            j;
+
+   for (i = 0; i < N; i++, p += 8)
+   {
+      for (j = 0; j < 4; j++)
+      {
+         t = p[j]; p[j] = p[7-j]; p[7-j] = t;
+      }
+   }
+}
+
+
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : SwapHeader
+@INPUT      : Hdr - a header read from a file of the other endianness
+@OUTPUT     : Hdr - with every numeric field byte-swapped
+@RETURNS    : (void)
+@DESCRIPTION:
+@METHOD     :
+@GLOBALS    :
+@CALLS      : Swap2, Swap4
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+static void SwapHeader (NiftiHeader *Hdr)
+{
+   Swap4 (&Hdr->sizeof_hdr, 1);
+   Swap4 (&Hdr->extents, 1);
+   Swap2 (&Hdr->session_error, 1);
+   Swap2 (Hdr->dim, 8);
+   Swap4 (&Hdr->intent_p1, 1);
+   Swap4 (&Hdr->intent_p2, 1);
+   Swap4 (&Hdr->intent_p3, 1);
+   Swap2 (&Hdr->intent_code, 1);
+   Swap2 (&Hdr->datatype, 1);
+   Swap2 (&Hdr->bitpix, 1);
+   Swap2 (&Hdr->slice_start, 1);
+   Swap4 (Hdr->pixdim, 8);
+   Swap4 (&Hdr->vox_offset, 1);
+   Swap4 (&Hdr->scl_slope, 1);
+   Swap4 (&Hdr->scl_inter, 1);
+   Swap2 (&Hdr->slice_end, 1);
+   Swap4 (&Hdr->cal_max, 1);
+   Swap4 (&Hdr->cal_min, 1);
+   Swap4 (&Hdr->slice_duration, 1);
+   Swap4 (&Hdr->toffset, 1);
+   Swap4 (&Hdr->glmax, 1);
+   Swap4 (&Hdr->glmin, 1);
+   Swap2 (&Hdr->qform_code, 1);
+   Swap2 (&Hdr->sform_code, 1);
+   Swap4 (&Hdr->quatern_b, 1);
+   Swap4 (&Hdr->quatern_c, 1);
+   Swap4 (&Hdr->quatern_d, 1);
+   Swap4 (&Hdr->qoffset_x, 1);
+   Swap4 (&Hdr->qoffset_y, 1);
+   Swap4 (&Hdr->qoffset_z, 1);
+   Swap4 (Hdr->srow_x, 4);
+   Swap4 (Hdr->srow_y, 4);
+   Swap4 (Hdr->srow_z, 4);
+}     /* SwapHeader */
+
+
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : ReadHeaderBytes
+@INPUT      : Filename - a .nii or .hdr file (or the .img of a .hdr/.img
+                pair, whose .hdr is then read), possibly gzip'd
+              Size - the most bytes to read
+@OUTPUT     : Buffer - the first *Length (up to Size) bytes of the header
+                file
+              *HdrFile - the name of the header file, malloc'd (to be
+                freed by the caller) if all went well
+@RETURNS    : ERR_NONE if all went well
+              ERR_NO_MEM if out of memory
+              ERR_IN_NIFTI if the file can't be opened (ErrMsg is set)
+@DESCRIPTION: Reads the start of a header file, through zlib, which stops
+              after the first few blocks of a gzip'd file.
+@METHOD     :
+@GLOBALS    : ErrMsg
+@CALLS      : zlib
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+static int ReadHeaderBytes (char Filename[], void *Buffer, int Size,
+                            int *Length, char **HdrFile)
+{
+   char    *Name;
+   char    *Ext;
+   gzFile   File;
+
+   Name = (char *) malloc (strlen (Filename) + 1);
+   if (Name == NULL)
+   {
+      sprintf (ErrMsg, "Out of memory");
+      return (ERR_NO_MEM);
+   }
+   strcpy (Name, Filename);
+
+   /* foo.img and foo.img.gz have their headers in foo.hdr[.gz] */
+
+   Ext = strstr (Name, ".img");
+   if ((Ext != NULL) &&
+       ((strcmp (Ext, ".img") == 0) || (strcmp (Ext, ".img.gz") == 0)))
+   {
+      memcpy (Ext, ".hdr", 4);
+   }
+
+   File = gzopen (Name, "rb");
+   if (File == NULL)
+   {
+      sprintf (ErrMsg, "Error opening NIfTI file %s", Name);
+      free (Name);
+      return (ERR_IN_NIFTI);
+   }
+   *Length = gzread (File, Buffer, (unsigned) Size);
+   gzclose (File);
+
+   *HdrFile = Name;
+   return (ERR_NONE);
+
+}     /* ReadHeaderBytes */
+
+
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : ReadNiftiHeader
+@INPUT      : Filename - a .nii or .hdr file (or the .img of a .hdr/.img
+                pair, whose .hdr is then read), possibly gzip'd
+@OUTPUT     : *Hdr - the header, in this machine's byte order
+              *Swapped - TRUE if the file is of the other byte order
+                (so its image will need swapping too)
+@RETURNS    : ERR_NONE if all went well
+              ERR_NO_MEM if out of memory
+              ERR_IN_NIFTI if the file can't be read or isn't NIfTI-1 (or
+                Analyze); ErrMsg is set
+@DESCRIPTION: Reads just the header of a NIfTI-1 file.  gzip'd files are
+              read through zlib, which stops after the first few blocks,
+              so this is as cheap for a .nii.gz as for a .nii.
+@METHOD     : The byte order is found as load_nii_hdr does: sizeof_hdr
+              must be 348 one way round or the other.
+@GLOBALS    : ErrMsg
+@CALLS      : ReadHeaderBytes, SwapHeader
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+int ReadNiftiHeader (char Filename[], NiftiHeader *Hdr, Boolean *Swapped)
+{
+   char    *HdrFile;
+   int      Length;
+   int      Result;
+
+   Result = ReadHeaderBytes (Filename, Hdr, NIFTI_HEADER_SIZE,
+                             &Length, &HdrFile);
+   if (Result != ERR_NONE)
+   {
+      return (Result);
+   }
+
+   *Swapped = FALSE;
+   if ((Length == NIFTI_HEADER_SIZE) &&
+       (Hdr->sizeof_hdr != NIFTI_HEADER_SIZE))
+   {
+      SwapHeader (Hdr);
+      *Swapped = TRUE;
+   }
+
+   if ((Length != NIFTI_HEADER_SIZE) ||
+       (Hdr->sizeof_hdr != NIFTI_HEADER_SIZE))
+   {
+      sprintf (ErrMsg, "%s is not a NIfTI or Analyze file", HdrFile);
+      free (HdrFile);
+      return (ERR_IN_NIFTI);
+   }
+
+   free (HdrFile);
+   return (ERR_NONE);
+
+}     /* ReadNiftiHeader */
+
+
+
+/*
+ * Fields of a NIfTI-2 header (nifti_2_header in nifti2.h), fetched by
+ * byte offset from the raw header so that no struct layout need be
+ * trusted for its 64-bit members.
+ */
+
+#define N2_DATATYPE       12
+#define N2_DIM            16
+#define N2_PIXDIM        104
+#define N2_VOX_OFFSET    168
+#define N2_SCL_SLOPE     176
+#define N2_SCL_INTER     184
+#define N2_QFORM_CODE    344
+#define N2_SFORM_CODE    348
+#define N2_QUATERN_B     352
+#define N2_SROW_X        400
+
+static long Raw2 (unsigned char *Raw, int Offset, Boolean Swapped)
+{
+   short      x;
+
+   memcpy (&x, Raw + Offset, 2);
+   if (Swapped) Swap2 (&x, 1);
+   return ((long) x);
+}
+
+static long Raw4 (unsigned char *Raw, int Offset, Boolean Swapped)
+{
+   int        x;
+
+   memcpy (&x, Raw + Offset, 4);
+   if (Swapped) Swap4 (&x, 1);
+   return ((long) x);
+}
+
+static long Raw8 (unsigned char *Raw, int Offset, Boolean Swapped)
+{
+   long long  x;
+
+   memcpy (&x, Raw + Offset, 8);
+   if (Swapped) Swap8 (&x, 1);
+   return ((long) x);
+}
+
+static double RawDouble (unsigned char *Raw, int Offset, Boolean Swapped)
+{
+   double     x;
+
+   memcpy (&x, Raw + Offset, 8);
+   if (Swapped) Swap8 (&x, 1);
+   return (x);
+}
+
+
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : SetNifti1Info, SetNifti2Info
+@INPUT      : Raw - the header as read from the file
+              Swapped - whether it is of the other byte order
+@OUTPUT     : *Info - version, dimensions, type, offset, scaling and
+                geometry, as the header has them
+@RETURNS    : (void)
+@DESCRIPTION: Fill in an NiftiInfoRec from either kind of header; the
+              rest is done by GetNiftiInfo.
+@METHOD     :
+@GLOBALS    :
+@CALLS      : SwapHeader, Raw2, Raw4, Raw8, RawDouble
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+static void SetNifti1Info (unsigned char *Raw, Boolean Swapped,
+                           NiftiInfoRec *Info)
+{
+   NiftiHeader  Hdr;
+   double      *g;
+   int          i;
+
+   memcpy (&Hdr, Raw, NIFTI_HEADER_SIZE);
+   if (Swapped)
+   {
+      SwapHeader (&Hdr);
+   }
+
+   Info->Version = 1;
+   for (i = 0; i < 8; i++)
+   {
+      Info->Dim [i] = Hdr.dim [i];
+   }
+   Info->DataType = Hdr.datatype;
+   Info->VoxOffset = (long) Hdr.vox_offset;
+   Info->Slope = Hdr.scl_slope;
+   Info->Inter = Hdr.scl_inter;
+
+   g = Info->Geometry;
+   *g++ = Hdr.qform_code;
+   *g++ = Hdr.sform_code;
+   for (i = 0; i < 4; i++)
+      *g++ = Hdr.pixdim [i];
+   *g++ = Hdr.quatern_b;
+   *g++ = Hdr.quatern_c;
+   *g++ = Hdr.quatern_d;
+   *g++ = Hdr.qoffset_x;
+   *g++ = Hdr.qoffset_y;
+   *g++ = Hdr.qoffset_z;
+   for (i = 0; i < 4; i++)
+      *g++ = Hdr.srow_x [i];
+   for (i = 0; i < 4; i++)
+      *g++ = Hdr.srow_y [i];
+   for (i = 0; i < 4; i++)
+      *g++ = Hdr.srow_z [i];
+}
+
+static void SetNifti2Info (unsigned char *Raw, Boolean Swapped,
+                           NiftiInfoRec *Info)
+{
+   double      *g;
+   int          i;
+
+   Info->Version = 2;
+   for (i = 0; i < 8; i++)
+   {
+      Info->Dim [i] = Raw8 (Raw, N2_DIM + 8*i, Swapped);
+   }
+   Info->DataType = (int) Raw2 (Raw, N2_DATATYPE, Swapped);
+   Info->VoxOffset = Raw8 (Raw, N2_VOX_OFFSET, Swapped);
+   Info->Slope = RawDouble (Raw, N2_SCL_SLOPE, Swapped);
+   Info->Inter = RawDouble (Raw, N2_SCL_INTER, Swapped);
+
+   /* quatern_b..qoffset_z and the srow_* follow each other as doubles */
+
+   g = Info->Geometry;
+   *g++ = Raw4 (Raw, N2_QFORM_CODE, Swapped);
+   *g++ = Raw4 (Raw, N2_SFORM_CODE, Swapped);
+   for (i = 0; i < 4; i++)
+      *g++ = RawDouble (Raw, N2_PIXDIM + 8*i, Swapped);
+   for (i = 0; i < 6; i++)
+      *g++ = RawDouble (Raw, N2_QUATERN_B + 8*i, Swapped);
+   for (i = 0; i < 12; i++)
+      *g++ = RawDouble (Raw, N2_SROW_X + 8*i, Swapped);
+}     /* SetNifti1Info, SetNifti2Info */
+
+
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : GetNiftiInfo
+@INPUT      : Filename - a NIfTI-1 or NIfTI-2 file: a .nii, or either
+                half of a .hdr/.img pair, possibly gzip'd
+@OUTPUT     : *Info - what is needed to read the image (see niftiutil.h)
+@RETURNS    : ERR_NONE if all went well
+              ERR_NO_MEM if out of memory
+              ERR_IN_NIFTI if the file can't be read, isn't NIfTI (or
+                Analyze), or is of a data type we can't read (ErrMsg is
+                set)
+@DESCRIPTION: Reads just the header of a NIfTI file, of either version,
+              and works out where its image is and how it is to be
+              scaled.  The scaling is that of load_nii (xform_nii):
+              scl_slope and scl_inter are applied only if the slope is
+              non-zero and they are not 1 and 0, and the result is then
+              rounded to single precision unless the file holds doubles.
+              Free Info with FreeNiftiInfo.
+@METHOD     : The version and byte order are both found from sizeof_hdr,
+              which is 348 or 540 one way round or the other.
+@GLOBALS    : ErrMsg
+@CALLS      : ReadHeaderBytes, SetNifti1Info, SetNifti2Info
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+int GetNiftiInfo (char Filename[], NiftiInfoRec *Info)
+{
+   unsigned char  Raw [NIFTI2_HEADER_SIZE];
+   char          *HdrFile;
+   char          *Ext;
+   int            Length;
+   int            Size;
+   int            Reversed;       /* Size, byte-swapped */
+   int            Result;
+   int            i;
+
+   memset (Info, 0, sizeof (NiftiInfoRec));
+   Result = ReadHeaderBytes (Filename, Raw, NIFTI2_HEADER_SIZE,
+                             &Length, &HdrFile);
+   if (Result != ERR_NONE)
+   {
+      return (Result);
+   }
+
+   Size = 0;
+   if (Length >= 4)
+   {
+      memcpy (&Size, Raw, 4);
+      memcpy (&Reversed, Raw, 4);
+      Swap4 (&Reversed, 1);
+   }
+
+   if ((Length >= NIFTI_HEADER_SIZE) &&
+       ((Size == NIFTI_HEADER_SIZE) || (Reversed == NIFTI_HEADER_SIZE)))
+   {
+      SetNifti1Info (Raw, (Size != NIFTI_HEADER_SIZE), Info);
+   }
+   else if ((Length == NIFTI2_HEADER_SIZE) &&
+            ((Size == NIFTI2_HEADER_SIZE) || (Reversed == NIFTI2_HEADER_SIZE)))
+   {
+      SetNifti2Info (Raw, (Size != NIFTI2_HEADER_SIZE), Info);
+   }
+   else
+   {
+      sprintf (ErrMsg, "%s is not a NIfTI or Analyze file", HdrFile);
+      free (HdrFile);
+      return (ERR_IN_NIFTI);
+   }
+   Info->Swapped = (Size != NIFTI_HEADER_SIZE) && (Size != NIFTI2_HEADER_SIZE);
+
+   Info->TypeSize = NiftiTypeSize (Info->DataType);
+   if ((Info->TypeSize == 0) || (Info->VoxOffset < 0))
+   {
+      sprintf (ErrMsg, "Can't read NIfTI data type %d from %s",
+               Info->DataType, HdrFile);
+      free (HdrFile);
+      return (ERR_IN_NIFTI);
+   }
+
+   /* Unused dimensions count as 1 */
+
+   Info->NumVolumes = 1;
+   for (i = 1; i < 8; i++)
+   {
+      if ((i > Info->Dim [0]) || (Info->Dim [i] < 1))
+      {
+         Info->Dim [i] = 1;
+      }
+      if (i > 3)
+      {
+         Info->NumVolumes *= Info->Dim [i];
+      }
+   }
+
+   if ((Info->Slope != 0) && ((Info->Slope != 1) || (Info->Inter != 0)))
+   {
+      Info->RoundToFloat = (Info->DataType != NIFTI_FLOAT64);
+   }
+   else
+   {
+      Info->Slope = 1;
+      Info->Inter = 0;
+   }
+
+   /* The image of foo.hdr[.gz] is in foo.img[.gz] */
+
+   Ext = strstr (HdrFile, ".hdr");
+   if ((Ext != NULL) &&
+       ((strcmp (Ext, ".hdr") == 0) || (strcmp (Ext, ".hdr.gz") == 0)))
+   {
+      memcpy (Ext, ".img", 4);
+   }
+   Length = (int) strlen (HdrFile);
+   Info->Compressed = (Length > 3) &&
+                      (strcmp (HdrFile + Length - 3, ".gz") == 0);
+   Info->ImageFile = HdrFile;
+
+   return (ERR_NONE);
+
+}     /* GetNiftiInfo */
+
+
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : SameNiftiGeometry
+@INPUT      : A, B - from GetNiftiInfo
+@OUTPUT     :
+@RETURNS    : TRUE if the first three dimensions and the orientation of
+              the two files are the same
+@DESCRIPTION: Files for which this is TRUE have their voxels in the same
+              order on disk, so one mask index does for both.
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+Boolean SameNiftiGeometry (NiftiInfoRec *A, NiftiInfoRec *B)
+{
+   int      i;
+
+   for (i = 1; i <= 3; i++)
+   {
+      if (A->Dim [i] != B->Dim [i])
+      {
+         return (FALSE);
+      }
+   }
+   for (i = 0; i < NIFTI_GEOMETRY; i++)
+   {
+      if (A->Geometry [i] != B->Geometry [i])
+      {
+         return (FALSE);
+      }
+   }
+   return (TRUE);
+}     /* SameNiftiGeometry */
+
+
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : MapNiftiImage
+@INPUT      : *Info - from GetNiftiInfo
+              FirstVolume, EndVolume - the (zero-based) volumes to map:
+                FirstVolume .. EndVolume-1
+@OUTPUT     : *Info - Map, MapLength, MapData and MapFirst are set
+@RETURNS    : ERR_NONE if all went well
+              ERR_IN_NIFTI if the image is gzip'd, can't be mapped, or is
+                too short for the header's dimensions (ErrMsg is set)
+@DESCRIPTION: Memory-maps (read-only) some consecutive volumes of an
+              uncompressed image file.  Nothing is read until the pages
+              are touched, so gathering a mask's voxels from the map reads
+              only the pages they are on.  The map is undone by
+              FreeNiftiInfo.
+@METHOD     : The kernel is told the map will be read in order, as
+              GatherNiftiMasked does, so it reads ahead generously.
+@GLOBALS    : ErrMsg
+@CALLS      : mmap
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+int MapNiftiImage (NiftiInfoRec *Info, long FirstVolume, long EndVolume)
+{
+   struct stat  Stat;
+   long         VolumeBytes;
+   long         Start, End;      /* bytes of the file wanted */
+   long         MapStart;        /* Start, rounded down to a page */
+   void        *Map;
+   int          fd;
+
+   if (Info->Compressed)
+   {
+      sprintf (ErrMsg, "%s is compressed, and can't be memory-mapped",
+               Info->ImageFile);
+      return (ERR_IN_NIFTI);
+   }
+   if ((FirstVolume < 0) || (EndVolume > Info->NumVolumes) ||
+       (FirstVolume >= EndVolume))
+   {
+      sprintf (ErrMsg, "No volume %ld in %s (it has %ld)", EndVolume,
+               Info->ImageFile, Info->NumVolumes);
+      return (ERR_IN_NIFTI);
+   }
+
+   VolumeBytes = Info->Dim [1] * Info->Dim [2] * Info->Dim [3] *
+                 Info->TypeSize;
+   Start = Info->VoxOffset + FirstVolume * VolumeBytes;
+   End = Info->VoxOffset + EndVolume * VolumeBytes;
+   MapStart = Start - Start % sysconf (_SC_PAGESIZE);
+
+   fd = open (Info->ImageFile, O_RDONLY);
+   if (fd < 0)
+   {
+      sprintf (ErrMsg, "Error opening NIfTI image %s", Info->ImageFile);
+      return (ERR_IN_NIFTI);
+   }
+   if ((fstat (fd, &Stat) != 0) || ((long) Stat.st_size < End))
+   {
+      close (fd);
+      sprintf (ErrMsg, "NIfTI image %s is shorter than its header says",
+               Info->ImageFile);
+      return (ERR_IN_NIFTI);
+   }
+
+   Map = mmap (NULL, (size_t) (End - MapStart), PROT_READ, MAP_PRIVATE,
+               fd, (off_t) MapStart);
+   close (fd);                      /* the map keeps the file open */
+   if (Map == MAP_FAILED)
+   {
+      sprintf (ErrMsg, "Error mapping NIfTI image %s", Info->ImageFile);
+      return (ERR_IN_NIFTI);
+   }
+   (void) posix_madvise (Map, (size_t) (End - MapStart),
+                         POSIX_MADV_SEQUENTIAL);
+
+   Info->Map = Map;
+   Info->MapLength = End - MapStart;
+   Info->MapData = (unsigned char *) Map + (Start - MapStart);
+   Info->MapFirst = FirstVolume;
+   return (ERR_NONE);
+
+}     /* MapNiftiImage */
+
+
+
+/*
+ * Gather masked voxels First..End-1 of type intype from Data (which
+ * holds the image from voxel Base on), byte-swapping if need be, scale
+ * them and store them as doubles or floats.
+ */
+
+#define GATHER(intype, swap)                                         \
+   {                                                                 \
+      intype   x;                                                    \
+                                                                     \
+      for (k = First; k < End; k++)                                  \
+      {                                                              \
+         memcpy (&x, Data + (Index [k] - Base) * sizeof (intype),    \
+                 sizeof (intype));                                   \
+         if (Info->Swapped) swap;                                    \
+         v = (double) x * Slope + Inter;                             \
+         v = Info->RoundToFloat ? (double) (float) v : v;            \
+         if (IsFloat)                                                \
+            ((float *) Out) [k * Stride] = (float) v;                \
+         else                                                        \
+            ((double *) Out) [k * Stride] = v;                       \
+      }                                                              \
+   }
+
+
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : GatherVoxels
+@INPUT      : *Info - from GetNiftiInfo
+              Data - part of the image, starting at voxel Base
+              Index - zero-based, ascending voxel indices into the first
+                volume, in file order
+              First, End - the range of Index to gather; all must lie
+                in Data
+              IsFloat - TRUE to store floats in Out, rather than doubles
+              Stride - distance between elements of Out
+@OUTPUT     : Out - values First..End-1, Stride elements apart
+@RETURNS    : (void)
+@DESCRIPTION: Converts, byte-swaps and scales masked voxels -- giving the
+              same values load_nii would -- on their way from the image
+              to Out.
+@METHOD     : One simple loop per type (see GATHER).
+@GLOBALS    :
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+static void GatherVoxels (NiftiInfoRec *Info, unsigned char *Data, long Base,
+                          long Index[], long First, long End,
+                          Boolean IsFloat, void *Out, long Stride)
+{
+   double          Slope = Info->Slope;
+   double          Inter = Info->Inter;
+   double          v;
+   long            k;
+
+   switch (Info->DataType)
+   {
+      case NIFTI_UINT8:   GATHER (unsigned char, (void) 0)            break;
+      case NIFTI_INT8:    GATHER (signed char, (void) 0)              break;
+      case NIFTI_INT16:   GATHER (short, Swap2 (&x, 1))               break;
+      case NIFTI_UINT16:  GATHER (unsigned short, Swap2 (&x, 1))      break;
+      case NIFTI_INT32:   GATHER (int, Swap4 (&x, 1))                 break;
+      case NIFTI_UINT32:  GATHER (unsigned int, Swap4 (&x, 1))        break;
+      case NIFTI_FLOAT32: GATHER (float, Swap4 (&x, 1))               break;
+      case NIFTI_FLOAT64: GATHER (double, Swap8 (&x, 1))              break;
+   }
+}     /* GatherVoxels */
+
+
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : RowStart, CopyRow
+@INPUT      : Out - an output matrix of doubles (or floats, if IsFloat)
+              Row - one of its rows
+              From, To - two of its rows; NumVoxels - its columns
+              Stride - its number of rows
+@OUTPUT     : (CopyRow) Out - with row From copied to row To
+@RETURNS    : (RowStart) the address of Out's first element in Row
+@DESCRIPTION: Helpers for placing one volume's masked voxels in a row of
+              the output.
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+static void *RowStart (void *Out, Boolean IsFloat, long Row)
+{
+   return ((char *) Out + Row * (IsFloat ? sizeof (float) : sizeof (double)));
+}
+
+static void CopyRow (void *Out, Boolean IsFloat, long From, long To,
+                     long NumVoxels, long Stride)
+{
+   long     k;
+
+   if (IsFloat)
+   {
+      float  *p = (float *) Out;
+
+      for (k = 0; k < NumVoxels; k++)
+         p [k*Stride + To] = p [k*Stride + From];
+   }
+   else
+   {
+      double *p = (double *) Out;
+
+      for (k = 0; k < NumVoxels; k++)
+         p [k*Stride + To] = p [k*Stride + From];
+   }
+}     /* RowStart, CopyRow */
+
+
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : GatherNiftiMasked
+@INPUT      : *Info - from GetNiftiInfo and MapNiftiImage
+              Volume - which (mapped) volume to gather from
+              Index - zero-based, ascending voxel indices into a volume,
+                in file order
+              NumVoxels - number of elements of Index
+              IsFloat - TRUE to store floats in Out, rather than doubles
+              Row, Stride - where the values go in Out: the row, and
+                the number of rows, of a matrix with one row per file
+@OUTPUT     : Out - NumVoxels values, in row Row
+@RETURNS    : (void)
+@DESCRIPTION: Copies the masked voxels straight from the mapped file to
+              Out.  Needs no memory of its own.
+@METHOD     :
+@GLOBALS    :
+@CALLS      : GatherVoxels
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+void GatherNiftiMasked (NiftiInfoRec *Info, long Volume, long Index[],
+                        long NumVoxels, Boolean IsFloat,
+                        void *Out, long Row, long Stride)
+{
+   long     VolumeBytes;
+
+   VolumeBytes = Info->Dim [1] * Info->Dim [2] * Info->Dim [3] *
+                 Info->TypeSize;
+   GatherVoxels (Info, Info->MapData + (Volume - Info->MapFirst) * VolumeBytes,
+                 0, Index, 0, NumVoxels, IsFloat,
+                 RowStart (Out, IsFloat, Row), Stride);
+}     /* GatherNiftiMasked */
+
+
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : SkipBytes
+@INPUT      : File - an open gzip stream
+              Buffer - scratch space of Size bytes
+              Bytes - how many bytes to inflate and drop
+@OUTPUT     :
+@RETURNS    : TRUE if all went well, FALSE if the stream ended early
+@DESCRIPTION: Moves forward in a gzip stream; there is no other way to
+              get there than by inflating everything in between.
+@METHOD     :
+@GLOBALS    :
+@CALLS      : zlib
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+static Boolean SkipBytes (gzFile File, unsigned char *Buffer, long Size,
+                          long Bytes)
+{
+   long     N;
+
+   for (; Bytes > 0; Bytes -= N)
+   {
+      N = min (Bytes, Size);
+      if (gzread (File, Buffer, (unsigned) N) != (int) N)
+      {
+         return (FALSE);
+      }
+   }
+   return (TRUE);
+}     /* SkipBytes */
+
+
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : StreamNiftiMasked
+@INPUT      : *Info - from GetNiftiInfo (the image may be gzip'd or not)
+              Volumes - the (zero-based) volumes to read, in ascending
+                order (repeats are allowed)
+              Rows - the row of Out for each volume
+              Count - number of elements of Volumes and Rows
+              Index, NumVoxels, IsFloat, Stride - as for GatherNiftiMasked
+@OUTPUT     : Out - NumVoxels values in each of the given rows
+@RETURNS    : ERR_NONE if all went well
+              ERR_NO_MEM if the inflate buffer could not be allocated
+              ERR_IN_NIFTI if the image can't be opened or is too short
+              (ErrMsg is NOT set, so that this can run alongside other
+              threads; the caller must say what went wrong)
+@DESCRIPTION: The counterpart of MapNiftiImage and GatherNiftiMasked for
+              a compressed image, which can't be mapped: the gzip stream
+              is inflated once, in order, STREAM_VOXELS voxels at a time,
+              and the masked voxels of each wanted volume are picked out
+              of each piece as it goes by.  Nothing is written to disk,
+              no more than one piece is held in memory, and inflating
+              stops at the last masked voxel of the last volume; so a
+              4-D file holding a whole cohort is read in a single pass.
+@METHOD     :
+@GLOBALS    :
+@CALLS      : zlib, SkipBytes, GatherVoxels, CopyRow
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+int StreamNiftiMasked (NiftiInfoRec *Info, long Volumes[], long Rows[],
+                       long Count, long Index[], long NumVoxels,
+                       Boolean IsFloat, void *Out, long Stride)
+{
+   unsigned char  *Buffer;
+   long            BufferBytes;
+   gzFile          File;
+   long            VolumeVoxels;
+   long            Pos;           /* voxels of the image inflated so far */
+   long            Start;         /* first voxel (of the volume) in Buffer */
+   long            N;             /* number of voxels in Buffer */
+   long            First, End;
+   long            v;
+   Boolean         Ok;
+
+   if ((NumVoxels == 0) || (Count == 0))
+   {
+      return (ERR_NONE);
+   }
+
+   BufferBytes = STREAM_VOXELS * Info->TypeSize;
+   Buffer = (unsigned char *) malloc (BufferBytes);
+   if (Buffer == NULL)
+   {
+      return (ERR_NO_MEM);
+   }
+
+   File = gzopen (Info->ImageFile, "rb");
+   if (File == NULL)
+   {
+      free (Buffer);
+      return (ERR_IN_NIFTI);
+   }
+   (void) gzbuffer (File, STREAM_BUFFER);
+
+   /* Inflate (and drop) the header and any extensions */
+
+   Ok = SkipBytes (File, Buffer, BufferBytes, Info->VoxOffset);
+
+   VolumeVoxels = Info->Dim [1] * Info->Dim [2] * Info->Dim [3];
+   Pos = 0;
+   for (v = 0; Ok && (v < Count); v++)
+   {
+      if ((v > 0) && (Volumes [v] == Volumes [v-1]))
+      {
+         CopyRow (Out, IsFloat, Rows [v-1], Rows [v], NumVoxels, Stride);
+         continue;
+      }
+
+      /* Inflate up to the start of the volume ... */
+
+      Ok = SkipBytes (File, Buffer, BufferBytes,
+                      (Volumes [v] * VolumeVoxels - Pos) * Info->TypeSize);
+      Pos = Volumes [v] * VolumeVoxels;
+
+      /* ... then through it, up to its last masked voxel */
+
+      First = 0;
+      for (Start = 0; Ok && (First < NumVoxels); Start += N)
+      {
+         N = min (STREAM_VOXELS, Index [NumVoxels-1] + 1 - Start);
+         Ok = (gzread (File, Buffer, (unsigned) (N * Info->TypeSize))
+               == (int) (N * Info->TypeSize));
+         if (Ok)
+         {
+            for (End = First; (End < NumVoxels) && (Index [End] < Start + N);
+                 End++)
+               ;
+            GatherVoxels (Info, Buffer, Start, Index, First, End, IsFloat,
+                          RowStart (Out, IsFloat, Rows [v]), Stride);
+            First = End;
+         }
+      }
+      Pos += Start;
+   }
+
+   gzclose (File);
+   free (Buffer);
+   return (Ok ? ERR_NONE : ERR_IN_NIFTI);
+
+}     /* StreamNiftiMasked */
+
+
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : FreeNiftiInfo
+@INPUT      : *Info - from GetNiftiInfo (whether or not it succeeded)
+@OUTPUT     : *Info - with its map undone and filename freed
+@RETURNS    : (void)
+@DESCRIPTION: Safe to call more than once.
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+void FreeNiftiInfo (NiftiInfoRec *Info)
+{
+   if (Info->Map != NULL)
+   {
+      munmap (Info->Map, (size_t) Info->MapLength);
+   }
+   free (Info->ImageFile);
+   Info->Map = NULL;
+   Info->MapData = NULL;
+   Info->ImageFile = NULL;
+}     /* FreeNiftiInfo */
+
+
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : ReadNiftiTask
+@INPUT      : Task - index of the group of entries to read (see
+                ReadNiftiMaskedFiles)
+              Thread - (unused)
+              Arg - the NiftiReadRec
+@OUTPUT     : the rows of Read->Out for those entries
+@RETURNS    : (void)
+@DESCRIPTION: Reads the masked voxels of a group of volumes of one file,
+              for RunTasks.  The header is read and the volumes mapped
+              under LockSerial, since that is where ErrMsg may be set;
+              the voxels are then gathered (or, for a gzip'd image,
+              inflated and gathered) in parallel with the other threads.
+              Once any file has failed, the rest are skipped.
+@METHOD     :
+@GLOBALS    : ErrMsg
+@CALLS      : GetNiftiInfo, SameNiftiGeometry, MapNiftiImage,
+              GatherNiftiMasked, StreamNiftiMasked, FreeNiftiInfo
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+static void ReadNiftiTask (long Task, int Thread, void *Arg)
+{
+   NiftiReadRec  *Read = (NiftiReadRec *) Arg;
+   NiftiInfoRec   Info;
+   long           First, Count;
+   long          *Volumes;
+   long          *Rows;
+   long           Failed;
+   long           i;
+   int            Result;
+
+   First = Read->TaskFirst [Task];
+   Count = Read->TaskFirst [Task+1] - First;
+   Volumes = Read->Volumes + First;
+   Rows = Read->Rows + First;
+   Failed = Rows [0];
+
+   memset (&Info, 0, sizeof (NiftiInfoRec));
+   LockSerial ();
+   Result = Read->Result;
+   if (Result == ERR_NONE)
+   {
+      Result = GetNiftiInfo (Read->Filenames [Rows [0]], &Info);
+      if ((Result == ERR_NONE) && !SameNiftiGeometry (Read->First, &Info))
+      {
+         sprintf (ErrMsg, "Dimensions or orientation differ from those of %s",
+                  Read->Filenames [0]);
+         Result = ERR_IN_NIFTI;
+      }
+      if ((Result == ERR_NONE) && (Volumes [Count-1] >= Info.NumVolumes))
+      {
+         sprintf (ErrMsg, "No volume %ld in the file (it has %ld)",
+                  Volumes [Count-1] + 1, Info.NumVolumes);
+         Failed = Rows [Count-1];
+         Result = ERR_IN_NIFTI;
+      }
+      if ((Result == ERR_NONE) && !Info.Compressed)
+      {
+         Result = MapNiftiImage (&Info, Volumes [0], Volumes [Count-1] + 1);
+      }
+      if (Result != ERR_NONE)
+      {
+         Read->Result = Result;
+         Read->Failed = Failed;
+      }
+   }
+   UnlockSerial ();
+
+   if (Result != ERR_NONE)
+   {
+      FreeNiftiInfo (&Info);
+      return;
+   }
+
+   if (!Info.Compressed)
+   {
+      for (i = 0; i < Count; i++)
+      {
+         GatherNiftiMasked (&Info, Volumes [i], Read->Index, Read->NumVoxels,
+                            Read->IsFloat, Read->Out, Rows [i],
+                            Read->NumFiles);
+      }
+   }
+   else
+   {
+      Result = StreamNiftiMasked (&Info, Volumes, Rows, Count,
+                                  Read->Index, Read->NumVoxels,
+                                  Read->IsFloat, Read->Out, Read->NumFiles);
+      if (Result != ERR_NONE)
+      {
+         LockSerial ();
+         if (Read->Result == ERR_NONE)
+         {
+            if (Result == ERR_NO_MEM)
+               sprintf (ErrMsg, "Out of memory inflating NIfTI image");
+            else
+               sprintf (ErrMsg, "Error reading compressed NIfTI image %s",
+                        Info.ImageFile);
+            Read->Result = Result;
+            Read->Failed = Failed;
+         }
+         UnlockSerial ();
+      }
+   }
+   FreeNiftiInfo (&Info);
+
+}     /* ReadNiftiTask */
+
+
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : CompareEntries
+@INPUT      : a, b - two NiftiEntryRecs
+@OUTPUT     :
+@RETURNS    : <0, 0 or >0, for qsort
+@DESCRIPTION: Orders entries by file, then volume, then row; so the
+              volumes of each file come together, in the order they are
+              stored.
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+static int CompareEntries (const void *a, const void *b)
+{
+   const NiftiEntryRec *A = (const NiftiEntryRec *) a;
+   const NiftiEntryRec *B = (const NiftiEntryRec *) b;
+   int                  c;
+
+   c = strcmp (A->Filename, B->Filename);
+   if (c != 0)
+      return (c);
+   if (A->Volume != B->Volume)
+      return ((A->Volume < B->Volume) ? -1 : 1);
+   return ((A->Row < B->Row) ? -1 : (A->Row > B->Row));
+}     /* CompareEntries */
+
+
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : ReadNiftiMaskedFiles
+@INPUT      : Filenames - the NIfTI files to read (gzip'd or not); the
+                same file may be named more than once
+              NumFiles - how many of them
+              Volumes - the zero-based volume to read from each file (for
+                files of more than three dimensions, eg. one subject per
+                volume of a 4-D file), or NULL to read the first of each
+              Index - zero-based, strictly ascending voxel indices into
+                a volume (in file order)
+              NumVoxels - number of elements of Index
+              IsFloat - TRUE if Out is of floats rather than doubles
+              NumThreads - number of threads to read the files with
+@OUTPUT     : Out - a NumFiles x NumVoxels matrix (column major) of the
+                masked voxels
+              *Failed - index of the file that failed (if any)
+@RETURNS    : ERR_NONE if all went well
+              ERR_ARGS if the mask index points outside the first file's
+                volume
+              ERR_NO_MEM if out of memory
+              otherwise, the error from the first file to fail
+              (ErrMsg is set on error)
+@DESCRIPTION: Reads the masked voxels from every file, using a pool of
+              NumThreads threads; so several gzip'd files are inflated
+              at once.  The first file sets the geometry the mask index
+              refers to; every other file must have the same dimensions
+              and orientation.
+
+              The entries are first sorted by file and volume.  All the
+              volumes wanted from one gzip'd file are then read by one
+              task, in a single pass through the stream; those of an
+              uncompressed file are mapped and gathered up to
+              MAP_VOLUMES at a time, so a 4-D file is still read by
+              several threads.
+@METHOD     : See MapNiftiImage, GatherNiftiMasked and StreamNiftiMasked.
+@GLOBALS    : ErrMsg
+@CALLS      : GetNiftiInfo, CompareEntries, RunTasks, ReadNiftiTask
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+int ReadNiftiMaskedFiles (char *Filenames[], long NumFiles, long Volumes[],
+                          long Index[], long NumVoxels, Boolean IsFloat,
+                          int NumThreads, void *Out, long *Failed)
+{
+   NiftiReadRec   Read;
+   NiftiInfoRec   First;
+   NiftiEntryRec *Entries;
+   long           Volume;
+   long           NumTasks;
+   long           e;
+   size_t         Length;
+   Boolean        Compressed;
+   int            Result;
+
+   *Failed = -1;
+   if (NumFiles == 0)
+   {
+      return (ERR_NONE);
+   }
+
+   Result = GetNiftiInfo (Filenames [0], &First);
+   if (Result != ERR_NONE)
+   {
+      *Failed = 0;
+      return (Result);
+   }
+
+   Volume = First.Dim [1] * First.Dim [2] * First.Dim [3];
+   if ((NumVoxels > 0) && (Index [NumVoxels-1] >= Volume))
+   {
+      FreeNiftiInfo (&First);
+      sprintf (ErrMsg, "Mask index out of range (volume has %ld voxels)",
+               Volume);
+      return (ERR_ARGS);
+   }
+
+   Entries = (NiftiEntryRec *) malloc (NumFiles * sizeof (NiftiEntryRec));
+   Read.Volumes = (long *) malloc (NumFiles * sizeof (long));
+   Read.Rows = (long *) malloc (NumFiles * sizeof (long));
+   Read.TaskFirst = (long *) malloc ((NumFiles + 1) * sizeof (long));
+   if ((Entries == NULL) || (Read.Volumes == NULL) ||
+       (Read.Rows == NULL) || (Read.TaskFirst == NULL))
+   {
+      free (Entries);
+      free (Read.Volumes);
+      free (Read.Rows);
+      free (Read.TaskFirst);
+      FreeNiftiInfo (&First);
+      sprintf (ErrMsg, "Out of memory for a list of %ld files", NumFiles);
+      return (ERR_NO_MEM);
+   }
+
+   /*
+    * Sort the entries, and cut them into tasks: a new task starts at
+    * every new file and, for uncompressed files, every MAP_VOLUMES
+    * volumes.
+    */
+
+   for (e = 0; e < NumFiles; e++)
+   {
+      Entries [e].Filename = Filenames [e];
+      Entries [e].Volume = (Volumes == NULL) ? 0 : Volumes [e];
+      Entries [e].Row = e;
+   }
+   qsort (Entries, NumFiles, sizeof (NiftiEntryRec), CompareEntries);
+
+   NumTasks = 0;
+   for (e = 0; e < NumFiles; e++)
+   {
+      Length = strlen (Entries [e].Filename);
+      Compressed = (Length > 3) &&
+                   (strcmp (Entries [e].Filename + Length - 3, ".gz") == 0);
+      if ((e == 0) ||
+          (strcmp (Entries [e].Filename, Entries [e-1].Filename) != 0) ||
+          (!Compressed && (e - Read.TaskFirst [NumTasks-1] >= MAP_VOLUMES)))
+      {
+         Read.TaskFirst [NumTasks++] = e;
+      }
+      Read.Volumes [e] = Entries [e].Volume;
+      Read.Rows [e] = Entries [e].Row;
+   }
+   Read.TaskFirst [NumTasks] = NumFiles;
+   free (Entries);
+
+   Read.Filenames = Filenames;
+   Read.NumFiles = NumFiles;
+   Read.Index = Index;
+   Read.NumVoxels = NumVoxels;
+   Read.IsFloat = IsFloat;
+   Read.Out = Out;
+   Read.First = &First;
+   Read.Result = ERR_NONE;
+   Read.Failed = -1;
+
+   NumThreads = (int) min (min (max (NumThreads, 1), NumTasks), MAX_THREADS);
+   (void) RunTasks (NumTasks, NumThreads, ReadNiftiTask, &Read);
+   FreeNiftiInfo (&First);
+   free (Read.Volumes);
+   free (Read.Rows);
+   free (Read.TaskFirst);
+
+   *Failed = Read.Failed;
+   return (Read.Result);
+
+}     /* ReadNiftiMaskedFiles */
+
+
+
+/*
+ * Convert N values (of type intype) to a floating-point or an integer
+ * outtype.  Integers are rounded to nearest (halves away from zero) and
+ * saturated, and NaN becomes 0 -- the same as MATLAB's fwrite, which
+ * is how save_nii writes them.
+ */
+
+#define CONVERT_FLOAT(intype, outtype)                               \
+   {                                                                 \
+      intype   *In = (intype *) Values;                              \
+      outtype  *Out = (outtype *) Buffer;                            \
+                                                                     \
+      for (i = 0; i < N; i++)                                        \
+      {                                                              \
+         Out [i] = (outtype) In [i];                                 \
+      }                                                              \
+   }
+
+#define CONVERT_INT(intype, outtype, lo, hi)                         \
+   {                                                                 \
+      intype   *In = (intype *) Values;                              \
+      outtype  *Out = (outtype *) Buffer;                            \
+                                                                     \
+      for (i = 0; i < N; i++)                                        \
+      {                                                              \
+         v = (double) In [i];                                        \
+         v = (v != v) ? 0 : v;                                       \
+         v = (v < (lo)) ? (lo) : ((v > (hi)) ? (hi) : v);            \
+         Out [i] = (outtype) ((v < 0) ? (v - 0.5) : (v + 0.5));      \
+      }                                                              \
+   }
+
+#define CONVERT_TO(outtype, lo, hi)                                  \
+   if (IsFloat)                                                      \
+      CONVERT_INT (float, outtype, lo, hi)                           \
+   else                                                              \
+      CONVERT_INT (double, outtype, lo, hi)
+
+
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : ConvertData
+@INPUT      : Values - N doubles (or floats, if IsFloat)
+              DataType - the NIfTI type to convert to
+@OUTPUT     : Buffer - N voxels of type DataType
+@RETURNS    : (void)
+@DESCRIPTION: Converts a piece of the caller's data to the file's type.
+@METHOD     : One simple loop per pair of types (see CONVERT_INT).
+@GLOBALS    :
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+static void ConvertData (void *Values, Boolean IsFloat, long N,
+                         int DataType, void *Buffer)
+{
+   long    i;
+   double  v;
+
+   switch (DataType)
+   {
+      case NIFTI_FLOAT32:
+         if (IsFloat)
+            memcpy (Buffer, Values, N * sizeof (float));
+         else
+            CONVERT_FLOAT (double, float)
+         break;
+      case NIFTI_FLOAT64:
+         if (IsFloat)
+            CONVERT_FLOAT (float, double)
+         else
+            memcpy (Buffer, Values, N * sizeof (double));
+         break;
+      case NIFTI_UINT8:
+         CONVERT_TO (unsigned char, 0.0, 255.0)
+         break;
+      case NIFTI_INT8:
+         CONVERT_TO (signed char, -128.0, 127.0)
+         break;
+      case NIFTI_INT16:
+         CONVERT_TO (short, -32768.0, 32767.0)
+         break;
+      case NIFTI_UINT16:
+         CONVERT_TO (unsigned short, 0.0, 65535.0)
+         break;
+      case NIFTI_INT32:
+         CONVERT_TO (int, -2147483648.0, 2147483647.0)
+         break;
+      case NIFTI_UINT32:
+         CONVERT_TO (unsigned int, 0.0, 4294967295.0)
+         break;
+   }
+}     /* ConvertData */
+
+
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : GzipThread
+@INPUT      : Arg - the NiftiWriterRec
+@OUTPUT     :
+@RETURNS    : NULL
+@DESCRIPTION: The background half of writing a .nii.gz: compresses each
+              buffer as WriteNiftiData queues it, until CloseNiftiWriter
+              says there are no more.  Stops at the first failed write.
+@METHOD     :
+@GLOBALS    :
+@CALLS      : zlib
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+static void *GzipThread (void *Arg)
+{
+   NiftiWriterRec *Writer = (NiftiWriterRec *) Arg;
+   int             Slot;
+   Boolean         Ok;
+
+   for (;;)
+   {
+      pthread_mutex_lock (&Writer->Lock);
+      while ((Writer->Written == Writer->Queued) && !Writer->Done)
+      {
+         pthread_cond_wait (&Writer->Cond, &Writer->Lock);
+      }
+      if (Writer->Written == Writer->Queued)        /* done, and drained */
+      {
+         pthread_mutex_unlock (&Writer->Lock);
+         break;
+      }
+      Slot = (int) (Writer->Written % WRITE_DEPTH);
+      pthread_mutex_unlock (&Writer->Lock);
+
+      Ok = (gzwrite (Writer->GzFile, Writer->Buffer [Slot],
+                     (unsigned) Writer->Length [Slot])
+            == (int) Writer->Length [Slot]);
+
+      pthread_mutex_lock (&Writer->Lock);
+      if (Ok)
+      {
+         Writer->Written++;
+      }
+      else
+      {
+         Writer->Failed = TRUE;
+      }
+      pthread_cond_broadcast (&Writer->Cond);
+      pthread_mutex_unlock (&Writer->Lock);
+
+      if (!Ok)
+      {
+         break;
+      }
+   }
+   return (NULL);
+}     /* GzipThread */
+
+
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : FreeWriter
+@INPUT      : Writer - a writer whose files are closed and thread stopped
+@OUTPUT     :
+@RETURNS    : (void)
+@DESCRIPTION: Frees everything OpenNiftiWriter allocated.
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+static void FreeWriter (NiftiWriterRec *Writer)
+{
+   int     i;
+
+   for (i = 0; i < WRITE_DEPTH; i++)
+   {
+      free (Writer->Buffer [i]);
+   }
+   free (Writer->Filename);
+   free (Writer);
+}
+
+
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : OpenNiftiWriter
+@INPUT      : Filename - the file to create; it is gzip'd if the name
+                ends in .gz (eg. foo.nii.gz)
+              Hdr - header for the new file; its datatype says what
+                the data is to be stored as
+              BufferVoxels - the most voxels WriteNiftiData will convert
+                at a time (eg. one slice)
+@OUTPUT     : Hdr - made into a single-file (.nii) header: vox_offset,
+                magic and bitpix are set
+              *Writer - the open writer, for WriteNiftiData
+@RETURNS    : ERR_NONE if all went well
+              ERR_ARGS if Hdr's datatype is not one we can write
+              ERR_NO_MEM if out of memory
+              ERR_OUT_NIFTI if the file can't be created or written
+              (ErrMsg is set on any error)
+@DESCRIPTION: Creates a .nii file and writes its header, with no
+              extensions; the image is then written with WriteNiftiData
+              and the file closed with CloseNiftiWriter.  Everything
+              else in Hdr (dimensions, voxel sizes, transforms, scaling,
+              glmax/glmin ...) is written exactly as given, so it must
+              all be set before calling this.  For a .gz file, the
+              background gzip thread is started here.
+@METHOD     :
+@GLOBALS    : ErrMsg
+@CALLS      : zlib, GzipThread
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+int OpenNiftiWriter (char Filename[], NiftiHeader *Hdr, long BufferVoxels,
+                     NiftiWriterRec **Writer)
+{
+   NiftiWriterRec *W;
+   char            Extender [4] = {0, 0, 0, 0};
+   size_t          Length;
+   Boolean         Compressed;
+   Boolean         Ok;
+   int             i;
+
+   if (NiftiTypeSize (Hdr->datatype) == 0)
+   {
+      sprintf (ErrMsg, "Can't write NIfTI data type %d", (int) Hdr->datatype);
+      return (ERR_ARGS);
+   }
+
+   Hdr->sizeof_hdr = NIFTI_HEADER_SIZE;
+   Hdr->bitpix = (short) (8 * NiftiTypeSize (Hdr->datatype));
+   Hdr->vox_offset = (float) NIFTI_VOX_OFFSET;
+   memcpy (Hdr->magic, "n+1", 4);
+
+   Length = strlen (Filename);
+   Compressed = (Length > 3) && (strcmp (Filename + Length - 3, ".gz") == 0);
+
+   W = (NiftiWriterRec *) calloc (1, sizeof (NiftiWriterRec));
+   if (W == NULL)
+   {
+      sprintf (ErrMsg, "Out of memory");
+      return (ERR_NO_MEM);
+   }
+   W->DataType = Hdr->datatype;
+   W->TypeSize = NiftiTypeSize (Hdr->datatype);
+   W->BufferVoxels = (BufferVoxels > 0) ? BufferVoxels : 1;
+   W->Filename = (char *) malloc (Length + 1);
+   Ok = (W->Filename != NULL);
+   for (i = 0; Ok && (i < (Compressed ? WRITE_DEPTH : 1)); i++)
+   {
+      W->Buffer [i] = malloc (W->BufferVoxels * W->TypeSize);
+      Ok = (W->Buffer [i] != NULL);
+   }
+   if (!Ok)
+   {
+      FreeWriter (W);
+      sprintf (ErrMsg, "Out of memory for NIfTI write buffers");
+      return (ERR_NO_MEM);
+   }
+   strcpy (W->Filename, Filename);
+
+   /* Create the file and write the header and (empty) extender */
+
+   if (Compressed)
+   {
+      W->GzFile = gzopen (Filename, "wb");
+      Ok = (W->GzFile != NULL) &&
+           (gzwrite (W->GzFile, Hdr, NIFTI_HEADER_SIZE) == NIFTI_HEADER_SIZE) &&
+           (gzwrite (W->GzFile, Extender, 4) == 4);
+   }
+   else
+   {
+      W->File = fopen (Filename, "wb");
+      Ok = (W->File != NULL) &&
+           (fwrite (Hdr, NIFTI_HEADER_SIZE, 1, W->File) == 1) &&
+           (fwrite (Extender, 4, 1, W->File) == 1);
+   }
+
+   if (Ok && Compressed)
+   {
+      pthread_mutex_init (&W->Lock, NULL);
+      pthread_cond_init (&W->Cond, NULL);
+      W->Threaded = (pthread_create (&W->Thread, NULL, GzipThread, W) == 0);
+      if (!W->Threaded)
+      {
+         pthread_cond_destroy (&W->Cond);
+         pthread_mutex_destroy (&W->Lock);
+         Ok = FALSE;
+      }
+   }
+
+   if (!Ok)
+   {
+      sprintf (ErrMsg, "Error creating NIfTI file %s", Filename);
+      if (W->GzFile != NULL) gzclose (W->GzFile);
+      if (W->File != NULL) fclose (W->File);
+      remove (Filename);
+      FreeWriter (W);
+      return (ERR_OUT_NIFTI);
+   }
+
+   *Writer = W;
+   return (ERR_NONE);
+
+}     /* OpenNiftiWriter */
+
+
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : WriteNiftiData
+@INPUT      : Writer - from OpenNiftiWriter
+              Values - the next NumValues voxels of the image, as doubles
+                (or floats, if IsFloat), in file order
+@OUTPUT     :
+@RETURNS    : ERR_NONE if all went well
+              ERR_OUT_NIFTI if writing failed (ErrMsg is set)
+@DESCRIPTION: Appends data to the image, converting it to the file's
+              type a buffer at a time.  For a .gz file, each buffer is
+              handed to the gzip thread once converted, and the next is
+              converted while it is being compressed; this waits only
+              when all the buffers are still queued.
+@METHOD     :
+@GLOBALS    : ErrMsg
+@CALLS      : ConvertData
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+int WriteNiftiData (NiftiWriterRec *Writer, void *Values, Boolean IsFloat,
+                    long NumValues)
+{
+   long     Done;
+   long     N;
+   int      Slot;
+   Boolean  Failed;
+   char    *Next;
+
+   Next = (char *) Values;
+   for (Done = 0; (Done < NumValues) && !Writer->Failed; Done += N)
+   {
+      N = min (NumValues - Done, Writer->BufferVoxels);
+
+      if (!Writer->Threaded)
+      {
+         ConvertData (Next, IsFloat, N, Writer->DataType, Writer->Buffer [0]);
+         if (fwrite (Writer->Buffer [0], Writer->TypeSize, N, Writer->File)
+             != (size_t) N)
+         {
+            Writer->Failed = TRUE;
+         }
+      }
+      else
+      {
+         /* Wait for a free buffer */
+
+         pthread_mutex_lock (&Writer->Lock);
+         while ((Writer->Queued - Writer->Written >= WRITE_DEPTH) &&
+                !Writer->Failed)
+         {
+            pthread_cond_wait (&Writer->Cond, &Writer->Lock);
+         }
+         Failed = Writer->Failed;
+         pthread_mutex_unlock (&Writer->Lock);
+         if (Failed)
+         {
+            break;
+         }
+
+         Slot = (int) (Writer->Queued % WRITE_DEPTH);
+         ConvertData (Next, IsFloat, N, Writer->DataType,
+                      Writer->Buffer [Slot]);
+         Writer->Length [Slot] = N * Writer->TypeSize;
+
+         pthread_mutex_lock (&Writer->Lock);
+         Writer->Queued++;
+         pthread_cond_broadcast (&Writer->Cond);
+         pthread_mutex_unlock (&Writer->Lock);
+      }
+
+      Next += N * (IsFloat ? sizeof (float) : sizeof (double));
+   }
+
+   if (Writer->Failed)
+   {
+      sprintf (ErrMsg, "Error writing NIfTI file %s", Writer->Filename);
+      return (ERR_OUT_NIFTI);
+   }
+   return (ERR_NONE);
+
+}     /* WriteNiftiData */
+
+
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : CloseNiftiWriter
+@INPUT      : Writer - from OpenNiftiWriter
+@OUTPUT     :
+@RETURNS    : ERR_NONE if the whole file was written
+              ERR_OUT_NIFTI if any write failed (ErrMsg is set), in
+                which case the file is removed
+@DESCRIPTION: Waits for the gzip thread (if any) to finish, closes the
+              file and frees the writer.  Must be called once for every
+              successful OpenNiftiWriter, whether or not WriteNiftiData
+              failed.
+@METHOD     :
+@GLOBALS    : ErrMsg
+@CALLS      : zlib, FreeWriter
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+int CloseNiftiWriter (NiftiWriterRec *Writer)
+{
+   Boolean  Failed;
+
+   if (Writer->Threaded)
+   {
+      pthread_mutex_lock (&Writer->Lock);
+      Writer->Done = TRUE;
+      pthread_cond_broadcast (&Writer->Cond);
+      pthread_mutex_unlock (&Writer->Lock);
+      pthread_join (Writer->Thread, NULL);
+
+      pthread_cond_destroy (&Writer->Cond);
+      pthread_mutex_destroy (&Writer->Lock);
+   }
+
+   Failed = Writer->Failed;
+   if (Writer->GzFile != NULL)
+   {
+      Failed |= (gzclose (Writer->GzFile) != Z_OK);
+   }
+   else
+   {
+      Failed |= (fclose (Writer->File) != 0);
+   }
+
+   if (Failed)
+   {
+      sprintf (ErrMsg, "Error writing NIfTI file %s", Writer->Filename);
+      remove (Writer->Filename);
+   }
+   FreeWriter (Writer);
+
+   return (Failed ? ERR_OUT_NIFTI : ERR_NONE);
+
+}     /* CloseNiftiWriter */
@@ -0,0 +1,201 @@
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : threadpool.c
+@DESCRIPTION: A very small pool of POSIX threads for running a numbered
+              list of independent tasks (eg. one per input file).  Also
+              supplies a single global lock, since neither the MINC nor
+              the NetCDF/HDF5 libraries may be entered from more than
+              one thread at a time: tasks should do their blocking I/O
+              outside of the lock, and call MINC functions only between
+              LockSerial() and UnlockSerial().
+
+              Note that none of the MATLAB mx/mex functions may be called
+              from a task either; allocate everything up front.
+@CREATED    :
+@MODIFIED   :
+@VERSION    : $Id: threadpool.c,v 1.1 $
+              $Name:  $
+---------------------------------------------------------------------------- */
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "emmageneral.h"
+#include "mierrors.h"
+#include "threadpool.h"
+
+typedef struct
+{
+   long             NumTasks;
+   long             NextTask;     /* next task to hand out */
+   TaskFunc         Func;
+   void            *Arg;
+   pthread_mutex_t  Lock;         /* protects NextTask */
+} PoolRec;
+
+typedef struct
+{
+   PoolRec  *Pool;
+   int       Thread;
+} WorkerRec;
+
+
+static pthread_mutex_t SerialLock = PTHREAD_MUTEX_INITIALIZER;
+
+
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : DefaultThreads
+@INPUT      :
+@OUTPUT     :
+@RETURNS    : the number of processors currently online (at least 1)
+@DESCRIPTION: A sensible default for the NumThreads argument of RunTasks.
+@METHOD     :
+@GLOBALS    :
+@CALLS      : sysconf
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+int DefaultThreads (void)
+{
+   long   NumCPU = 1;
+
+#ifdef _SC_NPROCESSORS_ONLN
+   NumCPU = sysconf (_SC_NPROCESSORS_ONLN);
+#endif
+   return ((int) min (max (NumCPU, 1), MAX_THREADS));
+}     /* DefaultThreads */
+
+
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : LockSerial, UnlockSerial
+@INPUT      :
+@OUTPUT     :
+@RETURNS    :
+@DESCRIPTION: Acquire/release the global lock around code that is not
+              thread-safe (ie. anything that calls MINC or NetCDF).
+@METHOD     :
+@GLOBALS    : SerialLock
+@CALLS      : pthread_mutex_lock, pthread_mutex_unlock
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+void LockSerial (void)
+{
+   pthread_mutex_lock (&SerialLock);
+}
+
+void UnlockSerial (void)
+{
+   pthread_mutex_unlock (&SerialLock);
+}
+
+
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : Worker
+@INPUT      : WorkerArg - pointer to this thread's WorkerRec
+@OUTPUT     :
+@RETURNS    : NULL
+@DESCRIPTION: Body of each thread in the pool: keeps taking the next
+              task number until there are none left.
+@METHOD     :
+@GLOBALS    :
+@CALLS      : the pool's task function
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+static void *Worker (void *WorkerArg)
+{
+   WorkerRec  *Me = (WorkerRec *) WorkerArg;
+   PoolRec    *Pool = Me->Pool;
+   long        Task;
+
+   for (;;)
+   {
+      pthread_mutex_lock (&Pool->Lock);
+      Task = Pool->NextTask++;
+      pthread_mutex_unlock (&Pool->Lock);
+
+      if (Task >= Pool->NumTasks)
+      {
+         break;
+      }
+      (*Pool->Func) (Task, Me->Thread, Pool->Arg);
+   }
+   return (NULL);
+}     /* Worker */
+
+
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : RunTasks
+@INPUT      : NumTasks - number of tasks to run
+              NumThreads - maximum number of threads to use (including
+                the calling thread)
+              Func - called as Func (Task, Thread, Arg) for every task
+              Arg - passed unchanged to Func
+@OUTPUT     :
+@RETURNS    : ERR_NONE once all tasks have been run
+@DESCRIPTION: Runs tasks 0..NumTasks-1 on up to NumThreads threads, and
+              waits for them all to finish.  Tasks are handed out in
+              order, one at a time, to whichever thread is free.  The
+              calling thread works as thread 0, so if no extra threads
+              can be started the tasks are simply run in sequence.
+
+              Func is responsible for recording any errors of its own
+              (eg. in *Arg); Thread can be used to index per-thread
+              buffers allocated by the caller.
+@METHOD     :
+@GLOBALS    :
+@CALLS      : pthread_create, pthread_join
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+int RunTasks (long NumTasks, int NumThreads, TaskFunc Func, void *Arg)
+{
+   PoolRec     Pool;
+   WorkerRec   Workers [MAX_THREADS];
+   pthread_t   Threads [MAX_THREADS];
+   int         NumStarted;
+   int         i;
+
+   NumThreads = (int) min (max (NumThreads, 1), MAX_THREADS);
+   NumThreads = (int) min (NumThreads, max (NumTasks, 1));
+
+   Pool.NumTasks = NumTasks;
+   Pool.NextTask = 0;
+   Pool.Func = Func;
+   Pool.Arg = Arg;
+   pthread_mutex_init (&Pool.Lock, NULL);
+
+   for (i = 0; i < NumThreads; i++)
+   {
+      Workers [i].Pool = &Pool;
+      Workers [i].Thread = i;
+   }
+
+   NumStarted = 0;
+   for (i = 1; i < NumThreads; i++)
+   {
+      if (pthread_create (&Threads [i], NULL, Worker, &Workers [i]) != 0)
+      {
+#ifdef DEBUG
+         printf ("RunTasks: could only start %d of %d threads\n",
+                 i, NumThreads);
+#endif
+         break;
+      }
+      NumStarted++;
+   }
+
+   (void) Worker (&Workers [0]);
+
+   for (i = 1; i <= NumStarted; i++)
+   {
+      pthread_join (Threads [i], NULL);
+   }
+   pthread_mutex_destroy (&Pool.Lock);
+
+   return (ERR_NONE);
+}     /* RunTasks */
@@ -0,0 +1,1589 @@
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : lmefit (CMEX)
+@INPUT      :
+@OUTPUT     :
+@RETURNS    :
+@DESCRIPTION: CMEX routine to fit a linear mixed-effects model, with one
+              grouping variable, at every voxel, by maximising the
+              profiled (restricted) likelihood.  See lmefit.m (or type
+              "help lmefit" in MATLAB) for details.
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+@COMMENTS   : For full usage documentation, see lmefit.m
+---------------------------------------------------------------------------- */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <math.h>
+#include <float.h>
+#include "mex.h"
+#include "emmageneral.h"
+#include "mierrors.h"         /* mine and Mark's */
+#include "mexutils.h"         /* N.B. must link in mexutils.o */
+#include "threadpool.h"
+
+#define PROGNAME "lmefit"
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+/*
+ * Constants to check for argument number and position
+ */
+
+#define MIN_IN_ARGS        4
+#define MAX_IN_ARGS        7
+#define MAX_OUT_ARGS       6
+
+/* ...POS macros: 1-based, used to determine if input args are present */
+
+#define PATTERN_POS        5
+#define METHOD_POS         6
+#define THREADS_POS        7
+
+/*
+ * Macros to access the input and output arguments from/to MATLAB
+ * (N.B. these only work in mexFunction())
+ */
+
+#define FIXED          prhs[0]                  /* subjects x coefficients */
+#define RANDOM         prhs[1]                  /* subjects x effects */
+#define GROUP          prhs[2]                  /* subjects x 1 */
+#define RESPONSE       prhs[3]                  /* subjects x voxels */
+#define PATTERN        prhs[PATTERN_POS-1]      /* eg. 'CompSymm' */
+#define METHOD         prhs[METHOD_POS-1]       /* 'REML' or 'ML' */
+#define NUM_THREADS    prhs[THREADS_POS-1]      /* number of threads */
+#define BETA           plhs[0]                  /* coefficients x voxels */
+#define STD_ERR        plhs[1]
+#define T_VALUES       plhs[2]
+#define SIGMA2         plhs[3]                  /* 1 x voxels */
+#define THETA          plhs[4]                  /* parameters x voxels */
+#define EVALS          plhs[5]                  /* 1 x voxels */
+
+/*
+ * Limits on the model, so that the small matrices can live on the
+ * stack: MAX_COEFFS fixed effects, and MAX_RANDOM random effects in
+ * each group.  Each task fits a run of consecutive voxels, each fit
+ * starting from the last one's estimates, so the runs are made long:
+ * TASKS_PER_THREAD per thread, but at least MIN_TASK_VOXELS voxels.
+ */
+
+#define MAX_COEFFS     32
+#define MAX_RANDOM      6
+#define MAX_PARAMS     (MAX_RANDOM * (MAX_RANDOM+1) / 2)
+#define MIN_TASK_VOXELS 32
+#define TASKS_PER_THREAD 4
+
+/*
+ * The Nelder-Mead search over the covariance parameters stops when the
+ * deviance varies by less than DEV_TOL (relative) and the parameters
+ * by less than PARAM_TOL over the simplex, or gives up after
+ * BASE_EVALS + PARAM_EVALS evaluations per parameter.
+ *
+ * From the previous voxel's estimates (a warm start), a quasi-Newton
+ * search is used instead, with derivatives from differences of
+ * NEWTON_DELTA.  It converges (when its step is under NEWTON_TOL) in a
+ * few steps if the estimates are close, but gives up if it has not
+ * after NEWTON_ITERS, if it strays more than NEWTON_RANGE from them
+ * (when it may be heading for some other local minimum), or if it
+ * comes within KINK_MARGIN of a point where the deviance is not smooth
+ * (see NearKink).  The voxel is then searched again from the usual
+ * start.
+ */
+
+#define DEV_TOL        1e-10
+#define PARAM_TOL      1e-6
+#define INIT_STEP      0.25
+#define NEWTON_DELTA   1e-4
+#define NEWTON_TOL     1e-5
+#define NEWTON_ITERS   10
+#define NEWTON_RANGE   0.5
+#define KINK_MARGIN    0.01
+#define BASE_EVALS     200
+#define PARAM_EVALS    200
+#define RHO_EPS        1e-9
+
+/* The covariance patterns of the random effects (as fitlme names them) */
+
+#define FULL_CHOLESKY  0
+#define DIAGONAL       1
+#define ISOTROPIC      2
+#define COMP_SYMM      3
+#define NUM_PATTERNS   4
+
+static char *PatternNames [NUM_PATTERNS] =
+   { "FullCholesky", "Diagonal", "Isotropic", "CompSymm" };
+
+/*
+ * Everything the tasks need.  The model at each voxel is
+ *
+ *    y = X*beta + Z_g*b_g + e,   b_g ~ N(0, sigma2*L*L'),
+ *    e ~ N(0, sigma2*I)
+ *
+ * where row i of Z_g is row i of Z for the subjects in group g, and
+ * zero for the rest; L (q x q, lower triangular) is built from the
+ * parameters theta according to Pattern.  The cross products that do
+ * not involve y are the same at every voxel, and are computed once.
+ */
+
+typedef struct
+{
+   long       n, p, q, m;          /* subjects, coefficients, random
+                                      effects per group, groups */
+   int        Pattern;
+   int        NumParams;
+   Boolean    Reml;
+   double    *X;                   /* n x p */
+   double    *Z;                   /* n x q */
+   long      *Group;               /* n, 0-based */
+   double    *XtX;                 /* p x p */
+   double    *XtXChol;             /* its Cholesky factor */
+   double    *ZtZ;                 /* q x q for each group */
+   double    *ZtX;                 /* q x p for each group */
+   void      *Response;
+   Boolean    ResponseIsFloat;
+   long       NumVoxels;
+   long       TaskVoxels;
+   double    *Work [MAX_THREADS];  /* n + m*q, one per thread */
+   double    *Beta, *SE, *T, *Sigma2, *Theta, *Evals;
+   double     NaN;                 /* mxGetNaN (), as tasks can't call it */
+} MixedRec;
+
+/*
+ * The statistics of one voxel's response that the deviance needs.
+ * Rather than y itself, they are of its residuals e from the ordinary
+ * least squares fit (whose coefficients are Beta0), which leaves the
+ * mixed model's fit unchanged but keeps e'e from being swamped by the
+ * mean of y.
+ */
+
+typedef struct
+{
+   double    *Zte;                 /* q for each group */
+   double     Xte [MAX_COEFFS];
+   double     ete;
+   double     Beta0 [MAX_COEFFS];
+} VoxelRec;
+
+/* The fixed effects and residual variance at the optimum */
+
+typedef struct
+{
+   double     Beta [MAX_COEFFS];
+   double     SE [MAX_COEFFS];
+   double     Sigma2;
+} SolutionRec;
+
+char       *ErrMsg ;             /* set as close to the occurence of the
+                                    error as possible; displayed by whatever
+                                    code exits */
+
+
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : ErrAbort
+@INPUT      : msg - character to string to print just before aborting
+              PrintUsage - whether or not to print a usage summary before
+                aborting
+              ExitCode - one of the standard codes from mierrors.h -- NOTE!
+                this parameter is NOT currently used, but I've included it for
+                consistency with other functions named ErrAbort in other
+                programs
+@OUTPUT     : none - function does not return!!!
+@RETURNS    :
+@DESCRIPTION: Optionally prints a usage summary, and calls mexErrMsgTxt with
+              the supplied msg, which ABORTS the mex-file!!!
+@METHOD     :
+@GLOBALS    : requires PROGNAME macro
+@CALLS      : standard mex functions
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+void ErrAbort (char msg[], Boolean PrintUsage, int ExitCode)
+{
+   if (PrintUsage)
+   {
+      (void) mexPrintf ("Usage: [beta, se, t, sigma2, theta, evals] = %s "
+                        "(fixed, random, group, response [, pattern "
+                        "[, method [, num_threads]]])\n", PROGNAME);
+   }
+   (void) mexErrMsgTxt (msg);
+}
+
+
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : Cholesky
+@INPUT      : A - a k x k symmetric matrix (column major; only the lower
+                triangle is used)
+              k - its order
+@OUTPUT     : A - its lower Cholesky factor, in the lower triangle
+@RETURNS    : TRUE, or FALSE if A is not positive definite
+@DESCRIPTION:
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+static Boolean Cholesky (double *A, long k)
+{
+   double   Sum;
+   long     i, j, c;
+
+   for (j = 0; j < k; j++)
+   {
+      Sum = A [j + j*k];
+      for (c = 0; c < j; c++)
+         Sum -= A [j + c*k] * A [j + c*k];
+      if (!(Sum > 0))
+         return (FALSE);
+      A [j + j*k] = sqrt (Sum);
+
+      for (i = j+1; i < k; i++)
+      {
+         Sum = A [i + j*k];
+         for (c = 0; c < j; c++)
+            Sum -= A [i + c*k] * A [j + c*k];
+         A [i + j*k] = Sum / A [j + j*k];
+      }
+   }
+   return (TRUE);
+}     /* Cholesky */
+
+
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : ForwardSolve
+@INPUT      : L - a k x k lower triangular matrix (from Cholesky)
+              k - its order
+              B - k x NumCols right hand sides (column major)
+@OUTPUT     : B - overwritten by L \ B
+@RETURNS    : (void)
+@DESCRIPTION:
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+static void ForwardSolve (double *L, long k, double *B, long NumCols)
+{
+   double  *b;
+   long     i, j, c;
+
+   for (c = 0; c < NumCols; c++)
+   {
+      b = B + c*k;
+      for (i = 0; i < k; i++)
+      {
+         for (j = 0; j < i; j++)
+            b [i] -= L [i + j*k] * b [j];
+         b [i] /= L [i + i*k];
+      }
+   }
+}
+
+
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : BackSolve
+@INPUT      : L - a k x k lower triangular matrix (from Cholesky)
+              k - its order
+              b - a vector of k
+@OUTPUT     : b - overwritten by L' \ b
+@RETURNS    : (void)
+@DESCRIPTION:
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+static void BackSolve (double *L, long k, double *b)
+{
+   long     i, j;
+
+   for (i = k-1; i >= 0; i--)
+   {
+      for (j = i+1; j < k; j++)
+         b [i] -= L [j + i*k] * b [j];
+      b [i] /= L [i + i*k];
+   }
+}
+
+
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : NumParams
+@INPUT      : Pattern - one of FULL_CHOLESKY, etc.
+              q - number of random effects per group
+@OUTPUT     :
+@RETURNS    : the number of covariance parameters of the pattern
+@DESCRIPTION:
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+static int NumParams (int Pattern, long q)
+{
+   switch (Pattern)
+   {
+      case FULL_CHOLESKY: return ((int) (q * (q+1) / 2));
+      case DIAGONAL:      return ((int) q);
+      case COMP_SYMM:     return ((q > 1) ? 2 : 1);
+      default:            return (1);
+   }
+}
+
+
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : Correlation
+@INPUT      : q - number of random effects per group
+              x - the parameter searched for
+@OUTPUT     :
+@RETURNS    : the correlation of CompSymm,
+
+                 rho = Low + (1 - Low) * (1 + sin (x)) / 2
+
+              where Low = -1/(q-1) is the smallest correlation a
+              compound symmetric q x q matrix may have.  rho always
+              lies between the bounds, and the search can reach either
+              (which is where the estimate often is); it is kept
+              RHO_EPS inside them so that the matrix has a Cholesky
+              factor.
+@DESCRIPTION:
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+static double Correlation (long q, double x)
+{
+   double   Low, Rho;
+
+   Low = -1.0 / (double) (q - 1);
+   Rho = Low + (1 - Low) * (1 + sin (x)) / 2;
+   return (max (min (Rho, 1 - RHO_EPS), Low + RHO_EPS));
+}
+
+
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : BuildFactor
+@INPUT      : *Mixed - the problem (for Pattern and q)
+              Theta - the parameters being searched
+@OUTPUT     : L - the q x q lower triangular factor of the random
+                effects' covariance, relative to sigma2
+@RETURNS    : TRUE, or FALSE if Theta gives no valid factor
+@DESCRIPTION: The parameters are the elements of L (the lower triangle
+              by columns for FullCholesky, the diagonal for Diagonal, a
+              single value for Isotropic); the diagonal is taken as the
+              absolute value of its parameter, so that every point of
+              the search is valid.  For CompSymm, Theta(1) is the
+              standard deviation s and Theta(2) sets the correlation rho
+              (see Correlation), and L is chol (s^2 * ((1-rho)*I +
+              rho*ones)).
+@METHOD     :
+@GLOBALS    :
+@CALLS      : Correlation, Cholesky
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+static Boolean BuildFactor (MixedRec *Mixed, double Theta[], double *L)
+{
+   long     q = Mixed->q;
+   long     i, j, k;
+   double   Rho, s;
+
+   for (k = 0; k < q*q; k++)
+      L [k] = 0;
+
+   switch (Mixed->Pattern)
+   {
+      case FULL_CHOLESKY:
+         k = 0;
+         for (j = 0; j < q; j++)
+            for (i = j; i < q; i++, k++)
+               L [i + j*q] = (i == j) ? fabs (Theta [k]) : Theta [k];
+         break;
+      case DIAGONAL:
+         for (j = 0; j < q; j++)
+            L [j + j*q] = fabs (Theta [j]);
+         break;
+      case ISOTROPIC:
+         for (j = 0; j < q; j++)
+            L [j + j*q] = fabs (Theta [0]);
+         break;
+      case COMP_SYMM:
+         s = fabs (Theta [0]);
+         if (q == 1)
+         {
+            L [0] = s;
+            break;
+         }
+         Rho = Correlation (q, Theta [1]);
+         for (j = 0; j < q; j++)
+            for (i = j; i < q; i++)
+               L [i + j*q] = (i == j) ? 1.0 : Rho;
+         if (!Cholesky (L, q))
+            return (FALSE);
+         for (j = 0; j < q; j++)
+            for (i = j; i < q; i++)
+               L [i + j*q] *= s;
+         for (j = 0; j < q; j++)           /* clear the upper triangle */
+            for (i = 0; i < j; i++)
+               L [i + j*q] = 0;
+         break;
+   }
+   return (TRUE);
+}     /* BuildFactor */
+
+
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : ColdStart
+@INPUT      : *Mixed - the problem
+@OUTPUT     : Theta - where the search starts when nothing better is
+                known: uncorrelated random effects with the same
+                variance as the residuals (L = I)
+@RETURNS    : (void)
+@DESCRIPTION:
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+static void ColdStart (MixedRec *Mixed, double Theta[])
+{
+   long     q = Mixed->q;
+   long     i, j;
+   int      k;
+
+   for (k = 0; k < Mixed->NumParams; k++)
+      Theta [k] = 1.0;
+   if (Mixed->Pattern == FULL_CHOLESKY)
+   {
+      k = 0;
+      for (j = 0; j < q; j++)
+         for (i = j; i < q; i++, k++)
+            Theta [k] = (i == j) ? 1.0 : 0.0;
+   }
+   else if ((Mixed->Pattern == COMP_SYMM) && (q > 1))
+   {
+      Theta [1] = asin (2.0 / (double) q - 1);     /* rho = 0 */
+   }
+}
+
+
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : ReportTheta
+@INPUT      : *Mixed - the problem
+              Theta - the parameters at the optimum
+@OUTPUT     : Out - the parameters as lmefit returns them: with the
+                diagonal of L made non-negative, and for CompSymm the
+                correlation itself rather than the value searched for
+@RETURNS    : (void)
+@DESCRIPTION:
+@METHOD     :
+@GLOBALS    :
+@CALLS      : Correlation
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+static void ReportTheta (MixedRec *Mixed, double Theta[], double *Out)
+{
+   long     q = Mixed->q;
+   long     i, j;
+   int      k;
+
+   for (k = 0; k < Mixed->NumParams; k++)
+      Out [k] = Theta [k];
+
+   switch (Mixed->Pattern)
+   {
+      case FULL_CHOLESKY:
+         k = 0;
+         for (j = 0; j < q; j++)
+            for (i = j; i < q; i++, k++)
+               if (i == j)
+                  Out [k] = fabs (Theta [k]);
+         break;
+      case COMP_SYMM:
+         Out [0] = fabs (Theta [0]);
+         if (q > 1)
+         {
+            Out [1] = Correlation (q, Theta [1]);
+         }
+         break;
+      default:
+         for (k = 0; k < Mixed->NumParams; k++)
+            Out [k] = fabs (Theta [k]);
+         break;
+   }
+}     /* ReportTheta */
+
+
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : ProfiledDeviance
+@INPUT      : *Mixed - the problem
+              *Voxel - the statistics of one voxel's response
+              Theta - covariance parameters
+              Solution - where to put the fixed effects, or NULL
+@OUTPUT     : *Solution - if not NULL, the fixed effects, their standard
+                errors, and sigma2, at Theta
+@RETURNS    : -2 times the log likelihood (restricted, if Mixed->Reml)
+              with beta and sigma2 profiled out; HUGE_VAL if Theta is
+              not valid
+@DESCRIPTION: With L from Theta, and for each group g the q x q matrix
+              A_g = L'*Z_g'*Z_g*L + I = C_g*C_g', the penalised least
+              squares problem for [u; beta] is solved by eliminating
+              each group's u in turn:
+
+                 r_g = C_g \ (L'*Z_g'*y),   R_g = C_g \ (L'*Z_g'*X),
+                 M = X'*X - sum R_g'*R_g  = RX*RX',
+                 w = RX \ (X'*y - sum R_g'*r_g),
+                 beta = RX' \ w,
+                 rss = y'*y - sum r_g'*r_g - w'*w
+
+              after which, with d = n (ML) or n - p (REML),
+
+                 deviance = sum log det (A_g) + d * (1 + log (2*pi*
+                            rss/d)) [+ log det (M) for REML]
+
+              sigma2 = rss/d, and cov (beta) = sigma2 * inv (M).  The
+              work is O(m*q*p^2) whatever the number of subjects.
+@METHOD     :
+@GLOBALS    :
+@CALLS      : BuildFactor, Cholesky, ForwardSolve, BackSolve
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+static double ProfiledDeviance (MixedRec *Mixed, VoxelRec *Voxel,
+                                double Theta[], SolutionRec *Solution)
+{
+   double   L [MAX_RANDOM * MAX_RANDOM];
+   double   W [MAX_RANDOM * MAX_RANDOM];
+   double   A [MAX_RANDOM * MAX_RANDOM];
+   double   R [MAX_RANDOM * MAX_COEFFS];
+   double   r [MAX_RANDOM];
+   double   M [MAX_COEFFS * MAX_COEFFS];
+   double   w [MAX_COEFFS];
+   double   x [MAX_COEFFS];
+   double  *ZtZ, *ZtX, *Zte;
+   double   LogDet, Rss, Df, Sum, Deviance;
+   long     n = Mixed->n;
+   long     p = Mixed->p;
+   long     q = Mixed->q;
+   long     a, b, c, k, g;
+
+   if (!BuildFactor (Mixed, Theta, L))
+      return (HUGE_VAL);
+
+   for (k = 0; k < p*p; k++)
+      M [k] = Mixed->XtX [k];
+   for (c = 0; c < p; c++)
+      w [c] = Voxel->Xte [c];
+   LogDet = 0;
+   Rss = Voxel->ete;
+
+   for (g = 0; g < Mixed->m; g++)
+   {
+      ZtZ = Mixed->ZtZ + g*q*q;
+      ZtX = Mixed->ZtX + g*q*p;
+      Zte = Voxel->Zte + g*q;
+
+      /* A = L'*ZtZ*L + I, using the zeros of L */
+
+      for (b = 0; b < q; b++)
+         for (a = 0; a < q; a++)
+         {
+            for (Sum = 0, k = b; k < q; k++)
+               Sum += ZtZ [a + k*q] * L [k + b*q];
+            W [a + b*q] = Sum;
+         }
+      for (b = 0; b < q; b++)
+         for (a = b; a < q; a++)
+         {
+            for (Sum = (a == b), k = a; k < q; k++)
+               Sum += L [k + a*q] * W [k + b*q];
+            A [a + b*q] = Sum;
+         }
+      if (!Cholesky (A, q))
+         return (HUGE_VAL);
+      for (a = 0; a < q; a++)
+         LogDet += 2 * log (A [a + a*q]);
+
+      /* r = C \ (L'*Z'e) and R = C \ (L'*Z'X) */
+
+      for (a = 0; a < q; a++)
+      {
+         for (Sum = 0, k = a; k < q; k++)
+            Sum += L [k + a*q] * Zte [k];
+         r [a] = Sum;
+         for (c = 0; c < p; c++)
+         {
+            for (Sum = 0, k = a; k < q; k++)
+               Sum += L [k + a*q] * ZtX [k + c*q];
+            R [a + c*q] = Sum;
+         }
+      }
+      ForwardSolve (A, q, r, 1);
+      ForwardSolve (A, q, R, p);
+
+      for (a = 0; a < q; a++)
+         Rss -= r [a] * r [a];
+      for (c = 0; c < p; c++)
+      {
+         for (b = c; b < p; b++)
+         {
+            for (Sum = 0, a = 0; a < q; a++)
+               Sum += R [a + b*q] * R [a + c*q];
+            M [b + c*p] -= Sum;
+         }
+         for (Sum = 0, a = 0; a < q; a++)
+            Sum += R [a + c*q] * r [a];
+         w [c] -= Sum;
+      }
+   }
+
+   if (!Cholesky (M, p))
+      return (HUGE_VAL);
+   ForwardSolve (M, p, w, 1);
+   for (c = 0; c < p; c++)
+      Rss -= w [c] * w [c];
+   if (!(Rss > 0))
+      return (HUGE_VAL);
+
+   Df = (double) (Mixed->Reml ? n - p : n);
+   Deviance = LogDet + Df * (1 + log (2 * M_PI * Rss / Df));
+   if (Mixed->Reml)
+   {
+      for (c = 0; c < p; c++)
+         Deviance += 2 * log (M [c + c*p]);
+   }
+
+   if (Solution != NULL)
+   {
+      Solution->Sigma2 = Rss / Df;
+      BackSolve (M, p, w);
+      for (c = 0; c < p; c++)
+         Solution->Beta [c] = Voxel->Beta0 [c] + w [c];
+
+      /* diag (inv (M)) is the sum of squares of each column of inv(RX) */
+
+      for (c = 0; c < p; c++)
+      {
+         for (k = 0; k < p; k++)
+            x [k] = (k == c);
+         ForwardSolve (M, p, x, 1);
+         for (Sum = 0, k = c; k < p; k++)
+            Sum += x [k] * x [k];
+         Solution->SE [c] = sqrt (Solution->Sigma2 * Sum);
+      }
+   }
+   return (Deviance);
+}     /* ProfiledDeviance */
+
+
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : NelderMead
+@INPUT      : *Mixed - the problem
+              *Voxel - the statistics of one voxel's response
+              Theta - where to start
+              Step - the size of the first simplex
+              MaxEvals - the most evaluations of the deviance to make
+@OUTPUT     : Theta - the parameters minimising ProfiledDeviance
+                (unchanged if the search did not converge)
+              *Deviance - the deviance there
+              *Evals - the number of evaluations made
+@RETURNS    : TRUE, or FALSE if the search did not converge
+@DESCRIPTION: Nelder-Mead simplex search, with the usual reflection,
+              expansion, contraction and shrink steps.
+@METHOD     :
+@GLOBALS    :
+@CALLS      : ProfiledDeviance
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+static Boolean NelderMead (MixedRec *Mixed, VoxelRec *Voxel,
+                           double Theta[], double Step, int MaxEvals,
+                           double *Deviance, int *Evals)
+{
+   double   S [MAX_PARAMS+1][MAX_PARAMS];
+   double   F [MAX_PARAMS+1];
+   double   Centre [MAX_PARAMS];
+   double   Try [MAX_PARAMS], Try2 [MAX_PARAMS];
+   double   FTry, FTry2, Spread;
+   int      K = Mixed->NumParams;
+   int      Best, Worst, Next;
+   int      i, k;
+
+   for (i = 0; i <= K; i++)
+   {
+      for (k = 0; k < K; k++)
+         S [i][k] = Theta [k] + ((i == k+1) ? Step : 0.0);
+      F [i] = ProfiledDeviance (Mixed, Voxel, S [i], NULL);
+   }
+   *Evals = K+1;
+
+   while (TRUE)
+   {
+      /* The best, worst and next worst points of the simplex */
+
+      Best = Worst = 0;
+      for (i = 1; i <= K; i++)
+      {
+         if (F [i] < F [Best])   Best = i;
+         if (F [i] >= F [Worst]) Worst = i;
+      }
+      Next = Best;
+      for (i = 0; i <= K; i++)
+      {
+         if ((i != Worst) && (F [i] >= F [Next]))
+            Next = i;
+      }
+
+      Spread = 0;
+      for (i = 0; i <= K; i++)
+         for (k = 0; k < K; k++)
+            Spread = max (Spread, fabs (S [i][k] - S [Best][k]));
+      if (isfinite (F [Best]) &&
+          (F [Worst] - F [Best] <= DEV_TOL * (1 + fabs (F [Best]))) &&
+          (Spread <= PARAM_TOL))
+      {
+         break;
+      }
+      if (*Evals >= MaxEvals)
+      {
+         return (FALSE);
+      }
+
+      /* Reflect the worst point through the centre of the rest */
+
+      for (k = 0; k < K; k++)
+      {
+         for (Centre [k] = 0, i = 0; i <= K; i++)
+            if (i != Worst)
+               Centre [k] += S [i][k];
+         Centre [k] /= K;
+         Try [k] = 2 * Centre [k] - S [Worst][k];
+      }
+      FTry = ProfiledDeviance (Mixed, Voxel, Try, NULL);
+      (*Evals)++;
+
+      if (FTry < F [Best])
+      {
+         for (k = 0; k < K; k++)                          /* expand */
+            Try2 [k] = 3 * Centre [k] - 2 * S [Worst][k];
+         FTry2 = ProfiledDeviance (Mixed, Voxel, Try2, NULL);
+         (*Evals)++;
+         if (FTry2 < FTry)
+         {
+            for (k = 0; k < K; k++) Try [k] = Try2 [k];
+            FTry = FTry2;
+         }
+      }
+      else if (FTry >= F [Next])
+      {
+         if (FTry < F [Worst])                   /* contract outside */
+         {
+            for (k = 0; k < K; k++)
+               Try2 [k] = 0.5 * (Centre [k] + Try [k]);
+         }
+         else                                    /* contract inside */
+         {
+            for (k = 0; k < K; k++)
+               Try2 [k] = 0.5 * (Centre [k] + S [Worst][k]);
+         }
+         FTry2 = ProfiledDeviance (Mixed, Voxel, Try2, NULL);
+         (*Evals)++;
+
+         if (FTry2 < min (FTry, F [Worst]))
+         {
+            for (k = 0; k < K; k++) Try [k] = Try2 [k];
+            FTry = FTry2;
+         }
+         else                                    /* shrink */
+         {
+            for (i = 0; i <= K; i++)
+            {
+               if (i == Best)
+                  continue;
+               for (k = 0; k < K; k++)
+                  S [i][k] = 0.5 * (S [i][k] + S [Best][k]);
+               F [i] = ProfiledDeviance (Mixed, Voxel, S [i], NULL);
+               (*Evals)++;
+            }
+            continue;
+         }
+      }
+
+      for (k = 0; k < K; k++)
+         S [Worst][k] = Try [k];
+      F [Worst] = FTry;
+   }
+
+   for (k = 0; k < K; k++)
+      Theta [k] = S [Best][k];
+   *Deviance = F [Best];
+   return (TRUE);
+}     /* NelderMead */
+
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : NearKink
+@INPUT      : *Mixed - the problem
+              Theta - covariance parameters
+@OUTPUT     :
+@RETURNS    : TRUE if Theta is so near a point where the deviance is not
+              smooth -- a standard deviation or diagonal element of L
+              near zero (where BuildFactor takes its absolute value), or
+              the correlation of CompSymm near one of its bounds (where
+              every voxel has a stationary point) -- that derivatives
+              cannot be trusted there
+@DESCRIPTION:
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+static Boolean NearKink (MixedRec *Mixed, double Theta[])
+{
+   long     q = Mixed->q;
+   long     i, j;
+   int      k;
+
+   switch (Mixed->Pattern)
+   {
+      case FULL_CHOLESKY:
+         k = 0;
+         for (j = 0; j < q; j++)
+            for (i = j; i < q; i++, k++)
+               if ((i == j) && (fabs (Theta [k]) < KINK_MARGIN))
+                  return (TRUE);
+         return (FALSE);
+      case COMP_SYMM:
+         return ((fabs (Theta [0]) < KINK_MARGIN) ||
+                 ((q > 1) && (fabs (cos (Theta [1])) < KINK_MARGIN)));
+      default:
+         for (k = 0; k < Mixed->NumParams; k++)
+            if (fabs (Theta [k]) < KINK_MARGIN)
+               return (TRUE);
+         return (FALSE);
+   }
+}     /* NearKink */
+
+
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : Derivatives
+@INPUT      : *Mixed - the problem
+              *Voxel - the statistics of one voxel's response
+              Theta - covariance parameters
+              F - the deviance at Theta
+              H - where to put the Hessian, or NULL
+@OUTPUT     : g - the gradient of the deviance at Theta
+              H - if not NULL, its Hessian (K x K, lower triangle)
+              *Evals - incremented by the evaluations made
+@RETURNS    : (void)
+@DESCRIPTION: Central differences of NEWTON_DELTA: 2*K evaluations for
+              the gradient, and 2*K*(K-1) more for the Hessian.
+@METHOD     :
+@GLOBALS    :
+@CALLS      : ProfiledDeviance
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+static void Derivatives (MixedRec *Mixed, VoxelRec *Voxel, double Theta[],
+                         double F, double g[], double *H, int *Evals)
+{
+   double   Try [MAX_PARAMS];
+   double   Fp, Fm, Fpp, Fpm, Fmp, Fmm;
+   double   h = NEWTON_DELTA;
+   int      K = Mixed->NumParams;
+   int      j, k;
+
+   for (k = 0; k < K; k++)
+      Try [k] = Theta [k];
+
+   for (k = 0; k < K; k++)
+   {
+      Try [k] = Theta [k] + h;
+      Fp = ProfiledDeviance (Mixed, Voxel, Try, NULL);
+      Try [k] = Theta [k] - h;
+      Fm = ProfiledDeviance (Mixed, Voxel, Try, NULL);
+      *Evals += 2;
+      g [k] = (Fp - Fm) / (2*h);
+      if (H != NULL)
+      {
+         H [k + k*K] = (Fp - 2*F + Fm) / (h*h);
+         for (j = 0; j < k; j++)
+         {
+            Try [k] = Theta [k] + h;  Try [j] = Theta [j] + h;
+            Fpp = ProfiledDeviance (Mixed, Voxel, Try, NULL);
+            Try [j] = Theta [j] - h;
+            Fpm = ProfiledDeviance (Mixed, Voxel, Try, NULL);
+            Try [k] = Theta [k] - h;
+            Fmm = ProfiledDeviance (Mixed, Voxel, Try, NULL);
+            Try [j] = Theta [j] + h;
+            Fmp = ProfiledDeviance (Mixed, Voxel, Try, NULL);
+            Try [j] = Theta [j];
+            *Evals += 4;
+            H [k + j*K] = (Fpp - Fpm - Fmp + Fmm) / (4*h*h);
+         }
+      }
+      Try [k] = Theta [k];
+   }
+}     /* Derivatives */
+
+
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : Newton
+@INPUT      : *Mixed - the problem
+              *Voxel - the statistics of one voxel's response
+              Theta - where to start: the estimates at a neighbouring
+                voxel
+              H - the Hessian of the deviance at the neighbour's
+                estimates (K x K), if *HaveHessian
+@OUTPUT     : Theta - the parameters minimising ProfiledDeviance
+                (unchanged if the search did not converge)
+              H, *HaveHessian - the Hessian at the new estimates, for
+                the next voxel
+              *Deviance - the deviance there
+              *Evals - the number of evaluations of the deviance made
+@RETURNS    : TRUE, or FALSE if the search did not converge
+@DESCRIPTION: A quasi-Newton search: the Hessian starts as the
+              neighbour's (or, if that is not known, from differences),
+              and is corrected by the BFGS update from the gradients
+              (from differences) met along the way, so that each step
+              costs 2*K + 1 evaluations; it is recomputed from
+              differences before the search is taken to have
+              converged.  The step is halved until the
+              deviance falls.  The search gives up, and leaves the
+              voxel to Nelder-Mead, if it gets near a kink (see
+              NearKink), if it strays more than NEWTON_RANGE from where
+              it started, or if it has not converged after NEWTON_ITERS
+              steps.
+@METHOD     :
+@GLOBALS    :
+@CALLS      : ProfiledDeviance, NearKink, Derivatives, Cholesky,
+              ForwardSolve, BackSolve
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+static Boolean Newton (MixedRec *Mixed, VoxelRec *Voxel, double Theta[],
+                       double *H, Boolean *HaveHessian, double *Deviance,
+                       int *Evals)
+{
+   double   x [MAX_PARAMS], Try [MAX_PARAMS];
+   double   g [MAX_PARAMS], gTry [MAX_PARAMS];
+   double   d [MAX_PARAMS], s [MAX_PARAMS], y [MAX_PARAMS];
+   double   Hs [MAX_PARAMS];
+   double   C [MAX_PARAMS * MAX_PARAMS];
+   double   F, FTry, Length, sy, sHs;
+   int      K = Mixed->NumParams;
+   Boolean  Fresh;
+   int      Iter, Halve;
+   int      j, k;
+
+   *Evals = 0;
+   for (k = 0; k < K; k++)
+      x [k] = Theta [k];
+   if (NearKink (Mixed, x))
+      return (FALSE);
+   F = ProfiledDeviance (Mixed, Voxel, x, NULL);
+   (*Evals)++;
+   if (!isfinite (F))
+      return (FALSE);
+   Fresh = !*HaveHessian;
+   Derivatives (Mixed, Voxel, x, F, g, Fresh ? H : NULL, Evals);
+   *HaveHessian = TRUE;
+
+   for (Iter = 0; Iter < NEWTON_ITERS; Iter++)
+   {
+      /* The step d = -H \ g, if H is positive definite */
+
+      for (k = 0; k < K*K; k++)
+         C [k] = H [k];
+      if (!Cholesky (C, K))
+      {
+         *HaveHessian = FALSE;
+         return (FALSE);
+      }
+      for (k = 0; k < K; k++)
+         d [k] = -g [k];
+      ForwardSolve (C, K, d, 1);
+      BackSolve (C, K, d);
+      Length = 0;
+      for (k = 0; k < K; k++)
+         Length = max (Length, fabs (d [k]));
+      if (!isfinite (Length))
+         return (FALSE);
+
+      /* Take as much of it as lowers the deviance */
+
+      for (Halve = 0; ; Halve++)
+      {
+         for (k = 0; k < K; k++)
+         {
+            Try [k] = x [k] + d [k];
+            if (fabs (Try [k] - Theta [k]) > NEWTON_RANGE)
+               return (FALSE);
+         }
+         if (NearKink (Mixed, Try))
+            return (FALSE);
+         FTry = ProfiledDeviance (Mixed, Voxel, Try, NULL);
+         (*Evals)++;
+         if (FTry <= F)
+            break;
+         if (Length <= NEWTON_TOL)           /* as low as it can get */
+         {
+            FTry = F;
+            for (k = 0; k < K; k++)
+               Try [k] = x [k];
+            break;
+         }
+         if (Halve == 3)
+            return (FALSE);
+         for (k = 0; k < K; k++)
+            d [k] /= 2;
+         Length /= 2;
+      }
+
+      /*
+       * A short step only means convergence if H is right; one that is
+       * too large gives short steps anywhere.  So H is recomputed from
+       * differences before believing it.
+       */
+
+      if ((Length <= NEWTON_TOL) && Fresh)
+      {
+         for (k = 0; k < K; k++)
+            Theta [k] = Try [k];
+         *Deviance = FTry;
+         return (TRUE);
+      }
+      if (Length <= NEWTON_TOL)
+      {
+         for (k = 0; k < K; k++)
+            x [k] = Try [k];
+         F = FTry;
+         Derivatives (Mixed, Voxel, x, F, g, H, Evals);
+         Fresh = TRUE;
+         continue;
+      }
+
+      /* The BFGS update of H, if the curvature along d is positive */
+
+      Derivatives (Mixed, Voxel, Try, FTry, gTry, NULL, Evals);
+      Fresh = FALSE;
+      for (k = 0; k < K; k++)
+      {
+         s [k] = Try [k] - x [k];
+         y [k] = gTry [k] - g [k];
+      }
+      for (sy = 0, k = 0; k < K; k++)
+         sy += s [k] * y [k];
+      for (j = 0; j < K; j++)
+      {
+         for (Hs [j] = 0, k = 0; k < K; k++)
+            Hs [j] += H [max (j,k) + min (j,k)*K] * s [k];
+      }
+      for (sHs = 0, k = 0; k < K; k++)
+         sHs += s [k] * Hs [k];
+      if ((sy > 0) && (sHs > 0))
+      {
+         for (k = 0; k < K; k++)
+            for (j = k; j < K; j++)
+               H [j + k*K] += y [j] * y [k] / sy - Hs [j] * Hs [k] / sHs;
+      }
+
+      for (k = 0; k < K; k++)
+      {
+         x [k] = Try [k];
+         g [k] = gTry [k];
+      }
+      F = FTry;
+   }
+   return (FALSE);
+}     /* Newton */
+
+
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : Element
+@INPUT      : Data - a matrix of doubles, or of floats if IsFloat
+              k - index of an element
+@OUTPUT     :
+@RETURNS    : Data[k], as a double
+@DESCRIPTION:
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+static double Element (void *Data, Boolean IsFloat, long k)
+{
+   return (IsFloat ? (double) ((float *) Data) [k] : ((double *) Data) [k]);
+}
+
+
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : LoadVoxel
+@INPUT      : *Mixed - the problem
+              v - which voxel
+              Work - n + m*q doubles of workspace
+@OUTPUT     : *Voxel - the statistics of the voxel's response, with
+                Voxel->Zte pointing into Work
+@RETURNS    : TRUE, or FALSE if the response has a non-finite value
+@DESCRIPTION: Fits the fixed effects alone by least squares (with the
+              Cholesky factor of X'X), and gathers X'e, Z_g'e and e'e
+              for the residuals e.
+@METHOD     :
+@GLOBALS    :
+@CALLS      : Element, ForwardSolve, BackSolve
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+static Boolean LoadVoxel (MixedRec *Mixed, long v, double *Work,
+                          VoxelRec *Voxel)
+{
+   long     n = Mixed->n;
+   long     p = Mixed->p;
+   long     q = Mixed->q;
+   double  *e = Work;
+   double   Sum;
+   long     i, c, a;
+
+   for (i = 0; i < n; i++)
+   {
+      e [i] = Element (Mixed->Response, Mixed->ResponseIsFloat, v*n + i);
+      if (!isfinite (e [i]))
+         return (FALSE);
+   }
+
+   for (c = 0; c < p; c++)
+   {
+      for (Sum = 0, i = 0; i < n; i++)
+         Sum += Mixed->X [c*n + i] * e [i];
+      Voxel->Beta0 [c] = Sum;
+   }
+   ForwardSolve (Mixed->XtXChol, p, Voxel->Beta0, 1);
+   BackSolve (Mixed->XtXChol, p, Voxel->Beta0);
+   for (c = 0; c < p; c++)
+      for (i = 0; i < n; i++)
+         e [i] -= Mixed->X [c*n + i] * Voxel->Beta0 [c];
+
+   for (c = 0; c < p; c++)
+   {
+      for (Sum = 0, i = 0; i < n; i++)
+         Sum += Mixed->X [c*n + i] * e [i];
+      Voxel->Xte [c] = Sum;
+   }
+   for (Sum = 0, i = 0; i < n; i++)
+      Sum += e [i] * e [i];
+   Voxel->ete = Sum;
+
+   Voxel->Zte = Work + n;
+   for (i = 0; i < Mixed->m * q; i++)
+      Voxel->Zte [i] = 0;
+   for (i = 0; i < n; i++)
+      for (a = 0; a < q; a++)
+         Voxel->Zte [Mixed->Group [i]*q + a] += Mixed->Z [a*n + i] * e [i];
+
+   return (TRUE);
+}     /* LoadVoxel */
+
+
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : FitTask
+@INPUT      : Task - which run of Mixed->TaskVoxels voxels to fit
+              Thread - which thread's workspace to use
+              Arg - the MixedRec
+@OUTPUT     : the task's columns of Mixed->Beta, SE, T, Sigma2, Theta and
+                Evals (NaN for voxels that could not be fitted)
+@RETURNS    : (void)
+@DESCRIPTION: Fits the task's voxels one after another, for RunTasks.
+              Neighbouring voxels have much the same covariance
+              parameters (and much the same deviance around them), so
+              each voxel is first fitted by Newton from the last
+              voxel's estimates and Hessian; if that does not converge
+              (or there are no estimates yet), Nelder-Mead starts
+              afresh from ColdStart.  So does a Newton fit whose
+              deviance is no lower than ColdStart's, as it has found
+              some other, poorer minimum.
+@METHOD     :
+@GLOBALS    :
+@CALLS      : LoadVoxel, Newton, ColdStart, NelderMead,
+              ProfiledDeviance, ReportTheta
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+static void FitTask (long Task, int Thread, void *Arg)
+{
+   MixedRec     *Mixed = (MixedRec *) Arg;
+   VoxelRec      Voxel;
+   SolutionRec   Solution;
+   double        Theta [MAX_PARAMS];
+   double        Last [MAX_PARAMS];
+   double        Start [MAX_PARAMS];
+   double        Hessian [MAX_PARAMS * MAX_PARAMS];
+   double        Deviance;
+   double        NaN = Mixed->NaN;
+   long          p = Mixed->p;
+   long          K = Mixed->NumParams;
+   long          v, End;
+   Boolean       Ok, Converged, Warm, HaveHessian;
+   int           Evals, Used;
+   int           j;
+
+   Warm = HaveHessian = FALSE;
+   End = min ((Task+1) * Mixed->TaskVoxels, Mixed->NumVoxels);
+   for (v = Task * Mixed->TaskVoxels; v < End; v++)
+   {
+      Ok = LoadVoxel (Mixed, v, Mixed->Work [Thread], &Voxel);
+      Converged = FALSE;
+      Evals = 0;
+      if (Ok && Warm)
+      {
+         for (j = 0; j < K; j++)
+            Theta [j] = Last [j];
+         Converged = Newton (Mixed, &Voxel, Theta, Hessian, &HaveHessian,
+                             &Deviance, &Used);
+         Evals += Used;
+
+         /* A minimum no better than the cold start is another basin's */
+         if (Converged)
+         {
+            ColdStart (Mixed, Start);
+            Converged = Deviance <
+                        ProfiledDeviance (Mixed, &Voxel, Start, NULL);
+            Evals++;
+         }
+      }
+      if (Ok && !Converged)
+      {
+         HaveHessian = FALSE;
+         ColdStart (Mixed, Theta);
+         Converged = NelderMead (Mixed, &Voxel, Theta, INIT_STEP,
+                                 BASE_EVALS + PARAM_EVALS * (int) K,
+                                 &Deviance, &Used);
+         Evals += Used;
+      }
+      Ok = Ok && Converged &&
+           isfinite (ProfiledDeviance (Mixed, &Voxel, Theta, &Solution));
+      if (Ok)
+      {
+         for (j = 0; j < K; j++)
+            Last [j] = Theta [j];
+         Warm = TRUE;
+      }
+
+      for (j = 0; j < p; j++)
+      {
+         Mixed->Beta [v*p + j] = Ok ? Solution.Beta [j] : NaN;
+         Mixed->SE [v*p + j] = Ok ? Solution.SE [j] : NaN;
+         Mixed->T [v*p + j] = Ok ? Solution.Beta [j] / Solution.SE [j] : NaN;
+      }
+      Mixed->Sigma2 [v] = Ok ? Solution.Sigma2 : NaN;
+      Mixed->Evals [v] = (double) Evals;
+      if (Ok)
+      {
+         ReportTheta (Mixed, Theta, Mixed->Theta + v*K);
+      }
+      else
+      {
+         for (j = 0; j < K; j++)
+            Mixed->Theta [v*K + j] = NaN;
+      }
+   }
+}     /* FitTask */
+
+
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : CrossProducts
+@INPUT      : *Mixed - the problem, with X, Z and Group set
+@OUTPUT     : Mixed->XtX, XtXChol, ZtZ and ZtX (which must be allocated)
+@RETURNS    : TRUE, or FALSE if X is rank deficient
+@DESCRIPTION: The parts of the deviance that are the same at every
+              voxel.
+@METHOD     :
+@GLOBALS    :
+@CALLS      : Cholesky
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+static Boolean CrossProducts (MixedRec *Mixed)
+{
+   long     n = Mixed->n;
+   long     p = Mixed->p;
+   long     q = Mixed->q;
+   double  *X = Mixed->X;
+   double  *Z = Mixed->Z;
+   double   Sum;
+   long     i, a, b, c, g;
+
+   for (c = 0; c < p; c++)
+      for (b = c; b < p; b++)
+      {
+         for (Sum = 0, i = 0; i < n; i++)
+            Sum += X [b*n + i] * X [c*n + i];
+         Mixed->XtX [b + c*p] = Mixed->XtX [c + b*p] = Sum;
+      }
+   for (i = 0; i < p*p; i++)
+      Mixed->XtXChol [i] = Mixed->XtX [i];
+   if (!Cholesky (Mixed->XtXChol, p))
+      return (FALSE);
+
+   for (i = 0; i < n; i++)
+   {
+      g = Mixed->Group [i];
+      for (a = 0; a < q; a++)
+      {
+         for (b = 0; b < q; b++)
+            Mixed->ZtZ [g*q*q + a + b*q] += Z [a*n + i] * Z [b*n + i];
+         for (c = 0; c < p; c++)
+            Mixed->ZtX [g*q*p + a + c*q] += Z [a*n + i] * X [c*n + i];
+      }
+   }
+   return (TRUE);
+}     /* CrossProducts */
+
+
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : CheckMatrix
+@INPUT      : Data - an mxArray from MATLAB
+              n - number of rows it must have (or -1 for any)
+              Singles - whether it may be single rather than double
+              Name - what to call it in error messages
+@OUTPUT     :
+@RETURNS    : (void) -- aborts if Data is not a real, full matrix of
+              doubles (or singles) with n rows
+@DESCRIPTION:
+@METHOD     :
+@GLOBALS    : ErrMsg
+@CALLS      : ErrAbort
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+static void CheckMatrix (const mxArray *Data, long n, Boolean Singles,
+                         char *Name)
+{
+   if ((Data == NULL) || mxIsComplex (Data) ||
+       (!mxIsDouble (Data) && !(Singles && mxIsSingle (Data))) ||
+       mxIsSparse (Data) || (mxGetNumberOfDimensions (Data) != 2) ||
+       ((n >= 0) && ((long) mxGetM (Data) != n)))
+   {
+      sprintf (ErrMsg, "%s must be a real, full matrix of %s with one "
+               "row per subject", Name, Singles ? "doubles or singles" :
+               "doubles");
+      ErrAbort (ErrMsg, TRUE, ERR_ARGS);
+   }
+}
+
+
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : mexFunction
+@INPUT      : nlhs, nrhs - number of output/input arguments (from MATLAB)
+              prhs - actual input arguments
+@OUTPUT     : plhs[0..5] - beta, se, t, sigma2, theta and evals (see
+                lmefit.m)
+@RETURNS    : (void)
+@DESCRIPTION: Checks the arguments and computes the cross products that
+              every voxel shares, then fits all the voxels with a pool
+              of threads, each with its own workspace.
+@METHOD     :
+@GLOBALS    : ErrMsg
+@CALLS      : CheckMatrix, CrossProducts, RunTasks, FitTask
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+void mexFunction(int    nlhs,
+                 mxArray *plhs[],
+                 int    nrhs,
+                 const mxArray *prhs[])
+{
+   MixedRec     Mixed;
+   char        *Pattern;
+   char        *Method;
+   long         NumThreads;
+   long         NumTasks;
+   long         n, p, q, i;
+   double       Level;
+   int          Result;
+   int          t;
+
+   ErrMsg = (char *) mxCalloc (256, sizeof (char));
+
+   if ((nrhs < MIN_IN_ARGS) || (nrhs > MAX_IN_ARGS) || (nlhs > MAX_OUT_ARGS))
+   {
+      ErrAbort ("Incorrect number of arguments", TRUE, ERR_ARGS);
+   }
+
+   CheckMatrix (FIXED, -1, FALSE, "fixed");
+   n = (long) mxGetM (FIXED);
+   p = (long) mxGetN (FIXED);
+   if ((p < 1) || (p > MAX_COEFFS) || (n <= p))
+   {
+      sprintf (ErrMsg, "fixed must have 1 to %d columns, and more rows "
+               "than columns", MAX_COEFFS);
+      ErrAbort (ErrMsg, TRUE, ERR_ARGS);
+   }
+   CheckMatrix (RANDOM, n, FALSE, "random");
+   q = (long) mxGetN (RANDOM);
+   if ((q < 1) || (q > MAX_RANDOM))
+   {
+      sprintf (ErrMsg, "random must have 1 to %d columns", MAX_RANDOM);
+      ErrAbort (ErrMsg, TRUE, ERR_ARGS);
+   }
+   CheckMatrix (GROUP, n, FALSE, "group");
+   CheckMatrix (RESPONSE, n, TRUE, "response");
+   if (mxGetN (GROUP) != 1)
+   {
+      ErrAbort ("group must be a column vector", TRUE, ERR_ARGS);
+   }
+
+   Mixed.n = n;
+   Mixed.p = p;
+   Mixed.q = q;
+   Mixed.X = mxGetPr (FIXED);
+   Mixed.Z = mxGetPr (RANDOM);
+   Mixed.Group = (long *) mxCalloc (n, sizeof (long));
+   Mixed.m = 0;
+   for (i = 0; i < n; i++)
+   {
+      Level = mxGetPr (GROUP) [i];
+      if (!(Level >= 1) || (Level != floor (Level)))
+      {
+         ErrAbort ("group must hold positive integers", TRUE, ERR_ARGS);
+      }
+      Mixed.Group [i] = (long) Level - 1;
+      Mixed.m = max (Mixed.m, (long) Level);
+   }
+   Mixed.Response = mxGetData (RESPONSE);
+   Mixed.ResponseIsFloat = mxIsSingle (RESPONSE);
+   Mixed.NumVoxels = (long) mxGetN (RESPONSE);
+
+   /* The covariance pattern, and the criterion */
+
+   Mixed.Pattern = FULL_CHOLESKY;
+   if ((nrhs >= PATTERN_POS) && !mxIsEmpty (PATTERN))
+   {
+      if (ParseStringArg (PATTERN, &Pattern) == NULL)
+      {
+         ErrAbort ("pattern must be a string", TRUE, ERR_ARGS);
+      }
+      for (t = 0; t < NUM_PATTERNS; t++)
+      {
+         if (strcmp (Pattern, PatternNames [t]) == 0)
+            break;
+      }
+      if (t == NUM_PATTERNS)
+      {
+         sprintf (ErrMsg, "Unknown covariance pattern %.40s", Pattern);
+         ErrAbort (ErrMsg, TRUE, ERR_ARGS);
+      }
+      Mixed.Pattern = t;
+   }
+   Mixed.NumParams = NumParams (Mixed.Pattern, q);
+
+   Mixed.Reml = TRUE;
+   if ((nrhs >= METHOD_POS) && !mxIsEmpty (METHOD))
+   {
+      if (ParseStringArg (METHOD, &Method) == NULL)
+      {
+         ErrAbort ("method must be a string", TRUE, ERR_ARGS);
+      }
+      if ((strcmp (Method, "REML") != 0) && (strcmp (Method, "ML") != 0))
+      {
+         ErrAbort ("method must be 'REML' or 'ML'", TRUE, ERR_ARGS);
+      }
+      Mixed.Reml = (strcmp (Method, "REML") == 0);
+   }
+
+   /* The number of threads; one (ie. no threads) by default */
+
+   NumThreads = 1;
+   if (nrhs >= THREADS_POS)
+   {
+      Result = ParseIntArg (NUM_THREADS, 1, &NumThreads);
+      if ((Result < 0) || ((Result == 1) && (NumThreads < 1)))
+      {
+         ErrAbort ("num_threads must be a positive scalar", TRUE, ERR_ARGS);
+      }
+      if (Result == 0)
+      {
+         NumThreads = DefaultThreads ();
+      }
+   }
+
+   NumThreads = min (NumThreads, MAX_THREADS);
+   Mixed.TaskVoxels = max ((Mixed.NumVoxels + NumThreads*TASKS_PER_THREAD - 1)
+                           / (NumThreads*TASKS_PER_THREAD), MIN_TASK_VOXELS);
+   NumTasks = (Mixed.NumVoxels + Mixed.TaskVoxels - 1) / Mixed.TaskVoxels;
+   NumThreads = min (NumThreads, max (NumTasks, 1));
+
+   /*
+    * Everything is allocated here, since the mx functions may only be
+    * called from this thread.
+    */
+
+   Mixed.XtX = (double *) mxCalloc (p * p, sizeof (double));
+   Mixed.XtXChol = (double *) mxCalloc (p * p, sizeof (double));
+   Mixed.ZtZ = (double *) mxCalloc (Mixed.m * q * q, sizeof (double));
+   Mixed.ZtX = (double *) mxCalloc (Mixed.m * q * p, sizeof (double));
+   if (!CrossProducts (&Mixed))
+   {
+      ErrAbort ("fixed is rank deficient", TRUE, ERR_ARGS);
+   }
+
+   BETA = mxCreateDoubleMatrix (p, Mixed.NumVoxels, mxREAL);
+   STD_ERR = mxCreateDoubleMatrix (p, Mixed.NumVoxels, mxREAL);
+   T_VALUES = mxCreateDoubleMatrix (p, Mixed.NumVoxels, mxREAL);
+   SIGMA2 = mxCreateDoubleMatrix (1, Mixed.NumVoxels, mxREAL);
+   THETA = mxCreateDoubleMatrix (Mixed.NumParams, Mixed.NumVoxels, mxREAL);
+   Mixed.Beta = mxGetPr (BETA);
+   Mixed.SE = mxGetPr (STD_ERR);
+   Mixed.T = mxGetPr (T_VALUES);
+   Mixed.Sigma2 = mxGetPr (SIGMA2);
+   Mixed.Theta = mxGetPr (THETA);
+   EVALS = mxCreateDoubleMatrix (1, Mixed.NumVoxels, mxREAL);
+   Mixed.Evals = mxGetPr (EVALS);
+   Mixed.NaN = mxGetNaN ();
+
+   for (t = 0; t < NumThreads; t++)
+   {
+      Mixed.Work [t] = (double *) mxCalloc (n + Mixed.m * q,
+                                            sizeof (double));
+   }
+
+   (void) RunTasks (NumTasks, (int) NumThreads, FitTask, &Mixed);
+
+   for (t = 0; t < NumThreads; t++)
+   {
+      mxFree (Mixed.Work [t]);
+   }
+
+}     /* mexFunction */
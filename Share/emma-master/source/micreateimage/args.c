@@ -9,7 +9,7 @@
 @GLOBALS    : 
 @CALLS      : 
 @CREATED    : 
-@MODIFIED   : 
+@MODIFIED   : the option globals moved here from micreateimage.c
 @VERSION    : $Id: args.c,v 1.7 1997-10-20 18:30:41 greg Rel $
               $Name:  $
 ---------------------------------------------------------------------------- */
@@ -23,10 +23,43 @@
 #include "args.h"		/* prototypes for functions in this file */
 
 
+/* 
+ * Various options from the command line.  These must be global for
+ * ParseArgv to work correctly.  They are interpreted by the functions
+ * in this file, and thence passed to the various functions (in
+ * dimensions.c, createimage.c and micreateimage.c) that need them.
+ * (They are defined here rather than with main() so that minewimage,
+ * which links this file but sets the options itself, shares the same
+ * definitions.)  Note that gChildFile and gParentFile are the filenames; gChildFile doesn't really need to be global
+ * (since it's not parsed out by ParseArgv -- it's just left over in
+ * argv[]), but I've made it global for consistency.  (Also, this way
+ * functions that set ErrMsg and need to know the name of the child
+ * file can do so without yet another argument being added to that 
+ * function.)  Also, the "g" in all these just stands for "global".
+ */
+
+int     gSizes [MAX_IMAGE_DIM] = {-1,-1,-1,-1};
+char   *gTypeStr = "byte";
+double  gValidRange [NUM_VALID];
+char   *gOrientation = "transverse";
+char   *gChildFile;
+char   *gParentFile;
+double  gImageVal = DBL_MAX;
+int     gClobberFlag = FALSE;
+int     gCompress = -1;
+int     gChunk = -1;
+
+/* Type strings (borrowed from Peter Neelin's mincinfo.c) */
+
+char *type_names[] = 
+   { NULL, "byte", "char", "short", "long", "float", "double" };
+
+
+
 /*
  * Define the valid command line arguments (-size, -type, -valid_range,
- * -orientation, and -value); what type of arguments should follow them;
- * and where to put those arguments when found.
+ * -orientation, -value, -compress and -chunk); what type of arguments
+ * should follow them; and where to put those arguments when found.
  */
       
      
@@ -46,6 +79,10 @@ ArgvInfo ArgTable [] =
        "value with which to fill the image" },
    {"-clobber", ARGV_CONSTANT, (char *) TRUE, (char *) &gClobberFlag,
        "overwrite child file if it already exists" },
+   {"-compress", ARGV_INT, (char *) 1, (char *) &gCompress,
+       "zlib compression level (0-9, 0 for none) of MINC 2 files" },
+   {"-chunk", ARGV_INT, (char *) 1, (char *) &gChunk,
+       "edge length of the image's chunks in MINC 2 files (0 for none)" },
       
    {NULL, ARGV_END, NULL, NULL, NULL}
 };
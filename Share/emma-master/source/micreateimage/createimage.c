@@ -0,0 +1,876 @@
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : createimage.c
+@DESCRIPTION: The guts of micreateimage: given an (optional) open parent
+              file, creates a new MINC file with its image dimensions,
+              dimension variables, image and image max/min variables,
+              and copies everything else of interest from the parent.
+              None of these functions exit or print; they all set
+              ErrMsg and return FALSE on error, so that they can be
+              called in-process (see minewimage.c) as well as from
+              micreateimage's main().
+@GLOBALS    : ErrMsg, gParentFile (used by dimensions.c for messages)
+@CALLS      : MINC, NetCDF libraries
+              functions in dimensions.c
+@CREATED    : code moved from micreateimage.c
+@MODIFIED   : 
+@VERSION    : $Id: createimage.c,v 1.1 $
+              $Name:  $
+---------------------------------------------------------------------------- */
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <float.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <assert.h>
+#include <netcdf.h>
+#include "minc.h"
+#include "mincutil.h"           /* for NCErrMsg () */
+#include "micreateimage.h"
+#include "dimensions.h"
+#include "createimage.h"
+#undef DEBUG
+
+/*
+ * Storage of the image variable in MINC 2 (HDF5) files; see ChunkEdge.
+ * CHUNK_CACHE_BYTES is the size of HDF5's default chunk cache, which
+ * is what MINC reads through.
+ */
+
+#define DEFAULT_COMPRESS   4            /* zlib level, as the MINC tools */
+#define CHUNK_CACHE_BYTES  (1024L*1024L)
+#define MIN_CHUNK_EDGE     8
+
+
+#ifdef DEBUG
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : DumpInfo
+@INPUT      : CDF - a NetCDF file handle
+@OUTPUT     : Info to stdout.
+@RETURNS    : (void)
+@DESCRIPTION: Prints to stdout a bunch of handy information about a NetCDF 
+              file.  Includes number of dimensions, variables, and global
+	      attributes; dimension lengths; variable types and dimensions.
+@METHOD     : 
+@GLOBALS    : 
+@CALLS      : NetCDF library
+@CREATED    : November 1993, Greg Ward.
+@MODIFIED   : 
+---------------------------------------------------------------------------- */
+void DumpInfo (int CDF)
+{
+   int     NumDims;
+   int     NumVars;
+   int     NumAtts;
+   int     i, j;
+   char    Name [MAX_NC_NAME];
+   long    Len;
+   nc_type Type;
+   int	   DimList [MAX_NC_DIMS];
+
+   if (CDF < 0) return;
+
+   ncinquire (CDF, &NumDims, &NumVars, &NumAtts, NULL);
+   printf ("%d dimensions, %d variables, %d global attributes\n",
+           NumDims, NumVars, NumAtts);
+
+   for (i = 0; i < NumDims; i++)
+   {
+      ncdiminq (CDF, i, Name, &Len);
+      printf ("Dim %d: %s (length %ld)\n", i, Name, Len);
+   }
+
+   for (i = 0; i < NumVars; i++)
+   {
+      ncvarinq (CDF, i, Name, &Type, &NumDims, DimList, &NumAtts);
+      printf ("Var %d: %s (%s) (%d dimensions:", 
+	      i, Name, type_names[Type], NumDims);
+      for (j = 0; j < NumDims; j++)
+      {
+	 ncdiminq (CDF, DimList[j], Name, NULL);
+	 printf (" %s", Name);
+      }
+      printf (")\n");
+   }	
+}
+#endif
+
+
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : ChunkEdge
+@INPUT      : NumSlices, Height, Width - image dimension lengths
+              NCType - type of the image variable
+@OUTPUT     : 
+@RETURNS    : the edge length (in voxels) of the chunks to store the
+              image in
+@DESCRIPTION: Picks a chunk size suited to the way ReadImages reads a
+              volume: one whole slice (or a block of rows of it) at a
+              time, working through the slices in order.  MINC 2 chunks
+              are cubes (cut down to the length of any shorter
+              dimension), so each chunk holds Edge consecutive slices
+              of part of the image.  Edge is chosen so that Edge whole
+              images fit in the chunk cache: then reading slice after
+              slice decompresses each chunk only once, where a larger
+              chunk (or a cache too small for a row of chunks) would
+              have it decompressed again for every slice it holds.  Small
+              images thus get chunks that are whole images, many slices
+              deep; images too big for even a few slices to fit in the
+              cache get chunks of MIN_CHUNK_EDGE, to keep the number of
+              chunks within reason.
+@METHOD     : 
+@GLOBALS    : 
+@CALLS      : 
+@CREATED    : 
+@MODIFIED   : 
+---------------------------------------------------------------------------- */
+long ChunkEdge (long NumSlices, long Height, long Width, nc_type NCType)
+{
+   long    Edge;
+   long    Largest;
+
+   Edge = CHUNK_CACHE_BYTES / (Height * Width * nctypelen (NCType));
+
+   Largest = (Height > Width) ? Height : Width;
+   if (NumSlices > Largest)
+   {
+      Largest = NumSlices;
+   }
+
+   if (Edge > Largest)
+   {
+      Edge = Largest;
+   }
+   if (Edge < MIN_CHUNK_EDGE)
+   {
+      Edge = MIN_CHUNK_EDGE;
+   }
+   return (Edge);
+
+}     /* ChunkEdge */
+
+
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : CreateChild
+@INPUT      : child_file  -> The name of the child file to be created.
+              Clobber     -> whether to overwrite child_file if it exists
+              Compress    -> zlib compression level for the image (0-9,
+                             where 0 means no compression)
+              Chunk       -> edge length of the image's chunks, or 0 to
+                             store the image contiguously
+@OUTPUT     : child_CDF   -> The cdfid of the created child file.
+@RETURNS    : TRUE if all went well
+              FALSE if error creating child file (ErrMsg is set)
+@DESCRIPTION: Creates the new MINC file, which is left open for
+              definition.  Compress and Chunk only apply when built
+              against MINC 2 (-DMINC2), which creates MINC 2 (HDF5)
+              files; NetCDF files have no compression or chunking, so
+              they are ignored otherwise.
+@METHOD     :
+@GLOBALS    : ErrMsg
+@CALLS      : NetCDF routines
+@CREATED    : May 31, 1993 by MW (as part of OpenFiles)
+@MODIFIED   : split out of OpenFiles; clobbering is now an argument
+              rather than the gClobberFlag global.
+              creates MINC 2 files, compressed and chunked, under MINC 2
+---------------------------------------------------------------------------- */
+Boolean CreateChild (char child_file[], Boolean Clobber,
+                     int Compress, long Chunk, int *child_CDF)
+{
+   struct stat statbuf;		/* used to check that created file exists */
+   int    cmode;
+#ifdef MINC2
+   struct mi2opts opts;
+#endif
+
+   /* 
+    * Create the child file, bomb if any error.  N.B. we call nccreate() 
+    * with a mode of NC_NOCLOBBER here because if we use NC_CLOBBER and 
+    * the file is uncreatable (eg. permission denied), then the NetCDF
+    * code incorrectly attempts to delete the file; this results in
+    * errno being clobbered, so we'd print out an inaccurate error 
+    * message here.
+    */
+
+   cmode = Clobber ? NC_CLOBBER : NC_NOCLOBBER;
+#ifdef MINC2
+   opts.struct_version = MI2_OPTS_V1;
+   opts.comp_type = (Compress > 0) ? MI2_COMP_ZLIB : MI2_COMP_UNKNOWN;
+   opts.comp_param = Compress;
+   opts.chunk_type = (Chunk > 0) ? MI2_CHUNK_ON : MI2_CHUNK_OFF;
+   opts.chunk_param = (int) Chunk;
+
+   *child_CDF = micreatex (child_file, cmode | MI2_CREATE_V2, &opts);
+#else
+   *child_CDF = nccreate (child_file, cmode);
+#endif
+   if (*child_CDF == MI_ERROR) 
+   {
+      sprintf (ErrMsg, "Error creating file %s: %s\n",
+               child_file, NCErrMsg (ncerr, errno));
+      return (FALSE);
+   }
+
+   /* 
+    * Now just check to make sure the file exists and has non-zero size
+    * (because NetCDF fails to report disk full!)
+    */
+
+   if (stat (child_file, &statbuf) != 0)
+   {
+      sprintf (ErrMsg, "File %s was not created: disk may be full\n",
+	       child_file);
+      ncclose (*child_CDF);
+      return (FALSE);
+   }
+
+#ifdef DEBUG
+   printf ("CreateChild: child file %s, CDF %d\n\n", child_file, *child_CDF);
+#endif
+
+   return (TRUE);
+}      /* CreateChild () */
+
+
+
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : FinishExclusionLists
+@INPUT      : ParentCDF
+              NumChildDims
+              ChildDimNames
+@OUTPUT     : NumExclude
+              Exclude
+@RETURNS    : 
+@DESCRIPTION: Finishes off the list of variables to exclude from mass
+              copying from parent to child file.  This includes
+              dimension and dimension-width variables associated with
+              dimensions in the parent file that don't exist in the
+              child file; and the obvious ones not to copy:
+              MIrootvariable, MIimage, MIimagemax, MIimagemin.
+@METHOD     : 
+@GLOBALS    : 
+@CALLS      : MINC/NetCDF stuff
+@CREATED    : fall 1993, Greg Ward
+@MODIFIED   : 
+---------------------------------------------------------------------------- */
+void FinishExclusionLists (int ParentCDF,
+			   int NumChildDims, char *ChildDimNames[],
+			   int *NumExclude, int Exclude[])
+{
+   int	NumParentDims;
+   int	CurParentDim;
+   char ParentDimName [MAX_NC_NAME];
+   char ParentVarName [MAX_NC_NAME];
+   int	ParentVar;
+   int	WidthVar;
+   int	CurChildDim;
+   int	DimMatch;
+
+#ifdef DEBUG
+   int  i;
+
+   printf ("FinishExclusionLists\n");
+   printf (" Initial list of variables to exclude from copying:\n");
+   for (i = 0; i < *NumExclude; i++)
+   {
+      ParentVar = Exclude [i];
+      ncvarinq (ParentCDF, ParentVar, ParentVarName, NULL, NULL, NULL, NULL);
+      printf ("  %s (ID %d)\n", ParentVarName, ParentVar);
+   }
+   putchar ('\n');
+#endif
+
+   /* 
+    * Find all dimensions in the parent file, and for any that do not
+    * have a corresponding dimension in the child file (using 
+    * ChildDimNames[] to match), add that parent dimension to both
+    * exclusion lists.
+    */
+
+#ifdef DEBUG
+   printf (" Looking for unmatched parent dimensions...\n");
+#endif
+
+   ncinquire (ParentCDF, &NumParentDims, NULL, NULL, NULL);
+   for (CurParentDim = 0; CurParentDim < NumParentDims; CurParentDim++)
+   {
+      ncdiminq (ParentCDF, CurParentDim, ParentDimName, NULL);
+
+#ifdef DEBUG
+      printf ("  Checking parent dimension %d (%s)\n", 
+	      CurParentDim, ParentDimName);
+#endif
+
+      /* 
+       * Get the ID's of the variables with the same name as this
+       * dimension, and with the dimension name + "-width" -- these
+       * will be needed if we are to add anything to the exclusion lists
+       */
+
+      strcpy (ParentVarName, ParentDimName);
+      ParentVar = ncvarid (ParentCDF, ParentVarName);
+
+      strcat (ParentVarName, "-width");
+      WidthVar = ncvarid (ParentCDF, ParentVarName);
+
+      /* Skip to next parent dimension if NEITHER one was found */
+
+      if ((ParentVar == -1) && (WidthVar == -1))
+      {
+	 continue;
+      }
+
+#ifdef DEBUG
+      printf ("  Dimension variable ID: %d; dimension-width variable ID: %d\n",
+	      ParentVar, WidthVar);
+#endif
+
+      /* 
+       * Loop through the names of the dimensions in the child file,
+       * stopping only when we find one that matches ParentDimName
+       * (or have gone through all the child's dimensions)
+       */
+
+      CurChildDim = 0;
+      do
+      {
+#ifdef DEBUG
+	 printf ("   Comparing with child dimension %d (%s)\n",
+		 CurChildDim, ChildDimNames[CurChildDim]);
+#endif
+	 DimMatch = strcmp (ParentDimName, ChildDimNames[CurChildDim]);
+	 CurChildDim++;
+      } while ((DimMatch != 0) && (CurChildDim < NumChildDims));
+
+      /*
+       * If we got here without finding a dimension in the child file  
+       * with the same name is the current dimension in the parent file,
+       * then add this dimension's dimension and dimension-width variables
+       * to both exclusion lists (but only if these variables actually
+       * exist!)
+       */
+
+      if (DimMatch != 0)
+      {
+	 if (ParentVar != -1)
+	 {
+	    Exclude [(*NumExclude)++] = ParentVar;
+	 }
+
+	 if (WidthVar != -1)
+	 {
+	    Exclude [(*NumExclude)++] = WidthVar;
+	 }
+      }
+   }     /* for CurParentDim */
+
+   /* 
+    * Now add all the obvious ones: MIrootvariable, MIimage, 
+    * MIimagemax, MIimagemin 
+    */
+
+   ParentVar = ncvarid (ParentCDF, MIrootvariable);
+   if (ParentVar != -1)
+   {
+      Exclude [(*NumExclude)++] = ParentVar;
+   }
+   
+   ParentVar = ncvarid (ParentCDF, MIimage);
+   if (ParentVar != -1)
+   {
+      Exclude [(*NumExclude)++] = ParentVar;
+   }
+   
+   ParentVar = ncvarid (ParentCDF, MIimagemax);
+   if (ParentVar != -1)
+   {
+      Exclude [(*NumExclude)++] = ParentVar;
+   }
+   
+   ParentVar = ncvarid (ParentCDF, MIimagemin);
+   if (ParentVar != -1)
+   {
+      Exclude [(*NumExclude)++] = ParentVar;
+   }
+   
+
+#ifdef DEBUG
+   printf (" Final list of variables to exclude from copying:\n");
+   for (i = 0; i < *NumExclude; i++)
+   {
+      ParentVar = Exclude [i];
+      ncvarinq (ParentCDF, ParentVar, ParentVarName, NULL, NULL, NULL, NULL);
+      printf ("  %s (ID %d)\n", ParentVarName, ParentVar);
+   }
+   putchar ('\n');
+#endif
+
+}     /* FinishExclusionLists () */
+
+
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : CreateImageVars
+@INPUT      : CDF - ID of the MINC file in which to create MIimagemax
+                    and MIimagemin variables
+              NumDim - *total* number of image dimensions (2,3, or 4)
+              DimIDs - ID's of the NumDim image dimensions
+	      NCType - type of the image variable
+	      Signed - TRUE or FALSE, for the image variable
+	      ValidRange - for the image variable
+@OUTPUT     : 
+@RETURNS    : TRUE on success
+              FALSE if any error creating either variable
+              (sets ErrMsg on error)
+@DESCRIPTION: Create the MIimagemax and MIimagemin variables in a newly
+              created MINC file (must be in definition mode!).  The 
+              variables will depend on the two lowest (slowest-varying) 
+              image dimensions, ie. frames and slices in the full 4-D
+              case.  If the file has no frames or no slices (or both),
+              that will be handled properly.
+@METHOD     : 
+@GLOBALS    : ErrMsg
+@CALLS      : MINC library
+@CREATED    : 93-10-28, Greg Ward: code moved from main()
+@MODIFIED   : 93-11-10, GPW: renamed and modified from CreateMinMax
+---------------------------------------------------------------------------- */
+Boolean CreateImageVars (int CDF, int NumDim, int DimIDs[], 
+			 nc_type NCType, Boolean Signed, double ValidRange[])
+{
+   int  image_id;
+   int  max_id, min_id;         /* ID's of the newly-created variables */
+
+#ifdef DEBUG
+   printf ("CreateImageVars:\n");
+   printf (" Creating MIimage variable with %d dimensions\n", NumDim);
+#endif
+
+   image_id = micreate_std_variable (CDF, MIimage, NCType, NumDim, DimIDs);
+   (void) miattputstr (CDF, image_id, MIsigntype, MI_SIGN_STR(Signed));
+   (void) miattputstr (CDF, image_id, MIcomplete, MI_FALSE);
+   
+   (void) ncattput (CDF, image_id, MIvalid_range, NC_DOUBLE, 2, ValidRange);
+
+   /*
+    * Create the image-max and image-min variables.  They should be
+    * dependent on the "non-image" dimensions (ie. time and slices,
+    * if they exist), so pass NumDim-2 as the number of
+    * dimensions, and DimIDs as the list of dimension ID's -- 
+    * micreate_std_variable should then only look at the first one
+    * or two dimension IDs in the list.
+    */
+
+#ifdef DEBUG
+   printf (" creating MIimagemin and MIimagemax with %d dimensions\n",
+           NumDim-2);
+#endif
+   
+   max_id = micreate_std_variable (CDF, MIimagemax, NC_DOUBLE,
+                                   NumDim-2, DimIDs);
+   min_id = micreate_std_variable (CDF, MIimagemin, NC_DOUBLE,
+                                   NumDim-2, DimIDs);
+   
+   if ((max_id == MI_ERROR) || (min_id == MI_ERROR))
+   {  
+      sprintf (ErrMsg, "Error creating image max/min variables: %s\n",
+               NCErrMsg (ncerr, errno));
+      return (FALSE);
+   }
+
+   return (TRUE);
+
+}     /* CreateImageVars () */
+
+
+
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : UpdateHistory
+@INPUT      : ChildCDF - the MINC file which will have TimeStamp prepended
+                         to its history attribute
+              TimeStamp - string to be added to history attribute in ChildCDF
+@OUTPUT     : (none)
+@RETURNS    : (void)
+@DESCRIPTION: Update the history of a MINC file by appending a string
+              to it.  The history attribute will be created if it does
+              not exist in the file specified by CDF; otherwise, its
+              current value will be read in, the string TimeStamp will
+              be appended to it, and it will be re-written.
+@METHOD     : 
+@GLOBALS    : 
+@CALLS      : NetCDF, MINC libraries
+@CREATED    : 93-10-27, Greg Ward (from MW's code formerly in micreate)
+@MODIFIED   : 93-11-16, Greg Ward: removed references to parent file; the
+              attribute should now be copied from the parent file before
+	      UpdateHistory is ever called.
+---------------------------------------------------------------------------- */
+void UpdateHistory (int ChildCDF, char *TimeStamp)
+{
+   nc_type  HistType;
+   int      HistLen;
+
+#ifdef DEBUG
+   printf ("UpdateHistory:\n");
+#endif
+
+
+   /* Update the history of the child file */
+   
+   if (ncattinq (ChildCDF,NC_GLOBAL,MIhistory,&HistType,&HistLen) == MI_ERROR)
+   {
+#ifdef DEBUG
+      printf (" creating history attribute\n");
+#endif
+      ncattput (ChildCDF, NC_GLOBAL, MIhistory, NC_CHAR, 
+                strlen(TimeStamp), TimeStamp);
+   }
+   else
+   {
+      char    *OldHist;
+      char    *NewHist;
+
+#ifdef DEBUG
+      printf (" adding to history attribute\n");
+#endif
+      OldHist = (char *) malloc ((size_t) (HistLen*sizeof(char) + 1));
+      ncattget (ChildCDF, NC_GLOBAL, MIhistory, OldHist);
+      NewHist = (char *) malloc 
+         ((size_t) (HistLen*sizeof(char) + strlen(TimeStamp)*sizeof(char) + 1));
+      strcpy (NewHist, OldHist);
+      strcat (NewHist, TimeStamp);
+      ncattput (ChildCDF, NC_GLOBAL, MIhistory, NC_CHAR, 
+                strlen(NewHist), NewHist);
+      free (NewHist);
+      free (OldHist);
+   }
+}     /* UpdateHistory () */
+
+
+
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : CopyOthers
+@INPUT      : ParentCDF  - CDF ID of the parent file
+              ChildCDF   - CDF ID of the child file
+              NumExclude - number of variables to exclude from the copy
+              Exclude    - list of variable ID's to be excluded
+              TimeStamp  - line to add to the history attribute
+@OUTPUT     : 
+@RETURNS    : TRUE if successfull
+              FALSE if any of micopy_all_var_defs(), ncendef(), 
+                 or mi_copy_all_var_values() indicate failure
+                 (ErrMsg is set; the child file is left open)
+@DESCRIPTION: Copies the definitions and values of all variables except 
+              those in the exclusion list.  Also calls UpdateHistory() to
+              update the history line.  The child file should be in 
+              definition mode when CopyOthers() is called; it will be
+	      ncendef()'d (put in update mode) before variable values are
+	      copied, and left that way on exit.
+@METHOD     : 
+@GLOBALS    : 
+@CALLS      : UpdateHistory
+@CREATED    : fall 1993, Greg Ward
+@MODIFIED   : moved to createimage.c; no longer closes ChildCDF on error
+---------------------------------------------------------------------------- */
+Boolean CopyOthers (int ParentCDF, int ChildCDF, 
+		    int NumExclude, int Exclude[],
+		    char *TimeStamp)
+{
+#ifdef DEBUG
+   printf ("CopyOthers:\n");
+   printf (" copying variable definitions...\n");
+#endif
+
+   if (micopy_all_var_defs(ParentCDF, ChildCDF, NumExclude, Exclude) == MI_ERROR)
+   {
+      sprintf (ErrMsg, "Error copying variable definitions: %s", 
+	       NCErrMsg (ncerr, errno));
+      return (FALSE);
+   }
+
+#ifdef DEBUG
+   printf (" updating history...\n");
+#endif 
+
+   UpdateHistory (ChildCDF, TimeStamp);
+
+#ifdef DEBUG
+   printf (" ncendef'ing and copying variable values...\n");
+#endif
+   if (ncendef (ChildCDF) == MI_ERROR)
+   {
+      sprintf (ErrMsg, "Error updating file (ncendef): %s",
+	       NCErrMsg (ncerr, errno));
+      return (FALSE);
+   }
+
+   if (micopy_all_var_values(ParentCDF, ChildCDF, NumExclude, Exclude) == MI_ERROR)
+   {
+      sprintf (ErrMsg, "Error copying variable values: %s", 
+	       NCErrMsg (ncerr, errno));
+      return (FALSE);
+   }
+
+   return (TRUE);
+
+}     /* CopyOthers () */
+
+
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : FillImage
+@INPUT      : CDF
+              NumDim - number of image dimensions in the child file
+	      DimIDs - list of image dimension IDs
+	      Value  - value with which to fill the image variable
+@OUTPUT     : 
+@RETURNS    : TRUE if successful, FALSE on error (ErrMsg is set)
+@DESCRIPTION: Fills the image variable in the child file with 
+              a given value.  File must be in data mode.
+@METHOD     : 
+@GLOBALS    : 
+@CALLS      : 
+@CREATED    : 95/6/28, Greg Ward
+@MODIFIED   : set ErrMsg rather than printing errors to stderr
+---------------------------------------------------------------------------- */
+Boolean FillImage (int CDF, int NumDim, int DimIDs[], double Value)
+{
+   int   i;
+   long  start[MAX_NC_DIMS], count[MAX_NC_DIMS];
+   int   image_elt = 1;		/* # elements in MIimage variable */
+   int   maxmin_elt = 1;	/* # elements in MIimage{max,min} vars */
+   double *values;
+   int   var_id;
+   
+   
+   /* 
+    * First compute the total number of elements in the image, and
+    * also make a count vector for passing to mivarput().
+    */
+
+   for (i = 0; i < NumDim; i++)
+   {
+      long   dimlength;
+      char   dimname [MAX_NC_NAME];
+
+      ncdiminq (CDF, DimIDs[i], dimname, &dimlength);
+      if (dimlength > 0)
+      {
+	 image_elt *= dimlength;
+	 if (i < NumDim-2) maxmin_elt *= dimlength;
+	 start[i] = 0;
+	 count[i] = dimlength;
+      }
+      else
+      {
+	 sprintf (ErrMsg, "Image dimension %s has length %ld",
+		  dimname, dimlength);
+	 return (FALSE);
+      }
+   }
+   assert (maxmin_elt <= image_elt);
+
+   /*
+    * Now allocate and fill a big chunk of memory that will hold
+    * image_elt copies of Value.
+    */
+
+   values = (double *) malloc (image_elt * sizeof (double));
+   if (values == NULL)
+   {
+      sprintf (ErrMsg, "Out of memory filling image variable");
+      return (FALSE);
+   }
+   for (i = 0; i < image_elt; i++)
+      values[i] = Value;
+   
+   /* Put the values into the image variable in the MINC file */
+   
+   var_id = ncvarid (CDF, MIimage);
+   if (var_id == MI_ERROR)
+   {
+      sprintf (ErrMsg, "Could not find image variable");
+      free (values);
+      return (FALSE);
+   }
+
+   if (mivarput (CDF, var_id, start, count, NC_DOUBLE, NULL, values)
+       == MI_ERROR)
+   {
+      sprintf (ErrMsg, "Error writing image values: %s",
+	       NCErrMsg(ncerr, errno));
+      free (values);
+      return (FALSE);
+   }
+
+   /* 
+    * Now do the same for the image-max and image-min variables.
+    * Since we've just filled image with a single value, we can use
+    * that same value for all elememts of image-max and image-min.
+    * In fact, since maxmin_elt has to be <= image_elt, we can 
+    * just reuse the values array that we've just created.
+    */
+
+   var_id = ncvarid (CDF, MIimagemax);
+   mivarput (CDF, var_id, start, count, NC_DOUBLE, MI_SIGNED, values);
+   var_id = ncvarid (CDF, MIimagemin);
+   mivarput (CDF, var_id, start, count, NC_DOUBLE, MI_SIGNED, values);
+
+   free (values);
+   return (TRUE);
+}     /* FillImage () */
+
+
+
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : CreateImageFile
+@INPUT      : ParentCDF - open parent file (read-only), or -1 for none
+              ChildFile - name of the MINC file to create
+              Clobber   - whether ChildFile may be overwritten
+              NumFrames, NumSlices, Height, Width - image dimension
+                 lengths (frames and/or slices may be zero)
+              Orientation - "transverse", "sagittal" or "coronal"
+              NCType, Signed, ValidRange - for the image variable
+              ImageVal  - value to fill the image with, or DBL_MAX to
+                 leave it unwritten
+              TimeStamp - line to add to the history attribute
+              Compress  - zlib level (0-9) to compress the image with,
+                 or -1 for the default (DEFAULT_COMPRESS)
+              Chunk     - edge length of the image's chunks, or -1 to
+                 pick one for slice-by-slice reading (see ChunkEdge)
+                 -- unless Compress is 0, in which case the default is
+                 no chunking at all, the quickest to write and read
+                 (for scratch files)
+@OUTPUT     : 
+@RETURNS    : TRUE on success
+              FALSE on any error (ErrMsg is set)
+@DESCRIPTION: Creates a complete new MINC file: the image dimensions and
+              their variables, the image and image max/min variables,
+              and (if there is a parent) copies of all other variables
+              and global attributes of the parent.  This is everything
+              micreateimage does after parsing its arguments.
+
+              The parent file is only read from, and is left open, so
+              that the caller may create any number of files from the
+              one parent without reopening it.  On error, the
+              partially created child file is closed and removed.
+@METHOD     : 
+@GLOBALS    : ErrMsg
+@CALLS      : CreateChild, CreateDims, CreateDimVars, CreateImageVars,
+              FinishExclusionLists, CopyOthers, FillImage
+@CREATED    : code moved from micreateimage's main()
+@MODIFIED   : compression and chunking (Compress, Chunk)
+---------------------------------------------------------------------------- */
+Boolean CreateImageFile (int ParentCDF, char *ChildFile, Boolean Clobber,
+                         long NumFrames, long NumSlices,
+                         long Height, long Width, char *Orientation,
+                         nc_type NCType, Boolean Signed, double ValidRange[],
+                         double ImageVal, char *TimeStamp,
+                         int Compress, long Chunk)
+{
+   int     ChildCDF;
+
+   /* NumDim will be the number of image dimensions actually created in
+    * the MINC file; DimIDs and DimNames will hold the ID's and names
+    * of these dimensions.  There will be 2 dimensions if both NumFrames
+    * and NumSlices are zero; 3 dimensions if either one but not both is
+    * zero; and 4 dimensions if neither are zero.  (Height and Width must
+    * always be non-zero.)
+    */
+
+   int     NumDim;       
+   int     DimIDs [MAX_IMAGE_DIM];
+   char   *DimNames [MAX_IMAGE_DIM];
+
+   int	   NumExclude;
+   int	   Exclude[MAX_NC_DIMS];
+
+   if ((Compress < -1) || (Compress > 9))
+   {
+      sprintf (ErrMsg, "Compression level must be between 0 and 9");
+      return (FALSE);
+   }
+   if (Chunk < -1)
+   {
+      sprintf (ErrMsg, "Chunk size must not be negative");
+      return (FALSE);
+   }
+
+   if (Compress == -1)
+   {
+      Compress = DEFAULT_COMPRESS;
+   }
+   if (Chunk == -1)
+   {
+      Chunk = (Compress == 0)
+         ? 0 : ChunkEdge ((NumSlices > 0) ? NumSlices : 1, Height, Width,
+                          NCType);
+   }
+
+   if (!CreateChild (ChildFile, Clobber, Compress, Chunk, &ChildCDF))
+   {
+      return (FALSE);
+   }
+
+   if (!CreateDims (ChildCDF, NumFrames, NumSlices, Height, Width, 
+                    Orientation, &NumDim, DimIDs, DimNames) ||
+       !CreateDimVars (ParentCDF, ChildCDF, NumDim, DimIDs, DimNames, 
+                       &NumExclude, Exclude) ||
+       !CreateImageVars (ChildCDF, NumDim, DimIDs, NCType, Signed,
+                         ValidRange))
+   {
+      ncclose (ChildCDF);
+      unlink (ChildFile);
+      return (FALSE);
+   }
+
+#ifdef DEBUG
+   printf ("--------------------------------------------------------------\n");
+   printf ("State of parent immediately before entering CopyOthers:\n");
+   DumpInfo (ParentCDF);
+
+   printf ("--------------------------------------------------------------\n");
+   printf ("State of %s immediately before entering CopyOthers:\n", ChildFile);
+   DumpInfo (ChildCDF);
+#endif
+
+   /*
+    * Now, copy everything else of possible interest from the parent file
+    * (but only if it exists!) to the child file.
+    */
+
+   if (ParentCDF != -1)
+   {
+      FinishExclusionLists (ParentCDF, NumDim, DimNames, &NumExclude, Exclude);
+
+      if (!CopyOthers (ParentCDF, ChildCDF, NumExclude, Exclude, TimeStamp))
+      {
+         ncclose (ChildCDF);
+         unlink (ChildFile);
+         return (FALSE);
+      }
+   }
+
+   if (ImageVal != DBL_MAX)
+   {
+      if (ParentCDF == -1)
+      {
+         ncendef (ChildCDF);
+      }
+      if (!FillImage (ChildCDF, NumDim, DimIDs, ImageVal))
+      {
+         ncclose (ChildCDF);
+         unlink (ChildFile);
+         return (FALSE);
+      }
+   }
+
+   ncclose (ChildCDF);
+   return (TRUE);
+
+}     /* CreateImageFile () */
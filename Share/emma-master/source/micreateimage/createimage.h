@@ -0,0 +1,28 @@
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : createimage.h
+@DESCRIPTION: Supplies prototypes for functions defined in createimage.c.
+@CREATED    : 
+@MODIFIED   : 
+@VERSION    : $Id: createimage.h,v 1.1 $
+              $Name:  $
+---------------------------------------------------------------------------- */
+
+long ChunkEdge (long NumSlices, long Height, long Width, nc_type NCType);
+Boolean CreateChild (char child_file[], Boolean Clobber,
+                     int Compress, long Chunk, int *child_CDF);
+void FinishExclusionLists (int ParentCDF,
+			   int NumChildDims, char *ChildDimNames[],
+			   int *NumExclude, int Exclude[]);
+Boolean CreateImageVars (int CDF, int NumDim, int DimIDs[], 
+			 nc_type NCType, Boolean Signed, double ValidRange[]);
+void UpdateHistory (int ChildCDF, char *TimeStamp);
+Boolean CopyOthers (int ParentCDF, int ChildCDF, 
+		    int NumExclude, int Exclude[],
+		    char *TimeStamp);
+Boolean FillImage (int CDF, int NumDim, int DimIDs[], double Value);
+Boolean CreateImageFile (int ParentCDF, char *ChildFile, Boolean Clobber,
+                         long NumFrames, long NumSlices,
+                         long Height, long Width, char *Orientation,
+                         nc_type NCType, Boolean Signed, double ValidRange[],
+                         double ImageVal, char *TimeStamp,
+                         int Compress, long Chunk);
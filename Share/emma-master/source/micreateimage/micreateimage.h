@@ -47,6 +47,8 @@ extern char   *gChildFile;
 extern char   *gParentFile;
 extern double  gImageVal;
 extern int     gClobberFlag;
+extern int     gCompress;
+extern int     gChunk;
 
 /* Function prototypes: globally needed functions defined in micreateimage.c */
 
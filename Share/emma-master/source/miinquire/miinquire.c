@@ -729,6 +729,7 @@ int GetDimNames (int CDF, int nargin, const mxArray *InArgs[], int *CurInArg,
     */
 
    NameList = (char **) mxCalloc (NumDims, sizeof (char *));
+   Length = 0;
    for (i = 0; i < NumDims; i++)
    {
       NameList[i] = (char *) mxCalloc (MAX_NC_NAME+2, sizeof (char));
@@ -873,6 +874,204 @@ int GetPermutation (int CDF, int nargin, const mxArray *InArgs[], int *CurInArg,
 
 
 
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : GetWholeVar
+@INPUT      : CDF - handle to the MINC file
+              VarName - name of a numeric variable
+@OUTPUT     : 
+@RETURNS    : a column vector holding every value of the variable (as
+              doubles, converted by MINC), or an empty matrix if the
+              variable does not exist or cannot be read
+@DESCRIPTION: Reads all of a (small) variable such as MItime or
+              MIimagemax in one go.
+@METHOD     : 
+@GLOBALS    : 
+@CALLS      : NetCDF, MINC (mivarget)
+@CREATED    : 
+@MODIFIED   : 
+---------------------------------------------------------------------------- */
+mxArray *GetWholeVar (int CDF, char *VarName)
+{
+   int       VarID;
+   int       NumDims;
+   int       DimIDs [MAX_NC_DIMS];
+   long      Start [MAX_NC_DIMS];
+   long      Count [MAX_NC_DIMS];
+   long      NumValues;
+   mxArray  *mValues;
+   int       i;
+
+   VarID = ncvarid (CDF, VarName);
+   if ((VarID == MI_ERROR) ||
+       (ncvarinq (CDF, VarID, NULL, NULL, &NumDims, DimIDs, NULL) == MI_ERROR))
+   {
+      return (mxCreateDoubleMatrix (0, 0, mxREAL));
+   }
+
+   NumValues = 1;
+   for (i = 0; i < NumDims; i++)
+   {
+      Start [i] = 0;
+      ncdiminq (CDF, DimIDs [i], NULL, &Count [i]);
+      NumValues *= Count [i];
+   }
+
+   mValues = mxCreateDoubleMatrix (NumValues, 1, mxREAL);
+   if ((NumValues > 0) &&
+       (mivarget (CDF, VarID, Start, Count, NC_DOUBLE, MI_SIGNED,
+                  mxGetPr (mValues)) == MI_ERROR))
+   {
+      mxDestroyArray (mValues);
+      return (mxCreateDoubleMatrix (0, 0, mxREAL));
+   }
+   return (mValues);
+}     /* GetWholeVar */
+
+
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : GetSpatialAtts
+@INPUT      : CDF - handle to the MINC file
+@OUTPUT     : Steps, Starts - 3x1 vectors of the step and start of
+                MIxspace, MIyspace and MIzspace (in that order)
+              DirCos - 3x3 matrix with the direction cosines of those
+                dimensions as its columns
+@RETURNS    : (void)
+@DESCRIPTION: Reads the world-coordinate attributes of the spatial
+              dimensions, as getimageinfo does for 'Steps', 'Starts' and
+              'DirCosines'.  Anything missing gets the MINC default
+              (step 1, start 0, the corresponding unit vector).
+@METHOD     : 
+@GLOBALS    : 
+@CALLS      : NetCDF, MINC (miattget)
+@CREATED    : 
+@MODIFIED   : 
+---------------------------------------------------------------------------- */
+void GetSpatialAtts (int CDF, double Steps[], double Starts[], double DirCos[])
+{
+   static char *SpaceNames [3] = { MIxspace, MIyspace, MIzspace };
+   int     VarID;
+   int     NumRead;
+   int     i, j;
+
+   for (i = 0; i < 3; i++)
+   {
+      Steps [i] = 1.0;
+      Starts [i] = 0.0;
+      for (j = 0; j < 3; j++)
+      {
+         DirCos [i*3 + j] = (i == j) ? 1.0 : 0.0;
+      }
+
+      VarID = ncvarid (CDF, SpaceNames [i]);
+      if (VarID == MI_ERROR)
+      {
+         continue;
+      }
+      (void) miattget1 (CDF, VarID, MIstep, NC_DOUBLE, &Steps [i]);
+      (void) miattget1 (CDF, VarID, MIstart, NC_DOUBLE, &Starts [i]);
+      if ((miattget (CDF, VarID, MIdirection_cosines, NC_DOUBLE, 3,
+                     &DirCos [i*3], &NumRead) == MI_ERROR) || (NumRead != 3))
+      {
+         for (j = 0; j < 3; j++)
+         {
+            DirCos [i*3 + j] = (i == j) ? 1.0 : 0.0;
+         }
+      }
+   }
+}     /* GetSpatialAtts */
+
+
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : GetImageInfoStruct
+@INPUT      : (standard)
+@OUTPUT     : (standard) - next output argument will be a struct with
+                everything that openimage and getimageinfo need to know
+                about the file
+@RETURNS    : ERR_NONE if all went well
+              otherwise, an error code from one of the functions called
+@DESCRIPTION: Gathers the image size, dimension names, orientation,
+              permutation, spatial steps/starts/direction cosines, frame
+              times and lengths and the image-max/image-min vectors into
+              a single MATLAB struct, so that all the header information
+              for a file can be had with one open of the file (instead of
+              one call to miinquire or mireadvar per item).  The fields
+              are named as the corresponding getimageinfo options.
+@METHOD     : Calls the functions for the individual options with a
+              private output list, and collects their results.
+@GLOBALS    : 
+@CALLS      : GetImageSize, GetDimNames, GetOrientation, GetPermutation,
+              GetSpatialAtts, GetWholeVar
+@CREATED    : 
+@MODIFIED   : 
+---------------------------------------------------------------------------- */
+int GetImageInfoStruct (int CDF, int nargin, const mxArray *InArgs[],
+                        int *CurInArg,
+                        int nargout, mxArray *OutArgs[], int *CurOutArg)
+{
+   static const char *FieldNames[] = 
+   {
+      "DimSizes", "DimNames", "Orientation", "Permutation",
+      "Steps", "Starts", "DirCosines",
+      "FrameTimes", "FrameLengths", "AllMax", "AllMin"
+   };
+#define NUM_INFO_FIELDS  (sizeof (FieldNames) / sizeof (FieldNames[0]))
+
+   mxArray  *Parts [4];         /* from the single-option functions */
+   int       NumParts;
+   int       DummyInArg;
+   mxArray  *mInfo;
+   mxArray  *mSteps, *mStarts, *mDirCos;
+   int       Result;
+
+   if (*CurOutArg >= nargout)
+   {
+      sprintf (ErrMsg, "imageinfo: not enough output arguments");
+      return (ERR_ARGS);
+   }
+
+   NumParts = 0;
+   DummyInArg = 0;
+   Result = GetImageSize (CDF, 0, NULL, &DummyInArg, 4, Parts, &NumParts);
+   if (Result == ERR_NONE)
+      Result = GetDimNames (CDF, 0, NULL, &DummyInArg, 4, Parts, &NumParts);
+   if (Result == ERR_NONE)
+      Result = GetOrientation (CDF, 0, NULL, &DummyInArg, 4, Parts, &NumParts);
+   if (Result == ERR_NONE)
+      Result = GetPermutation (CDF, 0, NULL, &DummyInArg, 4, Parts, &NumParts);
+   if (Result != ERR_NONE)
+   {
+      return (Result);
+   }
+
+   mSteps = mxCreateDoubleMatrix (3, 1, mxREAL);
+   mStarts = mxCreateDoubleMatrix (3, 1, mxREAL);
+   mDirCos = mxCreateDoubleMatrix (3, 3, mxREAL);
+   GetSpatialAtts (CDF, mxGetPr (mSteps), mxGetPr (mStarts), 
+                   mxGetPr (mDirCos));
+
+   mInfo = mxCreateStructMatrix (1, 1, NUM_INFO_FIELDS, FieldNames);
+   mxSetField (mInfo, 0, "DimSizes", Parts [0]);
+   mxSetField (mInfo, 0, "DimNames", Parts [1]);
+   mxSetField (mInfo, 0, "Orientation", Parts [2]);
+   mxSetField (mInfo, 0, "Permutation", Parts [3]);
+   mxSetField (mInfo, 0, "Steps", mSteps);
+   mxSetField (mInfo, 0, "Starts", mStarts);
+   mxSetField (mInfo, 0, "DirCosines", mDirCos);
+   mxSetField (mInfo, 0, "FrameTimes", GetWholeVar (CDF, MItime));
+   mxSetField (mInfo, 0, "FrameLengths", GetWholeVar (CDF, MItime_width));
+   mxSetField (mInfo, 0, "AllMax", GetWholeVar (CDF, MIimagemax));
+   mxSetField (mInfo, 0, "AllMin", GetWholeVar (CDF, MIimagemin));
+
+   OutArgs [(*CurOutArg)++] = mInfo;
+   (*CurInArg)++;
+
+   return (ERR_NONE);
+
+}     /* GetImageInfoStruct () */
+
+
 
 
 /* ----------------------------- MNI Header -----------------------------------
@@ -1030,6 +1229,11 @@ void mexFunction (int nargout, mxArray *outargs [],      /* output args */
 	 Result = GetPermutation (CDF, nargin, inargs, &cur_inarg,
 				  nargout,outargs,&cur_outarg);
       }
+      else if (strcasecmp (Option, "imageinfo") == 0)
+      {
+	 Result = GetImageInfoStruct (CDF, nargin, inargs, &cur_inarg,
+				      nargout,outargs,&cur_outarg);
+      }
       else if ((strcasecmp (Option, "varnames") == 0)
                ||(strcasecmp (Option, "vardims") == 0)
                ||(strcasecmp (Option, "varatts") == 0)
@@ -0,0 +1,431 @@
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : minewimage (CMEX)
+@INPUT      :
+@OUTPUT     :
+@RETURNS    :
+@DESCRIPTION: CMEX routine to create a new MINC file in-process, doing
+              the same work as the micreateimage program (whose code it
+              shares) without forking a shell for every new file.  The
+              parent file, if any, is kept open in the image cache
+              between calls, so creating many files from the same parent
+              reads its header only once.  See minewimage.m (or type
+              "help minewimage" in MATLAB) for details.
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+@COMMENTS   : For full usage documentation, see minewimage.m
+---------------------------------------------------------------------------- */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <float.h>
+#include "mex.h"
+#include "minc.h"
+#include "mierrors.h"         /* mine and Mark's */
+#include "mexutils.h"         /* N.B. must link in mexutils.o */
+#include "mincutil.h"
+#include "time_stamp.h"
+#include "../micreateimage/micreateimage.h"
+#include "../micreateimage/args.h"
+#include "../micreateimage/createimage.h"
+
+#define PROGNAME "minewimage"
+
+/*
+ * Constants to check for argument number and position
+ */
+
+#define MIN_IN_ARGS        2
+#define MAX_IN_ARGS        8
+
+/* ...POS macros: 1-based, used to determine if input args are present */
+
+#define PARENT_POS         3
+#define TYPE_POS           4
+#define RANGE_POS          5
+#define ORIENT_POS         6
+#define COMPRESS_POS       7
+#define CHUNK_POS          8
+
+/*
+ * Macros to access the input and output arguments from/to MATLAB
+ * (N.B. these only work in mexFunction())
+ */
+
+#define NEW_FILE       prhs[0]
+#define DIM_SIZES      prhs[1]                  /* 2 or 4 elements */
+#define PARENT_FILE    prhs[PARENT_POS-1]
+#define IMAGE_TYPE     prhs[TYPE_POS-1]
+#define VALID_RANGE    prhs[RANGE_POS-1]
+#define ORIENTATION    prhs[ORIENT_POS-1]
+#define COMPRESS       prhs[COMPRESS_POS-1]     /* zlib level, 0-9 */
+#define CHUNK          prhs[CHUNK_POS-1]        /* chunk edge length */
+#define NEW_SIZES      plhs[0]                  /* all 4 dimension sizes */
+
+/* True if input argument number pos (1-based) was given and not empty */
+
+#define GIVEN(pos) ((nrhs >= (pos)) && !mxIsEmpty (prhs[(pos)-1]))
+
+char       *ErrMsg ;             /* set as close to the occurence of the
+                                    error as possible; displayed by whatever
+                                    code exits */
+
+
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : ErrAbort
+@INPUT      : msg - character to string to print just before aborting
+              PrintUsage - whether or not to print a usage summary before
+                aborting
+              ExitCode - one of the standard codes from mierrors.h -- NOTE!
+                this parameter is NOT currently used, but I've included it for
+                consistency with other functions named ErrAbort in other
+                programs
+@OUTPUT     : none - function does not return!!!
+@RETURNS    :
+@DESCRIPTION: Optionally prints a usage summary, and calls mexErrMsgTxt with
+              the supplied msg, which ABORTS the mex-file!!!
+@METHOD     :
+@GLOBALS    : requires PROGNAME macro
+@CALLS      : standard mex functions
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+void ErrAbort (char msg[], Boolean PrintUsage, int ExitCode)
+{
+   if (PrintUsage)
+   {
+      (void) mexPrintf ("Usage: %s (new_file, dim_sizes [, parent_file "
+                        "[, image_type [, valid_range [, orientation "
+                        "[, compress [, chunk]]]]]])\n", PROGNAME);
+   }
+   (void) mexErrMsgTxt (msg);
+}
+
+
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : ParentOrientation
+@INPUT      : Parent - the open parent image
+@OUTPUT     :
+@RETURNS    : "transverse", "sagittal", "coronal", "xyz" or "unknown"
+@DESCRIPTION: Works out the orientation of the parent's image from which
+              spatial dimensions are its height and width, exactly as
+              miinquire's 'orientation' option does.
+@METHOD     :
+@GLOBALS    :
+@CALLS      : NetCDF
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+char *ParentOrientation (ImageInfoRec *Parent)
+{
+   int    NumDims;
+   int    DimIDs [MAX_NC_DIMS];
+   int    HeightDim, WidthDim;
+   int    xdim, ydim, zdim;
+
+   ncvarinq (Parent->CDF, Parent->ID, NULL, NULL, &NumDims, DimIDs, NULL);
+   HeightDim = DimIDs [NumDims-2];
+   WidthDim = DimIDs [NumDims-1];
+
+   /* Missing spatial dimensions are taken as dimension 0 (see miinquire) */
+
+   xdim = ncdimid (Parent->CDF, MIxspace);
+   ydim = ncdimid (Parent->CDF, MIyspace);
+   zdim = ncdimid (Parent->CDF, MIzspace);
+   if (xdim == MI_ERROR) xdim = 0;
+   if (ydim == MI_ERROR) ydim = 0;
+   if (zdim == MI_ERROR) zdim = 0;
+
+   if ((HeightDim == ydim) && (WidthDim == xdim))
+      return ("transverse");
+   else if ((HeightDim == zdim) && (WidthDim == ydim))
+      return ("sagittal");
+   else if ((HeightDim == zdim) && (WidthDim == xdim))
+      return ("coronal");
+   else if ((HeightDim == ydim) && (WidthDim == zdim))
+      return ("xyz");
+   else
+      return ("unknown");
+
+}     /* ParentOrientation */
+
+
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : DefaultRange
+@INPUT      : Type - the image type of the new file
+@OUTPUT     : ValidRange - the full range of Type
+@RETURNS    : (void)
+@DESCRIPTION: Sets the default valid range for a type, using the same
+              values as newimage.m (rather than those of micreateimage,
+              which depend on the C compiler's idea of char and long).
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+void DefaultRange (nc_type Type, double ValidRange[])
+{
+   switch (Type)
+   {
+      case NC_BYTE:
+         ValidRange[0] = 0;              ValidRange[1] = 255;
+         break;
+      case NC_SHORT:
+         ValidRange[0] = -32768;         ValidRange[1] = 32767;
+         break;
+      case NC_LONG:
+         ValidRange[0] = -2147483648.0;  ValidRange[1] = 2147483647.0;
+         break;
+      case NC_FLOAT:
+         ValidRange[0] = -FLT_MAX;       ValidRange[1] = FLT_MAX;
+         break;
+      default:
+         ValidRange[0] = -DBL_MAX;       ValidRange[1] = DBL_MAX;
+         break;
+   }
+}     /* DefaultRange */
+
+
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : mexFunction
+@INPUT      : nlhs, nrhs - number of output/input arguments (from MATLAB)
+              prhs - actual input arguments
+@OUTPUT     : plhs - actual output arguments
+@RETURNS    : (void)
+@DESCRIPTION: Fills in any arguments not given from the parent file (as
+              newimage.m does), and creates the new file with
+              CreateImageFile.
+@METHOD     :
+@GLOBALS    : ErrMsg, gParentFile
+@CALLS      : OpenCachedImage, SetTypeAndVR, CreateImageFile
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+void mexFunction(int    nlhs,
+                 mxArray *plhs[],
+                 int    nrhs,
+                 const mxArray *prhs[])
+{
+   char         *NewFile;
+   char         *ParentFile;
+   char         *TypeStr;
+   char         *Orientation;
+   ImageInfoRec *Parent;
+   int           ParentCDF;
+   long          Sizes [MAX_IMAGE_DIM];
+   int           NumSizes;
+   double        ValidRange [NUM_VALID];
+   nc_type       NCType;
+   Boolean       Signed;
+   char         *Argv [4];
+   char         *TimeStamp;
+   Boolean       Success;
+   double       *Out;
+   int           Result;
+   long          Compress;
+   long          Chunk;
+   int           i;
+
+   ncopts = 0;
+   ErrMsg = (char *) mxCalloc (256, sizeof (char));
+
+   /* The parents stay open in the image cache until we are cleared */
+
+   mexAtExit (FlushImageCache);
+
+   if ((nrhs < MIN_IN_ARGS) || (nrhs > MAX_IN_ARGS))
+   {
+      ErrAbort ("Incorrect number of arguments", TRUE, ERR_ARGS);
+   }
+
+   if (ParseStringArg (NEW_FILE, &NewFile) == NULL)
+   {
+      ErrAbort ("new_file must be a string", TRUE, ERR_ARGS);
+   }
+
+   NumSizes = ParseIntArg (DIM_SIZES, MAX_IMAGE_DIM, Sizes);
+   if ((NumSizes != 2) && (NumSizes != MAX_IMAGE_DIM))
+   {
+      ErrAbort ("dim_sizes must be a vector with either 2 or 4 elements",
+                TRUE, ERR_ARGS);
+   }
+
+   /*
+    * Open the parent (if any) through the image cache, so that the same
+    * parent given again is not reopened or reread.  A parent of '-' means
+    * none, as in newimage.m.
+    */
+
+   Parent = NULL;
+   ParentCDF = -1;
+   ParentFile = NULL;
+   if (GIVEN (PARENT_POS))
+   {
+      if (ParseStringArg (PARENT_FILE, &ParentFile) == NULL)
+      {
+         ErrAbort ("parent_file must be a string", TRUE, ERR_ARGS);
+      }
+      if (strcmp (ParentFile, "-") == 0)
+      {
+         ParentFile = NULL;
+      }
+   }
+   if (ParentFile != NULL)
+   {
+      Result = OpenCachedImage (ParentFile, &Parent, CreateNaN (), NC_DOUBLE);
+      if (Result != ERR_NONE)
+      {
+         ErrAbort (ErrMsg, FALSE, Result);
+      }
+      ParentCDF = Parent->CDF;
+   }
+   gParentFile = ParentFile;
+
+   if (NumSizes == 2)
+   {
+      if (Parent == NULL)
+      {
+         ErrAbort ("Must supply all 4 dimension sizes if parent file "
+                   "is not given", TRUE, ERR_ARGS);
+      }
+      Sizes [2] = Parent->Height;
+      Sizes [3] = Parent->Width;
+   }
+
+   /* The type defaults to the parent's, or to byte */
+
+   if (GIVEN (TYPE_POS))
+   {
+      if (ParseStringArg (IMAGE_TYPE, &TypeStr) == NULL)
+      {
+         ErrAbort ("image_type must be a string", TRUE, ERR_ARGS);
+      }
+   }
+   else if ((Parent != NULL) && (Parent->DataType >= NC_BYTE) &&
+            (Parent->DataType <= NC_DOUBLE))
+   {
+      TypeStr = type_names [Parent->DataType];
+   }
+   else
+   {
+      TypeStr = "byte";
+   }
+
+   /*
+    * The valid range is inherited only if the type is the same as the
+    * parent's (and is not a floating-point type); otherwise it is the
+    * full range of the type.  ValidRange is all zero until set, which
+    * SetTypeAndVR also takes to mean "not given".
+    */
+
+   ValidRange [0] = ValidRange [1] = 0;
+   if (GIVEN (RANGE_POS))
+   {
+      if (!mxIsDouble (VALID_RANGE) ||
+          (mxGetNumberOfElements (VALID_RANGE) != NUM_VALID))
+      {
+         ErrAbort ("valid_range must be a two-element vector", TRUE, ERR_ARGS);
+      }
+      ValidRange [0] = mxGetPr (VALID_RANGE) [0];
+      ValidRange [1] = mxGetPr (VALID_RANGE) [1];
+   }
+
+   if (!SetTypeAndVR (TypeStr, &NCType, &Signed, ValidRange))
+   {
+      ErrAbort (ErrMsg, TRUE, ERR_ARGS);
+   }
+
+   if (!GIVEN (RANGE_POS))
+   {
+      int    Length;
+
+      if ((Parent == NULL) || (NCType != Parent->DataType) ||
+          (NCType == NC_FLOAT) || (NCType == NC_DOUBLE) ||
+          (miattget (ParentCDF, Parent->ID, MIvalid_range, NC_DOUBLE,
+                     NUM_VALID, ValidRange, &Length) == MI_ERROR) ||
+          (Length != NUM_VALID))
+      {
+         DefaultRange (NCType, ValidRange);
+      }
+   }
+
+   /* And the orientation defaults to the parent's, or to transverse */
+
+   if (GIVEN (ORIENT_POS))
+   {
+      if (ParseStringArg (ORIENTATION, &Orientation) == NULL)
+      {
+         ErrAbort ("orientation must be a string", TRUE, ERR_ARGS);
+      }
+   }
+   else if (Parent != NULL)
+   {
+      Orientation = ParentOrientation (Parent);
+   }
+   else
+   {
+      Orientation = "transverse";
+   }
+
+   /*
+    * Compression and chunking are left to CreateImageFile (-1) unless
+    * given; they only matter for MINC 2 files.
+    */
+
+   Compress = -1;
+   if (GIVEN (COMPRESS_POS))
+   {
+      if ((ParseIntArg (COMPRESS, 1, &Compress) != 1) ||
+          (Compress < 0) || (Compress > 9))
+      {
+         ErrAbort ("compress must be a scalar from 0 to 9", TRUE, ERR_ARGS);
+      }
+   }
+
+   Chunk = -1;
+   if (GIVEN (CHUNK_POS))
+   {
+      if ((ParseIntArg (CHUNK, 1, &Chunk) != 1) || (Chunk < 0))
+      {
+         ErrAbort ("chunk must be a non-negative scalar", TRUE, ERR_ARGS);
+      }
+   }
+
+   /*
+    * The history line is what micreateimage would have been given on
+    * its command line (for the parts that matter).
+    */
+
+   Argv [0] = PROGNAME;
+   Argv [1] = NewFile;
+   Argv [2] = "-parent";
+   Argv [3] = ParentFile;
+   TimeStamp = time_stamp ((ParentFile != NULL) ? 4 : 2, Argv);
+
+   Success = CreateImageFile (ParentCDF, NewFile, FALSE,
+                              Sizes[0], Sizes[1], Sizes[2], Sizes[3],
+                              Orientation, NCType, Signed, ValidRange,
+                              DBL_MAX, TimeStamp, (int) Compress, Chunk);
+   free (TimeStamp);
+
+   if (!Success)
+   {
+      ErrAbort (ErrMsg, FALSE, ERR_OUT_MINC);
+   }
+
+   NEW_SIZES = mxCreateDoubleMatrix (1, MAX_IMAGE_DIM, mxREAL);
+   Out = mxGetPr (NEW_SIZES);
+   for (i = 0; i < MAX_IMAGE_DIM; i++)
+   {
+      Out [i] = (double) Sizes [i];
+   }
+
+}     /* mexFunction */
@@ -0,0 +1,663 @@
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : mireadblocks (CMEX)
+@INPUT      :
+@OUTPUT     :
+@RETURNS    :
+@DESCRIPTION: CMEX routine to read the voxels under a mask from a list of
+              MINC files a block at a time, so that the whole files x
+              voxels matrix never has to be in memory at once.  See
+              mireadblocks.m (or type "help mireadblocks" in MATLAB) for
+              details.
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+@COMMENTS   : For full usage documentation, see mireadblocks.m
+---------------------------------------------------------------------------- */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include "mex.h"
+#include "minc.h"
+#include "mierrors.h"         /* mine and Mark's */
+#include "mexutils.h"         /* N.B. must link in mexutils.o */
+#include "mincutil.h"
+#include "threadpool.h"
+#include "maskread.h"
+
+#define PROGNAME "mireadblocks"
+
+/*
+ * Constants to check for argument number and position (for 'open';
+ * the other commands take just the stream)
+ */
+
+#define MIN_OPEN_ARGS      4
+#define MAX_OPEN_ARGS      8
+
+/* ...POS macros: 1-based, used to determine if input args are present */
+
+#define PRECISION_POS      5
+#define THREADS_POS        6
+#define READ_AHEAD_POS     7
+#define FRAMES_POS         8
+
+/*
+ * Macros to access the input and output arguments from/to MATLAB
+ * (N.B. these only work in mexFunction() and the functions for the
+ * individual commands)
+ */
+
+#define COMMAND        prhs[0]                  /* 'open', 'next', etc. */
+#define STREAM         prhs[1]                  /* as returned by 'open' */
+#define MINC_FILES     prhs[1]                  /* cell array of filenames */
+#define MASK_INDEX     prhs[2]                  /* 1-based, ascending */
+#define BUDGET         prhs[3]                  /* megabytes per block */
+#define PRECISION      prhs[PRECISION_POS-1]    /* 'double' or 'single' */
+#define NUM_THREADS    prhs[THREADS_POS-1]      /* number of I/O threads */
+#define READ_AHEAD     prhs[READ_AHEAD_POS-1]   /* files to decode ahead */
+#define FRAMES         prhs[FRAMES_POS-1]       /* 1-based, one per file */
+
+#define MAX_STREAMS    16
+
+/*
+ * An open stream: the files and mask, and how the mask is divided up
+ * into blocks (each a range of slices).  Kept between calls, so all
+ * allocated with malloc.
+ */
+
+typedef struct
+{
+   Boolean      InUse;
+   char       **Filenames;
+   long         NumFiles;
+   long        *Frames;        /* zero-based, or NULL for the first */
+   MaskInfoRec  Mask;
+   nc_type      ICVType;
+   double       NaN;
+   int          NumThreads;
+   int          ReadAhead;
+   long         NumBlocks;
+   long        *FirstSlice;    /* block b is slices FirstSlice[b] .. */
+   long        *EndSlice;      /* ... EndSlice[b]-1 */
+   long         NextBlock;
+} StreamRec;
+
+static StreamRec  Streams [MAX_STREAMS];
+static Boolean    ExitRegistered = FALSE;
+
+char       *ErrMsg ;             /* set as close to the occurence of the
+                                    error as possible; displayed by whatever
+                                    code exits */
+
+
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : ErrAbort
+@INPUT      : msg - character to string to print just before aborting
+              PrintUsage - whether or not to print a usage summary before
+                aborting
+              ExitCode - one of the standard codes from mierrors.h -- NOTE!
+                this parameter is NOT currently used, but I've included it for
+                consistency with other functions named ErrAbort in other
+                programs
+@OUTPUT     : none - function does not return!!!
+@RETURNS    :
+@DESCRIPTION: Optionally prints a usage summary, and calls mexErrMsgTxt with
+              the supplied msg, which ABORTS the mex-file!!!
+@METHOD     :
+@GLOBALS    : requires PROGNAME macro
+@CALLS      : standard mex functions
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+void ErrAbort (char msg[], Boolean PrintUsage, int ExitCode)
+{
+   if (PrintUsage)
+   {
+      (void) mexPrintf ("Usage: [stream, num_blocks] = %s ('open', "
+                        "minc_files, mask_index, block_mb\n"
+                        "                                       "
+                        "[, precision [, num_threads [, read_ahead "
+                        "[, frames]]]])\n",
+                        PROGNAME);
+      (void) mexPrintf ("       [data, cols] = %s ('next', stream)\n",
+                        PROGNAME);
+      (void) mexPrintf ("       %s ('rewind', stream)\n", PROGNAME);
+      (void) mexPrintf ("       %s ('close', stream)\n", PROGNAME);
+   }
+   (void) mexErrMsgTxt (msg);
+}
+
+
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : FreeStream
+@INPUT      : *Stream - a stream slot
+@OUTPUT     : *Stream - marked unused
+@RETURNS    : (void)
+@DESCRIPTION: Frees everything belonging to a stream.
+@METHOD     :
+@GLOBALS    :
+@CALLS      : FreeMask
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+void FreeStream (StreamRec *Stream)
+{
+   long    file;
+
+   if (Stream->Filenames != NULL)
+   {
+      for (file = 0; file < Stream->NumFiles; file++)
+      {
+         free (Stream->Filenames [file]);
+      }
+      free (Stream->Filenames);
+   }
+   free (Stream->Frames);
+   FreeMask (&Stream->Mask);
+   free (Stream->FirstSlice);
+   free (Stream->EndSlice);
+   memset (Stream, 0, sizeof (StreamRec));
+}     /* FreeStream */
+
+
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : CloseAllStreams
+@INPUT      : (none)
+@OUTPUT     : (none)
+@RETURNS    : (void)
+@DESCRIPTION: Frees every open stream; registered with mexAtExit() so
+              that nothing is left behind when the MEX-file is cleared.
+@METHOD     :
+@GLOBALS    : Streams
+@CALLS      : FreeStream
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+void CloseAllStreams (void)
+{
+   int    i;
+
+   for (i = 0; i < MAX_STREAMS; i++)
+   {
+      FreeStream (&Streams [i]);
+   }
+}     /* CloseAllStreams */
+
+
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : PlanBlocks
+@INPUT      : *Stream - stream with its mask set up
+              MaxVoxels - most masked voxels (per file) to read per block
+@OUTPUT     : *Stream - NumBlocks, FirstSlice[] and EndSlice[] filled in
+@RETURNS    : ERR_NONE if all went well
+              ERR_NO_MEM if the block list could not be allocated
+@DESCRIPTION: Divides the volume up into blocks of consecutive slices,
+              each with no more than MaxVoxels masked voxels (unless a
+              single slice has more than that, in which case that slice
+              is a block on its own).  Slices without masked voxels are
+              left out of the blocks where possible.
+@METHOD     :
+@GLOBALS    : ErrMsg
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+int PlanBlocks (StreamRec *Stream, long MaxVoxels)
+{
+   long    *SliceFirst = Stream->Mask.SliceFirst;
+   long     Slices = Stream->Mask.Slices;
+   long     slice, end;
+
+   Stream->FirstSlice = (long *) malloc ((Slices + 1) * sizeof (long));
+   Stream->EndSlice = (long *) malloc ((Slices + 1) * sizeof (long));
+   if ((Stream->FirstSlice == NULL) || (Stream->EndSlice == NULL))
+   {
+      sprintf (ErrMsg, "Out of memory planning blocks");
+      return (ERR_NO_MEM);
+   }
+
+   Stream->NumBlocks = 0;
+   slice = 0;
+   for (;;)
+   {
+      while ((slice < Slices) && (SliceFirst [slice] == SliceFirst [slice+1]))
+      {
+         slice++;
+      }
+      if (slice >= Slices)
+      {
+         break;
+      }
+
+      end = slice + 1;
+      while ((end < Slices) &&
+             (SliceFirst [end+1] - SliceFirst [slice] <= MaxVoxels))
+      {
+         end++;
+      }
+
+      Stream->FirstSlice [Stream->NumBlocks] = slice;
+      Stream->EndSlice [Stream->NumBlocks] = end;
+      Stream->NumBlocks++;
+      slice = end;
+   }
+
+#ifdef DEBUG
+   printf ("PlanBlocks: %ld voxels/block -> %ld blocks\n",
+           MaxVoxels, Stream->NumBlocks);
+#endif
+   return (ERR_NONE);
+}     /* PlanBlocks */
+
+
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : GetStream
+@INPUT      : mStream - MATLAB scalar, as returned by OpenStream
+@OUTPUT     :
+@RETURNS    : pointer to the stream; aborts if mStream is not an open stream
+@DESCRIPTION: Looks up a stream handle.
+@METHOD     :
+@GLOBALS    : Streams
+@CALLS      : ParseIntArg
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+StreamRec *GetStream (const mxArray *mStream)
+{
+   long    Handle;
+
+   if ((ParseIntArg (mStream, 1, &Handle) != 1) ||
+       (Handle < 1) || (Handle > MAX_STREAMS) ||
+       !Streams [Handle-1].InUse)
+   {
+      ErrAbort ("Not an open stream", TRUE, ERR_ARGS);
+   }
+   return (&Streams [Handle-1]);
+}     /* GetStream */
+
+
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : OpenStream
+@INPUT      : nlhs, nrhs, prhs - as for mexFunction
+@OUTPUT     : plhs[0] - the stream handle
+              plhs[1] - the number of blocks (optional)
+@RETURNS    : (void); aborts on error
+@DESCRIPTION: Sets up a new stream: parses the arguments, copies the
+              filenames, reads the geometry of the first file to set up
+              the mask, and divides the mask into blocks so that one
+              block of data from all files fits in the memory budget.
+@METHOD     :
+@GLOBALS    : Streams, ErrMsg
+@CALLS      : SetMaskIndex, OpenImageAs, SetupMask, PlanBlocks
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+void OpenStream (int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
+{
+   StreamRec    *Stream;
+   ImageInfoRec  ImInfo;
+   char         *Precision;
+   char         *Filename;
+   nc_type       ICVType;
+   long          NumThreads;
+   long          ReadAhead;
+   double        BudgetMB;
+   long          MaxVoxels;
+   long          NumFiles;
+   long          file;
+   int           handle;
+   int           Result;
+
+   if ((nrhs < MIN_OPEN_ARGS) || (nrhs > MAX_OPEN_ARGS))
+   {
+      ErrAbort ("Incorrect number of arguments", TRUE, ERR_ARGS);
+   }
+
+   if (!mxIsCell (MINC_FILES))
+   {
+      ErrAbort ("MINC files must be given as a cell array of strings",
+                TRUE, ERR_ARGS);
+   }
+   NumFiles = mxGetNumberOfElements (MINC_FILES);
+   if (NumFiles == 0)
+   {
+      ErrAbort ("No MINC files given", TRUE, ERR_ARGS);
+   }
+
+   if (!mxIsDouble (MASK_INDEX) || mxIsComplex (MASK_INDEX) ||
+       ((mxGetM (MASK_INDEX) != 1) && (mxGetN (MASK_INDEX) != 1)))
+   {
+      ErrAbort ("Mask index must be a real vector of doubles",
+                TRUE, ERR_ARGS);
+   }
+
+   if (!mxIsDouble (BUDGET) || (mxGetNumberOfElements (BUDGET) != 1) ||
+       (*mxGetPr (BUDGET) <= 0))
+   {
+      ErrAbort ("block_mb must be a positive scalar", TRUE, ERR_ARGS);
+   }
+   BudgetMB = *mxGetPr (BUDGET);
+
+   /* Precision and threads exactly as for mireadmasked */
+
+   ICVType = NC_DOUBLE;
+   if ((nrhs >= PRECISION_POS) &&
+       (mxGetM(PRECISION)>0) && (mxGetN(PRECISION)>0))
+   {
+      if (ParseStringArg (PRECISION, &Precision) == NULL)
+      {
+         ErrAbort ("Precision must be a string", TRUE, ERR_ARGS);
+      }
+      if (strcmp (Precision, "single") == 0)
+      {
+         ICVType = NC_FLOAT;
+      }
+      else if (strcmp (Precision, "double") != 0)
+      {
+         ErrAbort ("Precision must be either 'double' or 'single'",
+                   TRUE, ERR_ARGS);
+      }
+   }
+
+   NumThreads = 1;
+   if (nrhs >= THREADS_POS)
+   {
+      Result = ParseIntArg (NUM_THREADS, 1, &NumThreads);
+      if ((Result < 0) || ((Result == 1) && (NumThreads < 1)))
+      {
+         ErrAbort ("num_threads must be a positive scalar", TRUE, ERR_ARGS);
+      }
+      if (Result == 0)
+      {
+         NumThreads = DefaultThreads ();
+      }
+   }
+
+   /* And how many files to decode ahead when reading with one thread */
+
+   ReadAhead = 0;
+   if (nrhs >= READ_AHEAD_POS)
+   {
+      Result = ParseIntArg (READ_AHEAD, 1, &ReadAhead);
+      if ((Result < 0) || ((Result == 1) && (ReadAhead < 0)))
+      {
+         ErrAbort ("read_ahead must be a non-negative scalar", TRUE, ERR_ARGS);
+      }
+   }
+
+   /* Find a free slot */
+
+   for (handle = 0; handle < MAX_STREAMS; handle++)
+   {
+      if (!Streams [handle].InUse)
+         break;
+   }
+   if (handle == MAX_STREAMS)
+   {
+      sprintf (ErrMsg, "Too many open streams (at most %d)", MAX_STREAMS);
+      ErrAbort (ErrMsg, FALSE, ERR_OTHER);
+   }
+   Stream = &Streams [handle];
+   memset (Stream, 0, sizeof (StreamRec));
+
+   /*
+    * From here on everything belongs to the stream, and is freed by
+    * FreeStream if anything goes wrong.
+    */
+
+   Result = SetMaskIndex (mxGetPr (MASK_INDEX),
+                          mxGetNumberOfElements (MASK_INDEX), &Stream->Mask);
+   if (Result != ERR_NONE)
+   {
+      ErrAbort (ErrMsg, TRUE, Result);
+   }
+
+   Stream->Filenames = (char **) malloc (NumFiles * sizeof (char *));
+   if (Stream->Filenames == NULL)
+   {
+      FreeStream (Stream);
+      ErrAbort ("Out of memory for file list", FALSE, ERR_NO_MEM);
+   }
+   for (file = 0; file < NumFiles; file++)
+   {
+      if (ParseStringArg (mxGetCell (MINC_FILES, file), &Filename) == NULL)
+      {
+         FreeStream (Stream);
+         sprintf (ErrMsg, "Element %ld of the file list is not a string",
+                  file+1);
+         ErrAbort (ErrMsg, TRUE, ERR_ARGS);
+      }
+      Stream->Filenames [file] = strdup (Filename);
+      Stream->NumFiles = file+1;
+      if (Stream->Filenames [file] == NULL)
+      {
+         FreeStream (Stream);
+         ErrAbort ("Out of memory for file list", FALSE, ERR_NO_MEM);
+      }
+   }
+
+   if ((nrhs >= FRAMES_POS) && !mxIsEmpty (FRAMES))
+   {
+      Result = ERR_ARGS;
+      strcpy (ErrMsg, "frames must be a real vector of doubles");
+      if (mxIsDouble (FRAMES) && !mxIsComplex (FRAMES))
+      {
+         Result = SetFrameList (mxGetPr (FRAMES),
+                                mxGetNumberOfElements (FRAMES),
+                                NumFiles, &Stream->Frames);
+      }
+      if (Result != ERR_NONE)
+      {
+         FreeStream (Stream);
+         ErrAbort (ErrMsg, TRUE, Result);
+      }
+   }
+
+   Stream->ICVType = ICVType;
+   Stream->NaN = CreateNaN ();
+   Stream->NumThreads = (int) NumThreads;
+   Stream->ReadAhead = (int) ReadAhead;
+
+   Result = OpenImageAs (Stream->Filenames [0], &ImInfo, NC_NOWRITE,
+                         Stream->NaN, ICVType);
+   if (Result == ERR_NONE)
+   {
+      Result = SetupMask (&ImInfo, &Stream->Mask);
+      CloseImage (&ImInfo);
+   }
+
+   /*
+    * The budget is for one block of data from all files; count the
+    * output matrix only (the slab buffers are small and fixed).
+    */
+
+   MaxVoxels = (long) (BudgetMB * 1048576.0 /
+                       ((double) NumFiles * nctypelen (ICVType)));
+   if (Result == ERR_NONE)
+   {
+      Result = PlanBlocks (Stream, max (MaxVoxels, 1));
+   }
+   if (Result != ERR_NONE)
+   {
+      FreeStream (Stream);
+      ErrAbort (ErrMsg, (Result == ERR_ARGS), Result);
+   }
+
+   Stream->InUse = TRUE;
+   if (!ExitRegistered)
+   {
+      mexAtExit (CloseAllStreams);
+      ExitRegistered = TRUE;
+   }
+
+   plhs[0] = mxCreateDoubleScalar ((double) (handle+1));
+   if (nlhs > 1)
+   {
+      plhs[1] = mxCreateDoubleScalar ((double) Stream->NumBlocks);
+   }
+}     /* OpenStream */
+
+
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : NextBlock
+@INPUT      : nlhs, nrhs, prhs - as for mexFunction
+@OUTPUT     : plhs[0] - the next block of data (files x voxels)
+              plhs[1] - one-based positions in the mask index of the
+                voxels in this block (optional)
+@RETURNS    : (void); aborts on error
+@DESCRIPTION: Reads the next block of a stream from every file.  Once
+              all blocks have been read, returns empty matrices.
+@METHOD     :
+@GLOBALS    : ErrMsg
+@CALLS      : ReadMaskedFiles
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+void NextBlock (int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
+{
+   StreamRec  *Stream;
+   mxClassID   ImageClass;
+   long        First, End;      /* range of mask voxels in the block */
+   long        Failed;
+   double     *Cols;
+   long        i;
+   int         Result;
+
+   if (nrhs != 2)
+   {
+      ErrAbort ("Incorrect number of arguments", TRUE, ERR_ARGS);
+   }
+   Stream = GetStream (STREAM);
+   ImageClass = (Stream->ICVType == NC_FLOAT) ? mxSINGLE_CLASS
+                                              : mxDOUBLE_CLASS;
+
+   if (Stream->NextBlock >= Stream->NumBlocks)
+   {
+      plhs[0] = mxCreateNumericMatrix (0, 0, ImageClass, mxREAL);
+      if (nlhs > 1)
+      {
+         plhs[1] = mxCreateDoubleMatrix (0, 0, mxREAL);
+      }
+      return;
+   }
+
+   First = Stream->Mask.SliceFirst [Stream->FirstSlice [Stream->NextBlock]];
+   End = Stream->Mask.SliceFirst [Stream->EndSlice [Stream->NextBlock]];
+
+   plhs[0] = mxCreateNumericMatrix (Stream->NumFiles, End - First,
+                                    ImageClass, mxREAL);
+   if (plhs[0] == NULL)
+   {
+      sprintf (ErrMsg, "Error allocating %ld x %ld matrix!",
+               Stream->NumFiles, End - First);
+      ErrAbort (ErrMsg, FALSE, ERR_NO_MEM);
+   }
+
+   Result = ReadMaskedFiles (Stream->Filenames, Stream->NumFiles,
+                             Stream->Frames, &Stream->Mask,
+                             Stream->FirstSlice [Stream->NextBlock],
+                             Stream->EndSlice [Stream->NextBlock],
+                             Stream->ICVType, Stream->NaN,
+                             Stream->NumThreads, Stream->ReadAhead,
+                             mxGetData (plhs[0]), &Failed);
+   if (Result != ERR_NONE)
+   {
+      char   *Msg;
+
+      if (Failed < 0)
+      {
+         ErrAbort (ErrMsg, FALSE, Result);
+      }
+      Msg = (char *) mxCalloc (strlen (ErrMsg) +
+                               strlen (Stream->Filenames [Failed]) + 8,
+                               sizeof (char));
+      sprintf (Msg, "%s: %s", Stream->Filenames [Failed], ErrMsg);
+      ErrAbort (Msg, FALSE, Result);
+   }
+   Stream->NextBlock++;
+
+   if (nlhs > 1)
+   {
+      plhs[1] = mxCreateDoubleMatrix (1, End - First, mxREAL);
+      Cols = mxGetPr (plhs[1]);
+      for (i = First; i < End; i++)
+      {
+         Cols [i-First] = (double) (i+1);
+      }
+   }
+}     /* NextBlock */
+
+
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : mexFunction
+@INPUT      : nlhs, nrhs - number of output/input arguments (from MATLAB)
+              prhs - actual input arguments
+@OUTPUT     : plhs - actual output arguments
+@RETURNS    : (void)
+@DESCRIPTION: Dispatches on the command string.
+@METHOD     :
+@GLOBALS    : ErrMsg
+@CALLS      : OpenStream, NextBlock, GetStream, FreeStream
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+void mexFunction(int    nlhs,
+                 mxArray *plhs[],
+                 int    nrhs,
+                 const mxArray *prhs[])
+{
+   char        *Command;
+
+   ncopts = 0;
+   ErrMsg = (char *) mxCalloc (256, sizeof (char));
+
+   if (nrhs < 2)
+   {
+      ErrAbort ("Incorrect number of arguments", TRUE, ERR_ARGS);
+   }
+   if (ParseStringArg (COMMAND, &Command) == NULL)
+   {
+      ErrAbort ("First argument must be a command string", TRUE, ERR_ARGS);
+   }
+
+   if (strcmp (Command, "open") == 0)
+   {
+      OpenStream (nlhs, plhs, nrhs, prhs);
+   }
+   else if (strcmp (Command, "next") == 0)
+   {
+      NextBlock (nlhs, plhs, nrhs, prhs);
+   }
+   else if (strcmp (Command, "rewind") == 0)
+   {
+      if (nrhs != 2)
+      {
+         ErrAbort ("Incorrect number of arguments", TRUE, ERR_ARGS);
+      }
+      GetStream (STREAM)->NextBlock = 0;
+   }
+   else if (strcmp (Command, "close") == 0)
+   {
+      if (nrhs != 2)
+      {
+         ErrAbort ("Incorrect number of arguments", TRUE, ERR_ARGS);
+      }
+      FreeStream (GetStream (STREAM));
+   }
+   else
+   {
+      sprintf (ErrMsg, "Unknown command: %s", Command);
+      ErrAbort (ErrMsg, TRUE, ERR_ARGS);
+   }
+}     /* mexFunction */
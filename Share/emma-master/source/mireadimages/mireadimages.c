@@ -17,6 +17,9 @@
                  pass old memory.  If this old memory is the same size as
                  the memory needed for the image(s), it is reused.  This
                  reduces the risk of memory fragmentation.
+              Files are now kept open between calls, in the EMMA
+                 library's image cache; mireadimages ('-flush') closes
+                 them.
 @COMMENTS   : For full usage documentation, see mireadimages.m
 @VERSION    : $Id: mireadimages.c,v 1.23 2008-01-10 12:23:23 rotor Exp $
               $Name:  $
@@ -50,7 +53,7 @@ double  NaN;                    /* NaN in native C format */
 
 
 #define MIN_IN_ARGS        1
-#define MAX_IN_ARGS        6
+#define MAX_IN_ARGS        7
 
 /* ...POS macros: 1-based, used to determine if input args are present */
 
@@ -59,6 +62,7 @@ double  NaN;                    /* NaN in native C format */
 #define OLD_MEMORY_POS     4
 #define START_ROW_POS      5
 #define NUM_ROWS_POS       6
+#define PRECISION_POS      7
 
 /*
  * Macros to access the input and output arguments from/to MATLAB
@@ -66,16 +70,15 @@ double  NaN;                    /* NaN in native C format */
  */
 
 #define MINC_FILENAME  prhs[0]
+#define FLUSH_OPTION   "-flush"                 /* given instead of filename */
 #define SLICES         prhs[SLICES_POS-1]       /* slices to read - vector */
 #define FRAMES         prhs[FRAMES_POS-1]       /* ditto for frames */
 #define START_ROW      prhs[START_ROW_POS-1]
 #define NUM_ROWS       prhs[NUM_ROWS_POS-1]
+#define PRECISION      prhs[PRECISION_POS-1]    /* 'double' or 'single' */
 #define OLD_MEMORY     prhs[OLD_MEMORY_POS-1]   /* old memory space to re-use */
 #define VECTOR_IMAGES  plhs[0]                  /* array of images: one per columns */
 
-#define MAX_READABLE   1024           /* max number of slices or frames that
-                                        can be read at a time */
-
 /*
  * Global variables (with apologies).  Interesting note:  when ErrMsg is
  * declared as char [256] here, MATLAB freezes (infinite, CPU-hogging
@@ -113,7 +116,10 @@ void ErrAbort (char msg[], Boolean PrintUsage, int ExitCode)
    if (PrintUsage)
    {
       (void) mexPrintf ("Usage: %s ('MINC_file' [, slices", PROGNAME);
-      (void) mexPrintf (" [, frames [, old_matrix [, start_row [, num_rows]]]]])\n");
+      (void) mexPrintf (" [, frames [, old_matrix [, start_row [, num_rows");
+      (void) mexPrintf (" [, precision]]]]]])\n");
+      (void) mexPrintf ("   or: %s ('%s' [, 'MINC_file'])\n",
+                        PROGNAME, FLUSH_OPTION);
    }
    (void) mexErrMsgTxt (msg);
 }
@@ -137,28 +143,23 @@ void ErrAbort (char msg[], Boolean PrintUsage, int ExitCode)
 @GLOBALS    : ErrMsg
 @CALLS      : 
 @CREATED    : 
-@MODIFIED   : 
+@MODIFIED   : Multiple slices may now be read together with multiple
+                frames, so that is no longer checked for.
 ---------------------------------------------------------------------------- */
 Boolean CheckBounds (long Slices[], long Frames[],
                      long NumSlices, long NumFrames,
                      long StartRow, long NumRows,
                      ImageInfoRec *Image)
 {
-   int   i;
+   long  i;
 
 #ifdef DEBUG
-   printf ("Checking %d slices and %d frames for validity...\n",
+   printf ("Checking %ld slices and %d frames for validity...\n",
            NumSlices, NumFrames);
    printf ("No slice >= %ld or frame >= %ld allowed\n",
            Image->Slices, Image->Frames);
 #endif
 
-   if ((NumSlices > 1) && (NumFrames > 1))
-   {
-      strcpy (ErrMsg, "Cannot read both multiple slices and multiple frames");
-      return (FALSE);
-   }
-
    for (i = 0; i < NumSlices; i++)
    {
       if ((Slices [i] >= Image->Slices) || (Slices [i] < 0))
@@ -219,7 +220,12 @@ Boolean CheckBounds (long Slices[], long Frames[],
               StartRow - starting row ('height' dimension) (zero-based!)
               NumRows - number of rows to read
 @OUTPUT     : *Mimages - pointer to MATLAB matrix (allocated by ReadImages)
-              containing the images specified by Slices[] and Frames[].
+              containing the images specified by Slices[] and Frames[]:
+              one column per slice/frame pair, slices varying slowest
+              (ie. column i*NumFrames + j holds slice Slices[i] of frame
+              Frames[j]).
+              The matrix is of class double or single, depending on
+              whether the ICV of Image was set up for NC_DOUBLE or NC_FLOAT.
               The matrix will have Image->ImageSize rows, and each column
               will correspond to one image, with the highest dimension
               of the image variable varying fastest.  Eg., if xspace is
@@ -242,9 +248,11 @@ Boolean CheckBounds (long Slices[], long Frames[],
               is missing from the MINC file, NumSlices or NumFrames
               (whichever applies, possibly both) should be zero.  ReadImages
               will read the "only" slice/frame in the file then.
-@METHOD     : 
+@METHOD     : Allocates the MATLAB matrix (unless *Mimages already points
+              to one of the right size) and lets ReadImageData (in the
+              EMMA library) fill it in.
 @GLOBALS    : ErrMsg
-@CALLS      : standard library, MINC functions
+@CALLS      : ReadImageData, standard mex functions
 @CREATED    : 93-6-6, Greg Ward
 @MODIFIED   : 93-8-23, GPW: added support for missing slice dimension 
                             (NumSlices==0) just like NumFrames==0 case
@@ -263,79 +271,24 @@ int ReadImages (ImageInfoRec *Image,
                 long    NumRows,
                 mxArray  **Mimages)
 {
-   long     slice, frame;
-   long     Start [MAX_NC_DIMS], Count [MAX_NC_DIMS];
-   long     Size;               /* the number of doubles per image (taking
+   long     Size;               /* the number of voxels per image (taking
                                    NumRows into account!) */
-   double   *VectorImages;
-   Boolean  DoFrames;           /* false if NumFrames (NumSlices) == 0, so we*/
-   Boolean  DoSlices;           /* know to not set a frame (slice) number */
-   int      RetVal;             /* from miicv_get -- if this is MI_ERROR */
-                                /* we have a problem!!  Should NOT!!! happen */
-   /*
-    * Setup start/count vectors.  We will always read from one image at
-    * a time, because the user is allowed to specify slices/frames such
-    * that non-contiguous images are read.  However, the image rows read
-    * are always contiguous, so we'll set the Height elements of Start/
-    * Count just once -- right here -- and leave them alone in the loops.
-    */
-
-   Start [Image->HeightDim] = StartRow;
-   Count [Image->HeightDim] = NumRows;
-   Start [Image->WidthDim] = 0L;
-   Count [Image->WidthDim] = Image->Width;
+   long     NumImages;
+   mxClassID ImageClass;
 
    Size = Image->Width * NumRows;
+   NumImages = max (NumSlices, 1) * max (NumFrames, 1);
 
-#ifdef DEBUG
-   printf ("Size: %ld\n", Size);
-#endif
-
-   /* 
-    * If the caller has set NumFrames (NumSlices) to 0, that REALLY means
-    * read one frame (slice) from a file with no frame (slice) dimension.
-    * We need to set NumFrames (NumSlices) to 1 so that we at least get
-    * into the inner (outer) loop below, but DoFrames (DoSlices) to 
-    * FALSE so we know there's really no frame (slice) dimension.
-    */
-
-   if (NumFrames == 0)
-   {
-      DoFrames = FALSE;
-      NumFrames = 1;         /* so that we at least get into the frames loop */
-   }
-   else
-   {
-      Count [Image->FrameDim] = 1L;
-      DoFrames = TRUE;
-   }
-
-   if (NumSlices == 0)
-   {
-      DoSlices = FALSE;
-      NumSlices = 1;
-   }
-   else
-   {
-      Count [Image->SliceDim] = 1L;
-      DoSlices = TRUE;
-   }
+   ImageClass = (Image->ICVType == NC_FLOAT) ? mxSINGLE_CLASS : mxDOUBLE_CLASS;
 
 #ifdef DEBUG
-   printf ("Reading %ld slices, %ld frames: %ld total images.\n",
-           NumSlices, NumFrames, NumSlices*NumFrames);
-   printf ("  Any frame dimension: %s\n", DoFrames ? "YES" : "NO");
-   printf ("  Any slice dimension: %s\n", DoSlices ? "YES" : "NO");
-   printf ("Reading from row %ld, for %ld rows.\n", StartRow, NumRows);
+   printf ("Size: %ld\n", Size);
 #endif
 
    /*
     * If *Mimages points to NULL, we want to allocate a new Matrix
     * and use this.  Otherwise, we want to use the already allocated
     * Matrix that *Mimages points to.
-    * Finally, we want the local variable VectorImages to point to
-    * the real part of the Matrix *Mimages.
-    *
     */
 
    if (*Mimages == NULL)
@@ -349,85 +302,27 @@ int ReadImages (ImageInfoRec *Image,
        printf ("Allocating new memory for return value.\n");
 #endif
 
-       *Mimages = mxCreateDoubleMatrix(Size, NumSlices*NumFrames, mxREAL);
+       *Mimages = mxCreateNumericMatrix (Size, NumImages, ImageClass, mxREAL);
        if (*Mimages == NULL)
        {
            sprintf (ErrMsg, "Error allocating %ld x %ld image matrix!\n", 
-                    Size, NumSlices*NumFrames);
+                    Size, NumImages);
            return (ERR_NO_MEM);
        }
    }
    
-   /* 
-    * *Mimages points at some memory, so we want to use the memory 
-    * that it points at.
-    */
-   
-   VectorImages = mxGetPr (*Mimages);
-
-
 #ifdef DEBUG
    printf ("Successfully allocated %ld x %ld image matrix; about to read:\n",
-           Size, NumSlices*NumFrames);
+           Size, NumImages);
 #endif
 
-   /*
-    * Now loop through slices and frames to read in the images, one at a time.
-    */
-
-   for (slice = 0; slice < NumSlices; slice++)
-   {  
-      /* Set the slice for all frames read in this slice */
-
-      if (DoSlices)
-      {
-         Start [Image->SliceDim] = Slices [slice];
-      }
-
-      for (frame = 0L; frame < NumFrames; frame++)
-      {
-         /* Set the frame for this one image only */
-
-         if (DoFrames)
-         {
-            Start [Image->FrameDim] = Frames [frame];
-         }
-
-         /* Now read the image */
-
-#ifdef DEBUG
-         printf ("Start: %ld %ld %ld %ld;  Count: %ld %ld %ld %ld\n",
-                 Start [0], Start [1], Start [2], Start [3],
-                 Count [0], Count [1], Count [2], Count [3]);
-#endif
-         RetVal = miicv_get (Image->ICV, Start, Count, VectorImages);
-         if (RetVal == MI_ERROR)
-         {
-            sprintf (ErrMsg, "!! BOMB !! error code %d (%s) set by miicv_get",
-                     ncerr, NCErrMsg (ncerr, errno));
-            return (ERR_IN_MINC);
-         }
-
-         VectorImages += Size;
-
-      }     /* for frame */
-
-   }     /* for slice */
-
-   /*
-    * We want to map -DBL_MAX to a MATLAB NaN
+   /* 
+    * *Mimages points at some memory, so read the images straight into
+    * its real part.
     */
 
-#ifdef DEBUG
-   printf ("Total number of doubles: %ld\n", 
-	   Size*NumFrames*NumSlices);
-#endif   
-
-#ifdef DEBUG
-   putchar ('\n');
-#endif
-
-   return (ERR_NONE);
+   return (ReadImageData (Image, Slices, Frames, NumSlices, NumFrames,
+                          StartRow, NumRows, mxGetData (*Mimages)));
 
 }     /* ReadImages */
 
@@ -462,9 +357,12 @@ void mexFunction(int    nlhs,
                  const mxArray *prhs[])
 {
    char        *Filename;
-   ImageInfoRec ImInfo;
-   long         Slice[MAX_READABLE];
-   long         Frame[MAX_READABLE];
+   char        *Precision;
+   nc_type      ICVType;         /* NC_DOUBLE or NC_FLOAT, from Precision */
+   mxClassID    ImageClass;      /* the corresponding MATLAB class */
+   ImageInfoRec *ImInfo;         /* belongs to the image cache */
+   long        *Slice;           /* allocated to fit the slices vector */
+   long        *Frame;           /* ditto for frames */
    long         NumSlices;
    long         NumFrames;
    long         StartRow;
@@ -494,7 +392,58 @@ void mexFunction(int    nlhs,
    {
        ErrAbort ("Error in filename", TRUE, ERR_ARGS);
    }
+
+   /*
+    * Make sure the image cache gets closed when we are cleared, and
+    * handle a request to flush it instead of reading anything.
+    */
+
+   mexAtExit (FlushImageCache);
+
+   if (strcmp (Filename, FLUSH_OPTION) == 0)
+   {
+      if (nrhs == 1)
+      {
+         FlushImageCache ();
+      }
+      else if (ParseStringArg (prhs[1], &Filename) != NULL)
+      {
+         FlushCachedImage (Filename);
+      }
+      else
+      {
+         ErrAbort ("Filename to flush must be a string", TRUE, ERR_ARGS);
+      }
+      return;
+   }
    
+   /*
+    * Parse the precision option, if given.  This just determines the
+    * type of the ICV (and hence of the returned matrix): images are 
+    * returned as doubles unless the caller asks for 'single'.
+    */
+
+   ICVType = NC_DOUBLE;
+   ImageClass = mxDOUBLE_CLASS;
+   if ((nrhs >= PRECISION_POS) && 
+       (mxGetM(PRECISION)>0) && (mxGetN(PRECISION)>0))
+   {
+      if (ParseStringArg (PRECISION, &Precision) == NULL)
+      {
+         ErrAbort ("Precision must be a string", TRUE, ERR_ARGS);
+      }
+      if (strcmp (Precision, "single") == 0)
+      {
+         ICVType = NC_FLOAT;
+         ImageClass = mxSINGLE_CLASS;
+      }
+      else if (strcmp (Precision, "double") != 0)
+      {
+         ErrAbort ("Precision must be either 'double' or 'single'", 
+                   TRUE, ERR_ARGS);
+      }
+   }
+
    /*
     * Create the NaN variable
     */
@@ -502,10 +451,12 @@ void mexFunction(int    nlhs,
    NaN = CreateNaN();
    
    /*
-    * Open MINC file, get info about image, and setup ICV
+    * Get the MINC file from the image cache (which opens it, gets info
+    * about the image, and sets up the ICV the first time through).  The
+    * file stays open between calls, so it is never closed here.
     */
 
-   Result = OpenImage (Filename, &ImInfo, NC_NOWRITE, NaN);
+   Result = OpenCachedImage (Filename, &ImInfo, NaN, ICVType);
    if (Result != ERR_NONE)
    {
       ErrAbort (ErrMsg, TRUE, Result);
@@ -518,13 +469,18 @@ void mexFunction(int    nlhs,
     * tried to supply a list of slices anyway, a warning is printed.
     */
 
+   Slice = NULL;
+   Frame = NULL;
+
    if ((nrhs >= SLICES_POS) && (mxGetM(SLICES)>0) && (mxGetN(SLICES)>0))
    {
 
-       NumSlices = ParseIntArg (SLICES, MAX_READABLE, Slice);
+       Slice = (long *) mxCalloc (mxGetNumberOfElements (SLICES), 
+                                  sizeof (long));
+       NumSlices = ParseIntArg (SLICES, mxGetNumberOfElements (SLICES), 
+                                Slice);
        if (NumSlices < 0)
        {
-           CloseImage (&ImInfo);
            switch (NumSlices)
            {
                case mexARGS_TOO_BIG:
@@ -536,7 +492,7 @@ void mexFunction(int    nlhs,
            } 
            ErrAbort (ErrMsg, TRUE, ERR_ARGS);
        }
-       if ((ImInfo.SliceDim == -1) && (NumSlices > 0))
+       if ((ImInfo->SliceDim == -1) && (NumSlices > 0))
        {
            printf ("Warning: file has no z dimension, slices vector ignored");
            NumSlices = 0;
@@ -544,7 +500,7 @@ void mexFunction(int    nlhs,
    }
    else                    /* caller did *not* specify slices vector */
    { 
-       if (ImInfo.SliceDim == -1)    /* file doesn't even have slices */
+       if (ImInfo->SliceDim == -1)    /* file doesn't even have slices */
        {                             /* so don't even try to read any */
            NumSlices = 0;
        }
@@ -559,10 +515,12 @@ void mexFunction(int    nlhs,
 
    if ((nrhs >= FRAMES_POS) && (mxGetM(FRAMES)>0) && (mxGetN(FRAMES)>0))
    {
-       NumFrames = ParseIntArg (FRAMES, MAX_READABLE, Frame);
+       Frame = (long *) mxCalloc (mxGetNumberOfElements (FRAMES), 
+                                  sizeof (long));
+       NumFrames = ParseIntArg (FRAMES, mxGetNumberOfElements (FRAMES), 
+                                Frame);
        if (NumFrames < 0)
        {
-           CloseImage (&ImInfo);
            switch (NumFrames)
            {
                case mexARGS_TOO_BIG:
@@ -575,7 +533,7 @@ void mexFunction(int    nlhs,
            ErrAbort (ErrMsg, TRUE, ERR_ARGS);
 
        }
-       if ((ImInfo.FrameDim == -1) && (NumFrames > 0))
+       if ((ImInfo->FrameDim == -1) && (NumFrames > 0))
        {
            printf ("Warning: file has no time dimension, frames vector ignored");
            NumFrames = 0;
@@ -583,7 +541,7 @@ void mexFunction(int    nlhs,
    }
    else
    {
-       if (ImInfo.FrameDim == -1)    /* file doesn't even have frames */
+       if (ImInfo->FrameDim == -1)    /* file doesn't even have frames */
        {                             /* so don't even try to read any */
            NumFrames = 0;
        }
@@ -598,6 +556,35 @@ void mexFunction(int    nlhs,
    printf ("Will read %d slices, %d frames\n", NumSlices, NumFrames);
 #endif
 
+   /* If starting row number supplied, fetch it; likewise for row count */
+
+   if (nrhs >= START_ROW_POS)
+   {
+      StartRow = (long) *(mxGetPr (START_ROW));
+      StartRowGiven = TRUE;
+   }
+   else
+   {
+      StartRow = 0;
+      StartRowGiven = FALSE;
+   }
+
+   if (nrhs >= NUM_ROWS_POS)
+   {
+      NumRows =  (long) *(mxGetPr (NUM_ROWS));
+   }
+   else   
+   {
+      if (StartRowGiven)	/* if the user supplied a starting row */
+         NumRows = 1;		/* (regardless of which row) we default to */
+      else			/* reading a single row only; otherwise, */
+	 NumRows = ImInfo->Height; /* read entire images */
+   }
+
+#ifdef DEBUG
+   printf ("Starting row: %ld; Number of rows: %ld\n", StartRow, NumRows);
+#endif
+
    /* Okay, now comes the tricky part.  In order to get around Matlab's */
    /* screwy memory use problems, we want to re-use the memory pointed  */
    /* at by OLD_MEMORY, if it exists.  If it's the wrong size, we want  */
@@ -609,14 +596,15 @@ void mexFunction(int    nlhs,
        /* First, make sure the vector is the right size */
        
 #ifdef DEBUG
-       printf("Image size: %ld\n", ImInfo.ImageSize);
+       printf("Image size: %ld\n", ImInfo->Width*NumRows);
        printf("Old memory rows: %ld\n", mxGetM(OLD_MEMORY));
-       printf("Image cols: %ld\n", (NumSlices+NumFrames-1));
+       printf("Image cols: %ld\n", max(NumSlices,1)*max(NumFrames,1));
        printf("Old memory cols: %ld\n", mxGetN(OLD_MEMORY));
 #endif       
 
-       if ((mxGetM(OLD_MEMORY) != (ImInfo.ImageSize)) ||
-           (mxGetN(OLD_MEMORY) != (NumSlices+NumFrames-1)))
+       if ((mxGetM(OLD_MEMORY) != (ImInfo->Width*NumRows)) ||
+           (mxGetN(OLD_MEMORY) != (max(NumSlices,1)*max(NumFrames,1))) ||
+           (mxGetClassID(OLD_MEMORY) != ImageClass))
        {
 
            /*
@@ -645,8 +633,8 @@ void mexFunction(int    nlhs,
                {
                    ErrAbort("Could not allocate memory!\n", FALSE, -1);
                }                   
-               mxFree(mxGetPr(OLD_MEMORY));
-               mxSetPr(OLD_MEMORY, junk_data);
+               mxFree(mxGetData(OLD_MEMORY));
+               mxSetData(OLD_MEMORY, junk_data);
            }
 
            /*
@@ -680,7 +668,7 @@ void mexFunction(int    nlhs,
             * the size later.
             */
 
-           VECTOR_IMAGES = mxCreateDoubleMatrix(1,1,mxREAL);
+           VECTOR_IMAGES = mxCreateNumericMatrix(1,1,ImageClass,mxREAL);
            if (VECTOR_IMAGES == NULL)
            {
                ErrAbort("Could not allocate memory!\n", FALSE, -1);
@@ -692,7 +680,7 @@ void mexFunction(int    nlhs,
             * part, since we won't be needing this memory.
             */
 
-           mxFree(mxGetPr(VECTOR_IMAGES));
+           mxFree(mxGetData(VECTOR_IMAGES));
 
            /*
             * Now, we redefine the size of the left hand side argument
@@ -708,7 +696,7 @@ void mexFunction(int    nlhs,
             * necessary for creating the left hand side argument.
             */
 
-           mxSetPr(VECTOR_IMAGES, mxGetPr(OLD_MEMORY));
+           mxSetData(VECTOR_IMAGES, mxGetData(OLD_MEMORY));
 
            /*
             * Finally, we set the real part pointer of the old Matrix
@@ -716,7 +704,7 @@ void mexFunction(int    nlhs,
             * return.
             */
 
-           mxSetPr(OLD_MEMORY, NULL);
+           mxSetData(OLD_MEMORY, NULL);
        }
    }
    else 
@@ -731,57 +719,25 @@ void mexFunction(int    nlhs,
    }
 
 
-   /* If starting row number supplied, fetch it; likewise for row count */
-
-   if (nrhs >= START_ROW_POS)
-   {
-      StartRow = (long) *(mxGetPr (START_ROW));
-      StartRowGiven = TRUE;
-   }
-   else
-   {
-      StartRow = 0;
-      StartRowGiven = FALSE;
-   }
-
-   if (nrhs >= NUM_ROWS_POS)
-   {
-      NumRows =  (long) *(mxGetPr (NUM_ROWS));
-   }
-   else   
-   {
-      if (StartRowGiven)	/* if the user supplied a starting row */
-         NumRows = 1;		/* (regardless of which row) we default to */
-      else			/* reading a single row only; otherwise, */
-	 NumRows = ImInfo.Height; /* read entire images */
-   }
-
-#ifdef DEBUG
-   printf ("Starting row: %ld; Number of rows: %ld\n", StartRow, NumRows);
-#endif
-
    /* Make sure the supplied slice, frame, and row numbers are within bounds */
 
-   if (!CheckBounds(Slice,Frame,NumSlices,NumFrames,StartRow,NumRows,&ImInfo))
+   if (!CheckBounds(Slice,Frame,NumSlices,NumFrames,StartRow,NumRows,ImInfo))
    {
-      CloseImage (&ImInfo);
       ErrAbort (ErrMsg, TRUE, ERR_ARGS);
    }
    
 
-   /* And read the images to a MATLAB Matrix (of doubles!) */
+   /* And read the images to a MATLAB Matrix (of doubles, or singles) */
 
-   Result = ReadImages (&ImInfo, 
+   Result = ReadImages (ImInfo, 
                         Slice, Frame, 
                         NumSlices, NumFrames, 
                         StartRow, NumRows,
                         &VECTOR_IMAGES);
    if (Result != ERR_NONE) 
    {
-      CloseImage (&ImInfo);
+      FlushCachedImage (Filename);      /* don't trust it next time */
       ErrAbort (ErrMsg, TRUE, Result);
    }
 
-   CloseImage (&ImInfo);
-
 }     /* mexFunction */
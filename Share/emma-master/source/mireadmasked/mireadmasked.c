@@ -0,0 +1,339 @@
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : mireadmasked (CMEX)
+@INPUT      :
+@OUTPUT     :
+@RETURNS    :
+@DESCRIPTION: CMEX routine to read the voxels under a mask from a list of
+              MINC files.  See mireadmasked.m (or type "help mireadmasked"
+              in MATLAB) for details.
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+@COMMENTS   : For full usage documentation, see mireadmasked.m
+---------------------------------------------------------------------------- */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <float.h>
+#include <errno.h>
+#include "mex.h"
+#include "minc.h"
+#include "mierrors.h"         /* mine and Mark's */
+#include "mexutils.h"         /* N.B. must link in mexutils.o */
+#include "mincutil.h"
+#include "threadpool.h"
+#include "maskread.h"
+
+#define PROGNAME "mireadmasked"
+
+/*
+ * Constants to check for argument number and position
+ */
+
+#define MIN_IN_ARGS        2
+#define MAX_IN_ARGS        6
+
+/* ...POS macros: 1-based, used to determine if input args are present */
+
+#define PRECISION_POS      3
+#define THREADS_POS        4
+#define READ_AHEAD_POS     5
+#define FRAMES_POS         6
+
+/*
+ * Macros to access the input and output arguments from/to MATLAB
+ * (N.B. these only work in mexFunction())
+ */
+
+#define MINC_FILES     prhs[0]                  /* cell array of filenames */
+#define MASK_INDEX     prhs[1]                  /* 1-based, ascending */
+#define PRECISION      prhs[PRECISION_POS-1]    /* 'double' or 'single' */
+#define NUM_THREADS    prhs[THREADS_POS-1]      /* number of I/O threads */
+#define READ_AHEAD     prhs[READ_AHEAD_POS-1]   /* files to decode ahead */
+#define FRAMES         prhs[FRAMES_POS-1]       /* 1-based, one per file */
+#define MASKED_DATA    plhs[0]                  /* one row per file */
+
+char       *ErrMsg ;             /* set as close to the occurence of the
+                                    error as possible; displayed by whatever
+                                    code exits */
+
+
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : ErrAbort
+@INPUT      : msg - character to string to print just before aborting
+              PrintUsage - whether or not to print a usage summary before
+                aborting
+              ExitCode - one of the standard codes from mierrors.h -- NOTE!
+                this parameter is NOT currently used, but I've included it for
+                consistency with other functions named ErrAbort in other
+                programs
+@OUTPUT     : none - function does not return!!!
+@RETURNS    :
+@DESCRIPTION: Optionally prints a usage summary, and calls mexErrMsgTxt with
+              the supplied msg, which ABORTS the mex-file!!!
+@METHOD     :
+@GLOBALS    : requires PROGNAME macro
+@CALLS      : standard mex functions
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+void ErrAbort (char msg[], Boolean PrintUsage, int ExitCode)
+{
+   if (PrintUsage)
+   {
+      (void) mexPrintf ("Usage: %s (minc_files, mask_index [, precision "
+                        "[, num_threads [, read_ahead [, frames]]]])\n",
+                        PROGNAME);
+   }
+   (void) mexErrMsgTxt (msg);
+}
+
+
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : ParseMaskIndex
+@INPUT      : Mindex - MATLAB vector of one-based voxel indices, as
+                returned by find() on a mask matrix
+@OUTPUT     : *Mask - NumVoxels and Index[] are filled in
+@RETURNS    : ERR_NONE if all went well
+              ERR_ARGS if the index is not a numeric vector, or is not
+                strictly ascending and positive (ErrMsg is set)
+@DESCRIPTION: Checks the type of the mask index and hands it to
+              SetMaskIndex.
+@METHOD     :
+@GLOBALS    : ErrMsg
+@CALLS      : standard mex functions, SetMaskIndex
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+int ParseMaskIndex (const mxArray *Mindex, MaskInfoRec *Mask)
+{
+   if (!mxIsDouble (Mindex) || mxIsComplex (Mindex) ||
+       ((mxGetM (Mindex) != 1) && (mxGetN (Mindex) != 1)))
+   {
+      strcpy (ErrMsg, "Mask index must be a real vector of doubles");
+      return (ERR_ARGS);
+   }
+
+   return (SetMaskIndex (mxGetPr (Mindex), mxGetNumberOfElements (Mindex),
+                         Mask));
+}     /* ParseMaskIndex */
+
+
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : mexFunction
+@INPUT      : nlhs, nrhs - number of output/input arguments (from MATLAB)
+              prhs - actual input arguments
+@OUTPUT     : plhs - actual output arguments
+@RETURNS    : (void)
+@DESCRIPTION:
+@METHOD     :
+@GLOBALS    : ErrMsg
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+void mexFunction(int    nlhs,
+                 mxArray *plhs[],
+                 int    nrhs,
+                 const mxArray *prhs[])
+{
+   char        *Precision;
+   nc_type      ICVType;         /* NC_DOUBLE or NC_FLOAT, from Precision */
+   mxClassID    ImageClass;      /* the corresponding MATLAB class */
+   long         NumThreads;
+   long         ReadAhead;
+   ImageInfoRec ImInfo;
+   MaskInfoRec  Mask;
+   long        *Frames;          /* zero-based, or NULL for the first */
+   char       **Filenames;
+   double       NaN;
+   long         NumFiles;
+   long         file;
+   long         Failed;
+   int          Result;
+
+   ncopts = 0;
+   ErrMsg = (char *) mxCalloc (256, sizeof (char));
+
+   /* First make sure a valid number of arguments was given. */
+
+   if ((nrhs < MIN_IN_ARGS) || (nrhs > MAX_IN_ARGS))
+   {
+      sprintf (ErrMsg, "Incorrect number of arguments");
+      ErrAbort (ErrMsg, TRUE, ERR_ARGS);
+   }
+
+   if (!mxIsCell (MINC_FILES))
+   {
+      ErrAbort ("MINC files must be given as a cell array of strings",
+                TRUE, ERR_ARGS);
+   }
+   NumFiles = mxGetNumberOfElements (MINC_FILES);
+
+   /* Parse the precision option, if given (see mireadimages.c) */
+
+   ICVType = NC_DOUBLE;
+   ImageClass = mxDOUBLE_CLASS;
+   if ((nrhs >= PRECISION_POS) &&
+       (mxGetM(PRECISION)>0) && (mxGetN(PRECISION)>0))
+   {
+      if (ParseStringArg (PRECISION, &Precision) == NULL)
+      {
+         ErrAbort ("Precision must be a string", TRUE, ERR_ARGS);
+      }
+      if (strcmp (Precision, "single") == 0)
+      {
+         ICVType = NC_FLOAT;
+         ImageClass = mxSINGLE_CLASS;
+      }
+      else if (strcmp (Precision, "double") != 0)
+      {
+         ErrAbort ("Precision must be either 'double' or 'single'",
+                   TRUE, ERR_ARGS);
+      }
+   }
+
+   /* And the number of threads; one (ie. no threads) by default */
+
+   NumThreads = 1;
+   if (nrhs >= THREADS_POS)
+   {
+      Result = ParseIntArg (NUM_THREADS, 1, &NumThreads);
+      if ((Result < 0) || ((Result == 1) && (NumThreads < 1)))
+      {
+         ErrAbort ("num_threads must be a positive scalar", TRUE, ERR_ARGS);
+      }
+      if (Result == 0)
+      {
+         NumThreads = DefaultThreads ();
+      }
+   }
+
+   /* And how many files to decode ahead when reading with one thread */
+
+   ReadAhead = 0;
+   if (nrhs >= READ_AHEAD_POS)
+   {
+      Result = ParseIntArg (READ_AHEAD, 1, &ReadAhead);
+      if ((Result < 0) || ((Result == 1) && (ReadAhead < 0)))
+      {
+         ErrAbort ("read_ahead must be a non-negative scalar", TRUE, ERR_ARGS);
+      }
+   }
+
+   /*
+    * The mask is malloc'd by the library, so it must be freed before
+    * aborting from here on.
+    */
+
+   Result = ParseMaskIndex (MASK_INDEX, &Mask);
+   if (Result != ERR_NONE)
+   {
+      ErrAbort (ErrMsg, TRUE, Result);
+   }
+
+   /*
+    * Get all the filenames now, since the mx functions may only be
+    * called from this thread.
+    */
+
+   Filenames = (char **) mxCalloc (max (NumFiles, 1), sizeof (char *));
+   for (file = 0; file < NumFiles; file++)
+   {
+      if (ParseStringArg (mxGetCell (MINC_FILES, file),
+                          &Filenames [file]) == NULL)
+      {
+         FreeMask (&Mask);
+         sprintf (ErrMsg, "Element %ld of the file list is not a string",
+                  file+1);
+         ErrAbort (ErrMsg, TRUE, ERR_ARGS);
+      }
+   }
+
+   /* And which frame of each file to read (for 4-D files) */
+
+   Frames = NULL;
+   if ((nrhs >= FRAMES_POS) && !mxIsEmpty (FRAMES))
+   {
+      Result = ERR_ARGS;
+      strcpy (ErrMsg, "frames must be a real vector of doubles");
+      if (mxIsDouble (FRAMES) && !mxIsComplex (FRAMES))
+      {
+         Result = SetFrameList (mxGetPr (FRAMES),
+                                mxGetNumberOfElements (FRAMES),
+                                NumFiles, &Frames);
+      }
+      if (Result != ERR_NONE)
+      {
+         FreeMask (&Mask);
+         ErrAbort (ErrMsg, TRUE, Result);
+      }
+   }
+
+   MASKED_DATA = mxCreateNumericMatrix (NumFiles, Mask.NumVoxels,
+                                        ImageClass, mxREAL);
+   if (MASKED_DATA == NULL)
+   {
+      FreeMask (&Mask);
+      free (Frames);
+      sprintf (ErrMsg, "Error allocating %ld x %ld matrix!",
+               NumFiles, Mask.NumVoxels);
+      ErrAbort (ErrMsg, FALSE, ERR_NO_MEM);
+   }
+   if (NumFiles == 0)
+   {
+      FreeMask (&Mask);
+      free (Frames);
+      return;
+   }
+
+   /*
+    * The first file tells us the geometry of the volume that the mask
+    * index refers to.
+    */
+
+   NaN = CreateNaN();
+   Result = OpenImageAs (Filenames [0], &ImInfo, NC_NOWRITE, NaN, ICVType);
+   if (Result == ERR_NONE)
+   {
+      Result = SetupMask (&ImInfo, &Mask);
+      CloseImage (&ImInfo);
+   }
+   if (Result != ERR_NONE)
+   {
+      FreeMask (&Mask);
+      free (Frames);
+      ErrAbort (ErrMsg, (Result == ERR_ARGS), Result);
+   }
+
+   /* Now read all the files, the whole volume at once */
+
+   Result = ReadMaskedFiles (Filenames, NumFiles, Frames, &Mask,
+                             0, Mask.Slices, ICVType, NaN,
+                             (int) NumThreads, (int) ReadAhead,
+                             mxGetData (MASKED_DATA), &Failed);
+   FreeMask (&Mask);
+   free (Frames);
+
+   if (Result != ERR_NONE)
+   {
+      char   *Msg;
+
+      if (Failed < 0)
+      {
+         ErrAbort (ErrMsg, FALSE, Result);
+      }
+      Msg = (char *) mxCalloc (strlen (ErrMsg) +
+                               strlen (Filenames [Failed]) + 8,
+                               sizeof (char));
+      sprintf (Msg, "%s: %s", Filenames [Failed], ErrMsg);
+      ErrAbort (Msg, FALSE, Result);
+   }
+
+}     /* mexFunction */
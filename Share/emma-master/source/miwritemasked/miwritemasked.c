@@ -0,0 +1,286 @@
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : miwritemasked (CMEX)
+@INPUT      :
+@OUTPUT     :
+@RETURNS    :
+@DESCRIPTION: CMEX routine to write a volume into a MINC file given just
+              the values of the voxels under a mask -- the reverse of
+              mireadmasked.  See miwritemasked.m (or type "help
+              miwritemasked" in MATLAB) for details.
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+@COMMENTS   : For full usage documentation, see miwritemasked.m
+---------------------------------------------------------------------------- */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include "mex.h"
+#include "minc.h"
+#include "mierrors.h"         /* mine and Mark's */
+#include "mexutils.h"         /* N.B. must link in mexutils.o */
+#include "mincutil.h"
+#include "maskread.h"
+
+#define PROGNAME "miwritemasked"
+
+/*
+ * Constants to check for argument number and position
+ */
+
+#define MIN_IN_ARGS        3
+#define MAX_IN_ARGS        4
+
+/* ...POS macros: 1-based, used to determine if input args are present */
+
+#define FILL_POS           4
+
+/*
+ * Macros to access the input arguments from MATLAB
+ * (N.B. these only work in mexFunction())
+ */
+
+#define MINC_FILENAME  prhs[0]
+#define VALUES         prhs[1]                  /* one per masked voxel */
+#define MASK_INDEX     prhs[2]                  /* 1-based, ascending */
+#define FILL_VALUE     prhs[FILL_POS-1]         /* for voxels off the mask */
+
+char       *ErrMsg ;             /* set as close to the occurence of the
+                                    error as possible; displayed by whatever
+                                    code exits */
+
+
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : ErrAbort
+@INPUT      : msg - character to string to print just before aborting
+              PrintUsage - whether or not to print a usage summary before
+                aborting
+              ExitCode - one of the standard codes from mierrors.h -- NOTE!
+                this parameter is NOT currently used, but I've included it for
+                consistency with other functions named ErrAbort in other
+                programs
+@OUTPUT     : none - function does not return!!!
+@RETURNS    :
+@DESCRIPTION: Optionally prints a usage summary, and calls mexErrMsgTxt with
+              the supplied msg, which ABORTS the mex-file!!!
+@METHOD     :
+@GLOBALS    : requires PROGNAME macro
+@CALLS      : standard mex functions
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+void ErrAbort (char msg[], Boolean PrintUsage, int ExitCode)
+{
+   if (PrintUsage)
+   {
+      (void) mexPrintf ("Usage: %s (minc_file, values, mask_index "
+                        "[, fill_value])\n", PROGNAME);
+   }
+   (void) mexErrMsgTxt (msg);
+}
+
+
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : WriteMasked
+@INPUT      : Image - the open (for writing) MINC file
+              Mask - the mask, set up for Image's geometry
+              Values - one value per masked voxel, as doubles or floats
+              IsFloat - TRUE if Values holds floats
+              Fill - value for every voxel not under the mask
+@OUTPUT     :
+@RETURNS    : ERR_NONE if all went well
+              ERR_NO_MEM if the slice buffer could not be allocated
+              ERR_OUT_MINC on any error writing (ErrMsg is set)
+@DESCRIPTION: Writes the whole volume one slice at a time.  Each slice
+              is set to Fill, the slice's masked voxels are scattered
+              into it, and it is written with WriteImages (which also
+              keeps image-max and image-min up to date); so no more than
+              one slice is ever held in memory, however many voxels are
+              in the mask.
+@METHOD     :
+@GLOBALS    : ErrMsg
+@CALLS      : WriteImages
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+int WriteMasked (ImageInfoRec *Image, MaskInfoRec *Mask,
+                 void *Values, Boolean IsFloat, double Fill)
+{
+   double  *Slice;
+   long     NumSlices;
+   long     s, v, i;
+   long     Base;
+   int      Result;
+
+   Slice = (double *) malloc (Mask->ImageSize * sizeof (double));
+   if (Slice == NULL)
+   {
+      sprintf (ErrMsg, "Out of memory allocating a slice buffer");
+      return (ERR_NO_MEM);
+   }
+
+   NumSlices = (Image->SliceDim == -1) ? 0 : 1;
+   for (s = 0; s < Mask->Slices; s++)
+   {
+      for (i = 0; i < Mask->ImageSize; i++)
+      {
+         Slice [i] = Fill;
+      }
+
+      Base = s * Mask->ImageSize;
+      if (IsFloat)
+      {
+         float  *In = (float *) Values;
+
+         for (v = Mask->SliceFirst [s]; v < Mask->SliceFirst [s+1]; v++)
+         {
+            Slice [Mask->Index [v] - Base] = (double) In [v];
+         }
+      }
+      else
+      {
+         double *In = (double *) Values;
+
+         for (v = Mask->SliceFirst [s]; v < Mask->SliceFirst [s+1]; v++)
+         {
+            Slice [Mask->Index [v] - Base] = In [v];
+         }
+      }
+
+      Result = WriteImages (Slice, Image, &s, NULL, NumSlices, 0);
+      if (Result != ERR_NONE)
+      {
+         free (Slice);
+         return (Result);
+      }
+   }
+
+   free (Slice);
+   return (ERR_NONE);
+
+}     /* WriteMasked */
+
+
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : mexFunction
+@INPUT      : nlhs, nrhs - number of output/input arguments (from MATLAB)
+              prhs - actual input arguments
+@OUTPUT     : (none)
+@RETURNS    : (void)
+@DESCRIPTION: Checks the arguments, opens the MINC file for writing, and
+              writes the masked values into it.
+@METHOD     :
+@GLOBALS    : ErrMsg
+@CALLS      : SetMaskIndex, SetupMask, WriteMasked
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+void mexFunction(int    nlhs,
+                 mxArray *plhs[],
+                 int    nrhs,
+                 const mxArray *prhs[])
+{
+   char         *Filename;
+   ImageInfoRec  ImInfo;
+   MaskInfoRec   Mask;
+   double        Fill;
+   int           Result;
+
+   ncopts = 0;
+   ErrMsg = (char *) mxCalloc (256, sizeof (char));
+
+   if ((nrhs < MIN_IN_ARGS) || (nrhs > MAX_IN_ARGS))
+   {
+      ErrAbort ("Incorrect number of arguments", TRUE, ERR_ARGS);
+   }
+
+   if (ParseStringArg (MINC_FILENAME, &Filename) == NULL)
+   {
+      ErrAbort ("Error in filename", TRUE, ERR_ARGS);
+   }
+
+   if ((!mxIsDouble (VALUES) && !mxIsSingle (VALUES)) ||
+       mxIsComplex (VALUES) || mxIsSparse (VALUES))
+   {
+      ErrAbort ("Values must be a real vector of doubles or singles",
+                TRUE, ERR_ARGS);
+   }
+
+   if (!mxIsDouble (MASK_INDEX) || mxIsComplex (MASK_INDEX))
+   {
+      ErrAbort ("Mask index must be a real vector of doubles",
+                TRUE, ERR_ARGS);
+   }
+
+   Fill = 0;
+   if ((nrhs >= FILL_POS) && !mxIsEmpty (FILL_VALUE))
+   {
+      if (!mxIsDouble (FILL_VALUE) || (mxGetNumberOfElements (FILL_VALUE) != 1))
+      {
+         ErrAbort ("fill_value must be a scalar", TRUE, ERR_ARGS);
+      }
+      Fill = mxGetScalar (FILL_VALUE);
+   }
+
+   if (mxGetNumberOfElements (VALUES) != mxGetNumberOfElements (MASK_INDEX))
+   {
+      ErrAbort ("There must be exactly one value per element of mask_index",
+                TRUE, ERR_ARGS);
+   }
+
+   /*
+    * The mask is malloc'd by the library, so it must be freed before
+    * aborting from here on.
+    */
+
+   Result = SetMaskIndex (mxGetPr (MASK_INDEX),
+                          mxGetNumberOfElements (MASK_INDEX), &Mask);
+   if (Result != ERR_NONE)
+   {
+      ErrAbort (ErrMsg, TRUE, Result);
+   }
+
+   Result = OpenImage (Filename, &ImInfo, NC_WRITE, CreateNaN());
+   if (Result != ERR_NONE)
+   {
+      FreeMask (&Mask);
+      ErrAbort (ErrMsg, TRUE, Result);
+   }
+
+   if (ImInfo.FrameDim != -1)
+   {
+      CloseImage (&ImInfo);
+      FreeMask (&Mask);
+      ErrAbort ("File must not have a frame dimension", TRUE, ERR_ARGS);
+   }
+
+   if ((ImInfo.MaxID == MI_ERROR) || (ImInfo.MinID == MI_ERROR))
+   {
+      sprintf (ErrMsg, "Missing image-max or image-min variable in file %s",
+               Filename);
+      CloseImage (&ImInfo);
+      FreeMask (&Mask);
+      ErrAbort (ErrMsg, TRUE, ERR_IN_MINC);
+   }
+
+   Result = SetupMask (&ImInfo, &Mask);
+   if (Result == ERR_NONE)
+   {
+      Result = WriteMasked (&ImInfo, &Mask, mxGetData (VALUES),
+                            mxIsSingle (VALUES), Fill);
+   }
+   CloseImage (&ImInfo);
+   FreeMask (&Mask);
+
+   if (Result != ERR_NONE)
+   {
+      ErrAbort (ErrMsg, (Result == ERR_ARGS), Result);
+   }
+
+}     /* mexFunction */
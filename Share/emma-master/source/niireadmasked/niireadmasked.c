@@ -0,0 +1,263 @@
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : niireadmasked (CMEX)
+@INPUT      :
+@OUTPUT     :
+@RETURNS    :
+@DESCRIPTION: CMEX routine to read the voxels under a mask from a list of
+              NIfTI files -- the NIfTI counterpart of mireadmasked.  See
+              niireadmasked.m (or type "help niireadmasked" in MATLAB)
+              for details.
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+@COMMENTS   : For full usage documentation, see niireadmasked.m
+---------------------------------------------------------------------------- */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include "mex.h"
+#include "minc.h"
+#include "mierrors.h"         /* mine and Mark's */
+#include "mexutils.h"         /* N.B. must link in mexutils.o */
+#include "mincutil.h"
+#include "threadpool.h"
+#include "maskread.h"
+#include "niftiutil.h"
+
+#define PROGNAME "niireadmasked"
+
+/*
+ * Constants to check for argument number and position
+ */
+
+#define MIN_IN_ARGS        2
+#define MAX_IN_ARGS        5
+
+/* ...POS macros: 1-based, used to determine if input args are present */
+
+#define PRECISION_POS      3
+#define THREADS_POS        4
+#define VOLUMES_POS        5
+
+/*
+ * Macros to access the input and output arguments from/to MATLAB
+ * (N.B. these only work in mexFunction())
+ */
+
+#define NII_FILES      prhs[0]                  /* cell array of filenames */
+#define MASK_INDEX     prhs[1]                  /* 1-based, ascending */
+#define PRECISION      prhs[PRECISION_POS-1]    /* 'double' or 'single' */
+#define NUM_THREADS    prhs[THREADS_POS-1]      /* number of threads */
+#define VOLUMES        prhs[VOLUMES_POS-1]      /* 1-based, one per file */
+#define MASKED_DATA    plhs[0]                  /* one row per file */
+
+char       *ErrMsg ;             /* set as close to the occurence of the
+                                    error as possible; displayed by whatever
+                                    code exits */
+
+
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : ErrAbort
+@INPUT      : msg - character to string to print just before aborting
+              PrintUsage - whether or not to print a usage summary before
+                aborting
+              ExitCode - one of the standard codes from mierrors.h -- NOTE!
+                this parameter is NOT currently used, but I've included it for
+                consistency with other functions named ErrAbort in other
+                programs
+@OUTPUT     : none - function does not return!!!
+@RETURNS    :
+@DESCRIPTION: Optionally prints a usage summary, and calls mexErrMsgTxt with
+              the supplied msg, which ABORTS the mex-file!!!
+@METHOD     :
+@GLOBALS    : requires PROGNAME macro
+@CALLS      : standard mex functions
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+void ErrAbort (char msg[], Boolean PrintUsage, int ExitCode)
+{
+   if (PrintUsage)
+   {
+      (void) mexPrintf ("Usage: %s (nii_files, mask_index [, precision "
+                        "[, num_threads [, volumes]]])\n", PROGNAME);
+   }
+   (void) mexErrMsgTxt (msg);
+}
+
+
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : mexFunction
+@INPUT      : nlhs, nrhs - number of output/input arguments (from MATLAB)
+              prhs - actual input arguments
+@OUTPUT     : plhs[0] - the masked voxels, one row per file
+@RETURNS    : (void)
+@DESCRIPTION: Checks the arguments and reads the masked voxels of every
+              file straight into the output matrix.
+@METHOD     :
+@GLOBALS    : ErrMsg
+@CALLS      : SetMaskIndex, SetFrameList, ReadNiftiMaskedFiles, FreeMask
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+void mexFunction(int    nlhs,
+                 mxArray *plhs[],
+                 int    nrhs,
+                 const mxArray *prhs[])
+{
+   char        *Precision;
+   Boolean      IsFloat;
+   mxClassID    ImageClass;
+   long         NumThreads;
+   MaskInfoRec  Mask;
+   char       **Filenames;
+   long        *Volumes;          /* zero-based, or NULL for the first */
+   long         NumFiles;
+   long         file;
+   long         Failed;
+   int          Result;
+
+   ErrMsg = (char *) mxCalloc (256, sizeof (char));
+
+   if ((nrhs < MIN_IN_ARGS) || (nrhs > MAX_IN_ARGS))
+   {
+      ErrAbort ("Incorrect number of arguments", TRUE, ERR_ARGS);
+   }
+
+   if (!mxIsCell (NII_FILES))
+   {
+      ErrAbort ("NIfTI files must be given as a cell array of strings",
+                TRUE, ERR_ARGS);
+   }
+   NumFiles = mxGetNumberOfElements (NII_FILES);
+
+   if (!mxIsDouble (MASK_INDEX) || mxIsComplex (MASK_INDEX) ||
+       ((mxGetM (MASK_INDEX) != 1) && (mxGetN (MASK_INDEX) != 1)))
+   {
+      ErrAbort ("Mask index must be a real vector of doubles",
+                TRUE, ERR_ARGS);
+   }
+
+   IsFloat = FALSE;
+   ImageClass = mxDOUBLE_CLASS;
+   if ((nrhs >= PRECISION_POS) && !mxIsEmpty (PRECISION))
+   {
+      if (ParseStringArg (PRECISION, &Precision) == NULL)
+      {
+         ErrAbort ("Precision must be a string", TRUE, ERR_ARGS);
+      }
+      if (strcmp (Precision, "single") == 0)
+      {
+         IsFloat = TRUE;
+         ImageClass = mxSINGLE_CLASS;
+      }
+      else if (strcmp (Precision, "double") != 0)
+      {
+         ErrAbort ("Precision must be either 'double' or 'single'",
+                   TRUE, ERR_ARGS);
+      }
+   }
+
+   /* The number of threads; one (ie. no threads) by default */
+
+   NumThreads = 1;
+   if (nrhs >= THREADS_POS)
+   {
+      Result = ParseIntArg (NUM_THREADS, 1, &NumThreads);
+      if ((Result < 0) || ((Result == 1) && (NumThreads < 1)))
+      {
+         ErrAbort ("num_threads must be a positive scalar", TRUE, ERR_ARGS);
+      }
+      if (Result == 0)
+      {
+         NumThreads = DefaultThreads ();
+      }
+   }
+
+   /*
+    * Get all the filenames now, since the mx functions may only be
+    * called from this thread.
+    */
+
+   Filenames = (char **) mxCalloc (max (NumFiles, 1), sizeof (char *));
+   for (file = 0; file < NumFiles; file++)
+   {
+      if (ParseStringArg (mxGetCell (NII_FILES, file),
+                          &Filenames [file]) == NULL)
+      {
+         sprintf (ErrMsg, "Element %ld of the file list is not a string",
+                  file+1);
+         ErrAbort (ErrMsg, TRUE, ERR_ARGS);
+      }
+   }
+
+   /*
+    * The mask is malloc'd by the library, so it must be freed before
+    * aborting from here on.
+    */
+
+   Result = SetMaskIndex (mxGetPr (MASK_INDEX),
+                          mxGetNumberOfElements (MASK_INDEX), &Mask);
+   if (Result != ERR_NONE)
+   {
+      ErrAbort (ErrMsg, TRUE, Result);
+   }
+
+   /* And which volume of each file to read (for 4-D files) */
+
+   Volumes = NULL;
+   if ((nrhs >= VOLUMES_POS) && !mxIsEmpty (VOLUMES))
+   {
+      Result = ERR_ARGS;
+      strcpy (ErrMsg, "volumes must be a real vector of doubles");
+      if (mxIsDouble (VOLUMES) && !mxIsComplex (VOLUMES))
+      {
+         Result = SetFrameList (mxGetPr (VOLUMES),
+                                mxGetNumberOfElements (VOLUMES),
+                                NumFiles, &Volumes);
+      }
+      if (Result != ERR_NONE)
+      {
+         FreeMask (&Mask);
+         ErrAbort (ErrMsg, TRUE, Result);
+      }
+   }
+
+   MASKED_DATA = mxCreateNumericMatrix (NumFiles, Mask.NumVoxels,
+                                        ImageClass, mxREAL);
+   if (MASKED_DATA == NULL)
+   {
+      FreeMask (&Mask);
+      free (Volumes);
+      sprintf (ErrMsg, "Error allocating %ld x %ld matrix!",
+               NumFiles, Mask.NumVoxels);
+      ErrAbort (ErrMsg, FALSE, ERR_NO_MEM);
+   }
+
+   Result = ReadNiftiMaskedFiles (Filenames, NumFiles, Volumes, Mask.Index,
+                                  Mask.NumVoxels, IsFloat, (int) NumThreads,
+                                  mxGetData (MASKED_DATA), &Failed);
+   FreeMask (&Mask);
+   free (Volumes);
+
+   if (Result != ERR_NONE)
+   {
+      char   *Msg;
+
+      if (Failed < 0)
+      {
+         ErrAbort (ErrMsg, (Result == ERR_ARGS), Result);
+      }
+      Msg = (char *) mxCalloc (strlen (ErrMsg) +
+                               strlen (Filenames [Failed]) + 8,
+                               sizeof (char));
+      sprintf (Msg, "%s: %s", Filenames [Failed], ErrMsg);
+      ErrAbort (Msg, FALSE, Result);
+   }
+
+}     /* mexFunction */
@@ -0,0 +1,381 @@
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : niiwrite (CMEX)
+@INPUT      :
+@OUTPUT     :
+@RETURNS    :
+@DESCRIPTION: CMEX routine to write a volume to a new NIfTI file (.nii
+              or .nii.gz), using another NIfTI file's header as the
+              template -- the same file as save_nii would write from the
+              result of load_nii on that file, but reading only its
+              header.  See niiwrite.m (or type "help niiwrite" in MATLAB)
+              for details.
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+@COMMENTS   : For full usage documentation, see niiwrite.m
+---------------------------------------------------------------------------- */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <math.h>
+#include "mex.h"
+#include "emmageneral.h"
+#include "mierrors.h"         /* mine and Mark's */
+#include "mexutils.h"         /* N.B. must link in mexutils.o */
+#include "niftiutil.h"
+
+#define PROGNAME "niiwrite"
+
+/*
+ * Constants to check for argument number and position
+ */
+
+#define MIN_IN_ARGS        3
+#define MAX_IN_ARGS        4
+
+/* ...POS macros: 1-based, used to determine if input args are present */
+
+#define TYPE_POS           4
+
+/*
+ * Macros to access the input arguments from MATLAB
+ * (N.B. these only work in mexFunction())
+ */
+
+#define NII_FILENAME   prhs[0]
+#define DATA           prhs[1]                  /* the whole volume */
+#define REF_FILENAME   prhs[2]
+#define DATA_TYPE      prhs[TYPE_POS-1]         /* as for setNiftiType */
+
+#define HEADER_OPTION  "-header"                /* given instead of nii_file */
+
+char       *ErrMsg ;             /* set as close to the occurence of the
+                                    error as possible; displayed by whatever
+                                    code exits */
+
+
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : ErrAbort
+@INPUT      : msg - character to string to print just before aborting
+              PrintUsage - whether or not to print a usage summary before
+                aborting
+              ExitCode - one of the standard codes from mierrors.h -- NOTE!
+                this parameter is NOT currently used, but I've included it for
+                consistency with other functions named ErrAbort in other
+                programs
+@OUTPUT     : none - function does not return!!!
+@RETURNS    :
+@DESCRIPTION: Optionally prints a usage summary, and calls mexErrMsgTxt with
+              the supplied msg, which ABORTS the mex-file!!!
+@METHOD     :
+@GLOBALS    : requires PROGNAME macro
+@CALLS      : standard mex functions
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+void ErrAbort (char msg[], Boolean PrintUsage, int ExitCode)
+{
+   if (PrintUsage)
+   {
+      (void) mexPrintf ("Usage: %s (nii_file, data, ref_file [, data_type])\n",
+                        PROGNAME);
+      (void) mexPrintf ("   or: %s ('%s', ref_file, hdr_file)\n",
+                        PROGNAME, HEADER_OPTION);
+   }
+   (void) mexErrMsgTxt (msg);
+}
+
+
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : SetDataType
+@INPUT      : TypeStr - 'byte', 'short', 'long', 'float' or 'double' (as
+                for setNiftiType), or NULL to keep the reference's type
+              Hdr - the reference's header
+@OUTPUT     : Hdr - with datatype (and perhaps the scaling) set
+@RETURNS    : TRUE if all went well
+              FALSE if TypeStr is not a type we know, or none was given
+                and the reference's type is not one we can write (ErrMsg
+                is set)
+@DESCRIPTION: Sets the type the new file is stored as.  If the reference
+              is scaled (scl_slope), load_nii would have applied the
+              scaling and turned its header into that of an unscaled
+              float (or double) file; so that is done here too.
+@METHOD     :
+@GLOBALS    : ErrMsg
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+Boolean SetDataType (char *TypeStr, NiftiHeader *Hdr)
+{
+   if ((Hdr->scl_slope != 0) &&
+       ((Hdr->scl_slope != 1) || (Hdr->scl_inter != 0)) &&
+       (NiftiTypeSize (Hdr->datatype) != 0))
+   {
+      if (Hdr->datatype != NIFTI_FLOAT64)
+      {
+         Hdr->datatype = NIFTI_FLOAT32;
+      }
+      Hdr->scl_slope = 0;
+   }
+
+   if (TypeStr == NULL)
+   {
+      if (NiftiTypeSize (Hdr->datatype) == 0)
+      {
+         sprintf (ErrMsg, "Can't write the reference's data type (%d); "
+                  "give data_type", (int) Hdr->datatype);
+         return (FALSE);
+      }
+   }
+   else if (strcmp (TypeStr, "byte") == 0)
+      Hdr->datatype = NIFTI_UINT8;
+   else if (strcmp (TypeStr, "short") == 0)
+      Hdr->datatype = NIFTI_INT16;
+   else if (strcmp (TypeStr, "long") == 0)
+      Hdr->datatype = NIFTI_INT32;
+   else if (strcmp (TypeStr, "float") == 0)
+      Hdr->datatype = NIFTI_FLOAT32;
+   else if (strcmp (TypeStr, "double") == 0)
+      Hdr->datatype = NIFTI_FLOAT64;
+   else
+   {
+      sprintf (ErrMsg, "Unknown data type: %s", TypeStr);
+      return (FALSE);
+   }
+   return (TRUE);
+
+}     /* SetDataType */
+
+
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : SetRange
+@INPUT      : Values - the volume, as doubles (or floats, if IsFloat)
+              N - number of voxels
+@OUTPUT     : Hdr - glmax and glmin set
+@RETURNS    : (void)
+@DESCRIPTION: Sets glmax and glmin to the rounded range of the data,
+              ignoring NaNs, as save_nii does.
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+void SetRange (void *Values, Boolean IsFloat, long N, NiftiHeader *Hdr)
+{
+   double   Max = -HUGE_VAL;
+   double   Min = HUGE_VAL;
+   double   v;
+   long     i;
+
+   for (i = 0; i < N; i++)
+   {
+      v = IsFloat ? (double) ((float *) Values) [i] : ((double *) Values) [i];
+      Max = (v > Max) ? v : Max;
+      Min = (v < Min) ? v : Min;
+   }
+
+   if (Max < Min)                     /* nothing but NaNs */
+   {
+      Max = Min = 0;
+   }
+   Hdr->glmax = (int) floor (Max + 0.5);
+   Hdr->glmin = (int) floor (Min + 0.5);
+
+}     /* SetRange */
+
+
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : CopyHeader
+@INPUT      : RefFile - a NIfTI file (possibly gzip'd)
+              HdrFile - name of the file to write
+@OUTPUT     : (none)
+@RETURNS    : ERR_NONE if all went well
+              ERR_OUT_TEMP if HdrFile can't be written (ErrMsg set)
+              any error from ReadNiftiHeader
+@DESCRIPTION: Writes RefFile's header, uncompressed and unchanged (but
+              for the byte order), followed by an empty extender, to
+              HdrFile -- so that load_nii_hdr can read the header of a
+              gzip'd file without the whole file being inflated.
+@METHOD     :
+@GLOBALS    : ErrMsg
+@CALLS      : ReadNiftiHeader
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+int CopyHeader (char RefFile[], char HdrFile[])
+{
+   NiftiHeader     Hdr;
+   Boolean         Swapped;
+   FILE           *File;
+   char            Extender [NIFTI_VOX_OFFSET - NIFTI_HEADER_SIZE];
+   int             Result;
+
+   Result = ReadNiftiHeader (RefFile, &Hdr, &Swapped);
+   if (Result != ERR_NONE)
+   {
+      return (Result);
+   }
+
+   memset (Extender, 0, sizeof (Extender));
+   File = fopen (HdrFile, "wb");
+   if ((File == NULL) ||
+       (fwrite (&Hdr, NIFTI_HEADER_SIZE, 1, File) != 1) ||
+       (fwrite (Extender, sizeof (Extender), 1, File) != 1) ||
+       (fclose (File) != 0))
+   {
+      sprintf (ErrMsg, "Error writing header file %.200s", HdrFile);
+      return (ERR_OUT_TEMP);
+   }
+   return (ERR_NONE);
+
+}     /* CopyHeader */
+
+
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : mexFunction
+@INPUT      : nlhs, nrhs - number of output/input arguments (from MATLAB)
+              prhs - actual input arguments
+@OUTPUT     : (none)
+@RETURNS    : (void)
+@DESCRIPTION: Checks the arguments, reads the reference header, and writes
+              the new file a slice at a time (or, given HEADER_OPTION,
+              just copies the reference header).
+@METHOD     :
+@GLOBALS    : ErrMsg
+@CALLS      : ReadNiftiHeader, SetDataType, SetRange, OpenNiftiWriter,
+              WriteNiftiData, CloseNiftiWriter, CopyHeader
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+void mexFunction(int    nlhs,
+                 mxArray *plhs[],
+                 int    nrhs,
+                 const mxArray *prhs[])
+{
+   char           *Filename;
+   char           *RefFile;
+   char           *TypeStr;
+   NiftiHeader     Hdr;
+   NiftiWriterRec *Writer;
+   Boolean         Swapped;
+   Boolean         IsFloat;
+   long            NumVoxels;
+   int             Result;
+   int             i;
+
+   ErrMsg = (char *) mxCalloc (256, sizeof (char));
+
+   if ((nrhs < MIN_IN_ARGS) || (nrhs > MAX_IN_ARGS))
+   {
+      ErrAbort ("Incorrect number of arguments", TRUE, ERR_ARGS);
+   }
+
+   if (ParseStringArg (NII_FILENAME, &Filename) == NULL)
+   {
+      ErrAbort ("Error in filename", TRUE, ERR_ARGS);
+   }
+
+   if (strcmp (Filename, HEADER_OPTION) == 0)
+   {
+      if ((nrhs != 3) ||
+          (ParseStringArg (prhs[1], &RefFile) == NULL) ||
+          (ParseStringArg (prhs[2], &Filename) == NULL))
+      {
+         ErrAbort ("Give the reference and header file names", TRUE,
+                   ERR_ARGS);
+      }
+      Result = CopyHeader (RefFile, Filename);
+      if (Result != ERR_NONE)
+      {
+         ErrAbort (ErrMsg, FALSE, Result);
+      }
+      return;
+   }
+
+   if ((!mxIsDouble (DATA) && !mxIsSingle (DATA)) ||
+       mxIsComplex (DATA) || mxIsSparse (DATA))
+   {
+      ErrAbort ("data must be a real matrix of doubles or singles",
+                TRUE, ERR_ARGS);
+   }
+   IsFloat = mxIsSingle (DATA);
+
+   if (ParseStringArg (REF_FILENAME, &RefFile) == NULL)
+   {
+      ErrAbort ("Error in reference filename", TRUE, ERR_ARGS);
+   }
+
+   TypeStr = NULL;
+   if ((nrhs >= TYPE_POS) && !mxIsEmpty (DATA_TYPE))
+   {
+      if (ParseStringArg (DATA_TYPE, &TypeStr) == NULL)
+      {
+         ErrAbort ("data_type must be a string", TRUE, ERR_ARGS);
+      }
+   }
+
+   Result = ReadNiftiHeader (RefFile, &Hdr, &Swapped);
+   if (Result != ERR_NONE)
+   {
+      ErrAbort (ErrMsg, FALSE, Result);
+   }
+
+   /*
+    * The new file is a single volume of the reference's first three
+    * dimensions, in this machine's byte order (ReadNiftiHeader has
+    * already swapped the header if need be).
+    */
+
+   for (i = 1; i <= 3; i++)
+   {
+      if ((i > Hdr.dim [0]) || (Hdr.dim [i] < 1))
+      {
+         Hdr.dim [i] = 1;
+      }
+   }
+   Hdr.dim [0] = 3;
+   for (i = 4; i < 8; i++)
+   {
+      Hdr.dim [i] = 1;
+   }
+
+   NumVoxels = (long) Hdr.dim [1] * Hdr.dim [2] * Hdr.dim [3];
+   if ((long) mxGetNumberOfElements (DATA) != NumVoxels)
+   {
+      sprintf (ErrMsg, "data must have %ld elements (%d x %d x %d) to match "
+               "%s", NumVoxels, (int) Hdr.dim [1], (int) Hdr.dim [2],
+               (int) Hdr.dim [3], RefFile);
+      ErrAbort (ErrMsg, TRUE, ERR_ARGS);
+   }
+
+   if (!SetDataType (TypeStr, &Hdr))
+   {
+      ErrAbort (ErrMsg, TRUE, ERR_ARGS);
+   }
+   SetRange (mxGetData (DATA), IsFloat, NumVoxels, &Hdr);
+
+   Result = OpenNiftiWriter (Filename, &Hdr, (long) Hdr.dim [1] * Hdr.dim [2],
+                             &Writer);
+   if (Result != ERR_NONE)
+   {
+      ErrAbort (ErrMsg, FALSE, Result);
+   }
+
+   (void) WriteNiftiData (Writer, mxGetData (DATA), IsFloat, NumVoxels);
+   Result = CloseNiftiWriter (Writer);
+   if (Result != ERR_NONE)
+   {
+      ErrAbort (ErrMsg, FALSE, Result);
+   }
+
+}     /* mexFunction */
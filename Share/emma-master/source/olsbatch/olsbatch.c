@@ -0,0 +1,668 @@
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : olsbatch (CMEX)
+@INPUT      :
+@OUTPUT     :
+@RETURNS    :
+@DESCRIPTION: CMEX routine to fit a linear model whose design changes
+              from voxel to voxel (because some of its predictors are
+              images) at every voxel, by ordinary least squares.  See
+              olsbatch.m (or type "help olsbatch" in MATLAB) for details.
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+@COMMENTS   : For full usage documentation, see olsbatch.m
+---------------------------------------------------------------------------- */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <math.h>
+#include <float.h>
+#include "mex.h"
+#include "emmageneral.h"
+#include "mierrors.h"         /* mine and Mark's */
+#include "mexutils.h"         /* N.B. must link in mexutils.o */
+#include "threadpool.h"
+
+#define PROGNAME "olsbatch"
+
+/*
+ * Constants to check for argument number and position
+ */
+
+#define MIN_IN_ARGS        4
+#define MAX_IN_ARGS        5
+#define MAX_OUT_ARGS       4
+
+/* ...POS macros: 1-based, used to determine if input args are present */
+
+#define THREADS_POS        5
+
+/*
+ * Macros to access the input and output arguments from/to MATLAB
+ * (N.B. these only work in mexFunction())
+ */
+
+#define FIXED          prhs[0]                  /* subjects x coefficients */
+#define POWERS         prhs[1]                  /* coefficients x images */
+#define RESPONSE       prhs[2]                  /* subjects x voxels (or 1) */
+#define IMAGES         prhs[3]                  /* cell: subjects x voxels */
+#define NUM_THREADS    prhs[THREADS_POS-1]      /* number of threads */
+#define BETA           plhs[0]                  /* coefficients x voxels */
+#define STD_ERR        plhs[1]
+#define T_VALUES       plhs[2]
+#define MSE            plhs[3]                  /* 1 x voxels */
+
+/*
+ * The voxels are fitted LANES at a time, with every array laid out so
+ * that the LANES values of one element are consecutive: each step of
+ * the QR decomposition is then a loop over the lanes, which the
+ * compiler turns into SIMD instructions.  MAX_COEFFS is the largest
+ * model handled; SolveLanes is compiled separately for every number of
+ * coefficients up to that, so that all its loops but the one over
+ * subjects have constant bounds.  Each task fits TASK_BATCHES batches
+ * of LANES voxels.
+ */
+
+#define LANES           8
+#define MAX_COEFFS     16
+#define TASK_BATCHES   16
+
+#if defined(__GNUC__)
+#define SPECIALISED static inline __attribute__ ((always_inline))
+#else
+#define SPECIALISED static __inline
+#endif
+
+/*
+ * The results for one batch of voxels, lane by lane.  Ok is FALSE for
+ * a voxel with a missing (non-finite) value, or whose design is rank
+ * deficient.
+ */
+
+typedef struct
+{
+   double    Beta [MAX_COEFFS][LANES];
+   double    SE [MAX_COEFFS][LANES];
+   double    T [MAX_COEFFS][LANES];
+   double    Mse [LANES];
+   Boolean   Ok [LANES];
+} LaneResultRec;
+
+typedef void (*SolveFunc) (double *A, long n, LaneResultRec *Result);
+
+/*
+ * Everything the tasks need.  Column c of the design at voxel v is
+ * Fixed(:,c) times the product of Images{m}(:,v) .^ Powers(c,m); the
+ * response is Response(:,v), or Response(:,1) at every voxel if Shared.
+ */
+
+typedef struct
+{
+   long       n, p, m;
+   double    *Fixed;
+   int       *Powers;              /* p x m */
+   void      *Response;
+   Boolean    ResponseIsFloat;
+   Boolean    Shared;
+   void     **Images;
+   Boolean   *ImageIsFloat;
+   long       NumVoxels;
+   SolveFunc  Solve;
+   double    *Work [MAX_THREADS];  /* (p+1) x n x LANES, one per thread */
+   double    *Beta, *SE, *T, *Mse;
+   double     NaN;                 /* mxGetNaN (), as tasks can't call it */
+} BatchRec;
+
+char       *ErrMsg ;             /* set as close to the occurence of the
+                                    error as possible; displayed by whatever
+                                    code exits */
+
+
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : ErrAbort
+@INPUT      : msg - character to string to print just before aborting
+              PrintUsage - whether or not to print a usage summary before
+                aborting
+              ExitCode - one of the standard codes from mierrors.h -- NOTE!
+                this parameter is NOT currently used, but I've included it for
+                consistency with other functions named ErrAbort in other
+                programs
+@OUTPUT     : none - function does not return!!!
+@RETURNS    :
+@DESCRIPTION: Optionally prints a usage summary, and calls mexErrMsgTxt with
+              the supplied msg, which ABORTS the mex-file!!!
+@METHOD     :
+@GLOBALS    : requires PROGNAME macro
+@CALLS      : standard mex functions
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+void ErrAbort (char msg[], Boolean PrintUsage, int ExitCode)
+{
+   if (PrintUsage)
+   {
+      (void) mexPrintf ("Usage: [beta, se, t, mse] = %s (fixed, powers, "
+                        "response, images [, num_threads])\n", PROGNAME);
+   }
+   (void) mexErrMsgTxt (msg);
+}
+
+
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : SolveLanes
+@INPUT      : A - the design and response of LANES voxels: element
+                A[(c*n + i)*LANES + l] is row i of column c for lane l,
+                with the response as column p
+              n - number of subjects
+              p - number of coefficients (a constant, in each of the
+                specialised copies made by SOLVE_LANES)
+              Result->Ok - FALSE for lanes not to be fitted
+@OUTPUT     : A - overwritten
+              *Result - estimates, standard errors, t values and
+                residual variances; Ok is cleared for any lane whose
+                design is rank deficient
+@RETURNS    : (void)
+@DESCRIPTION: Householder QR decomposition of [X y] for all the lanes at
+              once.  Afterwards, R is in the upper triangle of A's
+              first p columns, z = Q'y is in column p, and
+
+                 beta = R \ z(1:p),   SSE = sum (z(p+1:n) .^ 2),
+                 diag (inv (X'X)) = sum (inv(R) .^ 2, 2)
+
+              The lanes never branch apart: a lane whose column has
+              vanished just gets a zero reflection, and is marked as
+              rank deficient by the same test as olsfit uses.
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+SPECIALISED void SolveLanes (double *A, long n, const int p,
+                             LaneResultRec *Result)
+{
+   double   R [MAX_COEFFS][MAX_COEFFS][LANES];
+   double   RInv [MAX_COEFFS][MAX_COEFFS][LANES];
+   double   Norm [LANES], Scale [LANES], Dot [LANES];
+   double   MaxDiag [LANES];
+   double  *a, *b;
+   double   Tol;
+   long     i;
+   int      j, k, c, l;
+
+   for (l = 0; l < LANES; l++)
+      MaxDiag [l] = 0;
+
+   for (j = 0; j < p; j++)
+   {
+      /* The reflection that zeroes column j below the diagonal */
+
+      a = A + (long) j*n*LANES;
+      for (l = 0; l < LANES; l++)
+         Norm [l] = 0;
+      for (i = j; i < n; i++)
+         for (l = 0; l < LANES; l++)
+            Norm [l] += a [i*LANES + l] * a [i*LANES + l];
+
+      for (l = 0; l < LANES; l++)
+      {
+         double   Ajj = a [j*LANES + l];
+         double   Alpha = (Ajj > 0) ? -sqrt (Norm [l]) : sqrt (Norm [l]);
+         double   V0 = Ajj - Alpha;
+         double   VNorm2 = Norm [l] - Ajj*Ajj + V0*V0;
+
+         Scale [l] = (VNorm2 > 0) ? 2.0 / VNorm2 : 0.0;
+         a [j*LANES + l] = V0;                 /* v, stored in place */
+         R [j][j][l] = Alpha;
+         MaxDiag [l] = max (MaxDiag [l], fabs (Alpha));
+      }
+
+      /* Apply it to the columns to the right, and to y */
+
+      for (k = j+1; k <= p; k++)
+      {
+         b = A + (long) k*n*LANES;
+         for (l = 0; l < LANES; l++)
+            Dot [l] = 0;
+         for (i = j; i < n; i++)
+            for (l = 0; l < LANES; l++)
+               Dot [l] += a [i*LANES + l] * b [i*LANES + l];
+         for (l = 0; l < LANES; l++)
+            Dot [l] *= Scale [l];
+         for (i = j; i < n; i++)
+            for (l = 0; l < LANES; l++)
+               b [i*LANES + l] -= Dot [l] * a [i*LANES + l];
+         if (k < p)
+         {
+            for (l = 0; l < LANES; l++)
+               R [j][k][l] = b [j*LANES + l];
+         }
+      }
+   }
+
+   /* Rank, then beta by back substitution, and the SSE */
+
+   b = A + (long) p*n*LANES;
+   for (l = 0; l < LANES; l++)
+   {
+      Tol = (double) max (n, p) * DBL_EPSILON * MaxDiag [l];
+      for (j = 0; j < p; j++)
+      {
+         if (!(fabs (R [j][j][l]) > Tol))
+            Result->Ok [l] = FALSE;
+      }
+   }
+   for (j = 0; j < p; j++)             /* keep the dead lanes finite */
+      for (l = 0; l < LANES; l++)
+         if (!Result->Ok [l])
+            R [j][j][l] = 1;
+
+   for (j = p-1; j >= 0; j--)
+   {
+      for (l = 0; l < LANES; l++)
+         Dot [l] = b [j*LANES + l];
+      for (k = j+1; k < p; k++)
+         for (l = 0; l < LANES; l++)
+            Dot [l] -= R [j][k][l] * Result->Beta [k][l];
+      for (l = 0; l < LANES; l++)
+         Result->Beta [j][l] = Dot [l] / R [j][j][l];
+   }
+
+   for (l = 0; l < LANES; l++)
+      Norm [l] = 0;
+   for (i = p; i < n; i++)
+      for (l = 0; l < LANES; l++)
+         Norm [l] += b [i*LANES + l] * b [i*LANES + l];
+   for (l = 0; l < LANES; l++)
+      Result->Mse [l] = Norm [l] / (double) (n - p);
+
+   /* inv(R), a column at a time; then the standard errors */
+
+   for (c = 0; c < p; c++)
+   {
+      for (j = c; j >= 0; j--)
+      {
+         for (l = 0; l < LANES; l++)
+            Dot [l] = (j == c) ? 1.0 : 0.0;
+         for (k = j+1; k <= c; k++)
+            for (l = 0; l < LANES; l++)
+               Dot [l] -= R [j][k][l] * RInv [k][c][l];
+         for (l = 0; l < LANES; l++)
+            RInv [j][c][l] = Dot [l] / R [j][j][l];
+      }
+   }
+   for (j = 0; j < p; j++)
+   {
+      for (l = 0; l < LANES; l++)
+         Dot [l] = 0;
+      for (c = j; c < p; c++)
+         for (l = 0; l < LANES; l++)
+            Dot [l] += RInv [j][c][l] * RInv [j][c][l];
+      for (l = 0; l < LANES; l++)
+      {
+         Result->SE [j][l] = sqrt (Result->Mse [l] * Dot [l]);
+         Result->T [j][l] = Result->Beta [j][l] / Result->SE [j][l];
+      }
+   }
+}     /* SolveLanes */
+
+
+/*
+ * The specialised copies of SolveLanes, one per number of coefficients.
+ */
+
+#define SOLVE_LANES(P)                                                    \
+static void SolveLanes##P (double *A, long n, LaneResultRec *Result)     \
+{                                                                         \
+   SolveLanes (A, n, P, Result);                                          \
+}
+
+SOLVE_LANES(1)  SOLVE_LANES(2)  SOLVE_LANES(3)  SOLVE_LANES(4)
+SOLVE_LANES(5)  SOLVE_LANES(6)  SOLVE_LANES(7)  SOLVE_LANES(8)
+SOLVE_LANES(9)  SOLVE_LANES(10) SOLVE_LANES(11) SOLVE_LANES(12)
+SOLVE_LANES(13) SOLVE_LANES(14) SOLVE_LANES(15) SOLVE_LANES(16)
+
+static SolveFunc SolveTable [MAX_COEFFS+1] =
+{
+   NULL,          SolveLanes1,   SolveLanes2,   SolveLanes3,
+   SolveLanes4,   SolveLanes5,   SolveLanes6,   SolveLanes7,
+   SolveLanes8,   SolveLanes9,   SolveLanes10,  SolveLanes11,
+   SolveLanes12,  SolveLanes13,  SolveLanes14,  SolveLanes15,
+   SolveLanes16
+};
+
+
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : Element
+@INPUT      : Data - a matrix of doubles, or of floats if IsFloat
+              k - index of an element
+@OUTPUT     :
+@RETURNS    : Data[k], as a double
+@DESCRIPTION:
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+static double Element (void *Data, Boolean IsFloat, long k)
+{
+   return (IsFloat ? (double) ((float *) Data) [k] : ((double *) Data) [k]);
+}
+
+
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : LoadLanes
+@INPUT      : *Batch - the problem
+              First - the first voxel of the batch
+              Count - number of voxels in it (up to LANES)
+@OUTPUT     : A - the design and response of the batch, laid out for
+                SolveLanes
+              Result->Ok - FALSE for lanes with no voxel, or with a
+                non-finite value
+@RETURNS    : (void)
+@DESCRIPTION: Builds every voxel's design from the fixed columns and the
+              images.  Unused lanes repeat the last voxel, so that they
+              do no harm.
+@METHOD     :
+@GLOBALS    :
+@CALLS      : Element
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+static void LoadLanes (BatchRec *Batch, long First, long Count, double *A,
+                       LaneResultRec *Result)
+{
+   long     n = Batch->n;
+   long     i, v, Offset;
+   double   x;
+   int      c, m, e, l;
+
+   for (l = 0; l < LANES; l++)
+   {
+      v = First + min (l, Count-1);
+      Offset = v * n;
+      Result->Ok [l] = (l < Count);
+
+      for (c = 0; c < Batch->p; c++)
+      {
+         for (i = 0; i < n; i++)
+         {
+            x = Batch->Fixed [c*n + i];
+            for (m = 0; m < Batch->m; m++)
+            {
+               for (e = Batch->Powers [m*Batch->p + c]; e > 0; e--)
+                  x *= Element (Batch->Images [m],
+                                Batch->ImageIsFloat [m], Offset + i);
+            }
+            A [(c*n + i)*LANES + l] = x;
+         }
+      }
+
+      for (i = 0; i < n; i++)
+      {
+         A [(Batch->p*n + i)*LANES + l] =
+            Element (Batch->Response, Batch->ResponseIsFloat,
+                     Batch->Shared ? i : Offset + i);
+      }
+
+      for (i = 0; (i < (Batch->p+1) * n) && Result->Ok [l]; i++)
+      {
+         if (!isfinite (A [i*LANES + l]))
+            Result->Ok [l] = FALSE;
+      }
+      if (!Result->Ok [l])
+      {
+         for (i = 0; i < (Batch->p+1) * n; i++)
+            A [i*LANES + l] = (i % (n+1) == 0);      /* a harmless lane */
+      }
+   }
+}     /* LoadLanes */
+
+
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : FitTask
+@INPUT      : Task - which TASK_BATCHES * LANES voxels to fit
+              Thread - which thread's workspace to use
+              Arg - the BatchRec
+@OUTPUT     : the task's columns of Batch->Beta, SE, T and Mse (NaN for
+                voxels that could not be fitted)
+@RETURNS    : (void)
+@DESCRIPTION: Fits the task's voxels a batch of LANES at a time, for
+              RunTasks.
+@METHOD     :
+@GLOBALS    :
+@CALLS      : LoadLanes, Batch->Solve (SolveLanes)
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+static void FitTask (long Task, int Thread, void *Arg)
+{
+   BatchRec      *Batch = (BatchRec *) Arg;
+   LaneResultRec  Result;
+   long           First, Count, End;
+   long           p = Batch->p;
+   long           v;
+   double         NaN = Batch->NaN;
+   int            j, l;
+
+   End = min ((Task+1) * TASK_BATCHES * LANES, Batch->NumVoxels);
+   for (First = Task * TASK_BATCHES * LANES; First < End; First += Count)
+   {
+      Count = min (End - First, LANES);
+      LoadLanes (Batch, First, Count, Batch->Work [Thread], &Result);
+      (*Batch->Solve) (Batch->Work [Thread], Batch->n, &Result);
+
+      for (l = 0; l < Count; l++)
+      {
+         v = First + l;
+         for (j = 0; j < p; j++)
+         {
+            Batch->Beta [v*p + j] = Result.Ok [l] ? Result.Beta [j][l] : NaN;
+            Batch->SE [v*p + j] = Result.Ok [l] ? Result.SE [j][l] : NaN;
+            Batch->T [v*p + j] = Result.Ok [l] ? Result.T [j][l] : NaN;
+         }
+         Batch->Mse [v] = Result.Ok [l] ? Result.Mse [l] : NaN;
+      }
+   }
+}     /* FitTask */
+
+
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : CheckData
+@INPUT      : Data - an mxArray from MATLAB
+              n - number of rows it must have
+              Name - what to call it in error messages
+@OUTPUT     :
+@RETURNS    : (void) -- aborts if Data is not a real, full, n-row matrix
+              of doubles or singles
+@DESCRIPTION:
+@METHOD     :
+@GLOBALS    : ErrMsg
+@CALLS      : ErrAbort
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+static void CheckData (const mxArray *Data, long n, char *Name)
+{
+   if ((Data == NULL) || (!mxIsDouble (Data) && !mxIsSingle (Data)) ||
+       mxIsComplex (Data) || mxIsSparse (Data) ||
+       (mxGetNumberOfDimensions (Data) != 2) || ((long) mxGetM (Data) != n))
+   {
+      sprintf (ErrMsg, "%s must be a real, full matrix (doubles or singles) "
+               "with one row per subject", Name);
+      ErrAbort (ErrMsg, TRUE, ERR_ARGS);
+   }
+}
+
+
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : mexFunction
+@INPUT      : nlhs, nrhs - number of output/input arguments (from MATLAB)
+              prhs - actual input arguments
+@OUTPUT     : plhs[0..3] - beta, se, t and mse (see olsbatch.m)
+@RETURNS    : (void)
+@DESCRIPTION: Checks the arguments, then fits all the voxels with a pool
+              of threads, each with its own workspace.
+@METHOD     :
+@GLOBALS    : ErrMsg
+@CALLS      : CheckData, RunTasks, FitTask
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+void mexFunction(int    nlhs,
+                 mxArray *plhs[],
+                 int    nrhs,
+                 const mxArray *prhs[])
+{
+   BatchRec     Batch;
+   long         NumThreads;
+   long         NumTasks;
+   long         n, p, m;
+   long         k;
+   double       Power;
+   int          Result;
+   int          t;
+
+   ErrMsg = (char *) mxCalloc (256, sizeof (char));
+
+   if ((nrhs < MIN_IN_ARGS) || (nrhs > MAX_IN_ARGS) || (nlhs > MAX_OUT_ARGS))
+   {
+      ErrAbort ("Incorrect number of arguments", TRUE, ERR_ARGS);
+   }
+
+   if (!mxIsDouble (FIXED) || mxIsComplex (FIXED) || mxIsSparse (FIXED) ||
+       (mxGetNumberOfDimensions (FIXED) != 2))
+   {
+      ErrAbort ("fixed must be a real, full matrix of doubles",
+                TRUE, ERR_ARGS);
+   }
+   n = (long) mxGetM (FIXED);
+   p = (long) mxGetN (FIXED);
+   if ((p < 1) || (p > MAX_COEFFS) || (n <= p))
+   {
+      sprintf (ErrMsg, "fixed must have 1 to %d columns, and more rows "
+               "than columns", MAX_COEFFS);
+      ErrAbort (ErrMsg, TRUE, ERR_ARGS);
+   }
+
+   if (!mxIsCell (IMAGES))
+   {
+      ErrAbort ("images must be a cell array", TRUE, ERR_ARGS);
+   }
+   m = (long) mxGetNumberOfElements (IMAGES);
+
+   if (!mxIsDouble (POWERS) || mxIsComplex (POWERS) ||
+       ((long) mxGetM (POWERS) != p) || ((long) mxGetN (POWERS) != m))
+   {
+      ErrAbort ("powers must be a real matrix with one row per column of "
+                "fixed and one column per image", TRUE, ERR_ARGS);
+   }
+
+   /* Gather the problem; all the images must be the same size */
+
+   Batch.n = n;
+   Batch.p = p;
+   Batch.m = m;
+   Batch.Fixed = mxGetPr (FIXED);
+   Batch.Powers = (int *) mxCalloc (p * m + 1, sizeof (int));
+   for (k = 0; k < p * m; k++)
+   {
+      Power = mxGetPr (POWERS) [k];
+      if ((Power < 0) || (Power != floor (Power)))
+      {
+         ErrAbort ("powers must be non-negative integers", TRUE, ERR_ARGS);
+      }
+      Batch.Powers [k] = (int) Power;
+   }
+
+   Batch.Images = (void **) mxCalloc (m + 1, sizeof (void *));
+   Batch.ImageIsFloat = (Boolean *) mxCalloc (m + 1, sizeof (Boolean));
+   Batch.NumVoxels = -1;
+   for (k = 0; k < m; k++)
+   {
+      CheckData (mxGetCell (IMAGES, k), n, "Each image");
+      if ((Batch.NumVoxels >= 0) &&
+          ((long) mxGetN (mxGetCell (IMAGES, k)) != Batch.NumVoxels))
+      {
+         ErrAbort ("All the images must be the same size", TRUE, ERR_ARGS);
+      }
+      Batch.NumVoxels = (long) mxGetN (mxGetCell (IMAGES, k));
+      Batch.Images [k] = mxGetData (mxGetCell (IMAGES, k));
+      Batch.ImageIsFloat [k] = mxIsSingle (mxGetCell (IMAGES, k));
+   }
+
+   CheckData (RESPONSE, n, "response");
+   if (Batch.NumVoxels < 0)
+   {
+      Batch.NumVoxels = (long) mxGetN (RESPONSE);
+   }
+   Batch.Shared = (mxGetN (RESPONSE) == 1);
+   if (!Batch.Shared && ((long) mxGetN (RESPONSE) != Batch.NumVoxels))
+   {
+      ErrAbort ("response must have one column, or one per voxel",
+                TRUE, ERR_ARGS);
+   }
+   Batch.Response = mxGetData (RESPONSE);
+   Batch.ResponseIsFloat = mxIsSingle (RESPONSE);
+
+   /* The number of threads; one (ie. no threads) by default */
+
+   NumThreads = 1;
+   if (nrhs >= THREADS_POS)
+   {
+      Result = ParseIntArg (NUM_THREADS, 1, &NumThreads);
+      if ((Result < 0) || ((Result == 1) && (NumThreads < 1)))
+      {
+         ErrAbort ("num_threads must be a positive scalar", TRUE, ERR_ARGS);
+      }
+      if (Result == 0)
+      {
+         NumThreads = DefaultThreads ();
+      }
+   }
+
+   NumTasks = (Batch.NumVoxels + TASK_BATCHES*LANES - 1) /
+              (TASK_BATCHES*LANES);
+   NumThreads = min (min (NumThreads, max (NumTasks, 1)), MAX_THREADS);
+
+   /*
+    * Everything is allocated here, since the mx functions may only be
+    * called from this thread.
+    */
+
+   BETA = mxCreateDoubleMatrix (p, Batch.NumVoxels, mxREAL);
+   STD_ERR = mxCreateDoubleMatrix (p, Batch.NumVoxels, mxREAL);
+   T_VALUES = mxCreateDoubleMatrix (p, Batch.NumVoxels, mxREAL);
+   MSE = mxCreateDoubleMatrix (1, Batch.NumVoxels, mxREAL);
+   Batch.Beta = mxGetPr (BETA);
+   Batch.SE = mxGetPr (STD_ERR);
+   Batch.T = mxGetPr (T_VALUES);
+   Batch.Mse = mxGetPr (MSE);
+   Batch.NaN = mxGetNaN ();
+
+   for (t = 0; t < NumThreads; t++)
+   {
+      Batch.Work [t] = (double *) mxCalloc ((p+1) * n * LANES,
+                                            sizeof (double));
+   }
+   Batch.Solve = SolveTable [p];
+
+   (void) RunTasks (NumTasks, (int) NumThreads, FitTask, &Batch);
+
+   for (t = 0; t < NumThreads; t++)
+   {
+      mxFree (Batch.Work [t]);
+   }
+
+}     /* mexFunction */
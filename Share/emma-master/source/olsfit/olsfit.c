@@ -0,0 +1,399 @@
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : olsfit (CMEX)
+@INPUT      :
+@OUTPUT     :
+@RETURNS    :
+@DESCRIPTION: CMEX routine to fit the same linear model, by ordinary
+              least squares, to every column of a data matrix (eg. every
+              masked voxel, with one row per subject).  See olsfit.m (or
+              type "help olsfit" in MATLAB) for details.
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+@COMMENTS   : For full usage documentation, see olsfit.m
+---------------------------------------------------------------------------- */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <math.h>
+#include <float.h>
+#include "mex.h"
+#include "blas.h"             /* MATLAB's own BLAS and LAPACK */
+#include "lapack.h"
+#include "emmageneral.h"
+#include "mierrors.h"         /* mine and Mark's */
+
+#define PROGNAME "olsfit"
+
+/*
+ * Constants to check for argument number and position
+ */
+
+#define NUM_IN_ARGS        2
+#define MAX_OUT_ARGS       4
+
+/*
+ * Macros to access the input and output arguments from/to MATLAB
+ * (N.B. these only work in mexFunction())
+ */
+
+#define DESIGN         prhs[0]                  /* subjects x coefficients */
+#define DATA           prhs[1]                  /* subjects x voxels */
+#define BETA           plhs[0]                  /* coefficients x voxels */
+#define STD_ERR        plhs[1]
+#define T_VALUES       plhs[2]
+#define MSE            plhs[3]                  /* 1 x voxels */
+
+/*
+ * Number of voxels fitted by each round of matrix products; the
+ * residuals of one block (subjects x BLOCK_VOXELS doubles) are all the
+ * memory needed beyond the outputs.
+ */
+
+#define BLOCK_VOXELS    1024
+
+char       *ErrMsg ;             /* set as close to the occurence of the
+                                    error as possible; displayed by whatever
+                                    code exits */
+
+/*
+ * The factored design: X = Q*R, with Q (n x p) having orthonormal
+ * columns and R (p x p) upper triangular.  CovDiag is the diagonal of
+ * inv(X'*X), so that the standard error of coefficient j is
+ * sqrt(MSE * CovDiag[j]).
+ */
+
+typedef struct
+{
+   ptrdiff_t   n, p;
+   double     *Q;
+   double     *R;
+   double     *CovDiag;
+} DesignRec;
+
+
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : ErrAbort
+@INPUT      : msg - character to string to print just before aborting
+              PrintUsage - whether or not to print a usage summary before
+                aborting
+              ExitCode - one of the standard codes from mierrors.h -- NOTE!
+                this parameter is NOT currently used, but I've included it for
+                consistency with other functions named ErrAbort in other
+                programs
+@OUTPUT     : none - function does not return!!!
+@RETURNS    :
+@DESCRIPTION: Optionally prints a usage summary, and calls mexErrMsgTxt with
+              the supplied msg, which ABORTS the mex-file!!!
+@METHOD     :
+@GLOBALS    : requires PROGNAME macro
+@CALLS      : standard mex functions
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+void ErrAbort (char msg[], Boolean PrintUsage, int ExitCode)
+{
+   if (PrintUsage)
+   {
+      (void) mexPrintf ("Usage: [beta, se, t, mse] = %s (X, Y)\n", PROGNAME);
+   }
+   (void) mexErrMsgTxt (msg);
+}
+
+
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : FactorDesign
+@INPUT      : X - the design matrix, n x p (column major), n > p
+              n, p - its size
+@OUTPUT     : *Design - Q, R and CovDiag, allocated with mxCalloc
+@RETURNS    : ERR_NONE if all went well
+              ERR_ARGS if X is (numerically) rank deficient (ErrMsg set)
+@DESCRIPTION: Factors the design once, for all the voxels: a Householder
+              QR decomposition (dgeqrf), from which Q is formed explicitly
+              (dorgqr) so that each block of voxels needs just two
+              matrix products.  inv(R) (dtrtri) gives the diagonal of
+              inv(X'*X) = inv(R)*inv(R)'.
+@METHOD     : X is taken to be rank deficient if some |R(j,j)| is
+              below max(n,p) * eps * max |R(k,k)|.  fitlm would then
+              drop a coefficient, which this does not try to mimic.
+@GLOBALS    : ErrMsg
+@CALLS      : LAPACK: dgeqrf, dorgqr, dtrtri
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+int FactorDesign (double *X, ptrdiff_t n, ptrdiff_t p, DesignRec *Design)
+{
+   double     *Tau;
+   double     *Work;
+   double     *RInv;
+   double      WorkSize;
+   double      MaxDiag, Tol;
+   ptrdiff_t   LWork, Info;
+   ptrdiff_t   i, j;
+
+   Design->n = n;
+   Design->p = p;
+   Design->Q = (double *) mxCalloc (n * p, sizeof (double));
+   Design->R = (double *) mxCalloc (p * p, sizeof (double));
+   Design->CovDiag = (double *) mxCalloc (p, sizeof (double));
+   Tau = (double *) mxCalloc (p, sizeof (double));
+   RInv = (double *) mxCalloc (p * p, sizeof (double));
+   memcpy (Design->Q, X, n * p * sizeof (double));
+
+   /* Ask for the best workspace size, then factor */
+
+   LWork = -1;
+   dgeqrf (&n, &p, Design->Q, &n, Tau, &WorkSize, &LWork, &Info);
+   LWork = (ptrdiff_t) WorkSize;
+   Work = (double *) mxCalloc (LWork, sizeof (double));
+   dgeqrf (&n, &p, Design->Q, &n, Tau, Work, &LWork, &Info);
+
+   MaxDiag = 0;
+   for (j = 0; j < p; j++)
+   {
+      for (i = 0; i <= j; i++)
+      {
+         Design->R [j*p + i] = Design->Q [j*n + i];
+      }
+      MaxDiag = max (MaxDiag, fabs (Design->R [j*p + j]));
+   }
+   Tol = (double) max (n, p) * DBL_EPSILON * MaxDiag;
+   for (j = 0; j < p; j++)
+   {
+      if (!(fabs (Design->R [j*p + j]) > Tol))
+      {
+         sprintf (ErrMsg, "Design matrix is rank deficient (column %ld)",
+                  (long) j+1);
+         return (ERR_ARGS);
+      }
+   }
+
+   /* Form Q in place of the Householder vectors */
+
+   mxFree (Work);
+   LWork = -1;
+   dorgqr (&n, &p, &p, Design->Q, &n, Tau, &WorkSize, &LWork, &Info);
+   LWork = (ptrdiff_t) WorkSize;
+   Work = (double *) mxCalloc (LWork, sizeof (double));
+   dorgqr (&n, &p, &p, Design->Q, &n, Tau, Work, &LWork, &Info);
+
+   /* diag (inv(X'*X)) is the sum of squares of each row of inv(R) */
+
+   memcpy (RInv, Design->R, p * p * sizeof (double));
+   dtrtri ("U", "N", &p, RInv, &p, &Info);
+   for (j = 0; j < p; j++)
+   {
+      for (i = 0; i <= j; i++)
+      {
+         Design->CovDiag [i] += RInv [j*p + i] * RInv [j*p + i];
+      }
+   }
+
+   mxFree (Work);
+   mxFree (RInv);
+   mxFree (Tau);
+   return (ERR_NONE);
+
+}     /* FactorDesign */
+
+
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : FitBlock
+@INPUT      : *Design - from FactorDesign
+              W - the data of NumVoxels voxels, n x NumVoxels
+              Finite - whether each voxel's data are all finite
+              NumVoxels - number of voxels in the block
+@OUTPUT     : Beta, SE, T - p x NumVoxels: the estimates, their standard
+                errors and t values
+              Mse - NumVoxels residual variances (SSE / (n-p))
+              W - overwritten with the residuals
+@RETURNS    : (void)
+@DESCRIPTION: Fits every voxel of the block at once, with two level-3
+              BLAS products and a triangular solve:
+
+                 C = Q'*W;   W = W - Q*C;   Beta = R \ C
+
+              Voxels with any non-finite value are set to NaN (each
+              column is computed independently, so they don't affect
+              the others); the caller may refit those some other way.
+@METHOD     :
+@GLOBALS    :
+@CALLS      : BLAS: dgemm, dtrsm
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+void FitBlock (DesignRec *Design, double *W, Boolean Finite[],
+               ptrdiff_t NumVoxels, double *Beta, double *SE, double *T,
+               double *Mse)
+{
+   ptrdiff_t   n = Design->n;
+   ptrdiff_t   p = Design->p;
+   double      One = 1.0, MinusOne = -1.0, Zero = 0.0;
+   double      Sse, NaN;
+   double     *Resid;
+   ptrdiff_t   i, j, v;
+
+   dgemm ("T", "N", &p, &NumVoxels, &n, &One, Design->Q, &n, W, &n,
+          &Zero, Beta, &p);
+   dgemm ("N", "N", &n, &NumVoxels, &p, &MinusOne, Design->Q, &n, Beta, &p,
+          &One, W, &n);
+   dtrsm ("L", "U", "N", "N", &p, &NumVoxels, &One, Design->R, &p, Beta, &p);
+
+   NaN = mxGetNaN ();
+   for (v = 0; v < NumVoxels; v++)
+   {
+      if (!Finite [v])
+      {
+         for (j = 0; j < p; j++)
+         {
+            Beta [v*p + j] = SE [v*p + j] = T [v*p + j] = NaN;
+         }
+         Mse [v] = NaN;
+         continue;
+      }
+
+      Resid = W + v*n;
+      Sse = 0;
+      for (i = 0; i < n; i++)
+      {
+         Sse += Resid [i] * Resid [i];
+      }
+      Mse [v] = Sse / (double) (n - p);
+      for (j = 0; j < p; j++)
+      {
+         SE [v*p + j] = sqrt (Mse [v] * Design->CovDiag [j]);
+         T [v*p + j] = Beta [v*p + j] / SE [v*p + j];
+      }
+   }
+}     /* FitBlock */
+
+
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : mexFunction
+@INPUT      : nlhs, nrhs - number of output/input arguments (from MATLAB)
+              prhs - actual input arguments
+@OUTPUT     : plhs[0..3] - beta, se, t and mse (see olsfit.m)
+@RETURNS    : (void)
+@DESCRIPTION: Checks the arguments, factors the design, and fits the
+              voxels BLOCK_VOXELS at a time: each block of the data
+              (double or single) is copied into a buffer of doubles,
+              which FitBlock turns into residuals, with the results
+              going straight into the output matrices.
+@METHOD     :
+@GLOBALS    : ErrMsg
+@CALLS      : FactorDesign, FitBlock
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+void mexFunction(int    nlhs,
+                 mxArray *plhs[],
+                 int    nrhs,
+                 const mxArray *prhs[])
+{
+   DesignRec    Design;
+   ptrdiff_t    n, p, NumVoxels;
+   ptrdiff_t    Start, Count;
+   ptrdiff_t    i, v;
+   double      *W;
+   Boolean     *Finite;
+   Boolean      IsFloat;
+   double      *Beta, *SE, *T, *Mse;
+   int          Result;
+
+   ErrMsg = (char *) mxCalloc (256, sizeof (char));
+
+   if ((nrhs != NUM_IN_ARGS) || (nlhs > MAX_OUT_ARGS))
+   {
+      ErrAbort ("Incorrect number of arguments", TRUE, ERR_ARGS);
+   }
+
+   if (!mxIsDouble (DESIGN) || mxIsComplex (DESIGN) || mxIsSparse (DESIGN) ||
+       (mxGetNumberOfDimensions (DESIGN) != 2))
+   {
+      ErrAbort ("X must be a real, full matrix of doubles", TRUE, ERR_ARGS);
+   }
+   if ((!mxIsDouble (DATA) && !mxIsSingle (DATA)) ||
+       mxIsComplex (DATA) || mxIsSparse (DATA) ||
+       (mxGetNumberOfDimensions (DATA) != 2))
+   {
+      ErrAbort ("Y must be a real, full matrix of doubles or singles",
+                TRUE, ERR_ARGS);
+   }
+
+   n = (ptrdiff_t) mxGetM (DESIGN);
+   p = (ptrdiff_t) mxGetN (DESIGN);
+   NumVoxels = (ptrdiff_t) mxGetN (DATA);
+   IsFloat = mxIsSingle (DATA);
+   if ((p < 1) || (n <= p))
+   {
+      ErrAbort ("X must have more rows than columns", TRUE, ERR_ARGS);
+   }
+   if ((ptrdiff_t) mxGetM (DATA) != n)
+   {
+      ErrAbort ("X and Y must have the same number of rows", TRUE, ERR_ARGS);
+   }
+   for (i = 0; i < n*p; i++)
+   {
+      if (!isfinite (mxGetPr (DESIGN) [i]))
+      {
+         ErrAbort ("X must not contain NaN or Inf", TRUE, ERR_ARGS);
+      }
+   }
+
+   Result = FactorDesign (mxGetPr (DESIGN), n, p, &Design);
+   if (Result != ERR_NONE)
+   {
+      ErrAbort (ErrMsg, FALSE, Result);
+   }
+
+   BETA = mxCreateDoubleMatrix (p, NumVoxels, mxREAL);
+   STD_ERR = mxCreateDoubleMatrix (p, NumVoxels, mxREAL);
+   T_VALUES = mxCreateDoubleMatrix (p, NumVoxels, mxREAL);
+   MSE = mxCreateDoubleMatrix (1, NumVoxels, mxREAL);
+   Beta = mxGetPr (BETA);
+   SE = mxGetPr (STD_ERR);
+   T = mxGetPr (T_VALUES);
+   Mse = mxGetPr (MSE);
+
+   W = (double *) mxCalloc (n * min (NumVoxels, BLOCK_VOXELS) + 1,
+                            sizeof (double));
+   Finite = (Boolean *) mxCalloc (BLOCK_VOXELS, sizeof (Boolean));
+
+   for (Start = 0; Start < NumVoxels; Start += Count)
+   {
+      Count = min (NumVoxels - Start, BLOCK_VOXELS);
+      if (IsFloat)
+      {
+         float  *Y = (float *) mxGetData (DATA) + Start*n;
+
+         for (i = 0; i < Count*n; i++)
+            W [i] = (double) Y [i];
+      }
+      else
+      {
+         memcpy (W, mxGetPr (DATA) + Start*n, Count*n * sizeof (double));
+      }
+
+      for (v = 0; v < Count; v++)
+      {
+         Finite [v] = TRUE;
+         for (i = 0; (i < n) && Finite [v]; i++)
+            Finite [v] = isfinite (W [v*n + i]);
+      }
+
+      FitBlock (&Design, W, Finite, Count, Beta + Start*p, SE + Start*p,
+                T + Start*p, Mse + Start);
+   }
+
+   mxFree (Finite);
+   mxFree (W);
+
+}     /* mexFunction */
@@ -0,0 +1,33 @@
+function VoxelStatsWriteMasked( values, mask_index, filename, ref_file, imageType, dataType )
+%VOXELSTATSWRITEMASKED Write a result given only its in-mask values.
+%   VoxelStatsWriteMasked(values, mask_index, filename, ref_file, imageType)
+%   writes the volume whose voxels at mask_index (find(mask_slices)) are
+%   values and whose other voxels are 0, without expanding it to a full
+%   volume with getVoxelStructFromMask first; the file is written one
+%   slice at a time. dataType is as for VoxelStatsWriteResults.
+    if nargin < 6
+        dataType = '';
+    end
+
+    switch imageType
+        case {'mnc','MNC', 'minc', 'MINC'}
+            if isempty(dataType)
+                dataType = 'short';
+            end
+            slices = getRefSlicesMinc(ref_file);
+            h = newimage(filename, [0 slices], ref_file, dataType);
+            if exist('miwritemasked') == 3
+                miwritemasked(filename, values, mask_index);
+            else
+                image_elements = getimageinfo(h, 'ImageHeight') * getimageinfo(h, 'ImageWidth');
+                putimages(h, getVoxelStructFromMask(values, mask_index, image_elements, slices), 1:slices);
+            end
+            closeimage(h);
+        case {'nii','NII', 'nifti', 'NIFTI'}
+            ref_input = setNiftiType(load_nii(ref_file), dataType);
+            writeNiftiMasked(ref_input, values, mask_index, filename);
+        otherwise
+            error('Unknown Image type: %s', imageType);
+    end
+
+end
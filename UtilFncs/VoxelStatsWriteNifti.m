@@ -1,6 +1,24 @@
-function VoxelStatsWriteNifti( data, filename, ref_file )
+function VoxelStatsWriteNifti( data, filename, ref_file, dataType )
+%VOXELSTATSWRITENIFTI Write a volume to a NIfTI file like ref_file.
+%   VoxelStatsWriteNifti(data, filename, ref_file) writes data (a volume
+%   in the order load_nii(ref_file) reads it) to filename with the
+%   header of ref_file. dataType ('byte', 'short', 'long', 'float' or
+%   'double'; default '', the reference's own type) is the type of the
+%   new file.
+%
+%   When canWriteNiftiNative allows it, the niiwrite MEX file writes the
+%   file from the reference header alone, a slice at a time (gzip'd on
+%   a background thread for .nii.gz); otherwise the whole reference is
+%   read with load_nii and the result written with save_nii.
+    if nargin < 4
+        dataType = '';
+    end
+    if canWriteNiftiNative(filename, ref_file)
+        niiwrite(filename, data, ref_file, dataType);
+        return;
+    end
 
-    ref_input = load_nii(ref_file);
+    ref_input = setNiftiType(load_nii(ref_file), dataType);
     ref_height = ref_input.hdr.dime.dim(3);
     ref_width = ref_input.hdr.dime.dim(2);
     ref_slices = ref_input.hdr.dime.dim(4);
@@ -10,4 +28,3 @@ function VoxelStatsWriteNifti( data, filename, ref_file )
     save_nii(ref_input, filename);
 
 end
-
@@ -0,0 +1,112 @@
+function [ fileNames ] = VoxelStatsWriteResults( c_struct, outPrefix, ref_file, imageType, dataType, numThreads, mask_index )
+%VOXELSTATSWRITERESULTS Write every map in a VoxelStats result struct.
+%   fileNames = VoxelStatsWriteResults(c_struct, outPrefix, ref_file, imageType)
+%   writes each map in c_struct (eg. c_struct.tValues.Age) to its own
+%   file named <outPrefix>_<stat>_<coefficient>.mnc (or .nii), using
+%   ref_file (usually the mask) as the template. Fields of c_struct that
+%   are maps themselves, rather than structs of maps, are written as
+%   <outPrefix>_<stat>. imageType is 'minc' or 'nifti'.
+%
+%   The reference header is read once for the whole batch (or, for NIfTI
+%   maps that niiwrite can write -- see canWriteNiftiNative -- once per
+%   map, but never the reference image), and the maps
+%   are written in parallel over numThreads workers (default
+%   maxNumCompThreads; 0 writes them one after another). dataType is the
+%   storage type of the new files; it defaults to 'short' for MINC (as
+%   VoxelStatsWriteMinc) and to the reference's own type for NIfTI.
+%
+%   If mask_index (find(mask_slices)) is given, each map in c_struct is
+%   just its in-mask values (eg. a column of tStruct) rather than a full
+%   volume, and is scattered into its file one slice at a time (see
+%   VoxelStatsWriteMasked), so no full volume is ever built.
+%
+%   fileNames is a cell array of the files written.
+    if nargin < 5
+        dataType = '';
+    end
+    if nargin < 6
+        numThreads = maxNumCompThreads;
+    end
+    if nargin < 7
+        mask_index = [];
+    end
+    masked = ~isempty(mask_index);
+
+    [mapNames, maps] = collectMaps(c_struct, outPrefix);
+    n = length(maps);
+    fileNames = cell(n, 1);
+
+    switch imageType
+        case {'mnc','MNC', 'minc', 'MINC'}
+            if isempty(dataType)
+                dataType = 'short';
+            end
+            slices = getRefSlicesMinc(ref_file);
+            for i = 1:n
+                fileNames{i} = [mapNames{i} '.mnc'];
+            end
+            useMex = masked && exist('miwritemasked') == 3;
+            parfor (i = 1:n, numThreads)
+                h = newimage(fileNames{i}, [0 slices], ref_file, dataType);
+                if useMex
+                    miwritemasked(fileNames{i}, maps{i}, mask_index);
+                elseif masked
+                    image_elements = getimageinfo(h, 'ImageHeight') * getimageinfo(h, 'ImageWidth');
+                    putimages(h, getVoxelStructFromMask(maps{i}, mask_index, image_elements, slices), 1:slices);
+                else
+                    putimages(h, maps{i}, 1:slices);
+                end
+                closeimage(h);
+            end
+        case {'nii','NII', 'nifti', 'NIFTI'}
+            for i = 1:n
+                fileNames{i} = [mapNames{i} '.nii'];
+            end
+            if ~masked && n > 0 && canWriteNiftiNative(fileNames{1}, ref_file)
+                % Only the reference header is read, by each niiwrite
+                parfor (i = 1:n, numThreads)
+                    niiwrite(fileNames{i}, maps{i}, ref_file, dataType);
+                end
+                return;
+            end
+            ref_input = load_nii(ref_file);
+            ref_input = setNiftiType(ref_input, dataType);
+            dims = ref_input.hdr.dime.dim(2:4);
+            if masked
+                % Only the header is needed from here on
+                ref_input.img = [];
+            end
+            parfor (i = 1:n, numThreads)
+                if masked
+                    writeNiftiMasked(ref_input, maps{i}, mask_index, fileNames{i});
+                else
+                    out = ref_input;
+                    out.img = reshape(maps{i}, dims);
+                    out.fileprefix = fileNames{i};
+                    save_nii(out, fileNames{i});
+                end
+            end
+        otherwise
+            error('Unknown Image type: %s', imageType);
+    end
+
+end
+
+function [mapNames, maps] = collectMaps(c_struct, outPrefix)
+    mapNames = {};
+    maps = {};
+    stats = fieldnames(c_struct);
+    for s = 1:length(stats)
+        stat = c_struct.(stats{s});
+        if isstruct(stat)
+            coeffs = fieldnames(stat);
+            for c = 1:length(coeffs)
+                mapNames{end+1} = [outPrefix '_' stats{s} '_' coeffs{c}];
+                maps{end+1} = stat.(coeffs{c});
+            end
+        else
+            mapNames{end+1} = [outPrefix '_' stats{s}];
+            maps{end+1} = stat;
+        end
+    end
+end
@@ -0,0 +1,23 @@
+function ok = canWriteNiftiNative( filename, ref_file )
+%CANWRITENIFTINATIVE True if niiwrite can stand in for load_nii/save_nii.
+%   ok = canWriteNiftiNative(filename, ref_file) is true if the niiwrite
+%   MEX file is available, filename is a .nii or .nii.gz file, and
+%   ref_file is a NIfTI file that load_nii does not reorient (see
+%   niftiInFileOrder). niiwrite copies the reference header as it is on
+%   disk and writes the data in file order, so only then does it write
+%   what save_nii would from load_nii(ref_file). Only the header of
+%   ref_file is read (but see niftiInFileOrder for gzip'd files).
+    ok = false;
+    if exist('niiwrite') ~= 3
+        return;
+    end
+    if ~hasSuffix(filename, '.nii') && ~hasSuffix(filename, '.nii.gz')
+        return;
+    end
+    ok = niftiInFileOrder(ref_file);
+end
+
+function yes = hasSuffix(name, suffix)
+    yes = length(name) >= length(suffix) && ...
+        strcmp(name(end-length(suffix)+1:end), suffix);
+end
@@ -0,0 +1,10 @@
+function closeMultiVarStream(stream)
+    % Closes the block streams opened by openMultiVarStream.
+    if isempty(stream)
+        return;
+    end
+    handles = stream.handles.values;
+    for i = 1:length(handles)
+        mireadblocks('close', handles{i});
+    end
+end
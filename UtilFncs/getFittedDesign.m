@@ -0,0 +1,27 @@
+function [ X ] = getFittedDesign( model )
+%GETFITTEDDESIGN The design matrix of a fitted linear or generalized model.
+%   X = getFittedDesign(model) is the design matrix fitlm or fitglm built
+%   for model (its hidden Design property), for the subjects it used, as
+%   a full double matrix. It is [] if that is not available, or does not
+%   give back the model's fitted values (for a LinearModel) or linear
+%   predictor (for a GeneralizedLinearModel) from its coefficients.
+    X = [];
+    try
+        rows = model.ObservationInfo.Subset;
+        D = model.Design;
+        if size(D, 1) == length(rows)
+            D = D(rows, :);
+        end
+        if isa(model, 'GeneralizedLinearModel')
+            fitted = model.Fitted.LinearPredictor(rows);
+        else
+            fitted = model.Fitted(rows);
+        end
+        if size(D, 1) == sum(rows) && size(D, 2) == model.NumCoefficients && ...
+                norm(D * model.Coefficients.Estimate - fitted) <= 1e-8 * (1 + norm(fitted))
+            X = full(double(D));
+        end
+    catch
+        X = [];
+    end
+end
@@ -1,12 +1,18 @@
-function [multiVarMap] = getMultiVarData(imageType, mainDataTable, multivalueVariables, totalSlices, image_elements, mask_slices)
+function [multiVarMap] = getMultiVarData(imageType, mainDataTable, multivalueVariables, totalSlices, image_elements, mask_slices, precision, numThreads)
+    if nargin < 7
+        precision = 'double';
+    end
+    if nargin < 8
+        numThreads = maxNumCompThreads;
+    end
     multiVarMap = containers.Map();
     for var = multivalueVariables
         U = matlab.lang.makeUniqueStrings(var{1});
         switch imageType
             case {'mnc','MNC', 'minc', 'MINC'}
-                eval([U '= readmultiValuedMincData(mainDataTable.' var{1,1} ',' num2str(totalSlices) ',mask_slices);']);
+                eval([U '= readmultiValuedMincData(mainDataTable.' var{1,1} ',' num2str(totalSlices) ',mask_slices, precision, numThreads);']);
             case {'nii','NII', 'nifti', 'NIFTI'}
-                eval([U '= readmultiValuedNiftiData(mainDataTable.' var{1,1} ',' num2str(totalSlices) ',mask_slices);']);
+                eval([U '= readmultiValuedNiftiData(mainDataTable.' var{1,1} ',' num2str(totalSlices) ',mask_slices, precision, numThreads);']);
             otherwise
                 fprintf('Unknown Image type')
                 exit
@@ -0,0 +1,13 @@
+function [mapForBlock, cols, isEnd] = getMultiVarMapForBlock(stream, multivalueVariables)
+    % Reads the next block of voxels of every multi-valued variable from a
+    % stream opened by openMultiVarStream.  cols are the positions of the
+    % block's voxels in find(mask_slices), ie. the rows of the result
+    % structs that the block's models fill in.
+    mapForBlock = containers.Map();
+    cols = [];
+    for var = multivalueVariables
+        [data, cols] = mireadblocks('next', stream.handles(var{1,1}));
+        mapForBlock(var{1,1}) = data;
+    end
+    isEnd = isempty(cols);
+end
@@ -6,9 +6,9 @@ function [mapForSlice, numberOfModels, isEnd] = getMultiVarMapForSliceMultiVar(m
         if (((index-1)*blockSize)+1) > numOfModels
             numberOfModels = 0;
             isEnd = 1;
-        elseif (index*blockSize > numOfModels) && ((((index-1)*blockSize)+1) < numOfModels)
+        elseif (index*blockSize > numOfModels) && ((((index-1)*blockSize)+1) <= numOfModels)
             mapForSlice(var{1,1}) = varData(:,(((index-1)*blockSize)+1):end);
-            numberOfModels = numOfModels - (((index-1)*blockSize)+1);
+            numberOfModels = numOfModels - (((index-1)*blockSize)+1) + 1;
         else
             mapForSlice(var{1,1}) = varData(:,(((index-1)*blockSize)+1):(index*blockSize));
             numberOfModels = blockSize;
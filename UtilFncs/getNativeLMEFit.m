@@ -0,0 +1,88 @@
+function [ fastFit ] = getNativeLMEFit( lme, multivalueVariables, multiVarMap, k, covariancePattern )
+%GETNATIVELMEFIT A function fitting a block of voxels' mixed models at once.
+%   fastFit = getNativeLMEFit(lme, multivalueVariables, multiVarMap, k,
+%   covariancePattern) takes lme, the model fitlme fitted at voxel k with
+%   the given 'CovariancePattern', and returns a function
+%
+%       [beta, se, t, sigma2] = fastFit(multiVarMapForSlice, order)
+%
+%   that fits the same model to every voxel of a block with lmefit, giving
+%   the Estimate, SE and tStat of each voxel's coefficients (coefficients x
+%   voxels) as fitlme would. Voxels lmefit could not fit are NaN in
+%   sigma2, and should be refitted with fitlme. lmefit starts each voxel's
+%   search from the last voxel's covariance parameters, so the voxels are
+%   fitted in the given order (see getSpatialOrder), which should put
+%   neighbours next to each other; the results are in the block's order.
+%
+%   This is only possible when the images are the response and no
+%   predictor, so that the fixed and random designs (taken from lme) are
+%   the same at every voxel, and the model has a single random-effects
+%   term, eg. (1+Time|Subject). lmefit's fit at voxel k must also agree
+%   with lme. Otherwise (or if lmefit is not compiled) fastFit is [].
+    fastFit = [];
+    if exist('lmefit') ~= 3 || ~ismember(lme.ResponseName, multivalueVariables) || ...
+            any(ismember(lme.PredictorNames, multivalueVariables))
+        return;
+    end
+    name = lme.ResponseName;
+    response = multiVarMap(name);
+    try
+        rows = lme.ObservationInfo.Subset;
+        if any(isnan(response(rows, k)))
+            return;
+        end
+        X = designMatrix(lme, 'Fixed');
+        Z = designMatrix(lme, 'Random');
+        if size(X, 1) == length(rows) && ~all(rows)
+            X = X(rows, :);
+            Z = Z(rows, :);
+        end
+        X = full(double(X));
+        psi = covarianceParameters(lme);
+        if numel(psi) ~= 1
+            return;
+        end
+
+        % Z has q columns for each level of the grouping variable; find
+        % each observation's level, and its q values
+        n = size(Z, 1);
+        q = size(psi{1}, 1);
+        m = size(Z, 2) / q;
+        group = ones(n, 1);
+        [i, j, v] = find(Z);
+        group(i) = ceil(j / q);
+        R = zeros(n, q);
+        R(sub2ind([n q], i, j - (group(i) - 1) * q)) = v;
+        cols = bsxfun(@plus, (group - 1) * q, 1:q);
+        if m ~= round(m) || nnz(sparse(repmat((1:n)', 1, q), cols, R, n, size(Z, 2)) - Z) > 0
+            return;
+        end
+
+        % It must give back lme's coefficients at voxel k
+        method = lme.FitMethod;
+        [b, se] = lmefit(X, R, group, double(response(rows, k)), covariancePattern, method);
+        estimate = lme.Coefficients.Estimate;
+        stdErr = lme.Coefficients.SE;
+        if any(~(abs(b - estimate) <= 1e-2 * stdErr)) || any(~(abs(se - stdErr) <= 1e-2 * stdErr))
+            return;
+        end
+    catch
+        return;
+    end
+    fastFit = @(map, order) fitInOrder(X, R, group, map(name), rows, order, covariancePattern, method);
+    fprintf('Fixed and random designs are the same at every voxel - fitting blocks of voxels with lmefit\n');
+end
+
+function [b, se, t, sigma2] = fitInOrder(X, R, group, Y, rows, order, covariancePattern, method)
+    % lmefit on Y(rows,order), with the results put back in Y's order
+    if all(rows)
+        Y = Y(:, order);
+    else
+        Y = Y(rows, order);
+    end
+    [b, se, t, sigma2] = lmefit(X, R, group, Y, covariancePattern, method, []);
+    b(:, order) = b;
+    se(:, order) = se;
+    t(:, order) = t;
+    sigma2(order) = sigma2;
+end
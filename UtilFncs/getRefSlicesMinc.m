@@ -0,0 +1,12 @@
+function slices = getRefSlicesMinc(ref_file)
+    % Only the header is needed here, not the volume itself.
+    if exist('miinquire') == 3
+        info = miinquire(ref_file, 'imageinfo');
+        dimSizes = info.DimSizes;
+        slices = dimSizes(2);
+    else
+        h = openimage(ref_file);
+        slices = getimageinfo(h, 'NumSlices');
+        closeimage(h);
+    end
+end
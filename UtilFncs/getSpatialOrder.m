@@ -0,0 +1,22 @@
+function [ order ] = getSpatialOrder( index, image_width, image_height )
+%GETSPATIALORDER An order visiting a block's voxels as neighbours.
+%   order = getSpatialOrder(index, image_width, image_height) takes the
+%   linear indices into the image (image_width*image_height elements per
+%   slice) of a block's voxels, and gives the order in which to visit
+%   them so that each voxel is next to the one before it wherever the
+%   mask allows: along each row, back along the next row, and back up
+%   through the rows of the next slice.
+    index = index(:) - 1;
+    image_elements = image_width * image_height;
+    z = floor(index / image_elements);
+    row = floor(mod(index, image_elements) / image_width);
+    x = mod(index, image_width);
+
+    % Every other slice is walked backwards, and so is every other row
+    % in walking order
+    backSlice = mod(z, 2) == 1;
+    row(backSlice) = image_height - 1 - row(backSlice);
+    backRow = mod(z * image_height + row, 2) == 1;
+    x(backRow) = image_width - 1 - x(backRow);
+    [~, order] = sortrows([z row x]);
+end
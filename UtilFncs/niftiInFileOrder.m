@@ -0,0 +1,53 @@
+function yes = niftiInFileOrder( filename )
+%NIFTIINFILEORDER True if load_nii returns a NIfTI image in file order.
+%   yes = niftiInFileOrder(filename) is true if filename is a NIfTI file
+%   that load_nii does not reorient, so that its image (and any index
+%   into it, such as find(mask_slices)) is laid out exactly as the
+%   voxels are stored in the file. Only the header is read: load_nii_hdr
+%   can't read a gzip'd file, so its header is copied out by niiwrite
+%   into a temporary folder (removed again), or, without the niiwrite
+%   MEX file, the whole file is unpacked there. It is false for anything
+%   load_nii_hdr can't read.
+    yes = false;
+    tmpDir = '';
+    if length(filename) > 3 && strcmp(filename(end-2:end), '.gz')
+        % load_nii_hdr can't read gzip'd files; for a .hdr/.img pair,
+        % only the header need be unpacked
+        if length(filename) > 7 && strcmp(filename(end-6:end), '.img.gz')
+            filename = [filename(1:end-7) '.hdr.gz'];
+        end
+        tmpDir = tempname;
+        mkdir(tmpDir);
+        try
+            if exist('niiwrite') == 3
+                [~, name] = fileparts(filename);
+                unpacked = fullfile(tmpDir, name);
+                niiwrite('-header', filename, unpacked);
+                filename = unpacked;
+            else
+                unpacked = gunzip(filename, tmpDir);
+                filename = unpacked{1};
+            end
+        catch
+            rmdir(tmpDir, 's');
+            return;
+        end
+    end
+    try
+        [hdr, filetype, fileprefix, machine] = load_nii_hdr(filename);
+        nii.hdr = hdr;
+        nii.filetype = filetype;
+        nii.fileprefix = fileprefix;
+        nii.machine = machine;
+        nii.img = [];
+        % Only the orientation matters here, and xform_nii would apply
+        % any scaling to the (empty) image
+        nii.hdr.dime.scl_slope = 0;
+        nii = xform_nii(nii);
+        yes = isempty(nii.hdr.hist.rot_orient);
+    catch
+    end
+    if ~isempty(tmpDir)
+        rmdir(tmpDir, 's');
+    end
+end
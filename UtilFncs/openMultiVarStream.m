@@ -0,0 +1,37 @@
+function [stream] = openMultiVarStream(imageType, mainDataTable, multivalueVariables, mask_slices, blockMB, precision, numThreads, readAhead)
+    % Opens a block stream (see mireadblocks) over the images of every
+    % multi-valued variable, so that the model stage can be fed one block
+    % of voxels at a time instead of the whole subjects x voxels matrix.
+    % The memory budget blockMB (in MB) is shared by all the variables.
+    % Returns [] if streaming is not possible (not MINC, or mireadblocks
+    % is not compiled), in which case use getMultiVarData instead.
+    if nargin < 6
+        precision = 'double';
+    end
+    if nargin < 7
+        numThreads = maxNumCompThreads;
+    end
+    if nargin < 8
+        readAhead = 2;
+    end
+    stream = [];
+    if ~any(strcmp(imageType, {'mnc','MNC', 'minc', 'MINC'})) || exist('mireadblocks') ~= 3
+        return;
+    end
+    index = find(mask_slices);
+    numVars = length(multivalueVariables);
+    handles = containers.Map();
+    numBlocks = 0;
+    try
+        for var = multivalueVariables
+            [files, frames] = parseVolumeSpecs(mainDataTable.(var{1,1}));
+            [h, numBlocks] = mireadblocks('open', files, index, blockMB/numVars, precision, numThreads, readAhead, frames);
+            handles(var{1,1}) = h;
+        end
+    catch ME
+        fprintf('Could not open block stream (%s), reading all data at once...\n', ME.message);
+        closeMultiVarStream(struct('handles', handles));
+        return;
+    end
+    stream = struct('handles', handles, 'numBlocks', numBlocks);
+end
@@ -0,0 +1,26 @@
+function [files, volumes] = parseVolumeSpecs( subjectList )
+%PARSEVOLUMESPECS Split image entries of the form 'file,k' into files and volumes.
+%   [files, volumes] = parseVolumeSpecs(subjectList) takes the image
+%   column of a data table (eg. mainDataTable.<var>) and returns the file
+%   each entry names and the (one-based) volume of it to read, so that a
+%   cohort stored as a single 4-D file -- one subject per NIfTI volume or
+%   MINC frame -- can be listed one row per subject, as SPM does:
+%
+%       cohort.nii.gz,1
+%       cohort.nii.gz,2
+%       ...
+%
+%   An entry without ',k' is a file of its own and reads volume 1, so a
+%   list of 3-D files is returned unchanged. The readers (niireadmasked,
+%   mireadmasked and mireadblocks) read all the volumes wanted from a
+%   file together, in one pass through it.
+    files = subjectList(:,1);
+    volumes = ones(length(files), 1);
+    for i = 1:length(files)
+        tok = regexp(files{i}, '^(.+),\s*(\d+)\s*$', 'tokens', 'once');
+        if ~isempty(tok)
+            files{i} = tok{1};
+            volumes(i) = str2double(tok{2});
+        end
+    end
+end
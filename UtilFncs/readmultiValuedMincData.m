@@ -1,12 +1,38 @@
-function [resultMat] = readmultiValuedMincData( subjectList, totalSlices, mask_slices)
+function [resultMat] = readmultiValuedMincData( subjectList, totalSlices, mask_slices, precision, numThreads, readAhead)
+    if nargin < 4
+        precision = 'double';
+    end
+    if nargin < 5
+        numThreads = maxNumCompThreads;
+    end
+    if nargin < 6
+        readAhead = 2;
+    end
     [n m] = size(subjectList);
-    resultMat = zeros(n, sum(sum(mask_slices)));
+    % Entries may name frames of a 4-D file ('file,k'; see parseVolumeSpecs)
+    [files, frames] = parseVolumeSpecs(subjectList);
+    if exist('mireadmasked') == 3
+        try
+            resultMat = mireadmasked(files, find(mask_slices), precision, numThreads, readAhead, frames);
+            return;
+        catch
+            fprintf('mireadmasked failed, reading images one file at a time...\n');
+        end
+    end
+    resultMat = zeros(n, sum(sum(mask_slices)), precision);
     for i = 1:n
         h = [];
         for retry=1:5
             try
-                h = openimage(subjectList{i,1});
-                t = getimages(h, 1: totalSlices);
+                % openimage drops the time dimension, so a 4-D file's
+                % frame is read with mireadimages directly
+                imageSize = miinquire(files{i}, 'imagesize');
+                if imageSize(1) > 0
+                    t = mireadimages(files{i}, 0:totalSlices-1, frames(i)-1, [], 0, imageSize(3), precision);
+                else
+                    h = openimage(files{i});
+                    t = getimages(h, 1: totalSlices, [], [], [], [], precision);
+                end
                 resultMat(i,:) = t(mask_slices)';
                 break;
             catch
@@ -1,11 +1,31 @@
-function [resultMat] = readmultiValuedNiftiData( subjectList, totalSlices, mask_slices)
+function [resultMat] = readmultiValuedNiftiData( subjectList, totalSlices, mask_slices, precision, numThreads)
+    if nargin < 4
+        precision = 'double';
+    end
+    if nargin < 5
+        numThreads = maxNumCompThreads;
+    end
     [n m] = size(subjectList);
-    resultMat = zeros(n, sum(sum(mask_slices)));
-    for i = 1:n
+    % Entries may name volumes of a 4-D file ('file,k'; see parseVolumeSpecs)
+    [files, volumes] = parseVolumeSpecs(subjectList);
+    % niireadmasked gathers the masked voxels straight from each mapped
+    % (or, if gzip'd, inflated) file, which matches load_nii only if it
+    % leaves the files in file order (it also checks that every file
+    % shares the first's geometry)
+    if n > 0 && exist('niireadmasked') == 3 && niftiInFileOrder(files{1})
+        try
+            resultMat = niireadmasked(files, find(mask_slices), precision, max(numThreads, 1), volumes);
+            return;
+        catch
+            fprintf('niireadmasked failed, reading images one file at a time...\n');
+        end
+    end
+    resultMat = zeros(n, sum(sum(mask_slices)), precision);
+    parfor (i = 1:n, numThreads)
         h = [];
         for retry=1:5
             try
-                h = load_nii(subjectList{i,1});
+                h = load_nii(files{i}, volumes(i));
                 t = reshape(h.img, [], totalSlices);
                 resultMat(i,:) = t(mask_slices)';
                 break;
@@ -22,4 +42,3 @@ function [resultMat] = readmultiValuedNiftiData( subjectList, totalSlices, mask_
         end
     end
 end
-
@@ -0,0 +1,25 @@
+function [ t, e, se ] = refitVoxels( fitVoxel, voxels, t, e, se )
+%REFITVOXELS Fill in a block's results for voxels fitted one at a time.
+%   [t, e, se] = refitVoxels(fitVoxel, voxels, t, e, se) fits each of the
+%   block's voxels in voxels with fitVoxel(k), which returns the model
+%   fitted at the block's k-th voxel (or 'None' if the fit failed), in a
+%   parfor loop, and puts the tStat, Estimate and SE of its coefficients
+%   into those rows of t, e and se (voxels x coefficients). The rows of
+%   voxels whose fit failed are 0.
+    n = size(t, 2);
+    refit_t = zeros(length(voxels), n);
+    refit_e = zeros(length(voxels), n);
+    refit_se = zeros(length(voxels), n);
+    parfor i = 1:length(voxels)
+        model = fitVoxel(voxels(i));
+        if (strcmp(model, 'None'))
+          continue;
+        end
+        refit_t(i, :) = model.Coefficients.tStat';
+        refit_e(i, :) = model.Coefficients.Estimate';
+        refit_se(i, :) = model.Coefficients.SE';
+    end
+    t(voxels, :) = refit_t;
+    e(voxels, :) = refit_e;
+    se(voxels, :) = refit_se;
+end
@@ -0,0 +1,8 @@
+function [ Y ] = selectRows( Y, rows )
+%SELECTROWS Y(rows,:), without a copy if every row is wanted.
+%   Y = selectRows(Y, rows) picks the subjects a model used (rows, as in
+%   its ObservationInfo.Subset) out of a block of voxels' data.
+    if ~all(rows)
+        Y = Y(rows, :);
+    end
+end
@@ -0,0 +1,23 @@
+function nii = setNiftiType(nii, dataType)
+    switch dataType
+        case ''
+            return;
+        case 'byte'
+            nii.hdr.dime.datatype = 2;
+            nii.hdr.dime.bitpix = 8;
+        case 'short'
+            nii.hdr.dime.datatype = 4;
+            nii.hdr.dime.bitpix = 16;
+        case 'long'
+            nii.hdr.dime.datatype = 8;
+            nii.hdr.dime.bitpix = 32;
+        case 'float'
+            nii.hdr.dime.datatype = 16;
+            nii.hdr.dime.bitpix = 32;
+        case 'double'
+            nii.hdr.dime.datatype = 64;
+            nii.hdr.dime.bitpix = 64;
+        otherwise
+            error('Unknown data type: %s', dataType);
+    end
+end
@@ -0,0 +1,67 @@
+function writeNiftiMasked( nii, values, mask_index, filename )
+%WRITENIFTIMASKED Write a .nii volume from the voxels under a mask.
+%   writeNiftiMasked(nii, values, mask_index, filename) writes a volume
+%   with the header of nii (as returned by load_nii) in which the voxels
+%   at mask_index (ascending linear indices into nii.img, eg. find(mask))
+%   are set to values and all others to 0. The image is written one
+%   slice at a time, so the full volume is never built in memory.
+    hdr = nii.hdr;
+    switch double(hdr.dime.datatype)
+        case 2
+            precision = 'uint8';
+        case 4
+            precision = 'int16';
+        case 8
+            precision = 'int32';
+        case 16
+            precision = 'float32';
+        case 64
+            precision = 'float64';
+        case 256
+            precision = 'int8';
+        case 512
+            precision = 'uint16';
+        case 768
+            precision = 'uint32';
+        otherwise
+            error('This datatype is not supported');
+    end
+
+    dims = double(hdr.dime.dim(2:4));
+    image_elements = dims(1) * dims(2);
+    slices = dims(3);
+    mask_index = mask_index(:);
+    values = values(:);
+
+    % glmax/glmin as save_nii would set them for the full volume
+    range = double([min(values) max(values)]);
+    if length(mask_index) < image_elements * slices
+        range = [min([range 0]) max([range 0])];
+    end
+    hdr.dime.glmin = round(range(1));
+    hdr.dime.glmax = round(range(2));
+    hdr.dime.vox_offset = 352;
+    hdr.hist.magic = 'n+1';
+
+    if length(filename) < 4 || ~strcmp(filename(end-3:end), '.nii')
+        filename = [filename '.nii'];
+    end
+    fid = fopen(filename, 'w');
+    if fid < 0
+        error('Cannot open file %s.', filename);
+    end
+    save_nii_hdr(hdr, fid);
+    fwrite(fid, zeros(1, 4), 'uint8');
+
+    % Where each slice's voxels start in mask_index
+    sliceOf = floor((mask_index - 1) / image_elements) + 1;
+    sliceFirst = [0; cumsum(accumarray(sliceOf, 1, [slices 1]))];
+    for s = 1:slices
+        slice = zeros(image_elements, 1);
+        r = (sliceFirst(s) + 1):sliceFirst(s + 1);
+        slice(mask_index(r) - (s - 1) * image_elements) = values(r);
+        fwrite(fid, slice, precision);
+    end
+    fclose(fid);
+
+end
@@ -53,10 +53,10 @@ function [ c_struct, slices_p, image_height_p, image_width_p, coeff_vars, voxel_
     %%Run Analysis
     % Run only one voxel to get information
     k = 1
-    templm = parForVoxelLM(dataTable, stringModel, distribution, 1, categoricalVars, multivalueVariables, multiVarMap);
+    templm = parForVoxelLM(dataTable, stringModel, distribution, k, categoricalVars, multivalueVariables, multiVarMap);
     while (strcmp(templm, 'None'))
       k = k + 1;
-      templm = parForVoxelLM(dataTable, stringModel, distribution, 1, categoricalVars, multivalueVariables, multiVarMap);
+      templm = parForVoxelLM(dataTable, stringModel, distribution, k, categoricalVars, multivalueVariables, multiVarMap);
     end
     varsInRegressionNames = templm.CoefficientNames;
     nVarsInRegression = length(varsInRegressionNames);
@@ -65,6 +65,11 @@ function [ c_struct, slices_p, image_height_p, image_width_p, coeff_vars, voxel_
     voxel_num = sum(sum(mask_slices));
     df = templm.DFE
 
+    %%Fit whole blocks of voxels natively where the model allows (the
+    %%images are only the response, so the design is the same at every
+    %%voxel, and the family is one irlsfit fits)
+    fastFit = sharedDesignGLM(templm, multivalueVariables, multiVarMap, k);
+
     %Number of Analysis
     numOfModels = sum(sum(mask_slices));
     totalDataSlices = 200;
@@ -86,15 +91,19 @@ function [ c_struct, slices_p, image_height_p, image_width_p, coeff_vars, voxel_
         slices_t = zeros(numberOfModels_t, nVarsInRegression);
         slices_e = zeros(numberOfModels_t, nVarsInRegression);
         slices_se = zeros(numberOfModels_t, nVarsInRegression);
-        parfor k = 1:numberOfModels_t
-            lm = parForVoxelLM(dataTable, stringModel, distribution, k, categoricalVars, multivalueVariables, multiVarMapForSlice);
-            if (strcmp(lm,'None'))
-              continue;
-            end
-            slices_t(k, :) = lm.Coefficients.tStat';
-            slices_e(k, :) = lm.Coefficients.Estimate';
-            slices_se(k, :) = lm.Coefficients.SE';
+        if isempty(fastFit)
+            refit = 1:numberOfModels_t;
+        else
+            [b, se, t, dispersion] = fastFit(multiVarMapForSlice);
+            slices_t = t';
+            slices_e = b';
+            slices_se = se';
+            % Voxels with missing or out of range values, or whose fit
+            % did not converge, are left to fitglm
+            refit = find(isnan(dispersion));
         end
+        fitVoxel = @(k) parForVoxelLM(dataTable, stringModel, distribution, k, categoricalVars, multivalueVariables, multiVarMapForSlice);
+        [slices_t, slices_e, slices_se] = refitVoxels(fitVoxel, refit, slices_t, slices_e, slices_se);
         tStruct((((sliceCount-1)*blockSize)+1):(((sliceCount-1)*blockSize)+numberOfModels_t),:) = slices_t;
         eStruct((((sliceCount-1)*blockSize)+1):(((sliceCount-1)*blockSize)+numberOfModels_t),:) = slices_e;
         seStruct((((sliceCount-1)*blockSize)+1):(((sliceCount-1)*blockSize)+numberOfModels_t),:) = slices_se;
@@ -121,6 +130,48 @@ function [ c_struct, slices_p, image_height_p, image_width_p, coeff_vars, voxel_
     toc(functionTimer)
 end
 
+function fastFit = sharedDesignGLM(glm, multivalueVariables, multiVarMap, k)
+    % A function fitting a block of voxels at once with irlsfit, if every
+    % voxel's model has the design of glm (fitted at voxel k): the images
+    % are the response and no predictor, no subject was dropped for a
+    % missing response at voxel k, and glm has the canonical link of a
+    % family irlsfit fits. irlsfit's fit at voxel k must also agree with
+    % glm. Otherwise (or if irlsfit is not compiled) [].
+    fastFit = [];
+    if exist('irlsfit') ~= 3 || ~ismember(glm.ResponseName, multivalueVariables) || ...
+            any(ismember(glm.PredictorNames, multivalueVariables))
+        return;
+    end
+    name = glm.ResponseName;
+    response = multiVarMap(name);
+    try
+        families = {'normal', 'binomial', 'poisson', 'gamma'};
+        links = {'identity', 'logit', 'log', 'reciprocal'};
+        family = find(strcmpi(glm.Distribution.Name, families));
+        if isempty(family) || ~strcmpi(glm.Link.Name, links{family}) || any(isnan(response(:, k)))
+            return;
+        end
+        family = families{family};
+        X = getFittedDesign(glm);
+        if isempty(X)
+            return;
+        end
+
+        % It must give back glm's coefficients at voxel k
+        rows = glm.ObservationInfo.Subset;
+        [b, se] = irlsfit(X, double(response(rows, k)), family);
+        estimate = glm.Coefficients.Estimate;
+        stdErr = glm.Coefficients.SE;
+        if any(~(abs(b - estimate) <= 1e-4 * stdErr)) || any(~(abs(se - stdErr) <= 1e-4 * stdErr))
+            return;
+        end
+    catch
+        return;
+    end
+    fastFit = @(map) irlsfit(X, selectRows(map(name), rows), family);
+    fprintf('Design is the same at every voxel - fitting blocks of voxels with irlsfit\n');
+end
+
 function [ model ] = parForVoxelLM(table, formula, distribution, k, categoricalVars, multivalueVariables, multiVarMap)
     for varName = multivalueVariables
         varData = multiVarMap(varName{1,1});
@@ -33,9 +33,23 @@ function [ c_struct, slices_p, image_height_p, image_width_p, coeff_vars, voxel_
     %%Get info from Voxel files.
     image_elements = image_height * image_width;
 
+    %%Stream the data a block at a time if a memory budget (MB) is set
+    stream = [];
+    blockMB = str2double(getenv('VOXELSTATS_BLOCK_MB'));
+    if nargin <= 7 && blockMB > 0
+        stream = openMultiVarStream(imageType, mainDataTable, multivalueVariables, mask_slices, blockMB);
+        % Close the stream even if the analysis errors or is interrupted
+        streamCleanup = onCleanup(@() closeMultiVarStream(stream));
+    end
+
     fprintf('Reading Data: \n');
     readDataTimer = tic;
-    multiVarMap = getMultiVarData(imageType, mainDataTable, multivalueVariables, slices, image_elements, mask_slices);
+    if isempty(stream)
+        multiVarMap = getMultiVarData(imageType, mainDataTable, multivalueVariables, slices, image_elements, mask_slices);
+    else
+        multiVarMap = getMultiVarMapForBlock(stream, multivalueVariables);
+        cellfun(@(h) mireadblocks('rewind', h), stream.handles.values);
+    end
     fprintf('File Read - ');
     toc(readDataTimer)
     dataTable = mainDataTable(:,usedVars);
@@ -52,13 +66,18 @@ function [ c_struct, slices_p, image_height_p, image_width_p, coeff_vars, voxel_
 
 
     %%Run Analysis
-    % Run only one voxel to get information
+    % Run only one voxel to get information. multiVarMap only holds the
+    % first block when streaming, so the search stops at its last voxel
+    numberOfModels_t = size(multiVarMap(multivalueVariables{1}), 2);
     k = 1
     templm = parForVoxelLM(dataTable, stringModel, k, categoricalVars, multivalueVariables, multiVarMap);
-    while (strcmp(templm, 'None'))
+    while (strcmp(templm, 'None') && k < numberOfModels_t)
       k = k + 1;
       templm = parForVoxelLM(dataTable, stringModel, k, categoricalVars, multivalueVariables, multiVarMap);
     end
+    if (strcmp(templm, 'None'))
+        error('Cannot fit %s at any of the first %d voxels', stringModel, numberOfModels_t);
+    end
     varsInRegressionNames = templm.CoefficientNames;
     nVarsInRegression = length(varsInRegressionNames);
     %%Done one voxel fitlm
@@ -66,10 +85,20 @@ function [ c_struct, slices_p, image_height_p, image_width_p, coeff_vars, voxel_
     voxel_num = sum(sum(mask_slices));
     df = templm.DFE
 
+    %%Fit whole blocks of voxels natively where the model allows: if the
+    %%images are only the response, the design is the same at every voxel
+    %%(olsfit); if some are predictors, it is built from them (olsbatch)
+    fastFit = sharedDesignLM(templm, multivalueVariables, multiVarMap, k);
+    if isempty(fastFit)
+        fastFit = voxelDesignLM(templm, dataTable, stringModel, categoricalVars, multivalueVariables, multiVarMap, k);
+    end
 
     %Number of Analysis
     numOfModels = sum(sum(mask_slices));
     totalDataSlices = 200;
+    if ~isempty(stream)
+        totalDataSlices = stream.numBlocks;
+    end
     tStruct = zeros(numOfModels,nVarsInRegression);
     eStruct = zeros(numOfModels,nVarsInRegression);
     seStruct = zeros(numOfModels,nVarsInRegression);
@@ -79,8 +108,14 @@ function [ c_struct, slices_p, image_height_p, image_width_p, coeff_vars, voxel_
     for sliceCount = 1:totalDataSlices
         fprintf('Artificial Slice - %d - ', sliceCount);
         artificialSliceTimer = tic;
-        blockSize = ceil(numOfModels/totalDataSlices);
-        [multiVarMapForSlice, numberOfModels_t, isEnd] = getMultiVarMapForSliceMultiVar(multiVarMap, multivalueVariables, sliceCount, numOfModels, blockSize);
+        if isempty(stream)
+            blockSize = ceil(numOfModels/totalDataSlices);
+            [multiVarMapForSlice, numberOfModels_t, isEnd] = getMultiVarMapForSliceMultiVar(multiVarMap, multivalueVariables, sliceCount, numOfModels, blockSize);
+            rows = (((sliceCount-1)*blockSize)+1):(((sliceCount-1)*blockSize)+numberOfModels_t);
+        else
+            [multiVarMapForSlice, rows, isEnd] = getMultiVarMapForBlock(stream, multivalueVariables);
+            numberOfModels_t = length(rows);
+        end
         if isEnd
             toc(artificialSliceTimer)
             break;
@@ -88,20 +123,25 @@ function [ c_struct, slices_p, image_height_p, image_width_p, coeff_vars, voxel_
         slices_t = zeros(numberOfModels_t, nVarsInRegression);
         slices_e = zeros(numberOfModels_t, nVarsInRegression);
         slices_se = zeros(numberOfModels_t, nVarsInRegression);
-        parfor k = 1:numberOfModels_t
-            lm = parForVoxelLM(dataTable, stringModel, k, categoricalVars, multivalueVariables, multiVarMapForSlice);
-            if (strcmp(lm,'None'))
-              continue;
-            end
-            slices_t(k, :) = lm.Coefficients.tStat';
-            slices_e(k, :) = lm.Coefficients.Estimate';
-            slices_se(k, :) = lm.Coefficients.SE';
+        if isempty(fastFit)
+            refit = 1:numberOfModels_t;
+        else
+            [b, se, t, mse] = fastFit(multiVarMapForSlice);
+            slices_t = t';
+            slices_e = b';
+            slices_se = se';
+            % Voxels with missing values are left to fitlm, which drops
+            % those subjects
+            refit = find(isnan(mse));
         end
-        tStruct((((sliceCount-1)*blockSize)+1):(((sliceCount-1)*blockSize)+numberOfModels_t),:) = slices_t;
-        eStruct((((sliceCount-1)*blockSize)+1):(((sliceCount-1)*blockSize)+numberOfModels_t),:) = slices_e;
-        seStruct((((sliceCount-1)*blockSize)+1):(((sliceCount-1)*blockSize)+numberOfModels_t),:) = slices_se;
+        fitVoxel = @(k) parForVoxelLM(dataTable, stringModel, k, categoricalVars, multivalueVariables, multiVarMapForSlice);
+        [slices_t, slices_e, slices_se] = refitVoxels(fitVoxel, refit, slices_t, slices_e, slices_se);
+        tStruct(rows,:) = slices_t;
+        eStruct(rows,:) = slices_e;
+        seStruct(rows,:) = slices_se;
         toc(artificialSliceTimer)
     end
+    clear streamCleanup; % closes the block stream, if any
     fprintf('Analysis Done - ');
     toc(analysisTimer)
     slices_p = slices;
@@ -121,6 +161,138 @@ function [ c_struct, slices_p, image_height_p, image_width_p, coeff_vars, voxel_
     toc(functionTimer)
 end
 
+function fastFit = sharedDesignLM(lm, multivalueVariables, multiVarMap, k)
+    % A function fitting a block of voxels at once with olsfit, if every
+    % voxel's model has the design of lm (fitted at voxel k): the images
+    % are the response and no predictor, and no subject was dropped for
+    % a missing response at voxel k. olsfit's fit at voxel k must also
+    % agree with lm (it does not if the design is rank deficient, which
+    % fitlm allows but olsfit does not). Otherwise (or if olsfit is not
+    % compiled, or the design can't be recovered) [].
+    fastFit = [];
+    if exist('olsfit') ~= 3 || ~ismember(lm.ResponseName, multivalueVariables) || ...
+            any(ismember(lm.PredictorNames, multivalueVariables))
+        return;
+    end
+    response = multiVarMap(lm.ResponseName);
+    if any(isnan(response(:, k)))
+        return;
+    end
+    X = getFittedDesign(lm);
+    if isempty(X)
+        return;
+    end
+    rows = lm.ObservationInfo.Subset;
+    name = lm.ResponseName;
+    try
+        [b, se] = olsfit(X, double(response(rows, k)));
+        estimate = lm.Coefficients.Estimate;
+        stdErr = lm.Coefficients.SE;
+        if any(~(abs(b - estimate) <= 1e-6 * (stdErr + abs(estimate)))) || ...
+                any(~(abs(se - stdErr) <= 1e-6 * stdErr))
+            return;
+        end
+    catch
+        return;
+    end
+    fastFit = @(map) olsfit(X, selectRows(map(name), rows));
+    fprintf('Design is the same at every voxel - fitting blocks of voxels with olsfit\n');
+end
+
+function fastFit = voxelDesignLM(lm, table, formula, categoricalVars, multivalueVariables, multiVarMap, k)
+    % A function fitting a block of voxels at once with olsbatch, if some
+    % of the images are predictors of lm (fitted at voxel k), so that the
+    % design changes from voxel to voxel. Each column of the design must
+    % be a column that is the same at every voxel times powers of the
+    % images, as for 'FDG ~ AV45*Age'; the fixed columns are found by
+    % refitting with every image set to one, and the result checked
+    % against the design at voxel k. Otherwise (or if olsbatch is not
+    % compiled) [].
+    fastFit = [];
+    images = lm.PredictorNames(ismember(lm.PredictorNames, multivalueVariables));
+    images = images(:)';
+    if exist('olsbatch') ~= 3 || isempty(images) || lm.NumCoefficients > 16
+        return;
+    end
+    name = lm.ResponseName;
+    imageResponse = ismember(name, multivalueVariables);
+    values = [images {name}];
+    for v = values(1:end - ~imageResponse)
+        data = multiVarMap(v{1});
+        if any(isnan(data(:, k)))
+            return;
+        end
+    end
+    D = getFittedDesign(lm);
+    if isempty(D)
+        return;
+    end
+    rows = lm.ObservationInfo.Subset;
+    try
+        % The power of each image in each coefficient, from names such
+        % as 'AV45', 'Age:AV45' or 'AV45^2'
+        powers = zeros(lm.NumCoefficients, length(images));
+        for c = 1:lm.NumCoefficients
+            for part = strsplit(lm.CoefficientNames{c}, ':')
+                tok = regexp(part{1}, '^(\w+)\^?(\d*)$', 'tokens', 'once');
+                if ~isempty(tok) && any(strcmp(tok{1}, images))
+                    powers(c, strcmp(tok{1}, images)) = max(str2double(tok{2}), 1);
+                end
+            end
+        end
+
+        % The design with every image set to one, and the response at
+        % voxel k; this model is rank deficient, hence the warnings
+        for m = 1:length(images)
+            table.(images{m}) = ones(height(table), 1);
+        end
+        if imageResponse
+            response = multiVarMap(name);
+            table.(name) = double(response(:, k));
+        end
+        ws = warning('off', 'all');
+        try
+            if length(categoricalVars{1}) > 0
+                lm1 = fitlm(table, formula, 'CategoricalVars', categoricalVars);
+            else
+                lm1 = fitlm(table, formula);
+            end
+        catch
+            lm1 = [];
+        end
+        warning(ws);
+        if isempty(lm1) || ~isequal(lm1.ObservationInfo.Subset, rows)
+            return;
+        end
+        F = lm1.Design;
+        if size(F, 1) == length(rows)
+            F = F(rows, :);
+        end
+        F = full(double(F));
+
+        % It must give back the design fitlm used at voxel k
+        X = F;
+        for m = 1:length(images)
+            data = multiVarMap(images{m});
+            X = X .* bsxfun(@power, double(data(rows, k)), powers(:, m)');
+        end
+        if ~isequal(size(X), size(D)) || norm(X - D, 'fro') > 1e-8 * (1 + norm(D, 'fro'))
+            return;
+        end
+    catch
+        return;
+    end
+    if imageResponse
+        responseOf = @(map) selectRows(map(name), rows);
+    else
+        y = double(table.(name)(rows));
+        responseOf = @(map) y;
+    end
+    fastFit = @(map) olsbatch(F, powers, responseOf(map), ...
+        cellfun(@(v) selectRows(map(v), rows), images, 'UniformOutput', false), []);
+    fprintf('Design changes with the images - fitting blocks of voxels with olsbatch\n');
+end
+
 function [ model ] = parForVoxelLM(table, formula, k, categoricalVars, multivalueVariables, multiVarMap)
     for varName = multivalueVariables
         varData = multiVarMap(varName{1,1});
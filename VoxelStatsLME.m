@@ -65,8 +65,13 @@ function [ c_struct, slices_p, image_height_p, image_width_p, coeff_vars, voxel_
     voxel_num = sum(sum(mask_slices));
     df = templm.DFE
 
+    %%Fit whole blocks of voxels natively where the model allows (the
+    %%images are only the response, and there is one random-effects term)
+    fastFit = getNativeLMEFit(templm, multivalueVariables, multiVarMap, k, 'FullCholesky');
+
     %Number of Analysis
     numOfModels = sum(sum(mask_slices));
+    mask_index = find(mask_slices);
     totalDataSlices = 200;
     tStruct = zeros(numOfModels,nVarsInRegression);
     eStruct = zeros(numOfModels,nVarsInRegression);
@@ -86,15 +91,23 @@ function [ c_struct, slices_p, image_height_p, image_width_p, coeff_vars, voxel_
         slices_t = zeros(numberOfModels_t, nVarsInRegression);
         slices_e = zeros(numberOfModels_t, nVarsInRegression);
         slices_se = zeros(numberOfModels_t, nVarsInRegression);
-        parfor k = 1:numberOfModels_t
-            lm = parForVoxelLM(dataTable, stringModel, k, categoricalVars, multivalueVariables, multiVarMapForSlice);
-            if (strcmp(lm,'None'))
-              continue;
-            end
-            slices_t(k, :) = lm.Coefficients.tStat';
-            slices_e(k, :) = lm.Coefficients.Estimate';
-            slices_se(k, :) = lm.Coefficients.SE';
+        if isempty(fastFit)
+            refit = 1:numberOfModels_t;
+        else
+            % Fit the block's voxels walking from each to a neighbour,
+            % so that each fit starts from much the same parameters
+            blockRows = ((sliceCount-1)*blockSize+1):((sliceCount-1)*blockSize+numberOfModels_t);
+            order = getSpatialOrder(mask_index(blockRows), image_width, image_height);
+            [b, se, t, sigma2] = fastFit(multiVarMapForSlice, order);
+            slices_t = t';
+            slices_e = b';
+            slices_se = se';
+            % Voxels with missing values, or whose fit did not converge,
+            % are left to fitlme
+            refit = find(isnan(sigma2));
         end
+        fitVoxel = @(k) parForVoxelLM(dataTable, stringModel, k, categoricalVars, multivalueVariables, multiVarMapForSlice);
+        [slices_t, slices_e, slices_se] = refitVoxels(fitVoxel, refit, slices_t, slices_e, slices_se);
         tStruct((((sliceCount-1)*blockSize)+1):(((sliceCount-1)*blockSize)+numberOfModels_t),:) = slices_t;
         eStruct((((sliceCount-1)*blockSize)+1):(((sliceCount-1)*blockSize)+numberOfModels_t),:) = slices_e;
         seStruct((((sliceCount-1)*blockSize)+1):(((sliceCount-1)*blockSize)+numberOfModels_t),:) = slices_se;